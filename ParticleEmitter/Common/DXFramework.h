@@ -49,6 +49,9 @@ public:
 
 	virtual void ParseCommandLineArgs(_In_reads_(argc) WCHAR* argv[], int argc);
 
+	// A headless run, e.g. a test, quits in OnInit without showing the window.
+	virtual bool IsHeadless() const { return false; }
+
 protected:
 	std::wstring GetAssetFullPath(LPCWSTR assetName);
 	void GetHardwareAdapter(_In_ IDXGIFactory2* pFactory, _Outptr_result_maybenull_ IDXGIAdapter1** ppAdapter);
@@ -58,7 +58,7 @@ int Win32Application::Run(DXFramework *pFramework, HINSTANCE hInstance, int nCmd
 	// Initialize the sample. OnInit is defined in each child-implementation of DXSample.
 	pFramework->OnInit();
 
-	ShowWindow(m_hwnd, nCmdShow);
+	if (!pFramework->IsHeadless()) ShowWindow(m_hwnd, nCmdShow);
 
 	// Main sample loop.
 	MSG msg = {};
@@ -0,0 +1,153 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include "AliasSampler.h"
+#include "RandomBatch.h"
+
+#define RANDOM_SPAN	256u
+
+using namespace std;
+using namespace DirectX;
+using namespace XUSG;
+
+namespace
+{
+	inline XMFLOAT3 loadPosition(const uint8_t* pVertices, uint32_t stride, uint32_t i)
+	{
+		const auto pPos = reinterpret_cast<const float*>(&pVertices[stride * i]);
+
+		return XMFLOAT3(pPos[0], pPos[1], pPos[2]);
+	}
+}
+
+AliasSampler::AliasSampler() :
+	m_area(0.0)
+{
+}
+
+AliasSampler::~AliasSampler()
+{
+}
+
+bool AliasSampler::Build(const uint8_t* pVertices, uint32_t stride, const uint32_t* pIndices,
+	uint32_t numIndices, float groundY, uint32_t numThreads)
+{
+	const auto numTris = numIndices / 3;
+	m_entries.clear();
+	m_area = 0.0;
+
+	// Compute the triangle areas.
+	vector<double> weights(numTris);
+	ThreadPool threadPool(numThreads);
+	threadPool.ParallelFor(numTris, [&](uint32_t begin, uint32_t end)
+	{
+		for (auto t = begin; t < end; ++t)
+		{
+			XMFLOAT3 p[3];
+			for (uint8_t i = 0; i < 3; ++i) p[i] = loadPosition(pVertices, stride, pIndices[3 * t + i]);
+
+			if (p[0].y <= groundY || p[1].y <= groundY || p[2].y <= groundY) weights[t] = 0.0;
+			else
+			{
+				const double e0[] = { p[1].x - p[0].x, p[1].y - p[0].y, p[1].z - p[0].z };
+				const double e1[] = { p[2].x - p[0].x, p[2].y - p[0].y, p[2].z - p[0].z };
+				const double n[] =
+				{
+					e0[1] * e1[2] - e0[2] * e1[1],
+					e0[2] * e1[0] - e0[0] * e1[2],
+					e0[0] * e1[1] - e0[1] * e1[0]
+				};
+				weights[t] = sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]) * 0.5;
+			}
+		}
+	}, 1024);
+
+	for (const auto& weight : weights) m_area += weight;
+	if (!(m_area > 0.0)) return false;
+
+	// Scale the weights to an average of 1, then pair each underfull column with an overfull one.
+	vector<uint32_t> smalls, larges;
+	smalls.reserve(numTris);
+	larges.reserve(numTris);
+	for (auto t = 0u; t < numTris; ++t)
+	{
+		weights[t] *= numTris / m_area;
+		(weights[t] < 1.0 ? smalls : larges).push_back(t);
+	}
+
+	m_entries.resize(numTris);
+	while (!smalls.empty() && !larges.empty())
+	{
+		const auto s = smalls.back();
+		const auto l = larges.back();
+		smalls.pop_back();
+
+		m_entries[s].Probability = static_cast<float>(weights[s]);
+		m_entries[s].Alias = l;
+
+		// The overfull column gives away the rest of the underfull one.
+		weights[l] = (weights[l] + weights[s]) - 1.0;
+		if (weights[l] < 1.0)
+		{
+			larges.pop_back();
+			smalls.push_back(l);
+		}
+	}
+
+	// The leftovers are full up to the rounding errors.
+	for (const auto t : larges) m_entries[t] = { 1.0f, t };
+	for (const auto t : smalls) m_entries[t] = { 1.0f, t };
+
+	return true;
+}
+
+EmitterInfo AliasSampler::Sample(const uint32_t* pIndices, uint32_t random, float coin, float u, float v) const
+{
+	// Pick the column without the modulo bias, then the triangle with the coin.
+	const auto numTris = static_cast<uint32_t>(m_entries.size());
+	const auto i = static_cast<uint32_t>((static_cast<uint64_t>(random) * numTris) >> 32);
+	const auto& entry = m_entries[i];
+	const auto t = coin < entry.Probability ? i : entry.Alias;
+
+	// Uniform barycentric coordinates [Osada et al. 2002]
+	const auto su = sqrt(u);
+
+	EmitterInfo emitter;
+	emitter.Indices = XMUINT3(pIndices[3 * t], pIndices[3 * t + 1], pIndices[3 * t + 2]);
+	emitter.Barycoord = XMFLOAT2(1.0f - su, v * su);
+
+	return emitter;
+}
+
+void AliasSampler::Sample(EmitterInfo* pEmitters, uint32_t numEmitters, const uint32_t* pIndices, uint32_t seed) const
+{
+	// The words of emitter i are Pcg4d(i, seed, 0, 0), hashed in batches.
+	XMUINT4 randoms[RANDOM_SPAN];
+	for (auto i = 0u; i < numEmitters; i += RANDOM_SPAN)
+	{
+		const auto numRandoms = (min)(numEmitters - i, RANDOM_SPAN);
+		RandomBatch::Generate(randoms, numRandoms, XMUINT4(i, seed, 0, 0));
+		for (auto j = 0u; j < numRandoms; ++j)
+		{
+			const auto& random = randoms[j];
+			pEmitters[i + j] = Sample(pIndices, random.x, SharedRandom::RandomUnorm(random.y),
+				SharedRandom::RandomUnorm(random.z), SharedRandom::RandomUnorm(random.w));
+		}
+	}
+}
+
+uint32_t AliasSampler::GetNumEntries() const
+{
+	return static_cast<uint32_t>(m_entries.size());
+}
+
+const AliasSampler::Entry* AliasSampler::GetEntries() const
+{
+	return m_entries.data();
+}
+
+double AliasSampler::GetArea() const
+{
+	return m_area;
+}
@@ -0,0 +1,44 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include "Distributor.h"
+
+// Area-weighted emitter sampling with an alias table [Vose 1991]: one entry per triangle, so the
+// memory is proportional to the triangle count instead of the surface area, and a sample costs
+// one column lookup and one coin flip. The emitters are drawn with fresh barycentric coordinates,
+// so the density of the distribution pass is no longer baked in.
+class AliasSampler
+{
+public:
+	struct Entry
+	{
+		float		Probability;	// Probability to keep the column, otherwise take the alias
+		uint32_t	Alias;			// Triangle of the rest of the column
+	};
+
+	AliasSampler();
+	virtual ~AliasSampler();
+
+	// The vertices read their positions from the first 12 bytes. Triangles with a vertex at or
+	// below groundY get no weight, e.g. GROUND_Y / (density * scale) for the ground culling of the
+	// distribution pass. Returns false if no triangle has any area.
+	bool Build(const uint8_t* pVertices, uint32_t stride, const uint32_t* pIndices, uint32_t numIndices,
+		float groundY = -FLT_MAX, uint32_t numThreads = 0);
+
+	// random is uniform in the 32 bits and picks the column; coin, u and v are uniform in [0, 1).
+	EmitterInfo Sample(const uint32_t* pIndices, uint32_t random, float coin, float u, float v) const;
+	// Draws the emitters with the counter-based words of SharedRandom, so the ones of a seed are
+	// the same on any platform.
+	void Sample(EmitterInfo* pEmitters, uint32_t numEmitters, const uint32_t* pIndices, uint32_t seed) const;
+
+	uint32_t GetNumEntries() const;
+	const Entry* GetEntries() const;
+	double GetArea() const;
+
+protected:
+	std::vector<Entry> m_entries;
+	double m_area;
+};
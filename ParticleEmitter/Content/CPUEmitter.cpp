@@ -0,0 +1,312 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include "CPUEmitter.h"
+#include "SharedConst.h"
+#include "RandomBatch.h"
+#include "Optional/XUSGSIMD.h"
+#if XUSG_SIMD_X86
+#include <immintrin.h>
+#endif
+
+#define WORLD_TO_SIMULATION	0.1f	// WorldToSimulationSpace of Common.hlsli
+#define VERTEX_SIZE			8		// Floats per transformed vertex
+#define EMIT_BATCH			64		// Slots of a batch of the random words
+#define RANDOM_SPAN			256		// Counters of a batch at most, so the slots of a batch may skip a few
+
+using namespace std;
+using namespace DirectX;
+using namespace SharedRandom;
+using namespace XUSG;
+
+namespace
+{
+	struct TransformArgs
+	{
+		const float* pPos[3];
+		float* pPrevPos[3];
+		float* pVertices;
+		float Matrix[3][4];
+		float InvTimeStep;
+	};
+
+	// Vertex kernels. Each tier transforms the blocks of its width, transposes them to the vertex
+	// records, and leaves the rest to the tier below. The SIMD kernels evaluate the same operations
+	// in the same order as the scalar reference, which must not be contracted into FMAs.
+	using TransformFunc = void (*)(const TransformArgs& args, uint32_t begin, uint32_t end);
+
+	void transformScalar(const TransformArgs& args, uint32_t begin, uint32_t end)
+	{
+		const auto& m = args.Matrix;
+		for (auto i = begin; i < end; ++i)
+		{
+			const auto x = args.pPos[0][i], y = args.pPos[1][i], z = args.pPos[2][i];
+			const auto pVertex = &args.pVertices[VERTEX_SIZE * i];
+			for (uint8_t j = 0; j < 3; ++j)
+			{
+				const auto p = (m[j][0] * x + m[j][1] * y + m[j][2] * z + m[j][3]) * WORLD_TO_SIMULATION;
+				pVertex[j] = p;
+				pVertex[j + 3] = (p - args.pPrevPos[j][i]) * args.InvTimeStep;
+				args.pPrevPos[j][i] = p;
+			}
+			pVertex[6] = 0.0f;
+			pVertex[7] = 0.0f;
+		}
+	}
+
+#if XUSG_SIMD_X86
+	void transformSSE42(const TransformArgs& args, uint32_t begin, uint32_t end)
+	{
+		const auto& m = args.Matrix;
+		const auto scale = _mm_set1_ps(WORLD_TO_SIMULATION);
+		const auto invTimeStep = _mm_set1_ps(args.InvTimeStep);
+
+		auto i = begin;
+		for (; i + 4 <= end; i += 4)
+		{
+			const auto x = _mm_loadu_ps(&args.pPos[0][i]);
+			const auto y = _mm_loadu_ps(&args.pPos[1][i]);
+			const auto z = _mm_loadu_ps(&args.pPos[2][i]);
+
+			__m128 r[8];
+			for (uint8_t j = 0; j < 3; ++j)
+			{
+				const auto p = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(m[j][0]), x),
+					_mm_mul_ps(_mm_set1_ps(m[j][1]), y)), _mm_mul_ps(_mm_set1_ps(m[j][2]), z)),
+					_mm_set1_ps(m[j][3])), scale);
+				r[j] = p;
+				r[j + 3] = _mm_mul_ps(_mm_sub_ps(p, _mm_loadu_ps(&args.pPrevPos[j][i])), invTimeStep);
+				_mm_storeu_ps(&args.pPrevPos[j][i], p);
+			}
+			r[6] = r[7] = _mm_setzero_ps();
+
+			// Transpose (x, y, z, vx) and (vy, vz, 0, 0) of the 4 vertices
+			_MM_TRANSPOSE4_PS(r[0], r[1], r[2], r[3]);
+			_MM_TRANSPOSE4_PS(r[4], r[5], r[6], r[7]);
+			const auto pVertex = &args.pVertices[VERTEX_SIZE * i];
+			for (uint8_t k = 0; k < 4; ++k)
+			{
+				_mm_store_ps(&pVertex[VERTEX_SIZE * k], r[k]);
+				_mm_store_ps(&pVertex[VERTEX_SIZE * k + 4], r[k + 4]);
+			}
+		}
+
+		transformScalar(args, i, end);
+	}
+
+	// Transposes the rows (x, y, z, vx, vy, vz) of 8 vertices to their records.
+	inline void storeVertices(const __m256 r[6], float* pVertices)
+	{
+		const auto zero = _mm256_setzero_ps();
+		const auto t0 = _mm256_unpacklo_ps(r[0], r[1]), t1 = _mm256_unpackhi_ps(r[0], r[1]);
+		const auto t2 = _mm256_unpacklo_ps(r[2], r[3]), t3 = _mm256_unpackhi_ps(r[2], r[3]);
+		const auto t4 = _mm256_unpacklo_ps(r[4], r[5]), t5 = _mm256_unpackhi_ps(r[4], r[5]);
+		const auto u0 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(1, 0, 1, 0));
+		const auto u1 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(3, 2, 3, 2));
+		const auto u2 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(1, 0, 1, 0));
+		const auto u3 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(3, 2, 3, 2));
+		const auto u4 = _mm256_shuffle_ps(t4, zero, _MM_SHUFFLE(1, 0, 1, 0));
+		const auto u5 = _mm256_shuffle_ps(t4, zero, _MM_SHUFFLE(3, 2, 3, 2));
+		const auto u6 = _mm256_shuffle_ps(t5, zero, _MM_SHUFFLE(1, 0, 1, 0));
+		const auto u7 = _mm256_shuffle_ps(t5, zero, _MM_SHUFFLE(3, 2, 3, 2));
+		_mm256_store_ps(&pVertices[VERTEX_SIZE * 0], _mm256_permute2f128_ps(u0, u4, 0x20));
+		_mm256_store_ps(&pVertices[VERTEX_SIZE * 1], _mm256_permute2f128_ps(u1, u5, 0x20));
+		_mm256_store_ps(&pVertices[VERTEX_SIZE * 2], _mm256_permute2f128_ps(u2, u6, 0x20));
+		_mm256_store_ps(&pVertices[VERTEX_SIZE * 3], _mm256_permute2f128_ps(u3, u7, 0x20));
+		_mm256_store_ps(&pVertices[VERTEX_SIZE * 4], _mm256_permute2f128_ps(u0, u4, 0x31));
+		_mm256_store_ps(&pVertices[VERTEX_SIZE * 5], _mm256_permute2f128_ps(u1, u5, 0x31));
+		_mm256_store_ps(&pVertices[VERTEX_SIZE * 6], _mm256_permute2f128_ps(u2, u6, 0x31));
+		_mm256_store_ps(&pVertices[VERTEX_SIZE * 7], _mm256_permute2f128_ps(u3, u7, 0x31));
+	}
+
+	void transformAVX2(const TransformArgs& args, uint32_t begin, uint32_t end)
+	{
+		const auto& m = args.Matrix;
+		const auto scale = _mm256_set1_ps(WORLD_TO_SIMULATION);
+		const auto invTimeStep = _mm256_set1_ps(args.InvTimeStep);
+
+		auto i = begin;
+		for (; i + 8 <= end; i += 8)
+		{
+			const auto x = _mm256_loadu_ps(&args.pPos[0][i]);
+			const auto y = _mm256_loadu_ps(&args.pPos[1][i]);
+			const auto z = _mm256_loadu_ps(&args.pPos[2][i]);
+
+			__m256 r[6];
+			for (uint8_t j = 0; j < 3; ++j)
+			{
+				const auto p = _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(m[j][0]), x),
+					_mm256_mul_ps(_mm256_set1_ps(m[j][1]), y)), _mm256_mul_ps(_mm256_set1_ps(m[j][2]), z)),
+					_mm256_set1_ps(m[j][3])), scale);
+				r[j] = p;
+				r[j + 3] = _mm256_mul_ps(_mm256_sub_ps(p, _mm256_loadu_ps(&args.pPrevPos[j][i])), invTimeStep);
+				_mm256_storeu_ps(&args.pPrevPos[j][i], p);
+			}
+
+			storeVertices(r, &args.pVertices[VERTEX_SIZE * i]);
+		}
+
+		transformSSE42(args, i, end);
+	}
+
+	void transformAVX512(const TransformArgs& args, uint32_t begin, uint32_t end)
+	{
+		const auto& m = args.Matrix;
+		const auto scale = _mm512_set1_ps(WORLD_TO_SIMULATION);
+		const auto invTimeStep = _mm512_set1_ps(args.InvTimeStep);
+
+		auto i = begin;
+		for (; i + 16 <= end; i += 16)
+		{
+			const auto x = _mm512_loadu_ps(&args.pPos[0][i]);
+			const auto y = _mm512_loadu_ps(&args.pPos[1][i]);
+			const auto z = _mm512_loadu_ps(&args.pPos[2][i]);
+
+			__m256 lo[6], hi[6];
+			for (uint8_t j = 0; j < 3; ++j)
+			{
+				const auto p = _mm512_mul_ps(_mm512_add_ps(_mm512_add_ps(_mm512_add_ps(_mm512_mul_ps(_mm512_set1_ps(m[j][0]), x),
+					_mm512_mul_ps(_mm512_set1_ps(m[j][1]), y)), _mm512_mul_ps(_mm512_set1_ps(m[j][2]), z)),
+					_mm512_set1_ps(m[j][3])), scale);
+				const auto v = _mm512_mul_ps(_mm512_sub_ps(p, _mm512_loadu_ps(&args.pPrevPos[j][i])), invTimeStep);
+				_mm512_storeu_ps(&args.pPrevPos[j][i], p);
+				lo[j] = _mm512_castps512_ps256(p);
+				hi[j] = _mm512_extractf32x8_ps(p, 1);
+				lo[j + 3] = _mm512_castps512_ps256(v);
+				hi[j + 3] = _mm512_extractf32x8_ps(v, 1);
+			}
+
+			storeVertices(lo, &args.pVertices[VERTEX_SIZE * i]);
+			storeVertices(hi, &args.pVertices[VERTEX_SIZE * (i + 8)]);
+		}
+
+		transformAVX2(args, i, end);
+	}
+#endif
+
+	TransformFunc getTransformFunc()
+	{
+#if XUSG_SIMD_X86
+		switch (GetSIMDLevel())
+		{
+		case SIMDLevel::AVX512:
+			return transformAVX512;
+		case SIMDLevel::AVX2:
+			return transformAVX2;
+		case SIMDLevel::SSE4_2:
+			return transformSSE42;
+		}
+#endif
+		return transformScalar;
+	}
+}
+
+CPUEmitter::CPUEmitter() :
+	m_pVertices(nullptr),
+	m_numVertices(0),
+	m_frame(0),
+	m_hasPrevFrame(false)
+{
+}
+
+CPUEmitter::~CPUEmitter()
+{
+}
+
+void CPUEmitter::Init(const uint8_t* pVertices, uint32_t stride, uint32_t numVertices,
+	const EmitterInfo* pEmitters, uint32_t numEmitters)
+{
+	m_numVertices = numVertices;
+	for (uint8_t j = 0; j < 3; ++j)
+	{
+		m_positions[j].resize(numVertices);
+		m_prevPositions[j].assign(numVertices, 0.0f);
+	}
+
+	for (auto i = 0u; i < numVertices; ++i)
+	{
+		const auto pPos = reinterpret_cast<const float*>(&pVertices[stride * i]);
+		for (uint8_t j = 0; j < 3; ++j) m_positions[j][i] = pPos[j];
+	}
+
+	// Align the records to the cache lines, so a gather reads one line per vertex.
+	m_vertexStorage.resize(VERTEX_SIZE * numVertices + 16);
+	m_pVertices = reinterpret_cast<float*>((reinterpret_cast<uintptr_t>(m_vertexStorage.data()) + 63) & ~uintptr_t(63));
+
+	m_emitters.assign(pEmitters, pEmitters + numEmitters);
+	m_frame = 0;
+	m_hasPrevFrame = false;
+}
+
+void CPUEmitter::UpdateFrame(ThreadPool& threadPool, const XMFLOAT3X4& world, float timeStep, uint32_t frame)
+{
+	TransformArgs args;
+	for (uint8_t j = 0; j < 3; ++j)
+	{
+		args.pPos[j] = m_positions[j].data();
+		args.pPrevPos[j] = m_prevPositions[j].data();
+		for (uint8_t k = 0; k < 4; ++k) args.Matrix[j][k] = world.m[j][k];
+	}
+	args.pVertices = m_pVertices;
+	args.InvTimeStep = m_hasPrevFrame && timeStep > 0.0f ? 1.0f / timeStep : 0.0f;
+
+	// Blocks of 16 vertices keep the ranges on the 64-byte lines of the records.
+	const auto transform = getTransformFunc();
+	threadPool.ParallelFor((m_numVertices + 15) / 16, [&](uint32_t begin, uint32_t end)
+	{
+		transform(args, begin * 16, (min)(end * 16, m_numVertices));
+	}, 256);
+
+	m_frame = frame;
+	m_hasPrevFrame = true;
+}
+
+void CPUEmitter::Emit(ThreadPool& threadPool, const ParticleArrays& particles, const uint32_t* pSlots,
+	uint32_t numSlots) const
+{
+	const auto numEmitters = static_cast<uint32_t>(m_emitters.size());
+	if (numEmitters <= 0) return;
+
+	threadPool.ParallelFor(numSlots, [&](uint32_t begin, uint32_t end)
+	{
+		XMUINT4 randoms[RANDOM_SPAN];
+		for (auto i = begin; i < end; i += EMIT_BATCH)
+		{
+			// The words of a batch are hashed at once if its slots span few enough counters, like the
+			// ones of an emission window; the slots out of the span are hashed one by one.
+			const auto batchEnd = (min)(i + EMIT_BATCH, end);
+			const auto baseSlot = pSlots[i];
+			const auto span = pSlots[batchEnd - 1] - baseSlot + 1;
+			const auto numRandoms = span <= RANDOM_SPAN ? span : 0;
+			RandomBatch::Generate(randoms, numRandoms, XMUINT4(baseSlot, m_frame, 0, 0));
+
+			for (auto k = i; k < batchEnd; ++k)
+			{
+				const auto slot = pSlots[k];
+				const auto random = slot - baseSlot < numRandoms ? randoms[slot - baseSlot] : Pcg4d(XMUINT4(slot, m_frame, 0, 0));
+				const auto& emitter = m_emitters[RandomIndex(random.x, numEmitters)];
+				const float w[] = { emitter.Barycoord.x, emitter.Barycoord.y, 1.0f - (emitter.Barycoord.x + emitter.Barycoord.y) };
+				const float* pVertices[] =
+				{
+					&m_pVertices[VERTEX_SIZE * emitter.Indices.x],
+					&m_pVertices[VERTEX_SIZE * emitter.Indices.y],
+					&m_pVertices[VERTEX_SIZE * emitter.Indices.z]
+				};
+
+				for (uint8_t j = 0; j < 3; ++j)
+				{
+					particles.pPos[j][slot] = w[0] * pVertices[0][j] + w[1] * pVertices[1][j] + w[2] * pVertices[2][j];
+					particles.pVelocity[j][slot] = w[0] * pVertices[0][j + 3] + w[1] * pVertices[1][j + 3] +
+						w[2] * pVertices[2][j + 3];
+				}
+				particles.pLifeTime[slot] = FULL_LIFE + RandomUnorm(random.y);
+			}
+		}
+	}, 1024);
+}
+
+uint32_t CPUEmitter::GetNumVertices() const
+{
+	return m_numVertices;
+}
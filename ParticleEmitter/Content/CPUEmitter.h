@@ -0,0 +1,49 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include "Distributor.h"
+#include "ParticleArrays.h"
+
+// CPU counterpart of the emission of CSEmit, in batches. Once per frame, the vertices are moved
+// into the simulation space, with their velocities from the positions of the last frame, by the
+// SIMD kernels of the highest supported tier; emitting a particle is then a gather of 3 of them
+// and a barycentric blend, instead of 2 matrix transforms per particle. The blend follows the
+// transform, so the positions may differ from CSEmit by the rounding.
+class CPUEmitter
+{
+public:
+	CPUEmitter();
+	virtual ~CPUEmitter();
+
+	// The vertices read their positions from the first 12 bytes.
+	void Init(const uint8_t* pVertices, uint32_t stride, uint32_t numVertices,
+		const EmitterInfo* pEmitters, uint32_t numEmitters);
+
+	// world is the one of Emitter::UpdateFrame, and frame the frame word of the Pcg4d counters.
+	// The velocities of the first frame are 0.
+	void UpdateFrame(XUSG::ThreadPool& threadPool, const DirectX::XMFLOAT3X4& world, float timeStep,
+		uint32_t frame);
+
+	// Emits the particles of the slots, which are hashed like the particle IDs of CSEmit, so a
+	// slot gets the same emitter and lifetime as on the GPU. The words of the ascending runs of
+	// slots, e.g. the dead ones of an emission window, are hashed in batches by RandomBatch.
+	void Emit(XUSG::ThreadPool& threadPool, const ParticleArrays& particles, const uint32_t* pSlots,
+		uint32_t numSlots) const;
+
+	uint32_t GetNumVertices() const;
+
+protected:
+	std::vector<float>			m_positions[3];		// SoA in the mesh space
+	std::vector<float>			m_prevPositions[3];	// SoA in the simulation space of the last frame
+	std::vector<float>			m_vertexStorage;
+	float*						m_pVertices;		// (position, velocity, 0, 0) per vertex, 64-byte aligned
+
+	std::vector<EmitterInfo>	m_emitters;
+
+	uint32_t					m_numVertices;
+	uint32_t					m_frame;
+	bool						m_hasPrevFrame;
+};
@@ -0,0 +1,88 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include "CPUSimulation.h"
+#include "ParticleIntegrator.h"
+
+using namespace std;
+using namespace DirectX;
+using namespace XUSG;
+
+CPUSimulation::CPUSimulation(uint32_t numThreads) :
+	m_threadPool(numThreads),
+	m_particles(),
+	m_numParticles(0),
+	m_frame(0),
+	m_emitBegin(0)
+{
+}
+
+CPUSimulation::~CPUSimulation()
+{
+}
+
+void CPUSimulation::Init(uint32_t numParticles, const uint8_t* pVertices, uint32_t stride, uint32_t numVertices,
+	const EmitterInfo* pEmitters, uint32_t numEmitters)
+{
+	m_numParticles = numParticles;
+	m_emitter.Init(pVertices, stride, numVertices, pEmitters, numEmitters);
+
+	// The unborn particles are parked out of the view and the grids, like the ones of Emitter::Init.
+	const auto pitch = (numParticles + 15) & ~15u;
+	m_particleStorage.assign(7 * pitch + 16, 0.0f);
+	const auto pArrays = reinterpret_cast<float*>((reinterpret_cast<uintptr_t>(m_particleStorage.data()) + 63) & ~uintptr_t(63));
+	for (uint8_t j = 0; j < 3; ++j)
+	{
+		m_particles.pPos[j] = &pArrays[pitch * j];
+		m_particles.pVelocity[j] = &pArrays[pitch * (j + 3)];
+	}
+	m_particles.pLifeTime = &pArrays[pitch * 6];
+	fill(m_particles.pPos[1], m_particles.pPos[1] + numParticles, FLT_MAX);
+
+	m_emitSlots.clear();
+	m_emitSlots.reserve(numParticles);
+	m_frame = 0;
+	m_emitBegin = 0;
+	SetEmissionRate(0.0f, 0);
+	m_emissionController.Reset();
+}
+
+void CPUSimulation::SetEmissionRate(float particlesPerSecond, uint32_t maxPerFrame)
+{
+	particlesPerSecond = particlesPerSecond > 0.0f ? particlesPerSecond : m_numParticles / (FULL_LIFE + 1.0f);
+	maxPerFrame = maxPerFrame > 0 ? maxPerFrame : (max)(m_numParticles / 16, 1u);
+	m_emissionController.SetRate(particlesPerSecond, maxPerFrame);
+}
+
+uint32_t CPUSimulation::UpdateFrame(const XMFLOAT3X4& world, float timeStep)
+{
+	if (m_numParticles <= 0) return 0;
+
+	// The dead slots of the window are taken before the integration.
+	const auto numEmit = (min)(m_emissionController.Advance(timeStep), m_numParticles);
+	m_emitSlots.clear();
+	for (auto i = 0u; i < numEmit; ++i)
+	{
+		const auto slot = m_emitBegin + i < m_numParticles ? m_emitBegin + i : m_emitBegin + i - m_numParticles;
+		if (!(m_particles.pLifeTime[slot] > 0.0f)) m_emitSlots.emplace_back(slot);
+	}
+	m_emitBegin = (m_emitBegin + numEmit) % m_numParticles;
+
+	const auto numSlots = static_cast<uint32_t>(m_emitSlots.size());
+	m_emitter.UpdateFrame(m_threadPool, world, timeStep, m_frame++);
+	ParticleIntegrator::Integrate(m_threadPool, m_particles, m_numParticles, timeStep);
+	m_emitter.Emit(m_threadPool, m_particles, m_emitSlots.data(), numSlots);
+
+	return numSlots;
+}
+
+const ParticleArrays& CPUSimulation::GetParticles() const
+{
+	return m_particles;
+}
+
+uint32_t CPUSimulation::GetNumParticles() const
+{
+	return m_numParticles;
+}
@@ -0,0 +1,46 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include "CPUEmitter.h"
+#include "EmissionController.h"
+
+// CPU path of the particle update of Emitter and VSParticle, over the SoA particles of
+// ParticleArrays. At each frame, the emission budget gives the window of the slots from the one
+// after the last window, and like UpdateParticle, a slot integrates if it is alive, or emits if it
+// is dead in the window; a particle that dies at a frame emits at a later pass of the window. The
+// dead particles are left where they died, as the CPU path draws nothing.
+class CPUSimulation
+{
+public:
+	CPUSimulation(uint32_t numThreads = 0);
+	virtual ~CPUSimulation();
+
+	// The vertices read their positions from the first 12 bytes. All the particles are dead.
+	void Init(uint32_t numParticles, const uint8_t* pVertices, uint32_t stride, uint32_t numVertices,
+		const EmitterInfo* pEmitters, uint32_t numEmitters);
+
+	// The same as Emitter::SetEmissionRate, with the same defaults for 0.
+	void SetEmissionRate(float particlesPerSecond, uint32_t maxPerFrame = 0);
+
+	// world is the one of Emitter::UpdateFrame. Returns the number of the particles emitted.
+	uint32_t UpdateFrame(const DirectX::XMFLOAT3X4& world, float timeStep);
+
+	const ParticleArrays& GetParticles() const;
+	uint32_t GetNumParticles() const;
+
+protected:
+	XUSG::ThreadPool		m_threadPool;
+	CPUEmitter				m_emitter;
+	EmissionController		m_emissionController;
+
+	std::vector<float>		m_particleStorage;
+	ParticleArrays			m_particles;	// Arrays on 64-byte lines
+	std::vector<uint32_t>	m_emitSlots;
+
+	uint32_t				m_numParticles;
+	uint32_t				m_frame;
+	uint32_t				m_emitBegin;
+};
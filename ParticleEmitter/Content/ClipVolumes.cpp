@@ -0,0 +1,341 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include "ClipVolumes.h"
+#include "Optional/XUSGSIMD.h"
+#if XUSG_SIMD_X86
+#include <immintrin.h>
+#endif
+
+using namespace std;
+using namespace DirectX;
+using namespace XUSG;
+
+namespace
+{
+	// Point kernels. Each tier tests the blocks of its width, and leaves the rest to the tier below;
+	// the kept indices are written unconditionally and advanced only for the unclipped points, so
+	// pKeptIds holds numPoints entries. The SIMD kernels evaluate the same operations in the same
+	// order as the scalar reference, which must not be contracted into FMAs.
+	using ClipFunc = uint32_t (*)(const ClipVolume* pVolumes, uint32_t numVolumes, const float* pX,
+		const float* pY, const float* pZ, uint32_t begin, uint32_t end, uint32_t* pKeptIds, uint32_t numKept);
+
+	inline bool isClipped(const ClipVolume& volume, float x, float y, float z)
+	{
+		const auto& a = volume.Params[0];
+		const auto& b = volume.Params[1];
+		switch (volume.Type)
+		{
+		case ClipVolumeType::HALF_SPACE:
+			return a.x * x + a.y * y + a.z * z + a.w < 0.0f;
+		case ClipVolumeType::BOX:
+			return x >= a.x && y >= a.y && z >= a.z && x <= b.x && y <= b.y && z <= b.z;
+		case ClipVolumeType::SPHERE:
+		{
+			const auto dx = x - a.x, dy = y - a.y, dz = z - a.z;
+
+			return dx * dx + dy * dy + dz * dz < a.w;
+		}
+		}
+
+		return false;
+	}
+
+	uint32_t clipScalar(const ClipVolume* pVolumes, uint32_t numVolumes, const float* pX,
+		const float* pY, const float* pZ, uint32_t begin, uint32_t end, uint32_t* pKeptIds, uint32_t numKept)
+	{
+		for (auto i = begin; i < end; ++i)
+		{
+			auto clipped = false;
+			for (auto j = 0u; j < numVolumes && !clipped; ++j) clipped = isClipped(pVolumes[j], pX[i], pY[i], pZ[i]);
+			pKeptIds[numKept] = i;
+			numKept += clipped ? 0 : 1;
+		}
+
+		return numKept;
+	}
+
+#if XUSG_SIMD_X86
+	uint32_t clipSSE42(const ClipVolume* pVolumes, uint32_t numVolumes, const float* pX,
+		const float* pY, const float* pZ, uint32_t begin, uint32_t end, uint32_t* pKeptIds, uint32_t numKept)
+	{
+		auto i = begin;
+		for (; i + 4 <= end; i += 4)
+		{
+			const auto x = _mm_loadu_ps(&pX[i]), y = _mm_loadu_ps(&pY[i]), z = _mm_loadu_ps(&pZ[i]);
+			auto clipped = _mm_setzero_ps();
+			for (auto j = 0u; j < numVolumes && _mm_movemask_ps(clipped) != 0xf; ++j)
+			{
+				const auto& a = pVolumes[j].Params[0];
+				const auto& b = pVolumes[j].Params[1];
+				switch (pVolumes[j].Type)
+				{
+				case ClipVolumeType::HALF_SPACE:
+				{
+					const auto d = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(a.x), x),
+						_mm_mul_ps(_mm_set1_ps(a.y), y)), _mm_mul_ps(_mm_set1_ps(a.z), z)), _mm_set1_ps(a.w));
+					clipped = _mm_or_ps(clipped, _mm_cmplt_ps(d, _mm_setzero_ps()));
+					break;
+				}
+				case ClipVolumeType::BOX:
+				{
+					const auto inX = _mm_and_ps(_mm_cmpge_ps(x, _mm_set1_ps(a.x)), _mm_cmple_ps(x, _mm_set1_ps(b.x)));
+					const auto inY = _mm_and_ps(_mm_cmpge_ps(y, _mm_set1_ps(a.y)), _mm_cmple_ps(y, _mm_set1_ps(b.y)));
+					const auto inZ = _mm_and_ps(_mm_cmpge_ps(z, _mm_set1_ps(a.z)), _mm_cmple_ps(z, _mm_set1_ps(b.z)));
+					clipped = _mm_or_ps(clipped, _mm_and_ps(_mm_and_ps(inX, inY), inZ));
+					break;
+				}
+				case ClipVolumeType::SPHERE:
+				{
+					const auto dx = _mm_sub_ps(x, _mm_set1_ps(a.x));
+					const auto dy = _mm_sub_ps(y, _mm_set1_ps(a.y));
+					const auto dz = _mm_sub_ps(z, _mm_set1_ps(a.z));
+					const auto d = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+					clipped = _mm_or_ps(clipped, _mm_cmplt_ps(d, _mm_set1_ps(a.w)));
+					break;
+				}
+				}
+			}
+
+			const auto mask = _mm_movemask_ps(clipped);
+			for (uint8_t k = 0; k < 4; ++k)
+			{
+				pKeptIds[numKept] = i + k;
+				numKept += ~mask >> k & 1;
+			}
+		}
+
+		return clipScalar(pVolumes, numVolumes, pX, pY, pZ, i, end, pKeptIds, numKept);
+	}
+
+	uint32_t clipAVX2(const ClipVolume* pVolumes, uint32_t numVolumes, const float* pX,
+		const float* pY, const float* pZ, uint32_t begin, uint32_t end, uint32_t* pKeptIds, uint32_t numKept)
+	{
+		auto i = begin;
+		for (; i + 8 <= end; i += 8)
+		{
+			const auto x = _mm256_loadu_ps(&pX[i]), y = _mm256_loadu_ps(&pY[i]), z = _mm256_loadu_ps(&pZ[i]);
+			auto clipped = _mm256_setzero_ps();
+			for (auto j = 0u; j < numVolumes && _mm256_movemask_ps(clipped) != 0xff; ++j)
+			{
+				const auto& a = pVolumes[j].Params[0];
+				const auto& b = pVolumes[j].Params[1];
+				switch (pVolumes[j].Type)
+				{
+				case ClipVolumeType::HALF_SPACE:
+				{
+					const auto d = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(a.x), x),
+						_mm256_mul_ps(_mm256_set1_ps(a.y), y)), _mm256_mul_ps(_mm256_set1_ps(a.z), z)), _mm256_set1_ps(a.w));
+					clipped = _mm256_or_ps(clipped, _mm256_cmp_ps(d, _mm256_setzero_ps(), _CMP_LT_OQ));
+					break;
+				}
+				case ClipVolumeType::BOX:
+				{
+					const auto inX = _mm256_and_ps(_mm256_cmp_ps(x, _mm256_set1_ps(a.x), _CMP_GE_OQ),
+						_mm256_cmp_ps(x, _mm256_set1_ps(b.x), _CMP_LE_OQ));
+					const auto inY = _mm256_and_ps(_mm256_cmp_ps(y, _mm256_set1_ps(a.y), _CMP_GE_OQ),
+						_mm256_cmp_ps(y, _mm256_set1_ps(b.y), _CMP_LE_OQ));
+					const auto inZ = _mm256_and_ps(_mm256_cmp_ps(z, _mm256_set1_ps(a.z), _CMP_GE_OQ),
+						_mm256_cmp_ps(z, _mm256_set1_ps(b.z), _CMP_LE_OQ));
+					clipped = _mm256_or_ps(clipped, _mm256_and_ps(_mm256_and_ps(inX, inY), inZ));
+					break;
+				}
+				case ClipVolumeType::SPHERE:
+				{
+					const auto dx = _mm256_sub_ps(x, _mm256_set1_ps(a.x));
+					const auto dy = _mm256_sub_ps(y, _mm256_set1_ps(a.y));
+					const auto dz = _mm256_sub_ps(z, _mm256_set1_ps(a.z));
+					const auto d = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy)), _mm256_mul_ps(dz, dz));
+					clipped = _mm256_or_ps(clipped, _mm256_cmp_ps(d, _mm256_set1_ps(a.w), _CMP_LT_OQ));
+					break;
+				}
+				}
+			}
+
+			const auto mask = _mm256_movemask_ps(clipped);
+			for (uint8_t k = 0; k < 8; ++k)
+			{
+				pKeptIds[numKept] = i + k;
+				numKept += ~mask >> k & 1;
+			}
+		}
+
+		return clipSSE42(pVolumes, numVolumes, pX, pY, pZ, i, end, pKeptIds, numKept);
+	}
+
+	uint32_t clipAVX512(const ClipVolume* pVolumes, uint32_t numVolumes, const float* pX,
+		const float* pY, const float* pZ, uint32_t begin, uint32_t end, uint32_t* pKeptIds, uint32_t numKept)
+	{
+		const auto lanes = _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+
+		auto i = begin;
+		for (; i + 16 <= end; i += 16)
+		{
+			const auto x = _mm512_loadu_ps(&pX[i]), y = _mm512_loadu_ps(&pY[i]), z = _mm512_loadu_ps(&pZ[i]);
+			__mmask16 clipped = 0;
+			for (auto j = 0u; j < numVolumes && clipped != 0xffff; ++j)
+			{
+				const auto& a = pVolumes[j].Params[0];
+				const auto& b = pVolumes[j].Params[1];
+				switch (pVolumes[j].Type)
+				{
+				case ClipVolumeType::HALF_SPACE:
+				{
+					const auto d = _mm512_add_ps(_mm512_add_ps(_mm512_add_ps(_mm512_mul_ps(_mm512_set1_ps(a.x), x),
+						_mm512_mul_ps(_mm512_set1_ps(a.y), y)), _mm512_mul_ps(_mm512_set1_ps(a.z), z)), _mm512_set1_ps(a.w));
+					clipped |= _mm512_cmp_ps_mask(d, _mm512_setzero_ps(), _CMP_LT_OQ);
+					break;
+				}
+				case ClipVolumeType::BOX:
+				{
+					auto in = _mm512_cmp_ps_mask(x, _mm512_set1_ps(a.x), _CMP_GE_OQ);
+					in = _mm512_mask_cmp_ps_mask(in, y, _mm512_set1_ps(a.y), _CMP_GE_OQ);
+					in = _mm512_mask_cmp_ps_mask(in, z, _mm512_set1_ps(a.z), _CMP_GE_OQ);
+					in = _mm512_mask_cmp_ps_mask(in, x, _mm512_set1_ps(b.x), _CMP_LE_OQ);
+					in = _mm512_mask_cmp_ps_mask(in, y, _mm512_set1_ps(b.y), _CMP_LE_OQ);
+					clipped |= _mm512_mask_cmp_ps_mask(in, z, _mm512_set1_ps(b.z), _CMP_LE_OQ);
+					break;
+				}
+				case ClipVolumeType::SPHERE:
+				{
+					const auto dx = _mm512_sub_ps(x, _mm512_set1_ps(a.x));
+					const auto dy = _mm512_sub_ps(y, _mm512_set1_ps(a.y));
+					const auto dz = _mm512_sub_ps(z, _mm512_set1_ps(a.z));
+					const auto d = _mm512_add_ps(_mm512_add_ps(_mm512_mul_ps(dx, dx), _mm512_mul_ps(dy, dy)), _mm512_mul_ps(dz, dz));
+					clipped |= _mm512_cmp_ps_mask(d, _mm512_set1_ps(a.w), _CMP_LT_OQ);
+					break;
+				}
+				}
+			}
+
+			const auto kept = static_cast<__mmask16>(~clipped);
+			_mm512_mask_compressstoreu_epi32(&pKeptIds[numKept], kept, _mm512_add_epi32(_mm512_set1_epi32(i), lanes));
+			numKept += _mm_popcnt_u32(kept);
+		}
+
+		return clipAVX2(pVolumes, numVolumes, pX, pY, pZ, i, end, pKeptIds, numKept);
+	}
+#endif
+
+	ClipFunc getClipFunc()
+	{
+#if XUSG_SIMD_X86
+		switch (GetSIMDLevel())
+		{
+		case SIMDLevel::AVX512:
+			return clipAVX512;
+		case SIMDLevel::AVX2:
+			return clipAVX2;
+		case SIMDLevel::SSE4_2:
+			return clipSSE42;
+		}
+#endif
+		return clipScalar;
+	}
+}
+
+ClipVolumes::ClipVolumes()
+{
+}
+
+ClipVolumes::~ClipVolumes()
+{
+}
+
+void ClipVolumes::AddHalfSpace(const XMFLOAT3& normal, float d)
+{
+	ClipVolume volume = {};
+	volume.Type = ClipVolumeType::HALF_SPACE;
+	volume.Params[0] = XMFLOAT4(normal.x, normal.y, normal.z, d);
+	m_volumes.push_back(volume);
+}
+
+void ClipVolumes::AddBox(const XMFLOAT3& minPt, const XMFLOAT3& maxPt)
+{
+	ClipVolume volume = {};
+	volume.Type = ClipVolumeType::BOX;
+	volume.Params[0] = XMFLOAT4(minPt.x, minPt.y, minPt.z, 0.0f);
+	volume.Params[1] = XMFLOAT4(maxPt.x, maxPt.y, maxPt.z, 0.0f);
+	m_volumes.push_back(volume);
+}
+
+void ClipVolumes::AddSphere(const XMFLOAT3& center, float radius)
+{
+	ClipVolume volume = {};
+	volume.Type = ClipVolumeType::SPHERE;
+	volume.Params[0] = XMFLOAT4(center.x, center.y, center.z, radius * radius);
+	m_volumes.push_back(volume);
+}
+
+void ClipVolumes::Clear()
+{
+	m_volumes.clear();
+}
+
+ClipVolumes::Classification ClipVolumes::Classify(const XMFLOAT3 triangle[3]) const
+{
+	const XMFLOAT3 minPt((min)(triangle[0].x, (min)(triangle[1].x, triangle[2].x)),
+		(min)(triangle[0].y, (min)(triangle[1].y, triangle[2].y)),
+		(min)(triangle[0].z, (min)(triangle[1].z, triangle[2].z)));
+	const XMFLOAT3 maxPt((max)(triangle[0].x, (max)(triangle[1].x, triangle[2].x)),
+		(max)(triangle[0].y, (max)(triangle[1].y, triangle[2].y)),
+		(max)(triangle[0].z, (max)(triangle[1].z, triangle[2].z)));
+
+	auto result = OUTSIDE;
+	for (const auto& volume : m_volumes)
+	{
+		auto numInside = 0u;
+		for (uint8_t i = 0; i < 3; ++i) numInside += isClipped(volume, triangle[i].x, triangle[i].y, triangle[i].z) ? 1 : 0;
+		if (numInside == 3) return INSIDE;
+		if (numInside > 0 || result == STRADDLING)
+		{
+			result = STRADDLING;
+			continue;
+		}
+
+		// No vertex is inside, but the box or the sphere may still cross the triangle; a half-space
+		// holds the whole triangle in front.
+		const auto& a = volume.Params[0];
+		const auto& b = volume.Params[1];
+		switch (volume.Type)
+		{
+		case ClipVolumeType::BOX:
+			if (minPt.x <= b.x && minPt.y <= b.y && minPt.z <= b.z && maxPt.x >= a.x && maxPt.y >= a.y && maxPt.z >= a.z)
+				result = STRADDLING;
+			break;
+		case ClipVolumeType::SPHERE:
+		{
+			const auto dx = (max)(minPt.x - a.x, (max)(a.x - maxPt.x, 0.0f));
+			const auto dy = (max)(minPt.y - a.y, (max)(a.y - maxPt.y, 0.0f));
+			const auto dz = (max)(minPt.z - a.z, (max)(a.z - maxPt.z, 0.0f));
+			if (dx * dx + dy * dy + dz * dz < a.w) result = STRADDLING;
+			break;
+		}
+		}
+	}
+
+	return result;
+}
+
+uint32_t ClipVolumes::Clip(const float* pX, const float* pY, const float* pZ, uint32_t numPoints,
+	uint32_t* pKeptIds) const
+{
+	return getClipFunc()(m_volumes.data(), static_cast<uint32_t>(m_volumes.size()),
+		pX, pY, pZ, 0, numPoints, pKeptIds, 0);
+}
+
+bool ClipVolumes::IsEmpty() const
+{
+	return m_volumes.empty();
+}
+
+uint32_t ClipVolumes::GetNumVolumes() const
+{
+	return static_cast<uint32_t>(m_volumes.size());
+}
+
+const ClipVolume* ClipVolumes::GetVolumes() const
+{
+	return m_volumes.data();
+}
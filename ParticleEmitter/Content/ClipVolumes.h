@@ -0,0 +1,59 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include "Core/XUSG.h"
+
+enum class ClipVolumeType : uint32_t
+{
+	HALF_SPACE,
+	BOX,
+	SPHERE
+};
+
+struct ClipVolume
+{
+	ClipVolumeType Type;
+	DirectX::XMFLOAT4 Params[2];	// Half-space: (normal, d); box: min and max corners; sphere: (center, radius^2)
+};
+
+// Regions where no emitter is created, in the mesh space (the positions of the vertex buffer).
+// A point is clipped if it is in any volume: behind a plane, where dot(normal, p) + d < 0, in a box
+// including its faces, or strictly inside a sphere. The points are tested in batches by the SIMD
+// kernels of the highest supported tier, which match the scalar reference bit for bit.
+class ClipVolumes
+{
+public:
+	enum Classification : uint8_t
+	{
+		OUTSIDE,	// Meets no volume
+		STRADDLING,	// Each point must be tested
+		INSIDE		// In a volume as a whole
+	};
+
+	ClipVolumes();
+	virtual ~ClipVolumes();
+
+	void AddHalfSpace(const DirectX::XMFLOAT3& normal, float d);
+	void AddBox(const DirectX::XMFLOAT3& minPt, const DirectX::XMFLOAT3& maxPt);
+	void AddSphere(const DirectX::XMFLOAT3& center, float radius);
+	void Clear();
+
+	// The volumes are convex, so a triangle is inside one if all its vertices are; it is outside one
+	// if its AABB is. The points of a classified triangle may differ from the class by the rounding.
+	Classification Classify(const DirectX::XMFLOAT3 triangle[3]) const;
+
+	// Tests the points in SoA form, and writes the indices of the unclipped ones in ascending order;
+	// returns the number of them.
+	uint32_t Clip(const float* pX, const float* pY, const float* pZ, uint32_t numPoints,
+		uint32_t* pKeptIds) const;
+
+	bool IsEmpty() const;
+	uint32_t GetNumVolumes() const;
+	const ClipVolume* GetVolumes() const;
+
+protected:
+	std::vector<ClipVolume> m_volumes;
+};
@@ -0,0 +1,581 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include "Distributor.h"
+
+#define MAX_ROW_POINTS		65u			// Grid points in a row of a tile
+#define FRAME_THRESHOLD		0.6667f
+#define MARGIN_ULPS			32.0f
+#define MAX_KEPT_EMITTERS	512
+#define CHUNK_SIZE			1024u
+
+using namespace std;
+using namespace DirectX;
+using namespace XUSG;
+
+namespace
+{
+	inline XMFLOAT3 cross(const XMFLOAT3& a, const XMFLOAT3& b)
+	{
+		return XMFLOAT3(a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x);
+	}
+
+	inline float dot(const XMFLOAT3& a, const XMFLOAT3& b)
+	{
+		return a.x * b.x + a.y * b.y + a.z * b.z;
+	}
+
+	inline XMFLOAT3 normalize(const XMFLOAT3& a)
+	{
+		const auto l = sqrt(dot(a, a));
+
+		return XMFLOAT3(a.x / l, a.y / l, a.z / l);
+	}
+
+	inline float determinant(const XMFLOAT2& a, const XMFLOAT2& b, const XMFLOAT2& c)
+	{
+		return (b.x - a.x) * (c.y - a.y) - (b.y - a.y) * (c.x - a.x);
+	}
+
+	void loadTriangle(const uint8_t* pVertices, uint32_t stride, const uint32_t* pIndices,
+		float scale, uint32_t t, XMFLOAT3 p[3], XMUINT3& indices)
+	{
+		indices = XMUINT3(pIndices[3 * t], pIndices[3 * t + 1], pIndices[3 * t + 2]);
+		const uint32_t vIds[] = { indices.x, indices.y, indices.z };
+		for (uint8_t i = 0; i < 3; ++i)
+		{
+			const auto pPos = reinterpret_cast<const float*>(&pVertices[stride * vIds[i]]);
+			p[i] = XMFLOAT3(pPos[0] * scale, pPos[1] * scale, pPos[2] * scale);
+		}
+	}
+
+	// Returns the |cosine| between the normal and the y axis, which picks the tangent frame.
+	float toTangentSpace(const XMFLOAT3 p[3], XMFLOAT3 v[3])
+	{
+		// Compute orthonormal tangent space
+		const XMFLOAT3 e0(p[2].x - p[1].x, p[2].y - p[1].y, p[2].z - p[1].z);
+		const XMFLOAT3 e1(p[0].x - p[2].x, p[0].y - p[2].y, p[0].z - p[2].z);
+		const auto n = normalize(cross(e0, e1));
+
+		XMFLOAT3 u(0.0f, 1.0f, 0.0f);
+		XMFLOAT3 r(1.0f, 0.0f, 0.0f);
+		const auto cosine = fabs(dot(n, u));
+		if (cosine < FRAME_THRESHOLD)
+		{
+			r = normalize(cross(n, u));
+			u = cross(r, n);
+		}
+		else
+		{
+			u = normalize(cross(r, n));
+			r = cross(n, u);
+		}
+
+		// Transform to tangent space
+		for (uint8_t i = 0; i < 3; ++i) v[i] = XMFLOAT3(dot(r, p[i]), dot(u, p[i]), dot(n, p[i]));
+
+		return cosine;
+	}
+
+	// Computes the integer grid on the tangent-space AABB like HSDistribute; returns false if the
+	// patch is culled.
+	bool computeGrid(const XMFLOAT3 p[3], XMFLOAT3 v[3], XMFLOAT2& minPt, XMFLOAT2& gridMin, XMFLOAT2& gridMax)
+	{
+		// Ground culling
+		if (p[0].y <= GROUND_Y || p[1].y <= GROUND_Y || p[2].y <= GROUND_Y) return false;
+
+		toTangentSpace(p, v);
+
+		// Compute AABB; zero or NaN extents cull the patch.
+		minPt = XMFLOAT2((min)(v[0].x, (min)(v[1].x, v[2].x)), (min)(v[0].y, (min)(v[1].y, v[2].y)));
+		const XMFLOAT2 maxPt((max)(v[0].x, (max)(v[1].x, v[2].x)), (max)(v[0].y, (max)(v[1].y, v[2].y)));
+		gridMin = XMFLOAT2(floor(minPt.x), floor(minPt.y));
+		gridMax = XMFLOAT2(ceil(maxPt.x), ceil(maxPt.y));
+		const XMFLOAT2 aabb(gridMax.x - gridMin.x, gridMax.y - gridMin.y);
+
+		return aabb.x > 0.0f && aabb.y > 0.0f && aabb.x < MAX_GRID_EXTENT && aabb.y < MAX_GRID_EXTENT;
+	}
+
+	// Tiles of the max tess factor on the grid, which HSDistribute draws as instances
+	inline XMUINT2 getNumTiles(const XMFLOAT2& gridMin, const XMFLOAT2& gridMax)
+	{
+		return XMUINT2(static_cast<uint32_t>(ceil((gridMax.x - gridMin.x) / MAX_TESS_FACTOR)),
+			static_cast<uint32_t>(ceil((gridMax.y - gridMin.y) / MAX_TESS_FACTOR)));
+	}
+
+	// A triangle straddling the clip volumes, with its positions before the scale
+	struct TriangleClip
+	{
+		const ClipVolumes* pVolumes;
+		XMFLOAT3 Pos[3];
+	};
+
+	// Drops the clipped points of a row, and keeps the rest in order.
+	uint32_t clipRow(const TriangleClip& clip, XMFLOAT2* pBarycoords, uint32_t numPoints)
+	{
+		// Interpolate like CSEmit.
+		const auto& p = clip.Pos;
+		float x[MAX_ROW_POINTS], y[MAX_ROW_POINTS], z[MAX_ROW_POINTS];
+		for (auto i = 0u; i < numPoints; ++i)
+		{
+			const auto& b = pBarycoords[i];
+			const auto bz = 1.0f - (b.x + b.y);
+			x[i] = b.x * p[0].x + b.y * p[1].x + bz * p[2].x;
+			y[i] = b.x * p[0].y + b.y * p[1].y + bz * p[2].y;
+			z[i] = b.x * p[0].z + b.y * p[1].z + bz * p[2].z;
+		}
+
+		uint32_t keptIds[MAX_ROW_POINTS];
+		const auto numKept = clip.pVolumes->Clip(x, y, z, numPoints, keptIds);
+		for (auto i = 0u; i < numKept; ++i) pBarycoords[i] = pBarycoords[keptIds[i]];
+
+		return numKept;
+	}
+
+	// Distributes the emitters of a triangle like HSDistribute and DSDistribute; only counts them
+	// without pEmitters. The points are clipped row by row with pClip.
+	uint32_t distributeTriangle(const XMFLOAT3 p[3], const XMUINT3& indices, EmitterInfo* pEmitters,
+		const TriangleClip* pClip = nullptr)
+	{
+		XMFLOAT3 v[3];
+		XMFLOAT2 minPt, gridMin, gridMax;
+		if (!computeGrid(p, v, minPt, gridMin, gridMax)) return 0;
+
+		// Triangle edge equation setup
+		const auto a01 = v[0].y - v[1].y;
+		const auto b01 = v[1].x - v[0].x;
+		const auto a12 = v[1].y - v[2].y;
+		const auto b12 = v[2].x - v[1].x;
+		const auto a20 = v[2].y - v[0].y;
+		const auto b20 = v[0].x - v[2].x;
+
+		// Calculate barycentric coordinates at min corner.
+		const XMFLOAT2 v0(v[0].x, v[0].y), v1(v[1].x, v[1].y), v2(v[2].x, v[2].y);
+		const XMFLOAT3 w0(determinant(v1, v2, minPt), determinant(v2, v0, minPt), determinant(v0, v1, minPt));
+		const auto area = determinant(v0, v1, v2);
+
+		// Integer partitioning of the quad domain of each tile. A tile leaves its last row and column
+		// to the next tile, so the points on the shared edges are sampled once.
+		const auto numTiles = getNumTiles(gridMin, gridMax);
+		auto numEmitters = 0u;
+		for (auto ty = 0u; ty < numTiles.y; ++ty)
+		{
+			const auto tileMinY = gridMin.y + MAX_TESS_FACTOR * ty;
+			const auto tileMaxY = (min)(tileMinY + MAX_TESS_FACTOR, gridMax.y);
+			const auto numRows = static_cast<uint32_t>(tileMaxY - tileMinY);
+			const auto lastRow = ty + 1 < numTiles.y ? numRows - 1 : numRows;
+			for (auto tx = 0u; tx < numTiles.x; ++tx)
+			{
+				const auto tileMinX = gridMin.x + MAX_TESS_FACTOR * tx;
+				const auto tileMaxX = (min)(tileMinX + MAX_TESS_FACTOR, gridMax.x);
+				const auto numCols = static_cast<uint32_t>(tileMaxX - tileMinX);
+				const auto lastCol = tx + 1 < numTiles.x ? numCols - 1 : numCols;
+				for (auto j = 0u; j <= lastRow; ++j)
+				{
+					const auto y = tileMinY + (tileMaxY - tileMinY) * (static_cast<float>(j) / numRows);
+					const auto distY = y - minPt.y;
+					XMFLOAT2 barycoords[MAX_ROW_POINTS];
+					auto numRowEmitters = 0u;
+					for (auto i = 0u; i <= lastCol; ++i)
+					{
+						const auto x = tileMinX + (tileMaxX - tileMinX) * (static_cast<float>(i) / numCols);
+						const auto distX = x - minPt.x;
+
+						// If pixel is inside of all edges, set vertex.
+						const XMFLOAT3 w(w0.x + ((a12 * distX) + (b12 * distY)),
+							w0.y + ((a20 * distX) + (b20 * distY)),
+							w0.z + ((a01 * distX) + (b01 * distY)));
+						if (w.x <= 0.0f && w.y <= 0.0f && w.z <= 0.0f)
+						{
+							if (pEmitters || pClip) barycoords[numRowEmitters] = XMFLOAT2(w.x / area, w.y / area);
+							++numRowEmitters;
+						}
+					}
+
+					if (pClip && numRowEmitters > 0) numRowEmitters = clipRow(*pClip, barycoords, numRowEmitters);
+					for (auto i = 0u; pEmitters && i < numRowEmitters; ++i)
+					{
+						auto& emitter = pEmitters[numEmitters + i];
+						emitter.Indices = indices;
+						emitter.Barycoord = barycoords[i];
+					}
+					numEmitters += numRowEmitters;
+				}
+			}
+		}
+
+		return numEmitters;
+	}
+
+	// Loads and distributes a triangle; the clip volumes are tested per point only if they straddle it.
+	uint32_t distributeTriangle(const uint8_t* pVertices, uint32_t stride, const uint32_t* pIndices,
+		float scale, uint32_t t, const ClipVolumes* pClipVolumes, EmitterInfo* pEmitters)
+	{
+		XMFLOAT3 p[3];
+		XMUINT3 indices;
+		loadTriangle(pVertices, stride, pIndices, scale, t, p, indices);
+		if (!pClipVolumes || pClipVolumes->IsEmpty()) return distributeTriangle(p, indices, pEmitters);
+
+		TriangleClip clip;
+		clip.pVolumes = pClipVolumes;
+		loadTriangle(pVertices, stride, pIndices, 1.0f, t, clip.Pos, indices);
+		switch (pClipVolumes->Classify(clip.Pos))
+		{
+		case ClipVolumes::INSIDE:
+			return 0;
+		case ClipVolumes::STRADDLING:
+			return distributeTriangle(p, indices, pEmitters, &clip);
+		default:
+			return distributeTriangle(p, indices, pEmitters);
+		}
+	}
+
+	// Conservative: true only if the triangle certainly has no emitter at the scale. The ground
+	// culling is exact, as the rounding of the scaling keeps the order. Otherwise, the grid points
+	// are the integers in the AABB, so it is empty if an axis of the AABB holds no integer; the
+	// margin covers the rounding of the tangent space at the scale and of the tile interpolation.
+	inline bool isEmpty(const XMFLOAT2& minPt, const XMFLOAT2& maxPt, float minY, float margin, float scale)
+	{
+		if (minY * scale <= GROUND_Y) return true;
+
+		margin = margin * scale + MAX_TESS_FACTOR * FLT_EPSILON;
+		const XMFLOAT2 lo(minPt.x * scale - margin, minPt.y * scale - margin);
+		const XMFLOAT2 hi(maxPt.x * scale + margin, maxPt.y * scale + margin);
+
+		return floor(hi.x) < lo.x || floor(hi.y) < lo.y;
+	}
+}
+
+Distributor::Distributor()
+{
+}
+
+Distributor::~Distributor()
+{
+}
+
+void Distributor::Distribute(const uint8_t* pVertices, uint32_t stride, const uint32_t* pIndices,
+	uint32_t numIndices, float density, float scale, uint32_t numThreads, const ClipVolumes* pClipVolumes)
+{
+	// The positions are scaled like in VSDistribute.
+	scale *= density;
+	const auto numTris = numIndices / 3;
+
+	// Each triangle writes its own range.
+	ThreadPool threadPool(numThreads);
+	m_bounds.clear();
+	countEmitters(threadPool, pVertices, stride, pIndices, numIndices, scale, pClipVolumes, m_offsets);
+
+	m_emitters.resize(m_offsets[numTris]);
+	threadPool.ParallelFor(numTris, [&](uint32_t begin, uint32_t end)
+	{
+		for (auto t = begin; t < end; ++t)
+		{
+			if (m_offsets[t + 1] == m_offsets[t]) continue;
+			distributeTriangle(pVertices, stride, pIndices, scale, t, pClipVolumes, &m_emitters[m_offsets[t]]);
+		}
+	}, 1024);
+}
+
+void Distributor::Redistribute(const uint8_t* pVertices, uint32_t stride, const uint32_t* pIndices,
+	uint32_t numIndices, float density, float scale, uint32_t numThreads, const ClipVolumes* pClipVolumes)
+{
+	const auto numTris = numIndices / 3;
+	if (m_offsets.size() != numTris + 1)
+		return Distribute(pVertices, stride, pIndices, numIndices, density, scale, numThreads, pClipVolumes);
+
+	scale *= density;
+	ThreadPool threadPool(numThreads);
+	if (m_bounds.size() != numTris)
+	{
+		m_bounds.resize(numTris);
+		threadPool.ParallelFor(numTris, [&](uint32_t begin, uint32_t end)
+		{
+			for (auto t = begin; t < end; ++t)
+			{
+				XMFLOAT3 p[3], v[3];
+				XMUINT3 indices;
+				loadTriangle(pVertices, stride, pIndices, 1.0f, t, p, indices);
+				const auto cosine = toTangentSpace(p, v);
+
+				// The frame may flip with the rounding at another scale near the threshold.
+				auto& bound = m_bounds[t];
+				const auto isStable = fabs(cosine - FRAME_THRESHOLD) > 1e-3f;
+				bound.MinPt = isStable ? XMFLOAT2((min)(v[0].x, (min)(v[1].x, v[2].x)), (min)(v[0].y, (min)(v[1].y, v[2].y))) :
+					XMFLOAT2(-FLT_MAX, -FLT_MAX);
+				bound.MaxPt = isStable ? XMFLOAT2((max)(v[0].x, (max)(v[1].x, v[2].x)), (max)(v[0].y, (max)(v[1].y, v[2].y))) :
+					XMFLOAT2(FLT_MAX, FLT_MAX);
+				bound.MinY = (min)(p[0].y, (min)(p[1].y, p[2].y));
+
+				// The edges lose the low bits of the positions, so the rounding of the frame grows
+				// with the ratio of the position magnitude to the shortest edge.
+				auto extent = 0.0f, minEdgeSq = FLT_MAX;
+				for (uint8_t j = 0; j < 3; ++j)
+				{
+					const auto& q = p[(j + 1) % 3];
+					const XMFLOAT3 e(q.x - p[j].x, q.y - p[j].y, q.z - p[j].z);
+					extent = (max)(extent, (max)(fabs(p[j].x), (max)(fabs(p[j].y), fabs(p[j].z))));
+					minEdgeSq = (min)(minEdgeSq, dot(e, e));
+				}
+				bound.Margin = MARGIN_ULPS * FLT_EPSILON * extent * (extent / sqrt(minEdgeSq) + 1.0f);
+			}
+		}, 1024);
+	}
+
+	// Sample each triangle that may be non-empty once. The ones keeping their counts are written in
+	// place, and the others are kept in the lists of their chunks.
+	const auto numChunks = XUSG_DIV_UP(numTris, CHUNK_SIZE);
+	vector<vector<EmitterInfo>> chunkEmitters(numChunks);
+	vector<uint32_t> offsets(numTris + 1), chunkOffsets(numTris);
+	offsets[0] = 0;
+	threadPool.Execute(numChunks, [&](uint32_t i)
+	{
+		vector<EmitterInfo> emitters(MAX_KEPT_EMITTERS);
+		const auto end = (min)(CHUNK_SIZE * (i + 1), numTris);
+		for (auto t = CHUNK_SIZE * i; t < end; ++t)
+		{
+			const auto& bound = m_bounds[t];
+			auto& numEmitters = offsets[t + 1];
+			numEmitters = 0;
+			if (isEmpty(bound.MinPt, bound.MaxPt, bound.MinY, bound.Margin, scale)) continue;
+
+			// Large triangles are only counted, as keeping their emitters would cost more than
+			// sampling them again.
+			const auto maxEmitters = ((bound.MaxPt.x - bound.MinPt.x) * scale + 2.0f) *
+				((bound.MaxPt.y - bound.MinPt.y) * scale + 2.0f);
+			if (!(maxEmitters <= MAX_KEPT_EMITTERS))
+			{
+				numEmitters = distributeTriangle(pVertices, stride, pIndices, scale, t, pClipVolumes, nullptr);
+				chunkOffsets[t] = UINT32_MAX;
+				continue;
+			}
+
+			numEmitters = distributeTriangle(pVertices, stride, pIndices, scale, t, pClipVolumes, emitters.data());
+			if (numEmitters == m_offsets[t + 1] - m_offsets[t])
+				copy(emitters.cbegin(), emitters.cbegin() + numEmitters, m_emitters.begin() + m_offsets[t]);
+			else
+			{
+				chunkOffsets[t] = static_cast<uint32_t>(chunkEmitters[i].size());
+				chunkEmitters[i].insert(chunkEmitters[i].end(), emitters.cbegin(), emitters.cbegin() + numEmitters);
+			}
+		}
+	});
+
+	auto isSameLayout = true;
+	for (auto t = 0u; t < numTris; ++t)
+	{
+		offsets[t + 1] += offsets[t];
+		isSameLayout = isSameLayout && offsets[t + 1] == m_offsets[t + 1];
+	}
+	// Re-layout by the new prefix sum, unless no count changes; the large triangles are sampled
+	// again at their final ranges.
+	auto& emitters = m_spareEmitters;
+	if (!isSameLayout) emitters.resize(offsets[numTris]);
+	auto& dstEmitters = isSameLayout ? m_emitters : emitters;
+	threadPool.ParallelFor(numTris, [&](uint32_t begin, uint32_t end)
+	{
+		for (auto t = begin; t < end; ++t)
+		{
+			const auto numEmitters = offsets[t + 1] - offsets[t];
+			if (numEmitters <= 0) continue;
+
+			if (chunkOffsets[t] == UINT32_MAX)
+				distributeTriangle(pVertices, stride, pIndices, scale, t, pClipVolumes, &dstEmitters[offsets[t]]);
+			else if (isSameLayout) continue;
+			else if (numEmitters == m_offsets[t + 1] - m_offsets[t])
+				copy(m_emitters.cbegin() + m_offsets[t], m_emitters.cbegin() + m_offsets[t + 1], emitters.begin() + offsets[t]);
+			else
+			{
+				const auto first = chunkEmitters[t / CHUNK_SIZE].cbegin() + chunkOffsets[t];
+				copy(first, first + numEmitters, emitters.begin() + offsets[t]);
+			}
+		}
+	}, 1024);
+
+	if (!isSameLayout)
+	{
+		m_emitters.swap(emitters);
+		m_offsets.swap(offsets);
+	}
+}
+
+uint32_t Distributor::Count(const uint8_t* pVertices, uint32_t stride, const uint32_t* pIndices,
+	uint32_t numIndices, float density, float scale, uint32_t numThreads, const ClipVolumes* pClipVolumes)
+{
+	ThreadPool threadPool(numThreads);
+	vector<uint32_t> offsets;
+	countEmitters(threadPool, pVertices, stride, pIndices, numIndices, scale * density, pClipVolumes, offsets);
+
+	return offsets.back();
+}
+
+uint32_t Distributor::CollectTiledTriangles(const uint8_t* pVertices, uint32_t stride, const uint32_t* pIndices,
+	uint32_t numIndices, float density, float scale, vector<uint32_t>& tiledIndices, uint32_t numThreads)
+{
+	scale *= density;
+	const auto numTris = numIndices / 3;
+
+	vector<uint32_t> numTiles(numTris);
+	ThreadPool threadPool(numThreads);
+	threadPool.ParallelFor(numTris, [&](uint32_t begin, uint32_t end)
+	{
+		for (auto t = begin; t < end; ++t)
+		{
+			XMFLOAT3 p[3], v[3];
+			XMFLOAT2 minPt, gridMin, gridMax;
+			XMUINT3 indices;
+			loadTriangle(pVertices, stride, pIndices, scale, t, p, indices);
+			numTiles[t] = 0;
+			if (computeGrid(p, v, minPt, gridMin, gridMax))
+			{
+				const auto tiles = getNumTiles(gridMin, gridMax);
+				numTiles[t] = tiles.x * tiles.y;
+			}
+		}
+	}, 1024);
+
+	auto maxTiles = 0u;
+	tiledIndices.clear();
+	for (auto t = 0u; t < numTris; ++t)
+	{
+		maxTiles = (max)(maxTiles, numTiles[t]);
+		if (numTiles[t] > 1) tiledIndices.insert(tiledIndices.end(), &pIndices[3 * t], &pIndices[3 * t + 3]);
+	}
+
+	return maxTiles;
+}
+
+uint32_t Distributor::Verify(const EmitterInfo* pEmitters, uint32_t numEmitters, float tolerance) const
+{
+	// Sort both sides by the triangle, then by the barycentric coordinates.
+	const auto less = [](const EmitterInfo& a, const EmitterInfo& b)
+	{
+		if (a.Indices.x != b.Indices.x) return a.Indices.x < b.Indices.x;
+		if (a.Indices.y != b.Indices.y) return a.Indices.y < b.Indices.y;
+		if (a.Indices.z != b.Indices.z) return a.Indices.z < b.Indices.z;
+		if (a.Barycoord.y != b.Barycoord.y) return a.Barycoord.y < b.Barycoord.y;
+
+		return a.Barycoord.x < b.Barycoord.x;
+	};
+
+	const auto isSameTriangle = [](const EmitterInfo& a, const EmitterInfo& b)
+	{
+		return a.Indices.x == b.Indices.x && a.Indices.y == b.Indices.y && a.Indices.z == b.Indices.z;
+	};
+
+	vector<EmitterInfo> results(pEmitters, pEmitters + numEmitters);
+	vector<EmitterInfo> groundTruths(m_emitters);
+	sort(results.begin(), results.end(), less);
+	sort(groundTruths.begin(), groundTruths.end(), less);
+
+	// Walk the triangles of both sides in step.
+	auto numWrongTris = 0u;
+	auto maxError = 0.0f;
+	size_t i = 0, j = 0;
+	while (i < results.size() || j < groundTruths.size())
+	{
+		const auto& key = j >= groundTruths.size() || (i < results.size() && less(results[i], groundTruths[j])) ?
+			results[i] : groundTruths[j];
+		auto iEnd = i, jEnd = j;
+		while (iEnd < results.size() && isSameTriangle(results[iEnd], key)) ++iEnd;
+		while (jEnd < groundTruths.size() && isSameTriangle(groundTruths[jEnd], key)) ++jEnd;
+
+		auto isWrong = iEnd - i != jEnd - j;
+		for (auto k = 0u; !isWrong && i + k < iEnd; ++k)
+		{
+			const auto& a = results[i + k].Barycoord;
+			const auto& b = groundTruths[j + k].Barycoord;
+			const auto error = (max)(fabs(a.x - b.x), fabs(a.y - b.y));
+			maxError = (max)(maxError, error);
+			isWrong = error > tolerance;
+		}
+
+		if (isWrong && numWrongTris++ < 16)
+			cout << "Wrong triangle (" << key.Indices.x << ", " << key.Indices.y << ", " << key.Indices.z <<
+			"): result (" << iEnd - i << " emitters), ground truth (" << jEnd - j << " emitters)" << endl;
+
+		i = iEnd;
+		j = jEnd;
+	}
+
+	cout << "Distribution: " << numEmitters << " emitters, CPU " << m_emitters.size() << " emitters, " <<
+		numWrongTris << " triangles differ, max barycentric error " << maxError << endl;
+
+	return numWrongTris;
+}
+
+void Distributor::EncodeEmitters(EmitterCompact* pEmitters, uint32_t numThreads) const
+{
+	const auto numTris = m_offsets.empty() ? 0 : static_cast<uint32_t>(m_offsets.size() - 1);
+
+	ThreadPool threadPool(numThreads);
+	threadPool.ParallelFor(numTris, [&](uint32_t begin, uint32_t end)
+	{
+		for (auto t = begin; t < end; ++t)
+			for (auto i = m_offsets[t]; i < m_offsets[t + 1]; ++i)
+				pEmitters[i] = Encode(m_emitters[i], t);
+	}, 1024);
+}
+
+uint32_t Distributor::GetNumEmitters() const
+{
+	return static_cast<uint32_t>(m_emitters.size());
+}
+
+const EmitterInfo* Distributor::GetEmitters() const
+{
+	return m_emitters.data();
+}
+
+EmitterCompact Distributor::Encode(const EmitterInfo& emitter, uint32_t triangle)
+{
+	const auto toUnorm16 = [](float x)
+	{
+		return static_cast<uint32_t>((min)((max)(x, 0.0f), 1.0f) * 65535.0f + 0.5f);
+	};
+
+	// The rounding may push the point outside by a step, so take it from the larger one.
+	auto q0 = toUnorm16(emitter.Barycoord.x);
+	auto q1 = toUnorm16(emitter.Barycoord.y);
+	if (q0 + q1 > 65535)
+	{
+		if (q0 > q1) q0 = 65535 - q1;
+		else q1 = 65535 - q0;
+	}
+
+	EmitterCompact compact;
+	compact.Triangle = triangle;
+	compact.Barycoord = q0 | (q1 << 16);
+
+	return compact;
+}
+
+EmitterInfo Distributor::Decode(const EmitterCompact& emitter, const uint32_t* pIndices)
+{
+	const auto t = emitter.Triangle;
+
+	EmitterInfo info;
+	info.Indices = XMUINT3(pIndices[3 * t], pIndices[3 * t + 1], pIndices[3 * t + 2]);
+	info.Barycoord.x = (emitter.Barycoord & 0xffff) / 65535.0f;
+	info.Barycoord.y = (emitter.Barycoord >> 16) / 65535.0f;
+
+	return info;
+}
+
+void Distributor::countEmitters(ThreadPool& threadPool, const uint8_t* pVertices, uint32_t stride,
+	const uint32_t* pIndices, uint32_t numIndices, float scale, const ClipVolumes* pClipVolumes,
+	vector<uint32_t>& offsets)
+{
+	// Count the emitters of each triangle, then take the exclusive prefix sum.
+	const auto numTris = numIndices / 3;
+	offsets.resize(numTris + 1);
+	offsets[0] = 0;
+	threadPool.ParallelFor(numTris, [&](uint32_t begin, uint32_t end)
+	{
+		for (auto t = begin; t < end; ++t)
+			offsets[t + 1] = distributeTriangle(pVertices, stride, pIndices, scale, t, pClipVolumes, nullptr);
+	}, 1024);
+
+	for (auto t = 0u; t < numTris; ++t) offsets[t + 1] += offsets[t];
+}
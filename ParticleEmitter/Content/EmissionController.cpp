@@ -0,0 +1,48 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include "EmissionController.h"
+
+using namespace std;
+
+EmissionController::EmissionController() :
+	m_accumulator(0.0),
+	m_rate(0.0f),
+	m_maxPerFrame(UINT32_MAX)
+{
+}
+
+EmissionController::~EmissionController()
+{
+}
+
+void EmissionController::SetRate(float particlesPerSecond, uint32_t maxPerFrame)
+{
+	m_rate = (max)(particlesPerSecond, 0.0f);
+	m_maxPerFrame = maxPerFrame;
+}
+
+void EmissionController::Reset()
+{
+	m_accumulator = 0.0;
+}
+
+uint32_t EmissionController::Advance(float timeStep)
+{
+	m_accumulator += static_cast<double>(m_rate) * (max)(timeStep, 0.0f);
+	const auto numParticles = floor(m_accumulator);
+	m_accumulator -= numParticles;
+
+	return static_cast<uint32_t>((min)(numParticles, static_cast<double>(m_maxPerFrame)));
+}
+
+float EmissionController::GetRate() const
+{
+	return m_rate;
+}
+
+uint32_t EmissionController::GetMaxPerFrame() const
+{
+	return m_maxPerFrame;
+}
@@ -0,0 +1,33 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include "Core/XUSG.h"
+
+// Emission budget of a frame at a target rate, independent of the lifetimes. The fraction of a
+// particle left by a frame is carried to the next one, so the rate is exact over time; the count
+// of a frame is capped, and the particles over the cap are dropped instead of carried, so a long
+// frame bounds the emission cost rather than spreading a burst over the frames after it. The
+// counts depend only on the time steps, so a replay emits the same.
+class EmissionController
+{
+public:
+	EmissionController();
+	virtual ~EmissionController();
+
+	void SetRate(float particlesPerSecond, uint32_t maxPerFrame = UINT32_MAX);
+	void Reset();
+
+	// Returns the number of particles to emit at a frame of timeStep seconds.
+	uint32_t Advance(float timeStep);
+
+	float GetRate() const;
+	uint32_t GetMaxPerFrame() const;
+
+protected:
+	double		m_accumulator;
+	float		m_rate;
+	uint32_t	m_maxPerFrame;
+};
@@ -3,17 +3,13 @@
 //--------------------------------------------------------------------------------------
 
 #include "Emitter.h"
+#include "Distributor.h"
+#include "SharedConst.h"
 
 using namespace std;
 using namespace DirectX;
 using namespace XUSG;
 
-struct EmitterInfo
-{
-	DirectX::XMUINT3 Indices;
-	DirectX::XMFLOAT2 Barycoord;
-};
-
 struct ParticleInfo
 {
 	DirectX::XMFLOAT3 Pos;
@@ -21,6 +17,12 @@ struct ParticleInfo
 	float LifeTime;
 };
 
+struct CBDistribution
+{
+	DirectX::XMFLOAT3X4 Transform;
+	uint32_t BaseTile;
+};
+
 struct CBPerObject
 {
 	DirectX::XMFLOAT3X4 World;
@@ -29,11 +31,18 @@ struct CBPerObject
 	uint32_t BaseSeed;
 	uint32_t NumEmitters;
 	uint32_t NumParticles;
+	uint32_t EmitBegin;
+	uint32_t NumEmit;
+	uint32_t Padding[2];	// ViewProj starts a register
 	DirectX::XMFLOAT4X4 ViewProj;
 };
 
 Emitter::Emitter() :
-	m_srvTable(XUSG_NULL)
+	m_srvTable(XUSG_NULL),
+	m_frame(0),
+	m_emitBegin(0),
+	m_numTiledIndices(0),
+	m_numTiles(1)
 {
 	m_shaderLib = ShaderLib::MakeUnique();
 }
@@ -60,12 +69,6 @@ bool Emitter::Init(CommandList* pCommandList, uint32_t numParticles,
 		ResourceFlag::ALLOW_UNORDERED_ACCESS | ResourceFlag::DENY_SHADER_RESOURCE,
 		MemoryType::DEFAULT, 0, nullptr, 1, nullptr, MemoryFlag::NONE, L"Counter"), false);
 
-	m_emitterBuffer = StructuredBuffer::MakeUnique();
-	m_emitterBuffer->SetCounter(m_counter);
-	XUSG_N_RETURN(m_emitterBuffer->Create(pDevice, 1 << 24, sizeof(EmitterInfo),
-		ResourceFlag::ALLOW_UNORDERED_ACCESS, MemoryType::DEFAULT, 1,
-		nullptr, 1, nullptr, MemoryFlag::NONE, L"EmitterBuffer"), false);
-
 	uint8_t particleBufferIdx = 0;
 	for (auto& particleBuffer : m_particleBuffers)
 	{
@@ -80,8 +83,8 @@ bool Emitter::Init(CommandList* pCommandList, uint32_t numParticles,
 	{
 		particle = {};
 		particle.Pos.y = FLT_MAX;
-		particle.LifeTime = rand() % numParticles / 10000.0f;
 	}
+	SetEmissionRate(0.0f, 0);
 	uploaders.emplace_back(Resource::MakeUnique());
 	m_particleBuffers[REARRANGED]->Upload(pCommandList, uploaders.back().get(), particles.data(),
 		sizeof(ParticleInfo) * numParticles);
@@ -98,54 +101,6 @@ bool Emitter::Init(CommandList* pCommandList, uint32_t numParticles,
 	return true;
 }
 
-bool Emitter::SetEmitterCount(CommandList* pCommandList, RawBuffer* pCounter,
-	XUSG::StructuredBuffer::uptr& emitterScratch)
-{
-	m_numEmitters = *reinterpret_cast<const uint32_t*>(pCounter->Map(nullptr));
-#if defined(_DEBUG)
-	cout << m_numEmitters << endl;
-#endif
-
-	if (emitterScratch)
-	{
-		// Set source barrier
-		ResourceBarrier barriers[2];
-		auto numBarriers = m_emitterBuffer->SetBarrier(barriers, ResourceState::COPY_SOURCE);
-
-		XUSG_N_RETURN(emitterScratch->Create(pCommandList->GetDevice(), m_numEmitters, sizeof(EmitterInfo), ResourceFlag::NONE,
-			MemoryType::DEFAULT, 1, nullptr, 0, nullptr, MemoryFlag::NONE, L"EmitterBuffer"), false);
-
-		// Set barriers
-		numBarriers = emitterScratch->SetBarrier(barriers, ResourceState::COPY_DEST, numBarriers);
-		pCommandList->Barrier(numBarriers, barriers);
-
-		// Copy data
-		pCommandList->CopyBufferRegion(emitterScratch.get(), 0,
-			m_emitterBuffer.get(), 0, sizeof(EmitterInfo) * m_numEmitters);
-
-		// Set destination barrier
-		numBarriers = emitterScratch->SetBarrier(barriers, ResourceState::NON_PIXEL_SHADER_RESOURCE);
-		pCommandList->Barrier(numBarriers, barriers);
-
-		m_emitterBuffer.swap(emitterScratch);
-	}
-
-	if (!m_srvTable)
-	{
-		// Create SRV table
-		const auto descriptorTable = Util::DescriptorTable::MakeUnique();
-		const Descriptor descriptors[] =
-		{
-			m_emitterBuffer->GetSRV(),
-			m_srvVertexBuffer
-		};
-		descriptorTable->SetDescriptors(0, static_cast<uint32_t>(size(descriptors)), descriptors);
-		XUSG_X_RETURN(m_srvTable, descriptorTable->GetCbvSrvUavTable(m_descriptorTableLib.get()), false);
-	}
-
-	return true;
-}
-
 void Emitter::UpdateFrame(uint8_t frameIndex, double time, float timeStep,
 	const XMFLOAT3X4& world, const CXMMATRIX viewProj)
 {
@@ -155,18 +110,29 @@ void Emitter::UpdateFrame(uint8_t frameIndex, double time, float timeStep,
 	pCbData->WorldPrev = m_world;
 	pCbData->World = world;
 	pCbData->TimeStep = timeStep;
-	pCbData->BaseSeed = rand();
+	pCbData->BaseSeed = m_frame++;	// The frame word of the Pcg4d counters
 	pCbData->NumEmitters = m_numEmitters;
 	pCbData->NumParticles = m_numParticles;
+	pCbData->EmitBegin = m_emitBegin;
+	pCbData->NumEmit = (min)(m_emissionController.Advance(timeStep), m_numParticles);
+	m_emitBegin = (m_emitBegin + pCbData->NumEmit) % m_numParticles;
 	XMStoreFloat4x4(&pCbData->ViewProj, XMMatrixTranspose(viewProj));
 	m_world = pCbData->World;
 }
 
-void Emitter::Distribute(CommandList* pCommandList, const RawBuffer* pCounter,
+void Emitter::SetEmissionRate(float particlesPerSecond, uint32_t maxPerFrame)
+{
+	// A slot is dead again when the window of the emission comes back to it at the default rate.
+	particlesPerSecond = particlesPerSecond > 0.0f ? particlesPerSecond : m_numParticles / (FULL_LIFE + 1.0f);
+	maxPerFrame = maxPerFrame > 0 ? maxPerFrame : (max)(m_numParticles / 16, 1u);
+	m_emissionController.SetRate(particlesPerSecond, maxPerFrame);
+}
+
+bool Emitter::Distribute(CommandList* pCommandList, uint32_t numEmitters, RawBuffer* pCounter,
 	const VertexBuffer* pVB, const IndexBuffer* pIB, uint32_t numIndices,
 	float density, float scale)
 {
-	m_srvVertexBuffer = pVB->GetSRV();
+	XUSG_N_RETURN(createEmitterBuffer(pCommandList, numEmitters, pVB), false);
 
 	// Bind the descriptor heap.
 	const auto descriptorHeap = m_descriptorTableLib->GetDescriptorHeap(CBV_SRV_UAV_HEAP);
@@ -187,11 +153,54 @@ void Emitter::Distribute(CommandList* pCommandList, const RawBuffer* pCounter,
 
 	// Set barriers
 	auto numBarriers = m_emitterBuffer->SetBarrier(barriers, ResourceState::NON_PIXEL_SHADER_RESOURCE);
-	numBarriers = m_counter->SetBarrier(barriers, ResourceState::COPY_SOURCE);
+	numBarriers = m_counter->SetBarrier(barriers, ResourceState::COPY_SOURCE, numBarriers);
 	pCommandList->Barrier(numBarriers, barriers);
 
 	// Copy the counter for readback
 	pCommandList->CopyResource(pCounter, m_counter.get());
+
+	return true;
+}
+
+bool Emitter::SetEmitterCount(RawBuffer* pCounter)
+{
+	const auto numAppended = *static_cast<const uint32_t*>(pCounter->Map(nullptr));
+	pCounter->Unmap();
+
+	const auto isExact = numAppended == m_numEmitters;
+	if (!isExact) cout << "Distribution appended " << numAppended << " emitters of " << m_numEmitters << endl;
+	m_numEmitters = (min)(numAppended, m_numEmitters);
+
+	return isExact;
+}
+
+bool Emitter::SetTiledTriangles(CommandList* pCommandList, const uint32_t* pIndices, uint32_t numIndices,
+	uint32_t numTiles, vector<Resource::uptr>& uploaders)
+{
+	m_numTiledIndices = numTiles > 1 ? numIndices : 0;
+	m_numTiles = numTiles;
+	if (m_numTiledIndices <= 0) return true;
+
+	const uint32_t byteWidth = sizeof(uint32_t) * m_numTiledIndices;
+	m_tiledIndexBuffer = IndexBuffer::MakeUnique();
+	XUSG_N_RETURN(m_tiledIndexBuffer->Create(pCommandList->GetDevice(), byteWidth, Format::R32_UINT, ResourceFlag::NONE,
+		MemoryType::DEFAULT, 1, nullptr, 1, nullptr, 1, nullptr, MemoryFlag::NONE, L"TiledTriangleIB"), false);
+	uploaders.emplace_back(Resource::MakeUnique());
+
+	return m_tiledIndexBuffer->Upload(pCommandList, uploaders.back().get(), pIndices,
+		byteWidth, 0, ResourceState::INDEX_BUFFER);
+}
+
+bool Emitter::SetEmitters(CommandList* pCommandList, uint32_t numEmitters, const EmitterInfo* pEmitters,
+	const VertexBuffer* pVB, vector<Resource::uptr>& uploaders)
+{
+	XUSG_N_RETURN(createEmitterBuffer(pCommandList, numEmitters, pVB), false);
+	if (m_numEmitters <= 0) return true;
+
+	uploaders.emplace_back(Resource::MakeUnique());
+
+	return m_emitterBuffer->Upload(pCommandList, uploaders.back().get(), pEmitters,
+		sizeof(EmitterInfo) * m_numEmitters, 0, ResourceState::NON_PIXEL_SHADER_RESOURCE);
 }
 
 void Emitter::EmitParticle(const CommandList* pCommandList, uint8_t frameIndex,
@@ -294,17 +303,27 @@ void Emitter::Visualize(const CommandList* pCommandList, const Descriptor& rtv,
 	pCommandList->Draw(m_numEmitters, 1, 0, 0);
 }
 
+void Emitter::ReadBackEmitters(CommandList* pCommandList, Buffer* pReadBuffer)
+{
+	m_emitterBuffer->ReadBack(pCommandList, pReadBuffer, sizeof(EmitterInfo) * m_numEmitters);
+}
+
 const StructuredBuffer::uptr* Emitter::GetParticleBuffers() const
 {
 	return m_particleBuffers;
 }
 
+uint32_t Emitter::GetNumEmitters() const
+{
+	return m_numEmitters;
+}
+
 bool Emitter::createPipelineLayouts()
 {
 	// Generate uniformized distribution
 	{
 		const auto pipelineLayout = Util::PipelineLayout::MakeUnique();
-		pipelineLayout->SetConstants(0, XUSG_UINT32_SIZE_OF(XMFLOAT3X4), 0, 0, Shader::Stage::VS);
+		pipelineLayout->SetConstants(0, XUSG_UINT32_SIZE_OF(CBDistribution), 0, 0, Shader::Stage::VS);
 		pipelineLayout->SetRange(1, DescriptorType::UAV, 1, 0, 0, DescriptorFlag::DATA_STATIC_WHILE_SET_AT_EXECUTE);
 		pipelineLayout->SetShaderStage(1, Shader::Stage::DS);
 		XUSG_X_RETURN(m_pipelineLayouts[DISTRIBUTE], pipelineLayout->GetPipelineLayout(m_pipelineLayoutLib.get(),
@@ -482,12 +501,6 @@ bool Emitter::createPipelines(const InputLayout* pInputLayout, Format rtFormat,
 bool Emitter::createDescriptorTables()
 {
 	// Create UAV tables
-	{
-		const auto descriptorTable = Util::DescriptorTable::MakeUnique();
-		descriptorTable->SetDescriptors(0, 1, &m_emitterBuffer->GetUAV());
-		XUSG_X_RETURN(m_uavTables[UAV_TABLE_EMITTER], descriptorTable->GetCbvSrvUavTable(m_descriptorTableLib.get()), false);
-	}
-
 	{
 		const auto descriptorTable = Util::DescriptorTable::MakeUnique();
 		descriptorTable->SetDescriptors(0, 1, &m_counter->GetUAV());
@@ -504,6 +517,42 @@ bool Emitter::createDescriptorTables()
 	return true;
 }
 
+bool Emitter::createEmitterBuffer(CommandList* pCommandList, uint32_t numEmitters, const VertexBuffer* pVB)
+{
+	m_numEmitters = numEmitters;
+	m_srvVertexBuffer = pVB->GetSRV();
+
+	// Create the emitter buffer at the exact size; the empty distribution still needs a valid view.
+	m_emitterBuffer = StructuredBuffer::MakeUnique();
+	m_emitterBuffer->SetCounter(m_counter);
+	XUSG_N_RETURN(m_emitterBuffer->Create(pCommandList->GetDevice(), (max)(m_numEmitters, 1u),
+		sizeof(EmitterInfo), ResourceFlag::ALLOW_UNORDERED_ACCESS, MemoryType::DEFAULT, 1,
+		nullptr, 1, nullptr, MemoryFlag::NONE, L"EmitterBuffer"), false);
+#if defined(_DEBUG)
+	cout << m_numEmitters << " emitters, " << sizeof(EmitterInfo) * m_numEmitters / 1048576.0 << " MB" << endl;
+#endif
+
+	// Create UAV and SRV tables
+	{
+		const auto descriptorTable = Util::DescriptorTable::MakeUnique();
+		descriptorTable->SetDescriptors(0, 1, &m_emitterBuffer->GetUAV());
+		XUSG_X_RETURN(m_uavTables[UAV_TABLE_EMITTER], descriptorTable->GetCbvSrvUavTable(m_descriptorTableLib.get()), false);
+	}
+
+	{
+		const auto descriptorTable = Util::DescriptorTable::MakeUnique();
+		const Descriptor descriptors[] =
+		{
+			m_emitterBuffer->GetSRV(),
+			m_srvVertexBuffer
+		};
+		descriptorTable->SetDescriptors(0, static_cast<uint32_t>(size(descriptors)), descriptors);
+		XUSG_X_RETURN(m_srvTable, descriptorTable->GetCbvSrvUavTable(m_descriptorTableLib.get()), false);
+	}
+
+	return true;
+}
+
 void Emitter::distribute(const CommandList* pCommandList, const VertexBuffer* pVB,
 	const IndexBuffer* pIB, uint32_t numIndices, float density, float scale)
 {
@@ -515,13 +564,24 @@ void Emitter::distribute(const CommandList* pCommandList, const VertexBuffer* pV
 
 	// Set descriptor tables
 	scale *= density;
-	XMFLOAT3X4 transform;
-	XMStoreFloat3x4(&transform, XMMatrixScaling(scale, scale, scale));
-	pCommandList->SetGraphics32BitConstants(0, XUSG_UINT32_SIZE_OF(XMFLOAT3X4), &transform);
+	CBDistribution cb;
+	XMStoreFloat3x4(&cb.Transform, XMMatrixScaling(scale, scale, scale));
+	cb.BaseTile = 0;
+	pCommandList->SetGraphics32BitConstants(0, XUSG_UINT32_SIZE_OF(CBDistribution), &cb);
 	pCommandList->SetGraphicsDescriptorTable(1, m_uavTables[UAV_TABLE_EMITTER]);
 
 	pCommandList->IASetVertexBuffers(0, 1, &pVB->GetVBV());
 	pCommandList->IASetIndexBuffer(pIB->GetIBV());
 
+	// The first tiles of all the triangles
 	pCommandList->DrawIndexed(numIndices, 1, 0, 0, 0);
+
+	// The rest tiles of the large triangles
+	if (m_numTiledIndices > 0)
+	{
+		cb.BaseTile = 1;
+		pCommandList->SetGraphics32BitConstant(0, cb.BaseTile, XUSG_UINT32_SIZE_OF(XMFLOAT3X4));
+		pCommandList->IASetIndexBuffer(m_tiledIndexBuffer->GetIBV());
+		pCommandList->DrawIndexed(m_numTiledIndices, m_numTiles - 1, 0, 0, 0);
+	}
 }
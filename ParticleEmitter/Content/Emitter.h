@@ -5,6 +5,9 @@
 #pragma once
 
 #include "Core/XUSG.h"
+#include "EmissionController.h"
+
+struct EmitterInfo;
 
 class Emitter
 {
@@ -16,14 +19,30 @@ public:
 		const XUSG::DescriptorTableLib::sptr& descriptorTableLib,
 		std::vector<XUSG::Resource::uptr> &uploaders, const XUSG::InputLayout* pInputLayout,
 		XUSG::Format rtFormat, XUSG::Format dsFormat);
-	bool SetEmitterCount(XUSG::CommandList* pCommandList, XUSG::RawBuffer* pCounter,
-		XUSG::StructuredBuffer::uptr& emitterScratch);
 
 	void UpdateFrame(uint8_t frameIndex, double time, float timeStep,
 		const DirectX::XMFLOAT3X4& world, const DirectX::CXMMATRIX viewProj);
-	void Distribute(XUSG::CommandList* pCommandList, const XUSG::RawBuffer* pCounter,
+	// The dead particles emit in a window of slots that moves around the particle buffer by the
+	// budget of each frame, so no more than maxPerFrame emit. 0 keeps the defaults: the rate that
+	// reuses a slot after the max lifetime, and 1/16 of the particles per frame.
+	void SetEmissionRate(float particlesPerSecond, uint32_t maxPerFrame);
+	// numEmitters is the exact count of the distribution, e.g. from Distributor::Count, so the
+	// emitter buffer is created once at its final size. The appended count is copied to pCounter,
+	// a readback buffer, for SetEmitterCount.
+	bool Distribute(XUSG::CommandList* pCommandList, uint32_t numEmitters, XUSG::RawBuffer* pCounter,
 		const XUSG::VertexBuffer* pVB, const XUSG::IndexBuffer* pIB, uint32_t numIndices,
 		float density, float scale);
+	// After the GPU has run Distribute, keeps only the emitters the distribution pass appended, in
+	// case it appended fewer than counted; the ones beyond the buffer were dropped. Returns whether
+	// the appended count matches.
+	bool SetEmitterCount(XUSG::RawBuffer* pCounter);
+	// Sets the triangles of more than one tile and the max number of tiles per triangle, e.g. from
+	// Distributor::CollectTiledTriangles, before Distribute.
+	bool SetTiledTriangles(XUSG::CommandList* pCommandList, const uint32_t* pIndices, uint32_t numIndices,
+		uint32_t numTiles, std::vector<XUSG::Resource::uptr>& uploaders);
+	// Uploads the emitters of an earlier distribution, e.g. from EmitterCache, instead.
+	bool SetEmitters(XUSG::CommandList* pCommandList, uint32_t numEmitters, const EmitterInfo* pEmitters,
+		const XUSG::VertexBuffer* pVB, std::vector<XUSG::Resource::uptr>& uploaders);
 	void EmitParticle(const XUSG::CommandList* pCommandList, uint8_t frameIndex,
 		uint32_t numParticles, const XUSG::DescriptorTable& uavTable);
 	void Render(const XUSG::CommandList* pCommandList, uint8_t frameIndex,
@@ -35,7 +54,10 @@ public:
 	void Visualize(const XUSG::CommandList* pCommandList, const XUSG::Descriptor& rtv,
 		const XUSG::Descriptor* pDsv, const DirectX::XMFLOAT4X4& worldViewProj);
 
+	void ReadBackEmitters(XUSG::CommandList* pCommandList, XUSG::Buffer* pReadBuffer);
+
 	const XUSG::StructuredBuffer::uptr* GetParticleBuffers() const;
+	uint32_t GetNumEmitters() const;
 
 	static const uint8_t FrameCount = 3;
 	
@@ -73,6 +95,7 @@ protected:
 	bool createPipelineLayouts();
 	bool createPipelines(const XUSG::InputLayout* pInputLayout, XUSG::Format rtFormat, XUSG::Format dsFormat);
 	bool createDescriptorTables();
+	bool createEmitterBuffer(XUSG::CommandList* pCommandList, uint32_t numEmitters, const XUSG::VertexBuffer* pVB);
 
 	void distribute(const XUSG::CommandList* pCommandList, const XUSG::VertexBuffer* pVB,
 		const XUSG::IndexBuffer* pIB, uint32_t numIndices, float density, float scale);
@@ -93,12 +116,19 @@ protected:
 
 	XUSG::RawBuffer::sptr	m_counter;
 	XUSG::StructuredBuffer::uptr m_emitterBuffer;
+	XUSG::IndexBuffer::uptr	m_tiledIndexBuffer;
 	XUSG::StructuredBuffer::uptr m_particleBuffers[NUM_PARTICLE_BUFFER];
 
 	XUSG::ConstantBuffer::uptr m_cbPerObject;
 
 	double					m_time;
+	uint32_t				m_frame;
+	uint32_t				m_emitBegin;
 	uint32_t				m_numParticles;
 	uint32_t				m_numEmitters;
+	uint32_t				m_numTiledIndices;
+	uint32_t				m_numTiles;
 	DirectX::XMFLOAT3X4		m_world;
+
+	EmissionController		m_emissionController;
 };
@@ -0,0 +1,138 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include "EmitterCache.h"
+#include "Optional/XUSGFileUtil.h"
+
+using namespace std;
+using namespace DirectX;
+using namespace XUSG;
+
+namespace
+{
+	const uint32_t cacheMagic = 0x54494d45; // "EMIT"
+
+	// Bump it whenever the distribution changes, so the stale caches are rejected.
+	const uint32_t cacheVersion = 4;
+}
+
+EmitterCache::EmitterCache() :
+	m_pHeader(nullptr),
+	m_hFile(INVALID_HANDLE_VALUE),
+	m_hMapping(nullptr)
+{
+}
+
+EmitterCache::~EmitterCache()
+{
+	Release();
+}
+
+uint64_t EmitterCache::HashMesh(const uint8_t* pVertices, uint32_t stride, uint32_t numVertices,
+	const uint32_t* pIndices, uint32_t numIndices)
+{
+	auto h = FNV_BASIS;
+	for (auto i = 0u; i < numVertices; ++i)
+	{
+		uint64_t xy;
+		uint32_t z;
+		memcpy(&xy, &pVertices[stride * i], sizeof(uint64_t));
+		memcpy(&z, &pVertices[stride * i + sizeof(uint64_t)], sizeof(uint32_t));
+		h = (h ^ xy) * FNV_PRIME;
+		h = (h ^ z) * FNV_PRIME;
+	}
+
+	return HashData(pIndices, sizeof(uint32_t) * numIndices, h);
+}
+
+uint64_t EmitterCache::HashClipVolumes(const ClipVolumes& clipVolumes)
+{
+	return clipVolumes.IsEmpty() ? 0 : HashData(clipVolumes.GetVolumes(), sizeof(ClipVolume) * clipVolumes.GetNumVolumes());
+}
+
+bool EmitterCache::Load(const char* pszFilename, uint64_t meshHash, uint64_t clipHash, float density, float scale)
+{
+	Release();
+
+	// Map the cache file
+	uint64_t cacheSize;
+	m_pHeader = static_cast<const Header*>(MapFile(pszFilename, m_hFile, m_hMapping, cacheSize));
+	if (!m_pHeader) return false;
+
+	if (cacheSize < sizeof(Header))
+	{
+		Release();
+
+		return false;
+	}
+
+	// Validate the header, the key and the layout
+	const auto emitterBytes = static_cast<uint64_t>(m_pHeader->NumEmitters) * sizeof(EmitterInfo);
+	if (m_pHeader->Magic != cacheMagic || m_pHeader->Version != cacheVersion ||
+		m_pHeader->EmitterSize != sizeof(EmitterInfo) || m_pHeader->MeshHash != meshHash ||
+		m_pHeader->ClipHash != clipHash || m_pHeader->Density != density || m_pHeader->Scale != scale || m_pHeader->GroundY != GROUND_Y ||
+		m_pHeader->EmitterOffset < sizeof(Header) || m_pHeader->EmitterOffset % sizeof(uint32_t) ||
+		m_pHeader->EmitterOffset + emitterBytes != cacheSize)
+	{
+		Release();
+
+		return false;
+	}
+
+	// Validate the payload; a truncated or corrupt array could index out of the vertex buffer.
+	if (HashData(GetEmitters(), static_cast<size_t>(emitterBytes)) != m_pHeader->EmitterHash)
+	{
+		Release();
+
+		return false;
+	}
+
+	return true;
+}
+
+bool EmitterCache::Save(const char* pszFilename, uint64_t meshHash, uint64_t clipHash, float density, float scale,
+	const EmitterInfo* pEmitters, uint32_t numEmitters) const
+{
+	const auto emitterBytes = sizeof(EmitterInfo) * numEmitters;
+
+	Header header = {};
+	header.Magic = cacheMagic;
+	header.Version = cacheVersion;
+	header.EmitterSize = sizeof(EmitterInfo);
+	header.NumEmitters = numEmitters;
+	header.MeshHash = meshHash;
+	header.ClipHash = clipHash;
+	header.Density = density;
+	header.Scale = scale;
+	header.GroundY = GROUND_Y;
+	header.EmitterOffset = sizeof(Header);
+	header.EmitterHash = HashData(pEmitters, emitterBytes);
+
+	ofstream fileStream(pszFilename, ios::out | ios::binary | ios::trunc);
+	if (!fileStream) return false;
+
+	fileStream.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	fileStream.write(reinterpret_cast<const char*>(pEmitters), emitterBytes);
+
+	return fileStream.good();
+}
+
+void EmitterCache::Release()
+{
+	if (m_pHeader) UnmapFile(m_pHeader, m_hFile, m_hMapping);
+	m_pHeader = nullptr;
+	m_hMapping = nullptr;
+	m_hFile = INVALID_HANDLE_VALUE;
+}
+
+uint32_t EmitterCache::GetNumEmitters() const
+{
+	return m_pHeader ? m_pHeader->NumEmitters : 0;
+}
+
+const EmitterInfo* EmitterCache::GetEmitters() const
+{
+	return m_pHeader ? reinterpret_cast<const EmitterInfo*>(reinterpret_cast<const uint8_t*>(m_pHeader) +
+		m_pHeader->EmitterOffset) : nullptr;
+}
@@ -0,0 +1,56 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include "Distributor.h"
+
+// On-disk cache of the final emitter array, keyed by the content hash of the mesh positions and
+// indices, the clip volumes, the density and the scale of the distribution. The file is a header followed by the
+// emitters in the shader layout; it is memory mapped on loading, so the emitters can be uploaded
+// straight from the mapped view.
+class EmitterCache
+{
+public:
+	EmitterCache();
+	virtual ~EmitterCache();
+
+	// Hashes the positions, read from the first 12 bytes of the vertices, and the indices
+	static uint64_t HashMesh(const uint8_t* pVertices, uint32_t stride, uint32_t numVertices,
+		const uint32_t* pIndices, uint32_t numIndices);
+
+	// Hashes the clip volumes in their order; 0 for none
+	static uint64_t HashClipVolumes(const ClipVolumes& clipVolumes);
+
+	// Maps the cache file, and returns false if it is missing, from another format version, for
+	// another key, or corrupt. The emitters stay valid until Release or the destruction.
+	bool Load(const char* pszFilename, uint64_t meshHash, uint64_t clipHash, float density, float scale);
+	bool Save(const char* pszFilename, uint64_t meshHash, uint64_t clipHash, float density, float scale,
+		const EmitterInfo* pEmitters, uint32_t numEmitters) const;
+	void Release();
+
+	uint32_t GetNumEmitters() const;
+	const EmitterInfo* GetEmitters() const;
+
+protected:
+	struct Header
+	{
+		uint32_t	Magic;
+		uint32_t	Version;
+		uint32_t	EmitterSize;
+		uint32_t	NumEmitters;
+		uint64_t	MeshHash;
+		uint64_t	ClipHash;
+		float		Density;
+		float		Scale;
+		float		GroundY;
+		uint32_t	Reserved;
+		uint64_t	EmitterOffset;
+		uint64_t	EmitterHash;
+	};
+
+	const Header*	m_pHeader;
+	HANDLE			m_hFile;
+	HANDLE			m_hMapping;
+};
@@ -0,0 +1,116 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include "EmitterSorter.h"
+
+#define MORTON_BITS		21
+#define MORTON_MAX		((1u << MORTON_BITS) - 1)
+
+using namespace std;
+using namespace DirectX;
+using namespace XUSG;
+
+namespace
+{
+	// Spreads the low 21 bits to every third bit.
+	inline uint64_t spreadBits(uint32_t x)
+	{
+		auto v = static_cast<uint64_t>(x) & MORTON_MAX;
+		v = (v | v << 32) & 0x1f00000000ffffull;
+		v = (v | v << 16) & 0x1f0000ff0000ffull;
+		v = (v | v << 8) & 0x100f00f00f00f00full;
+		v = (v | v << 4) & 0x10c30c30c30c30c3ull;
+		v = (v | v << 2) & 0x1249249249249249ull;
+
+		return v;
+	}
+
+	// Interpolates like CSEmit.
+	inline XMFLOAT3 getPosition(const EmitterInfo& emitter, const uint8_t* pVertices, uint32_t stride)
+	{
+		const float w[] = { emitter.Barycoord.x, emitter.Barycoord.y, 1.0f - (emitter.Barycoord.x + emitter.Barycoord.y) };
+		const uint32_t vIds[] = { emitter.Indices.x, emitter.Indices.y, emitter.Indices.z };
+		XMFLOAT3 p(0.0f, 0.0f, 0.0f);
+		for (uint8_t i = 0; i < 3; ++i)
+		{
+			const auto pPos = reinterpret_cast<const float*>(&pVertices[stride * vIds[i]]);
+			p = XMFLOAT3(p.x + pPos[0] * w[i], p.y + pPos[1] * w[i], p.z + pPos[2] * w[i]);
+		}
+
+		return p;
+	}
+}
+
+void EmitterSorter::SortByMorton(EmitterInfo* pEmitters, uint32_t numEmitters, const uint8_t* pVertices,
+	uint32_t stride, uint32_t numThreads)
+{
+	if (numEmitters <= 1) return;
+
+	ThreadPool threadPool(numThreads);
+	vector<XMFLOAT3> positions(numEmitters);
+	threadPool.ParallelFor(numEmitters, [&](uint32_t begin, uint32_t end)
+	{
+		for (auto i = begin; i < end; ++i) positions[i] = getPosition(pEmitters[i], pVertices, stride);
+	}, 4096);
+
+	XMFLOAT3 minPt(FLT_MAX, FLT_MAX, FLT_MAX), maxPt(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+	for (const auto& p : positions)
+	{
+		minPt = XMFLOAT3((min)(minPt.x, p.x), (min)(minPt.y, p.y), (min)(minPt.z, p.z));
+		maxPt = XMFLOAT3((max)(maxPt.x, p.x), (max)(maxPt.y, p.y), (max)(maxPt.z, p.z));
+	}
+
+	// Cubic cells, so the curve is not stretched along the short axes
+	const auto extent = (max)(maxPt.x - minPt.x, (max)(maxPt.y - minPt.y, maxPt.z - minPt.z));
+	const auto cellScale = extent > 0.0f ? MORTON_MAX / extent : 0.0f;
+	const auto quantize = [cellScale](float x)
+	{
+		return static_cast<uint32_t>((min)(x * cellScale, static_cast<float>(MORTON_MAX)));
+	};
+
+	vector<pair<uint64_t, uint32_t>> keys(numEmitters);
+	threadPool.ParallelFor(numEmitters, [&](uint32_t begin, uint32_t end)
+	{
+		for (auto i = begin; i < end; ++i)
+		{
+			const auto& p = positions[i];
+			const auto code = spreadBits(quantize(p.x - minPt.x)) | spreadBits(quantize(p.y - minPt.y)) << 1 |
+				spreadBits(quantize(p.z - minPt.z)) << 2;
+			keys[i] = make_pair(code, i);
+		}
+	}, 4096);
+	sort(keys.begin(), keys.end());
+
+	const vector<EmitterInfo> emitters(pEmitters, pEmitters + numEmitters);
+	threadPool.ParallelFor(numEmitters, [&](uint32_t begin, uint32_t end)
+	{
+		for (auto i = begin; i < end; ++i) pEmitters[i] = emitters[keys[i].second];
+	}, 4096);
+}
+
+void EmitterSorter::ReorderVertices(EmitterInfo* pEmitters, uint32_t numEmitters, uint8_t* pVertices,
+	uint32_t stride, uint32_t numVertices, uint32_t* pIndices, uint32_t numIndices)
+{
+	vector<uint32_t> remap(numVertices, UINT32_MAX);
+	auto numRemapped = 0u;
+	const auto remapIndex = [&](uint32_t& i)
+	{
+		if (remap[i] == UINT32_MAX) remap[i] = numRemapped++;
+		i = remap[i];
+	};
+
+	for (auto i = 0u; i < numEmitters; ++i)
+	{
+		auto& indices = pEmitters[i].Indices;
+		remapIndex(indices.x);
+		remapIndex(indices.y);
+		remapIndex(indices.z);
+	}
+	for (auto& i : remap) if (i == UINT32_MAX) i = numRemapped++;
+	for (auto i = 0u; i < numIndices; ++i) pIndices[i] = remap[pIndices[i]];
+
+	const vector<uint8_t> vertices(pVertices, pVertices + static_cast<size_t>(stride) * numVertices);
+	for (auto i = 0u; i < numVertices; ++i)
+		memcpy(&pVertices[static_cast<size_t>(stride) * remap[i]], &vertices[static_cast<size_t>(stride) * i], stride);
+}
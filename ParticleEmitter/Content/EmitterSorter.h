@@ -0,0 +1,30 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include "Distributor.h"
+
+// Post-passes on an emitter array for the locality of the emission fetches. The distribution
+// pass appends the emitters in an arbitrary order, so consecutive emitters read vertices far
+// apart. Sorted by the Morton code of their positions, a run of consecutive emitters covers a
+// compact patch of the surface, and a range of the array is a spatial stratum. The emission picks
+// the emitter of a slot by a hash, so it gains from the order only within the noise on the CPU
+// (SelfTest::TestEmitterOrder); the strata are what the order is for.
+class EmitterSorter
+{
+public:
+	// Sorts the emitters by the 63-bit Morton code of their positions in a cube around them, with
+	// 21 bits per axis; ties keep their order. The vertices read their positions from the first
+	// 12 bytes.
+	static void SortByMorton(EmitterInfo* pEmitters, uint32_t numEmitters, const uint8_t* pVertices,
+		uint32_t stride, uint32_t numThreads = 0);
+
+	// Renumbers the vertices in the order of their first use by the emitters, and the unused ones
+	// after them in their order; rewrites the emitter and the triangle indices, and permutes the
+	// vertices in place. The renderer keeps the vertex order of ObjLoader, which is tuned for the
+	// post-transform cache, so this is meant for the vertex copies of the CPU emission.
+	static void ReorderVertices(EmitterInfo* pEmitters, uint32_t numEmitters, uint8_t* pVertices,
+		uint32_t stride, uint32_t numVertices, uint32_t* pIndices, uint32_t numIndices);
+};
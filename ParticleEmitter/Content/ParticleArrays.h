@@ -0,0 +1,13 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+// Particles of the CPU simulation in SoA form, in the simulation space like the shaders
+struct ParticleArrays
+{
+	float* pPos[3];
+	float* pVelocity[3];
+	float* pLifeTime;
+};
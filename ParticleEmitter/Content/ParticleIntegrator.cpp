@@ -0,0 +1,276 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include "ParticleIntegrator.h"
+#include "SharedConst.h"
+#include "Optional/XUSGSIMD.h"
+#if XUSG_SIMD_X86
+#include <immintrin.h>
+#elif XUSG_SIMD_ARM
+#include <arm_neon.h>
+#endif
+
+#define GROUND_STIFFNESS	0.7f	// groundStiffness of VSParticle.hlsl
+#define BLOCK_SIZE			16		// Particles per block of a range, one line of each array
+
+using namespace std;
+using namespace DirectX;
+using namespace XUSG;
+
+namespace
+{
+	struct IntegrateArgs
+	{
+		ParticleArrays Particles;
+		float Acceleration[3];
+		float TimeStep;
+	};
+
+	// Particle kernels. Each tier integrates the blocks of its width and leaves the rest to the tier
+	// below. The SIMD kernels compute every lane and keep the results of the live ones only; the
+	// operations must not be contracted into FMAs, or the tiers would round differently.
+	using IntegrateFunc = void (*)(const IntegrateArgs& args, uint32_t begin, uint32_t end);
+
+	void integrateScalar(const IntegrateArgs& args, uint32_t begin, uint32_t end)
+	{
+		const auto& p = args.Particles;
+		const auto dt = args.TimeStep;
+		for (auto i = begin; i < end; ++i)
+		{
+			if (!(p.pLifeTime[i] > 0.0f)) continue;
+			float vel[] = { p.pVelocity[0][i], p.pVelocity[1][i], p.pVelocity[2][i] };
+
+			// Compute acceleration
+			float acc[] = { args.Acceleration[0], args.Acceleration[1], args.Acceleration[2] };
+			acc[1] -= p.pPos[1][i] <= 0.0f ? vel[1] / dt * (GROUND_STIFFNESS + 1.0f) : 0.0f;
+#ifdef GRAVITY
+			acc[1] -= GRAVITY;
+#endif
+#ifdef VELOCITY_LOSS
+			for (uint8_t j = 0; j < 3; ++j) acc[j] -= vel[j] * VELOCITY_LOSS;
+#endif
+
+			// Integrate and update particle
+			for (uint8_t j = 0; j < 3; ++j)
+			{
+				vel[j] += acc[j] * dt;
+				p.pVelocity[j][i] = vel[j];
+				p.pPos[j][i] += vel[j] * dt;
+			}
+			p.pLifeTime[i] -= dt;
+		}
+	}
+
+#if XUSG_SIMD_X86
+	void integrateSSE42(const IntegrateArgs& args, uint32_t begin, uint32_t end)
+	{
+		const auto& p = args.Particles;
+		const auto zero = _mm_setzero_ps();
+		const auto dt = _mm_set1_ps(args.TimeStep);
+		const auto response = _mm_set1_ps(GROUND_STIFFNESS + 1.0f);
+
+		auto i = begin;
+		for (; i + 4 <= end; i += 4)
+		{
+			const auto life = _mm_loadu_ps(&p.pLifeTime[i]);
+			const auto alive = _mm_cmpgt_ps(life, zero);
+			__m128 vel[3], acc[3];
+			for (uint8_t j = 0; j < 3; ++j)
+			{
+				vel[j] = _mm_loadu_ps(&p.pVelocity[j][i]);
+				acc[j] = _mm_set1_ps(args.Acceleration[j]);
+			}
+
+			// Compute acceleration
+			const auto grounded = _mm_cmple_ps(_mm_loadu_ps(&p.pPos[1][i]), zero);
+			acc[1] = _mm_sub_ps(acc[1], _mm_and_ps(grounded, _mm_mul_ps(_mm_div_ps(vel[1], dt), response)));
+#ifdef GRAVITY
+			acc[1] = _mm_sub_ps(acc[1], _mm_set1_ps(GRAVITY));
+#endif
+#ifdef VELOCITY_LOSS
+			for (uint8_t j = 0; j < 3; ++j) acc[j] = _mm_sub_ps(acc[j], _mm_mul_ps(vel[j], _mm_set1_ps(VELOCITY_LOSS)));
+#endif
+
+			// Integrate and update particle
+			for (uint8_t j = 0; j < 3; ++j)
+			{
+				const auto v = _mm_add_ps(vel[j], _mm_mul_ps(acc[j], dt));
+				const auto pos = _mm_loadu_ps(&p.pPos[j][i]);
+				_mm_storeu_ps(&p.pVelocity[j][i], _mm_blendv_ps(vel[j], v, alive));
+				_mm_storeu_ps(&p.pPos[j][i], _mm_blendv_ps(pos, _mm_add_ps(pos, _mm_mul_ps(v, dt)), alive));
+			}
+			_mm_storeu_ps(&p.pLifeTime[i], _mm_blendv_ps(life, _mm_sub_ps(life, dt), alive));
+		}
+
+		integrateScalar(args, i, end);
+	}
+
+	void integrateAVX2(const IntegrateArgs& args, uint32_t begin, uint32_t end)
+	{
+		const auto& p = args.Particles;
+		const auto zero = _mm256_setzero_ps();
+		const auto dt = _mm256_set1_ps(args.TimeStep);
+		const auto response = _mm256_set1_ps(GROUND_STIFFNESS + 1.0f);
+
+		auto i = begin;
+		for (; i + 8 <= end; i += 8)
+		{
+			const auto life = _mm256_loadu_ps(&p.pLifeTime[i]);
+			const auto alive = _mm256_cmp_ps(life, zero, _CMP_GT_OQ);
+			__m256 vel[3], acc[3];
+			for (uint8_t j = 0; j < 3; ++j)
+			{
+				vel[j] = _mm256_loadu_ps(&p.pVelocity[j][i]);
+				acc[j] = _mm256_set1_ps(args.Acceleration[j]);
+			}
+
+			// Compute acceleration
+			const auto grounded = _mm256_cmp_ps(_mm256_loadu_ps(&p.pPos[1][i]), zero, _CMP_LE_OQ);
+			acc[1] = _mm256_sub_ps(acc[1], _mm256_and_ps(grounded, _mm256_mul_ps(_mm256_div_ps(vel[1], dt), response)));
+#ifdef GRAVITY
+			acc[1] = _mm256_sub_ps(acc[1], _mm256_set1_ps(GRAVITY));
+#endif
+#ifdef VELOCITY_LOSS
+			for (uint8_t j = 0; j < 3; ++j) acc[j] = _mm256_sub_ps(acc[j], _mm256_mul_ps(vel[j], _mm256_set1_ps(VELOCITY_LOSS)));
+#endif
+
+			// Integrate and update particle
+			for (uint8_t j = 0; j < 3; ++j)
+			{
+				const auto v = _mm256_add_ps(vel[j], _mm256_mul_ps(acc[j], dt));
+				const auto pos = _mm256_loadu_ps(&p.pPos[j][i]);
+				_mm256_storeu_ps(&p.pVelocity[j][i], _mm256_blendv_ps(vel[j], v, alive));
+				_mm256_storeu_ps(&p.pPos[j][i], _mm256_blendv_ps(pos, _mm256_add_ps(pos, _mm256_mul_ps(v, dt)), alive));
+			}
+			_mm256_storeu_ps(&p.pLifeTime[i], _mm256_blendv_ps(life, _mm256_sub_ps(life, dt), alive));
+		}
+
+		integrateSSE42(args, i, end);
+	}
+
+	void integrateAVX512(const IntegrateArgs& args, uint32_t begin, uint32_t end)
+	{
+		const auto& p = args.Particles;
+		const auto zero = _mm512_setzero_ps();
+		const auto dt = _mm512_set1_ps(args.TimeStep);
+		const auto response = _mm512_set1_ps(GROUND_STIFFNESS + 1.0f);
+
+		auto i = begin;
+		for (; i + 16 <= end; i += 16)
+		{
+			const auto life = _mm512_loadu_ps(&p.pLifeTime[i]);
+			const auto alive = _mm512_cmp_ps_mask(life, zero, _CMP_GT_OQ);
+			__m512 vel[3], acc[3];
+			for (uint8_t j = 0; j < 3; ++j)
+			{
+				vel[j] = _mm512_loadu_ps(&p.pVelocity[j][i]);
+				acc[j] = _mm512_set1_ps(args.Acceleration[j]);
+			}
+
+			// Compute acceleration
+			const auto grounded = _mm512_cmp_ps_mask(_mm512_loadu_ps(&p.pPos[1][i]), zero, _CMP_LE_OQ);
+			acc[1] = _mm512_mask_sub_ps(acc[1], grounded, acc[1], _mm512_mul_ps(_mm512_div_ps(vel[1], dt), response));
+#ifdef GRAVITY
+			acc[1] = _mm512_sub_ps(acc[1], _mm512_set1_ps(GRAVITY));
+#endif
+#ifdef VELOCITY_LOSS
+			for (uint8_t j = 0; j < 3; ++j) acc[j] = _mm512_sub_ps(acc[j], _mm512_mul_ps(vel[j], _mm512_set1_ps(VELOCITY_LOSS)));
+#endif
+
+			// Integrate and update particle; the dead lanes are not written.
+			for (uint8_t j = 0; j < 3; ++j)
+			{
+				const auto v = _mm512_add_ps(vel[j], _mm512_mul_ps(acc[j], dt));
+				const auto pos = _mm512_loadu_ps(&p.pPos[j][i]);
+				_mm512_mask_storeu_ps(&p.pVelocity[j][i], alive, v);
+				_mm512_mask_storeu_ps(&p.pPos[j][i], alive, _mm512_add_ps(pos, _mm512_mul_ps(v, dt)));
+			}
+			_mm512_mask_storeu_ps(&p.pLifeTime[i], alive, _mm512_sub_ps(life, dt));
+		}
+
+		integrateAVX2(args, i, end);
+	}
+#elif XUSG_SIMD_ARM
+	void integrateNEON(const IntegrateArgs& args, uint32_t begin, uint32_t end)
+	{
+		const auto& p = args.Particles;
+		const auto zero = vdupq_n_f32(0.0f);
+		const auto dt = vdupq_n_f32(args.TimeStep);
+		const auto response = vdupq_n_f32(GROUND_STIFFNESS + 1.0f);
+
+		auto i = begin;
+		for (; i + 4 <= end; i += 4)
+		{
+			const auto life = vld1q_f32(&p.pLifeTime[i]);
+			const auto alive = vcgtq_f32(life, zero);
+			float32x4_t vel[3], acc[3];
+			for (uint8_t j = 0; j < 3; ++j)
+			{
+				vel[j] = vld1q_f32(&p.pVelocity[j][i]);
+				acc[j] = vdupq_n_f32(args.Acceleration[j]);
+			}
+
+			// Compute acceleration
+			const auto grounded = vcleq_f32(vld1q_f32(&p.pPos[1][i]), zero);
+			const auto groundAcc = vmulq_f32(vdivq_f32(vel[1], dt), response);
+			acc[1] = vsubq_f32(acc[1], vreinterpretq_f32_u32(vandq_u32(grounded, vreinterpretq_u32_f32(groundAcc))));
+#ifdef GRAVITY
+			acc[1] = vsubq_f32(acc[1], vdupq_n_f32(GRAVITY));
+#endif
+#ifdef VELOCITY_LOSS
+			for (uint8_t j = 0; j < 3; ++j) acc[j] = vsubq_f32(acc[j], vmulq_f32(vel[j], vdupq_n_f32(VELOCITY_LOSS)));
+#endif
+
+			// Integrate and update particle
+			for (uint8_t j = 0; j < 3; ++j)
+			{
+				const auto v = vaddq_f32(vel[j], vmulq_f32(acc[j], dt));
+				const auto pos = vld1q_f32(&p.pPos[j][i]);
+				vst1q_f32(&p.pVelocity[j][i], vbslq_f32(alive, v, vel[j]));
+				vst1q_f32(&p.pPos[j][i], vbslq_f32(alive, vaddq_f32(pos, vmulq_f32(v, dt)), pos));
+			}
+			vst1q_f32(&p.pLifeTime[i], vbslq_f32(alive, vsubq_f32(life, dt), life));
+		}
+
+		integrateScalar(args, i, end);
+	}
+#endif
+
+	IntegrateFunc getIntegrateFunc()
+	{
+#if XUSG_SIMD_X86
+		switch (GetSIMDLevel())
+		{
+		case SIMDLevel::AVX512:
+			return integrateAVX512;
+		case SIMDLevel::AVX2:
+			return integrateAVX2;
+		case SIMDLevel::SSE4_2:
+			return integrateSSE42;
+		}
+#elif XUSG_SIMD_ARM
+		if (GetSIMDLevel() >= SIMDLevel::NEON) return integrateNEON;
+#endif
+		return integrateScalar;
+	}
+}
+
+void ParticleIntegrator::Integrate(ThreadPool& threadPool, const ParticleArrays& particles, uint32_t numParticles,
+	float timeStep, const XMFLOAT3& acceleration)
+{
+	IntegrateArgs args;
+	args.Particles = particles;
+	args.Acceleration[0] = acceleration.x;
+	args.Acceleration[1] = acceleration.y;
+	args.Acceleration[2] = acceleration.z;
+	args.TimeStep = timeStep;
+
+	// The ranges are made of whole blocks, so no 2 threads write the same line of an array that
+	// starts on a line.
+	const auto integrate = getIntegrateFunc();
+	threadPool.ParallelFor((numParticles + BLOCK_SIZE - 1) / BLOCK_SIZE, [&](uint32_t begin, uint32_t end)
+	{
+		integrate(args, begin * BLOCK_SIZE, (min)(end * BLOCK_SIZE, numParticles));
+	}, 1024);
+}
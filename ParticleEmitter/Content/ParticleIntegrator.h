@@ -0,0 +1,23 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include "Optional/XUSGThreadPool.h"
+#include "ParticleArrays.h"
+
+// CPU counterpart of the integration of UpdateParticle in VSParticle.hlsl, over the SoA particles
+// of ParticleArrays. The particles are integrated 4, 8 or 16 at a time by the SIMD kernels of the
+// highest supported tier, with the same ground response, the optional GRAVITY and VELOCITY_LOSS,
+// and the same operations in the same order as the scalar reference, so every tier gives the same
+// bits.
+class ParticleIntegrator
+{
+public:
+	// Integrates the live particles in [0, numParticles), i.e. the ones with positive lifetimes, by
+	// one time step, and leaves the dead ones untouched. The acceleration is the external one, like
+	// the one of UpdateParticle.
+	static void Integrate(XUSG::ThreadPool& threadPool, const ParticleArrays& particles, uint32_t numParticles,
+		float timeStep, const DirectX::XMFLOAT3& acceleration = DirectX::XMFLOAT3(0.0f, 0.0f, 0.0f));
+};
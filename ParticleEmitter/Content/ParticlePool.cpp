@@ -0,0 +1,129 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include "ParticlePool.h"
+
+#define CHUNK_SIZE	4096u
+
+using namespace std;
+using namespace XUSG;
+
+ParticlePool::ParticlePool() :
+	m_numSorted(0),
+	m_numFree(0),
+	m_numAlive(0)
+{
+}
+
+ParticlePool::~ParticlePool()
+{
+}
+
+void ParticlePool::Init(uint32_t capacity)
+{
+	// The top of the stack is at the back, so slot 0 pops first.
+	m_freeIndices.resize(capacity);
+	for (auto i = 0u; i < capacity; ++i) m_freeIndices[i] = capacity - 1 - i;
+	m_aliveIndices.resize(capacity);
+	m_survivorIndices.resize(capacity);
+	m_aliveFlags.resize(capacity);
+	m_chunkOffsets.resize((capacity + CHUNK_SIZE - 1) / CHUNK_SIZE + 1);
+
+	m_numSorted = 0;
+	m_numFree = capacity;
+	m_numAlive = 0;
+}
+
+uint32_t ParticlePool::Emit(uint32_t numParticles, uint32_t* pIndices)
+{
+	// Pop a block of the free list
+	auto top = m_numFree.load();
+	uint32_t numTaken;
+	do numTaken = (min)(numParticles, top);
+	while (!m_numFree.compare_exchange_weak(top, top - numTaken));
+	if (numTaken == 0) return 0;
+
+	// Append it to the alive list from the top down
+	const auto pFree = &m_freeIndices[top - numTaken];
+	const auto pAlive = &m_aliveIndices[m_numAlive.fetch_add(numTaken)];
+	for (auto i = 0u; i < numTaken; ++i) pAlive[i] = pFree[numTaken - 1 - i];
+	if (pIndices) memcpy(pIndices, pAlive, sizeof(uint32_t) * numTaken);
+
+	return numTaken;
+}
+
+void ParticlePool::Update(ThreadPool& threadPool, const UpdateFunc& update)
+{
+	// Merge the emitted slots into the sorted survivors of the last update, so the particles are
+	// visited in the order of their slots, rather than gathered at random as the list ages.
+	const uint32_t numAlive = m_numAlive;
+	if (m_numSorted < numAlive)
+	{
+		const auto pSorted = m_aliveIndices.data();
+		sort(pSorted + m_numSorted, pSorted + numAlive);
+		merge(pSorted, pSorted + m_numSorted, pSorted + m_numSorted, pSorted + numAlive, m_survivorIndices.begin());
+		m_aliveIndices.swap(m_survivorIndices);
+	}
+
+	const auto numChunks = (numAlive + CHUNK_SIZE - 1) / CHUNK_SIZE;
+
+	// Update the chunks, and count their survivors
+	threadPool.Execute(numChunks, [&](uint32_t i)
+	{
+		const auto begin = CHUNK_SIZE * i;
+		const auto numIndices = (min)(CHUNK_SIZE, numAlive - begin);
+		const auto pAlive = &m_aliveFlags[begin];
+		memset(pAlive, 1, numIndices);
+		update(&m_aliveIndices[begin], numIndices, pAlive);
+
+		auto numSurvivors = 0u;
+		for (auto j = 0u; j < numIndices; ++j) numSurvivors += pAlive[j] ? 1 : 0;
+		m_chunkOffsets[i + 1] = numSurvivors;
+	});
+
+	// Prefix sum of the survivor counts
+	m_chunkOffsets[0] = 0;
+	for (auto i = 0u; i < numChunks; ++i) m_chunkOffsets[i + 1] += m_chunkOffsets[i];
+	const auto numSurvivors = m_chunkOffsets[numChunks];
+
+	// Compact the survivors, and push the dead slots
+	const uint32_t numFree = m_numFree;
+	threadPool.Execute(numChunks, [&](uint32_t i)
+	{
+		const auto begin = CHUNK_SIZE * i;
+		const auto end = (min)(begin + CHUNK_SIZE, numAlive);
+		auto survivorIdx = m_chunkOffsets[i];
+		auto deadIdx = numFree + begin - survivorIdx;
+		for (auto j = begin; j < end; ++j)
+		{
+			if (m_aliveFlags[j]) m_survivorIndices[survivorIdx++] = m_aliveIndices[j];
+			else m_freeIndices[deadIdx++] = m_aliveIndices[j];
+		}
+	});
+
+	m_aliveIndices.swap(m_survivorIndices);
+	m_numAlive = numSurvivors;
+	m_numSorted = numSurvivors;
+	m_numFree = numFree + numAlive - numSurvivors;
+}
+
+const uint32_t* ParticlePool::GetAliveIndices() const
+{
+	return m_aliveIndices.data();
+}
+
+uint32_t ParticlePool::GetNumAlive() const
+{
+	return m_numAlive;
+}
+
+uint32_t ParticlePool::GetNumDead() const
+{
+	return m_numFree;
+}
+
+uint32_t ParticlePool::GetCapacity() const
+{
+	return static_cast<uint32_t>(m_freeIndices.size());
+}
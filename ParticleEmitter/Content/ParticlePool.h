@@ -0,0 +1,53 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include "Core/XUSG.h"
+#include "Optional/XUSGThreadPool.h"
+
+// Particle slots of the CPU simulation, tracked by a free list of the dead slots and a compacted
+// list of the alive ones, so the emission takes only dead slots and the update visits only alive
+// ones; the alive count sizes the work, like an indirect argument on the GPU. The free list is a
+// lock-free stack of slot indices with an atomic top, used like an append/consume buffer: the
+// emission pops from it, and the update pushes the slots that die, but never in the same phase.
+// The pool pays off at low alive ratios only; CPUSimulation, at about two thirds alive, keeps the
+// dense scan of ParticleIntegrator, which SelfTest::TestParticlePool measures against it.
+class ParticlePool
+{
+public:
+	// Updates the particles of pIndices[0, numIndices), and sets pAlive[i] to 0 for the ones that die.
+	using UpdateFunc = std::function<void(const uint32_t* pIndices, uint32_t numIndices, uint8_t* pAlive)>;
+
+	ParticlePool();
+	virtual ~ParticlePool();
+
+	// All the slots start dead, and are taken in ascending order by the first emission.
+	void Init(uint32_t capacity);
+
+	// Takes up to numParticles dead slots, appends them to the alive list, and writes them to
+	// pIndices if not null; returns the number taken. Calls may run concurrently with each other.
+	uint32_t Emit(uint32_t numParticles, uint32_t* pIndices = nullptr);
+
+	// Runs the update on chunks of the alive list in parallel, then keeps the survivors and pushes
+	// the dead slots in the order of the list, so the result does not depend on the threads. The
+	// list is in ascending slot order during the update.
+	void Update(XUSG::ThreadPool& threadPool, const UpdateFunc& update);
+
+	const uint32_t* GetAliveIndices() const;
+	uint32_t GetNumAlive() const;
+	uint32_t GetNumDead() const;
+	uint32_t GetCapacity() const;
+
+protected:
+	std::vector<uint32_t>	m_freeIndices;
+	std::vector<uint32_t>	m_aliveIndices;
+	std::vector<uint32_t>	m_survivorIndices;
+	std::vector<uint8_t>	m_aliveFlags;
+	std::vector<uint32_t>	m_chunkOffsets;
+
+	uint32_t				m_numSorted;
+	std::atomic_uint32_t	m_numFree;
+	std::atomic_uint32_t	m_numAlive;
+};
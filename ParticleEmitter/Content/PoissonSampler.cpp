@@ -0,0 +1,198 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include "PoissonSampler.h"
+
+#define CHUNK_SIZE		65536u
+#define CELL_BITS		21
+#define CELL_MASK		((1u << CELL_BITS) - 1)
+#define MAX_CELL_SAMPLES	8	// Corners of the cube
+
+using namespace std;
+using namespace DirectX;
+using namespace XUSG;
+
+namespace
+{
+	inline uint64_t getCellKey(uint32_t x, uint32_t y, uint32_t z)
+	{
+		return (static_cast<uint64_t>(z) << (CELL_BITS * 2)) | (static_cast<uint64_t>(y) << CELL_BITS) | x;
+	}
+
+	inline float distanceSq(const XMFLOAT3& a, const XMFLOAT3& b)
+	{
+		const XMFLOAT3 d(a.x - b.x, a.y - b.y, a.z - b.z);
+
+		return d.x * d.x + d.y * d.y + d.z * d.z;
+	}
+}
+
+PoissonSampler::PoissonSampler()
+{
+}
+
+PoissonSampler::~PoissonSampler()
+{
+}
+
+bool PoissonSampler::Sample(const uint8_t* pVertices, uint32_t stride, const uint32_t* pIndices,
+	uint32_t numIndices, float spacing, float groundY, float oversampling, uint32_t seed,
+	uint32_t numThreads)
+{
+	m_emitters.clear();
+	if (!(spacing > 0.0f)) return false;
+
+	// Area-weighted candidates
+	AliasSampler aliasSampler;
+	if (!aliasSampler.Build(pVertices, stride, pIndices, numIndices, groundY, numThreads)) return false;
+
+	const auto numCandidatesF = oversampling * aliasSampler.GetArea() / (static_cast<double>(spacing) * spacing);
+	if (!(numCandidatesF < static_cast<double>(1u << 31))) return false;
+	const auto numCandidates = (max)(static_cast<uint32_t>(numCandidatesF), 1u);
+
+	// Each chunk has its own seed, so the candidates do not depend on the thread count.
+	ThreadPool threadPool(numThreads);
+	vector<EmitterInfo> candidates(numCandidates);
+	vector<XMFLOAT3> positions(numCandidates);
+	threadPool.Execute(XUSG_DIV_UP(numCandidates, CHUNK_SIZE), [&](uint32_t i)
+	{
+		const auto begin = CHUNK_SIZE * i;
+		const auto end = (min)(begin + CHUNK_SIZE, numCandidates);
+		aliasSampler.Sample(&candidates[begin], end - begin, pIndices, seed + i * 0x9e3779b9);
+
+		for (auto j = begin; j < end; ++j)
+		{
+			const auto& candidate = candidates[j];
+			const float w[] = { candidate.Barycoord.x, candidate.Barycoord.y, 1.0f - (candidate.Barycoord.x + candidate.Barycoord.y) };
+			const uint32_t vIds[] = { candidate.Indices.x, candidate.Indices.y, candidate.Indices.z };
+			auto& p = positions[j];
+			p = XMFLOAT3(0.0f, 0.0f, 0.0f);
+			for (uint8_t k = 0; k < 3; ++k)
+			{
+				const auto pPos = reinterpret_cast<const float*>(&pVertices[stride * vIds[k]]);
+				p = XMFLOAT3(p.x + pPos[0] * w[k], p.y + pPos[1] * w[k], p.z + pPos[2] * w[k]);
+			}
+		}
+	});
+
+	// Cells of the spacing
+	XMFLOAT3 minPt(FLT_MAX, FLT_MAX, FLT_MAX), maxPt(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+	for (const auto& p : positions)
+	{
+		minPt = XMFLOAT3((min)(minPt.x, p.x), (min)(minPt.y, p.y), (min)(minPt.z, p.z));
+		maxPt = XMFLOAT3((max)(maxPt.x, p.x), (max)(maxPt.y, p.y), (max)(maxPt.z, p.z));
+	}
+
+	const auto cellScale = 1.0f / spacing;
+	const auto extent = (max)(maxPt.x - minPt.x, (max)(maxPt.y - minPt.y, maxPt.z - minPt.z));
+	if (!(extent * cellScale < CELL_MASK)) return false;
+
+	// Sort the candidates by the cells; within a cell, they stay in the random order.
+	vector<pair<uint64_t, uint32_t>> cellCandidates(numCandidates);
+	threadPool.ParallelFor(numCandidates, [&](uint32_t begin, uint32_t end)
+	{
+		for (auto i = begin; i < end; ++i)
+		{
+			const auto& p = positions[i];
+			const auto x = static_cast<uint32_t>((p.x - minPt.x) * cellScale);
+			const auto y = static_cast<uint32_t>((p.y - minPt.y) * cellScale);
+			const auto z = static_cast<uint32_t>((p.z - minPt.z) * cellScale);
+			cellCandidates[i] = make_pair(getCellKey(x, y, z), i);
+		}
+	}, 4096);
+	sort(cellCandidates.begin(), cellCandidates.end());
+
+	// Gather the occupied cells, and group them by the phases. The positions are reordered by the
+	// cells for the locality.
+	vector<uint64_t> cellKeys;
+	vector<uint32_t> cellStarts;
+	vector<uint32_t> phaseCells[27];
+	vector<XMFLOAT3> cellPositions(numCandidates);
+	for (auto i = 0u; i < numCandidates; ++i)
+	{
+		const auto key = cellCandidates[i].first;
+		cellPositions[i] = positions[cellCandidates[i].second];
+		if (i > 0 && key == cellCandidates[i - 1].first) continue;
+
+		const auto x = static_cast<uint32_t>(key) & CELL_MASK;
+		const auto y = static_cast<uint32_t>(key >> CELL_BITS) & CELL_MASK;
+		const auto z = static_cast<uint32_t>(key >> (CELL_BITS * 2));
+		phaseCells[((z % 3) * 3 + y % 3) * 3 + x % 3].push_back(static_cast<uint32_t>(cellKeys.size()));
+		cellKeys.push_back(key);
+		cellStarts.push_back(i);
+	}
+	const auto numCells = static_cast<uint32_t>(cellKeys.size());
+	cellStarts.push_back(numCandidates);
+
+	// Accept the candidates in order if they keep the spacing to the samples so far. The samples
+	// of each cell are stored at the front of its candidate range.
+	const auto spacingSq = spacing * spacing;
+	vector<uint32_t> samples(numCandidates);
+	vector<uint8_t> cellNumSamples(numCells);
+	for (const auto& cells : phaseCells)
+	{
+		threadPool.ParallelFor(static_cast<uint32_t>(cells.size()), [&](uint32_t begin, uint32_t end)
+		{
+			XMFLOAT3 neighbors[27 * MAX_CELL_SAMPLES];
+			for (auto i = begin; i < end; ++i)
+			{
+				const auto cell = cells[i];
+				const auto key = cellKeys[cell];
+				const auto x = static_cast<uint32_t>(key) & CELL_MASK;
+				const auto y = static_cast<uint32_t>(key >> CELL_BITS) & CELL_MASK;
+				const auto z = static_cast<uint32_t>(key >> (CELL_BITS * 2));
+
+				// Samples of the neighbor cells; the cells of each row are contiguous in the key order.
+				auto numNeighbors = 0u;
+				for (auto k = -1; k <= 1; ++k)
+					for (auto j = -1; j <= 1; ++j)
+					{
+						if ((y == 0 && j < 0) || (z == 0 && k < 0)) continue;
+
+						const auto rowKey = getCellKey(0, y + j, z + k);
+						const auto firstKey = rowKey | (x > 0 ? x - 1 : 0);
+						const auto lastKey = rowKey | (x + 1);
+						auto neighbor = (j | k) == 0 ? cell - (cell > 0 && cellKeys[cell - 1] >= firstKey ? 1 : 0) :
+							static_cast<uint32_t>(lower_bound(cellKeys.cbegin(), cellKeys.cend(), firstKey) - cellKeys.cbegin());
+						for (; neighbor < numCells && cellKeys[neighbor] <= lastKey; ++neighbor)
+							for (auto m = 0u; m < cellNumSamples[neighbor]; ++m)
+								neighbors[numNeighbors++] = cellPositions[samples[cellStarts[neighbor] + m]];
+					}
+
+				auto& numSamples = cellNumSamples[cell];
+				for (auto j = cellStarts[cell]; j < cellStarts[cell + 1]; ++j)
+				{
+					const auto& p = cellPositions[j];
+					auto isValid = true;
+					for (auto k = 0u; k < numNeighbors && isValid; ++k)
+						isValid = distanceSq(p, neighbors[k]) >= spacingSq;
+
+					if (isValid)
+					{
+						samples[cellStarts[cell] + numSamples++] = j;
+						neighbors[numNeighbors++] = p;
+						if (numSamples >= MAX_CELL_SAMPLES) break;
+					}
+				}
+			}
+		}, 64);
+	}
+
+	// Output in the cell order
+	for (auto i = 0u; i < numCells; ++i)
+		for (auto j = 0u; j < cellNumSamples[i]; ++j)
+			m_emitters.push_back(candidates[cellCandidates[samples[cellStarts[i] + j]].second]);
+
+	return true;
+}
+
+uint32_t PoissonSampler::GetNumEmitters() const
+{
+	return static_cast<uint32_t>(m_emitters.size());
+}
+
+const EmitterInfo* PoissonSampler::GetEmitters() const
+{
+	return m_emitters.data();
+}
@@ -0,0 +1,34 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include "AliasSampler.h"
+
+// Blue-noise emitters on the mesh surface: Poisson-disk sampling by parallel dart throwing
+// [Bowers et al. 2010]. Area-weighted candidates are binned into the cells of a spatial hash,
+// as large as the spacing, so a candidate only checks the samples of the 27 cells around it. The
+// cells are processed in 27 phases of (x mod 3, y mod 3, z mod 3), so the cells of the same phase
+// never see each other's samples, and the result does not depend on the thread count.
+class PoissonSampler
+{
+public:
+	PoissonSampler();
+	virtual ~PoissonSampler();
+
+	// The emitters are at least spacing apart in the Euclidean distance, so thin features shorter
+	// than the spacing are sampled on one side only. oversampling scales the number of candidates,
+	// area / spacing^2 at 1; 8 keeps about 90% of the samples of a saturated dart throwing, and each
+	// doubling adds about 6% for twice the time. The vertices read their positions from the first
+	// 12 bytes; triangles with a vertex at or below groundY are skipped.
+	bool Sample(const uint8_t* pVertices, uint32_t stride, const uint32_t* pIndices, uint32_t numIndices,
+		float spacing, float groundY = -FLT_MAX, float oversampling = 8.0f, uint32_t seed = 0,
+		uint32_t numThreads = 0);
+
+	uint32_t GetNumEmitters() const;
+	const EmitterInfo* GetEmitters() const;
+
+protected:
+	std::vector<EmitterInfo> m_emitters;
+};
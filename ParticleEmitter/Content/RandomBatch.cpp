@@ -0,0 +1,206 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include "RandomBatch.h"
+#include "Optional/XUSGSIMD.h"
+#if XUSG_SIMD_X86
+#include <immintrin.h>
+#endif
+
+#define PCG_MUL	1664525
+#define PCG_INC	1013904223
+
+using namespace std;
+using namespace DirectX;
+using namespace XUSG;
+
+namespace
+{
+	// Batch kernels. Each tier hashes the blocks of its width in SoA form, transposes them to the
+	// results, and leaves the rest to the tier below. The integer operations wrap the same way in
+	// every lane, so the words match the scalar reference exactly.
+	using GenerateFunc = void (*)(XMUINT4* pResults, const XMUINT4& counter, uint32_t begin, uint32_t end);
+
+	void generateScalar(XMUINT4* pResults, const XMUINT4& counter, uint32_t begin, uint32_t end)
+	{
+		for (auto i = begin; i < end; ++i)
+			pResults[i] = SharedRandom::Pcg4d(XMUINT4(counter.x + i, counter.y, counter.z, counter.w));
+	}
+
+#if XUSG_SIMD_X86
+	void generateSSE42(XMUINT4* pResults, const XMUINT4& counter, uint32_t begin, uint32_t end)
+	{
+		const auto mul = _mm_set1_epi32(PCG_MUL);
+		const auto inc = _mm_set1_epi32(PCG_INC);
+		const auto y0 = _mm_add_epi32(_mm_mullo_epi32(_mm_set1_epi32(counter.y), mul), inc);
+		const auto z0 = _mm_add_epi32(_mm_mullo_epi32(_mm_set1_epi32(counter.z), mul), inc);
+		const auto w0 = _mm_add_epi32(_mm_mullo_epi32(_mm_set1_epi32(counter.w), mul), inc);
+		auto x0 = _mm_add_epi32(_mm_set1_epi32(counter.x + begin), _mm_setr_epi32(0, 1, 2, 3));
+
+		auto i = begin;
+		for (; i + 4 <= end; i += 4)
+		{
+			auto x = _mm_add_epi32(_mm_mullo_epi32(x0, mul), inc), y = y0, z = z0, w = w0;
+			x0 = _mm_add_epi32(x0, _mm_set1_epi32(4));
+
+			x = _mm_add_epi32(x, _mm_mullo_epi32(y, w));
+			y = _mm_add_epi32(y, _mm_mullo_epi32(z, x));
+			z = _mm_add_epi32(z, _mm_mullo_epi32(x, y));
+			w = _mm_add_epi32(w, _mm_mullo_epi32(y, z));
+
+			x = _mm_xor_si128(x, _mm_srli_epi32(x, 16));
+			y = _mm_xor_si128(y, _mm_srli_epi32(y, 16));
+			z = _mm_xor_si128(z, _mm_srli_epi32(z, 16));
+			w = _mm_xor_si128(w, _mm_srli_epi32(w, 16));
+
+			x = _mm_add_epi32(x, _mm_mullo_epi32(y, w));
+			y = _mm_add_epi32(y, _mm_mullo_epi32(z, x));
+			z = _mm_add_epi32(z, _mm_mullo_epi32(x, y));
+			w = _mm_add_epi32(w, _mm_mullo_epi32(y, z));
+
+			x = _mm_xor_si128(x, _mm_srli_epi32(x, 16));
+			y = _mm_xor_si128(y, _mm_srli_epi32(y, 16));
+			z = _mm_xor_si128(z, _mm_srli_epi32(z, 16));
+			w = _mm_xor_si128(w, _mm_srli_epi32(w, 16));
+
+			// Transpose to (x, y, z, w) per counter
+			const auto xy0 = _mm_unpacklo_epi32(x, y), xy1 = _mm_unpackhi_epi32(x, y);
+			const auto zw0 = _mm_unpacklo_epi32(z, w), zw1 = _mm_unpackhi_epi32(z, w);
+			const auto pDst = reinterpret_cast<__m128i*>(&pResults[i]);
+			_mm_storeu_si128(&pDst[0], _mm_unpacklo_epi64(xy0, zw0));
+			_mm_storeu_si128(&pDst[1], _mm_unpackhi_epi64(xy0, zw0));
+			_mm_storeu_si128(&pDst[2], _mm_unpacklo_epi64(xy1, zw1));
+			_mm_storeu_si128(&pDst[3], _mm_unpackhi_epi64(xy1, zw1));
+		}
+
+		generateScalar(pResults, counter, i, end);
+	}
+
+	void generateAVX2(XMUINT4* pResults, const XMUINT4& counter, uint32_t begin, uint32_t end)
+	{
+		const auto mul = _mm256_set1_epi32(PCG_MUL);
+		const auto inc = _mm256_set1_epi32(PCG_INC);
+		const auto y0 = _mm256_add_epi32(_mm256_mullo_epi32(_mm256_set1_epi32(counter.y), mul), inc);
+		const auto z0 = _mm256_add_epi32(_mm256_mullo_epi32(_mm256_set1_epi32(counter.z), mul), inc);
+		const auto w0 = _mm256_add_epi32(_mm256_mullo_epi32(_mm256_set1_epi32(counter.w), mul), inc);
+		auto x0 = _mm256_add_epi32(_mm256_set1_epi32(counter.x + begin), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+
+		auto i = begin;
+		for (; i + 8 <= end; i += 8)
+		{
+			auto x = _mm256_add_epi32(_mm256_mullo_epi32(x0, mul), inc), y = y0, z = z0, w = w0;
+			x0 = _mm256_add_epi32(x0, _mm256_set1_epi32(8));
+
+			x = _mm256_add_epi32(x, _mm256_mullo_epi32(y, w));
+			y = _mm256_add_epi32(y, _mm256_mullo_epi32(z, x));
+			z = _mm256_add_epi32(z, _mm256_mullo_epi32(x, y));
+			w = _mm256_add_epi32(w, _mm256_mullo_epi32(y, z));
+
+			x = _mm256_xor_si256(x, _mm256_srli_epi32(x, 16));
+			y = _mm256_xor_si256(y, _mm256_srli_epi32(y, 16));
+			z = _mm256_xor_si256(z, _mm256_srli_epi32(z, 16));
+			w = _mm256_xor_si256(w, _mm256_srli_epi32(w, 16));
+
+			x = _mm256_add_epi32(x, _mm256_mullo_epi32(y, w));
+			y = _mm256_add_epi32(y, _mm256_mullo_epi32(z, x));
+			z = _mm256_add_epi32(z, _mm256_mullo_epi32(x, y));
+			w = _mm256_add_epi32(w, _mm256_mullo_epi32(y, z));
+
+			x = _mm256_xor_si256(x, _mm256_srli_epi32(x, 16));
+			y = _mm256_xor_si256(y, _mm256_srli_epi32(y, 16));
+			z = _mm256_xor_si256(z, _mm256_srli_epi32(z, 16));
+			w = _mm256_xor_si256(w, _mm256_srli_epi32(w, 16));
+
+			// Transpose within the 128-bit lanes, which hold the counters 0-3 and 4-7, then regroup them
+			const auto xy0 = _mm256_unpacklo_epi32(x, y), xy1 = _mm256_unpackhi_epi32(x, y);
+			const auto zw0 = _mm256_unpacklo_epi32(z, w), zw1 = _mm256_unpackhi_epi32(z, w);
+			const auto r0 = _mm256_unpacklo_epi64(xy0, zw0), r1 = _mm256_unpackhi_epi64(xy0, zw0);
+			const auto r2 = _mm256_unpacklo_epi64(xy1, zw1), r3 = _mm256_unpackhi_epi64(xy1, zw1);
+			const auto pDst = reinterpret_cast<__m256i*>(&pResults[i]);
+			_mm256_storeu_si256(&pDst[0], _mm256_permute2x128_si256(r0, r1, 0x20));
+			_mm256_storeu_si256(&pDst[1], _mm256_permute2x128_si256(r2, r3, 0x20));
+			_mm256_storeu_si256(&pDst[2], _mm256_permute2x128_si256(r0, r1, 0x31));
+			_mm256_storeu_si256(&pDst[3], _mm256_permute2x128_si256(r2, r3, 0x31));
+		}
+
+		generateSSE42(pResults, counter, i, end);
+	}
+
+	void generateAVX512(XMUINT4* pResults, const XMUINT4& counter, uint32_t begin, uint32_t end)
+	{
+		const auto mul = _mm512_set1_epi32(PCG_MUL);
+		const auto inc = _mm512_set1_epi32(PCG_INC);
+		const auto y0 = _mm512_add_epi32(_mm512_mullo_epi32(_mm512_set1_epi32(counter.y), mul), inc);
+		const auto z0 = _mm512_add_epi32(_mm512_mullo_epi32(_mm512_set1_epi32(counter.z), mul), inc);
+		const auto w0 = _mm512_add_epi32(_mm512_mullo_epi32(_mm512_set1_epi32(counter.w), mul), inc);
+		auto x0 = _mm512_add_epi32(_mm512_set1_epi32(counter.x + begin),
+			_mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15));
+
+		auto i = begin;
+		for (; i + 16 <= end; i += 16)
+		{
+			auto x = _mm512_add_epi32(_mm512_mullo_epi32(x0, mul), inc), y = y0, z = z0, w = w0;
+			x0 = _mm512_add_epi32(x0, _mm512_set1_epi32(16));
+
+			x = _mm512_add_epi32(x, _mm512_mullo_epi32(y, w));
+			y = _mm512_add_epi32(y, _mm512_mullo_epi32(z, x));
+			z = _mm512_add_epi32(z, _mm512_mullo_epi32(x, y));
+			w = _mm512_add_epi32(w, _mm512_mullo_epi32(y, z));
+
+			x = _mm512_xor_si512(x, _mm512_srli_epi32(x, 16));
+			y = _mm512_xor_si512(y, _mm512_srli_epi32(y, 16));
+			z = _mm512_xor_si512(z, _mm512_srli_epi32(z, 16));
+			w = _mm512_xor_si512(w, _mm512_srli_epi32(w, 16));
+
+			x = _mm512_add_epi32(x, _mm512_mullo_epi32(y, w));
+			y = _mm512_add_epi32(y, _mm512_mullo_epi32(z, x));
+			z = _mm512_add_epi32(z, _mm512_mullo_epi32(x, y));
+			w = _mm512_add_epi32(w, _mm512_mullo_epi32(y, z));
+
+			x = _mm512_xor_si512(x, _mm512_srli_epi32(x, 16));
+			y = _mm512_xor_si512(y, _mm512_srli_epi32(y, 16));
+			z = _mm512_xor_si512(z, _mm512_srli_epi32(z, 16));
+			w = _mm512_xor_si512(w, _mm512_srli_epi32(w, 16));
+
+			// Transpose within the 128-bit lanes, which hold the counters 4k to 4k + 3, then regroup them
+			const auto xy0 = _mm512_unpacklo_epi32(x, y), xy1 = _mm512_unpackhi_epi32(x, y);
+			const auto zw0 = _mm512_unpacklo_epi32(z, w), zw1 = _mm512_unpackhi_epi32(z, w);
+			const auto r0 = _mm512_unpacklo_epi64(xy0, zw0), r1 = _mm512_unpackhi_epi64(xy0, zw0);
+			const auto r2 = _mm512_unpacklo_epi64(xy1, zw1), r3 = _mm512_unpackhi_epi64(xy1, zw1);
+			const auto a = _mm512_shuffle_i32x4(r0, r1, _MM_SHUFFLE(2, 0, 2, 0));	// 0, 8, 1, 9
+			const auto b = _mm512_shuffle_i32x4(r2, r3, _MM_SHUFFLE(2, 0, 2, 0));	// 2, 10, 3, 11
+			const auto c = _mm512_shuffle_i32x4(r0, r1, _MM_SHUFFLE(3, 1, 3, 1));	// 4, 12, 5, 13
+			const auto d = _mm512_shuffle_i32x4(r2, r3, _MM_SHUFFLE(3, 1, 3, 1));	// 6, 14, 7, 15
+			const auto pDst = reinterpret_cast<__m512i*>(&pResults[i]);
+			_mm512_storeu_si512(&pDst[0], _mm512_shuffle_i32x4(a, b, _MM_SHUFFLE(2, 0, 2, 0)));
+			_mm512_storeu_si512(&pDst[1], _mm512_shuffle_i32x4(c, d, _MM_SHUFFLE(2, 0, 2, 0)));
+			_mm512_storeu_si512(&pDst[2], _mm512_shuffle_i32x4(a, b, _MM_SHUFFLE(3, 1, 3, 1)));
+			_mm512_storeu_si512(&pDst[3], _mm512_shuffle_i32x4(c, d, _MM_SHUFFLE(3, 1, 3, 1)));
+		}
+
+		generateAVX2(pResults, counter, i, end);
+	}
+#endif
+
+	GenerateFunc getGenerateFunc()
+	{
+#if XUSG_SIMD_X86
+		switch (GetSIMDLevel())
+		{
+		case SIMDLevel::AVX512:
+			return generateAVX512;
+		case SIMDLevel::AVX2:
+			return generateAVX2;
+		case SIMDLevel::SSE4_2:
+			return generateSSE42;
+		}
+#endif
+		return generateScalar;
+	}
+}
+
+void RandomBatch::Generate(XMUINT4* pResults, uint32_t numResults, const XMUINT4& counter)
+{
+	getGenerateFunc()(pResults, counter, 0, numResults);
+}
@@ -0,0 +1,17 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include "SharedRandom.h"
+
+// Batches of the counter-based random numbers of SharedRandom.h on the CPU. The counters of a
+// batch are consecutive in x, e.g. the particle IDs, and hashed by the SIMD kernels of the highest
+// supported tier, 4, 8 or 16 lanes at a time; the words are the same as Pcg4d gives in the shaders.
+class RandomBatch
+{
+public:
+	// Writes Pcg4d(counter + (i, 0, 0, 0)) to pResults[i] for i in [0, numResults).
+	static void Generate(DirectX::XMUINT4* pResults, uint32_t numResults, const DirectX::XMUINT4& counter);
+};
@@ -2,7 +2,6 @@
 // Copyright (c) XU, Tianchen. All rights reserved.
 //--------------------------------------------------------------------------------------
 
-#include "Optional/XUSGObjLoader.h"
 #include "Renderer.h"
 
 using namespace std;
@@ -28,7 +27,7 @@ Renderer::~Renderer()
 }
 
 bool Renderer::Init(CommandList* pCommandList, uint32_t width, uint32_t height,
-	vector<Resource::uptr>& uploaders, const char* fileName,
+	vector<Resource::uptr>& uploaders, const ObjLoader& objLoader,
 	Format rtFormat, Format dsFormat)
 {
 	const auto pDevice = pCommandList->GetDevice();
@@ -38,8 +37,6 @@ bool Renderer::Init(CommandList* pCommandList, uint32_t width, uint32_t height,
 	m_viewport = XMUINT2(width, height);
 
 	// Load inputs
-	ObjLoader objLoader;
-	if (!objLoader.Import(fileName, true, true)) return false;
 	XUSG_N_RETURN(createVB(pCommandList, objLoader.GetNumVertices(), objLoader.GetVertexStride(), objLoader.GetVertices(), uploaders), false);
 	XUSG_N_RETURN(createIB(pCommandList, objLoader.GetNumIndices(), objLoader.GetIndices(), uploaders), false);
 
@@ -5,6 +5,7 @@
 #pragma once
 
 #include "Core/XUSG.h"
+#include "Optional/XUSGObjLoader.h"
 
 class Renderer
 {
@@ -13,7 +14,7 @@ public:
 	virtual ~Renderer();
 
 	bool Init(XUSG::CommandList* pCommandList, uint32_t width, uint32_t height,
-		std::vector<XUSG::Resource::uptr>& uploaders, const char* fileName,
+		std::vector<XUSG::Resource::uptr>& uploaders, const XUSG::ObjLoader& objLoader,
 		XUSG::Format rtFormat, XUSG::Format dsFormat);
 
 	void UpdateFrame(uint8_t frameIndex, double time, float timeStep,
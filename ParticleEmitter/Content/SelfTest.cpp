@@ -0,0 +1,2787 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include "Optional/XUSGObjLoader.h"
+#include "Optional/XUSGMeshletBuilder.h"
+#include "Optional/XUSGMeshSimplifier.h"
+#include "SelfTest.h"
+#include "Distributor.h"
+#include "EmitterCache.h"
+#include "EmitterSorter.h"
+#include "CPUSimulation.h"
+#include "ParticleIntegrator.h"
+#include "ParticlePool.h"
+#include "PoissonSampler.h"
+#include "RandomBatch.h"
+#include "Optional/XUSGSIMD.h"
+#include <chrono>
+#include <array>
+
+#define NUM_RUNS	3	// Runs of a benchmark, of which the fastest counts
+#define DENSITY		32.0f	// The distribution density of the app
+#define NUM_WORDS	(1 << 22)	// Words of a random stream under test
+#define P_MIN		0.001	// The p-values outside [P_MIN, 1 - P_MIN] fail, as TestU01 flags them
+#define TIME_STEP	(1.0f / 60.0f)
+#define NUM_FRAMES	240	// Frames of a CPU simulation run
+#define LIFE_FRAMES	16	// Mean frames of the life of a particle of the pool benchmark
+#define NUM_CELLS	16	// Cells along each axis of the mesh AABB for the sampling tests
+
+using namespace std;
+using namespace DirectX;
+using namespace XUSG;
+
+namespace
+{
+	// The meshes with the scales of the launch scripts; TuringBowl has none, and its scale keeps
+	// the emitters at about the million of the others, against the 156M ones of the scale 1.
+	const struct
+	{
+		const char* FileName;
+		float Scale;
+	} meshes[] =
+	{
+		{ "Assets/bunny.obj", 1.0f },
+		{ "Assets/dragon.obj", 1.0f },
+		{ "Assets/venusm.obj", 0.003f },
+		{ "Assets/TuringBowl.obj", 0.1f }
+	};
+
+	// Returns the seconds of the fastest of the runs.
+	template<typename Func>
+	double getBestTime(const Func& func, uint32_t numRuns = NUM_RUNS)
+	{
+		auto bestTime = DBL_MAX;
+		for (auto i = 0u; i < numRuns; ++i)
+		{
+			const auto start = chrono::steady_clock::now();
+			func();
+			const chrono::duration<double> time = chrono::steady_clock::now() - start;
+			bestTime = (min)(bestTime, time.count());
+		}
+
+		return bestTime;
+	}
+
+	// Parses the positions and the position indices of an OBJ file line by line by the CRT; the
+	// polygons are triangulated as fans, and the texcoords and the normals are skipped.
+	void parseObjByCRT(const char* pszFilename, vector<ObjLoader::float3>& positions, vector<uint32_t>& indices)
+	{
+		positions.clear();
+		indices.clear();
+
+		ifstream fileStream(pszFilename);
+		string line;
+		while (getline(fileStream, line))
+		{
+			if (line.size() < 2 || !isspace(static_cast<uint8_t>(line[1]))) continue;
+
+			const auto pLine = line.c_str();
+			if (line[0] == 'v')
+			{
+				char* p;
+				ObjLoader::float3 v;
+				v.x = strtof(pLine + 1, &p);
+				v.y = strtof(p, &p);
+				v.z = strtof(p, &p);
+				positions.emplace_back(v);
+			}
+			else if (line[0] == 'f')
+			{
+				uint32_t v[3];
+				auto numCorners = 0u;
+				for (auto p = pLine + 1; ;)
+				{
+					char* pNext;
+					const auto vi = strtol(p, &pNext, 10);
+					if (pNext == p) break;
+
+					v[numCorners < 3 ? numCorners : 2] = static_cast<uint32_t>(vi < 0 ?
+						vi + static_cast<long>(positions.size()) : vi - 1);
+					if (++numCorners >= 3)
+					{
+						indices.insert(indices.end(), v, v + 3);
+						v[1] = v[2];
+					}
+
+					// Skip the texcoord and normal indices of the corner.
+					for (p = pNext; *p && !isspace(static_cast<uint8_t>(*p)); ++p);
+				}
+			}
+		}
+	}
+
+	const char* getSIMDLevelName(SIMDLevel level)
+	{
+		switch (level)
+		{
+		case SIMDLevel::AVX512:
+			return "AVX-512";
+		case SIMDLevel::AVX2:
+			return "AVX2";
+		case SIMDLevel::SSE4_2:
+#if XUSG_SIMD_ARM
+			return "NEON";
+#else
+			return "SSE4.2";
+#endif
+		default:
+			return "scalar";
+		}
+	}
+
+	// Runs the function with the dispatch capped at each tier up to the supported one, from the
+	// scalar reference up, and lifts the cap again.
+	template<typename Func>
+	void forEachSIMDLevel(const Func& func)
+	{
+		const auto maxLevel = GetSIMDLevel();
+		for (auto i = 0u; i <= static_cast<uint32_t>(maxLevel); ++i)
+		{
+			LimitSIMDLevel(static_cast<SIMDLevel>(i));
+			if (GetSIMDLevel() == static_cast<SIMDLevel>(i)) func(static_cast<SIMDLevel>(i));
+		}
+		LimitSIMDLevel(SIMDLevel::AVX512);
+	}
+
+	// The vertex splitting that weldVertices replaced: a vertex is split whenever a corner gives its
+	// position another normal than the first one, even if the same pair was split before, and the
+	// vertex buffer grows by a vertex at a time. Returns the reallocations of the vertex buffer.
+	uint32_t splitVertices(const vector<ObjLoader::float3>& positions, const vector<ObjLoader::float3>& normals,
+		const vector<uint32_t>& nIndices, vector<uint32_t>& indices, vector<ObjLoader::float3>& vertices)
+	{
+		vector<ObjLoader::float3>(2 * positions.size(), ObjLoader::float3(0.0f, 0.0f, 0.0f)).swap(vertices);
+		for (size_t i = 0; i < positions.size(); ++i) vertices[2 * i] = positions[i];
+		if (normals.empty()) return 1;
+
+		auto numReallocs = 1u;
+		vector<uint32_t> vni(positions.size(), UINT32_MAX);
+		const auto numIdx = static_cast<uint32_t>(indices.size());
+		for (auto i = 0u; i < numIdx; ++i)
+		{
+			auto vi = indices[i];
+			if (vni[vi] == nIndices[i] || nIndices[i] == UINT32_MAX) continue;
+
+			if (vni[vi] < UINT32_MAX)
+			{
+				// Split vertex
+				const auto capacity = vertices.capacity();
+				vi = static_cast<uint32_t>(vertices.size() / 2);
+				vertices.resize(vertices.size() + 2);
+				vertices[2 * vi] = vertices[2 * indices[i]];
+				numReallocs += vertices.capacity() != capacity ? 1 : 0;
+				indices[i] = vi;
+			}
+			else vni[vi] = nIndices[i];
+
+			auto n = normals[nIndices[i]];
+			const auto l = sqrt(n.x * n.x + n.y * n.y + n.z * n.z);
+			n.x /= l;
+			n.y /= l;
+			n.z /= l;
+			vertices[2 * vi + 1] = n;
+		}
+		numReallocs += vertices.capacity() != vertices.size() ? 1 : 0;
+		vertices.shrink_to_fit();
+
+		return numReallocs;
+	}
+
+	// Runs the geometry passes of ObjLoader on the records of a file, as Import does after the
+	// parse with the normals, without the forDX flip.
+	class ObjLoaderProbe : public ObjLoader
+	{
+	public:
+		void SetRecords(const vector<float3>& positions, const vector<float3>& normals,
+			const vector<uint32_t>& indices, const vector<uint32_t>& nIndices)
+		{
+			m_records.Positions = positions;
+			m_records.Normals = normals;
+			m_records.Indices = indices;
+			m_records.NIndices = nIndices;
+			m_records.TIndices.assign(indices.size(), UINT32_MAX);
+		}
+
+		// Returns the time to weld a copy of the records, and whether the vertex buffer was
+		// allocated once, at its final size.
+		double Weld(bool& isAllocatedOnce)
+		{
+			m_geometry = m_records;
+			vector<uint8_t>().swap(m_vertices);
+			m_stride = sizeof(float3[2]);
+			const auto time = getBestTime([&]() { createGeometry(m_geometry, true, false, false); }, 1);
+			isAllocatedOnce = m_vertices.capacity() == m_vertices.size();
+
+			return time;
+		}
+
+		// Returns the time to optimize the welded records for the vertex cache like Import does.
+		double OptimizeVertexCache(uint32_t cacheSize)
+		{
+			bool isAllocatedOnce;
+			Weld(isAllocatedOnce);
+
+			return getBestTime([&]()
+			{
+				optimizeVertexCache(cacheSize);
+				reorderVertices();
+			}, 1);
+		}
+
+		double RecomputeNormals(uint32_t numThreads)
+		{
+			return getBestTime([&]() { recomputeNormals(numThreads); });
+		}
+
+		double ComputeAABB()
+		{
+			return getBestTime([&]() { computeAABB(); });
+		}
+
+	protected:
+		ObjGeometry m_records;
+		ObjGeometry m_geometry;
+	};
+
+	// Checks the SIMD tiers of the normal and bounds kernels on the welded records of the probe
+	// against the scalar reference, at the tolerance of the FMA contraction of the scalar code: 2e-4
+	// per normal component, and none on the bounds. Reports the times on a thread.
+	bool checkGeometryKernels(ObjLoaderProbe& probe, const char* pszName)
+	{
+		bool isAllocatedOnce;
+		probe.Weld(isAllocatedOnce);
+		const auto numVertices = probe.GetNumVertices();
+		const auto stride = probe.GetVertexStride();
+		vector<uint8_t> reference;
+		ObjLoader::AABB referenceAABB = {};
+		auto maxError = 0.0f;
+		auto numInexact = 0u;
+		auto isAABBSame = true;
+		cout << fixed << setprecision(2) << "ObjLoader: " << pszName << ", " << probe.GetNumIndices() / 3 <<
+			" triangles, ms of the normals and the AABB";
+		forEachSIMDLevel([&](SIMDLevel level)
+		{
+			const auto normalTime = probe.RecomputeNormals(1);
+			const auto aabbTime = probe.ComputeAABB();
+			if (level == SIMDLevel::SCALAR)
+			{
+				reference.assign(probe.GetVertices(), probe.GetVertices() + stride * numVertices);
+				referenceAABB = probe.GetAABB();
+			}
+
+			for (auto i = 0u; i < numVertices; ++i)
+			{
+				const auto n = reinterpret_cast<const float*>(&probe.GetVertices()[stride * i + sizeof(ObjLoader::float3)]);
+				const auto r = reinterpret_cast<const float*>(&reference[stride * i + sizeof(ObjLoader::float3)]);
+				for (uint8_t k = 0; k < 3; ++k)
+				{
+					const auto error = fabs(n[k] - r[k]);
+					maxError = (max)(maxError, error);
+					numInexact += error > 1e-6f ? 1 : 0;
+				}
+			}
+			isAABBSame = isAABBSame && !memcmp(&probe.GetAABB(), &referenceAABB, sizeof(ObjLoader::AABB));
+			cout << (level == SIMDLevel::SCALAR ? ": " : ", ") << getSIMDLevelName(level) << " " <<
+				normalTime * 1000.0 << " and " << aabbTime * 1000.0;
+		});
+		cout << scientific << setprecision(1) << "; max normal difference " << maxError << ", " << numInexact <<
+			" components over 1e-6, AABB " << (isAABBSame ? "same" : "DIFFERENT") << endl;
+		cout.unsetf(ios::floatfield);
+
+		return maxError <= 2e-4f && isAABBSame;
+	}
+
+	// Upper tail of the chi-square distribution, by the regularized incomplete gamma function
+	// [Press et al., "Numerical Recipes", 6.2], or by the Wilson-Hilferty normal approximation for
+	// the large degrees of freedom.
+	double chiSquareP(double chi2, double dof)
+	{
+		if (dof > 1000.0)
+		{
+			const auto v = 2.0 / (9.0 * dof);
+			const auto z = (pow(chi2 / dof, 1.0 / 3.0) - (1.0 - v)) / sqrt(v);
+
+			return 0.5 * erfc(z / sqrt(2.0));
+		}
+
+		const auto a = 0.5 * dof, x = 0.5 * chi2;
+		if (x <= 0.0) return 1.0;
+		const auto scale = exp(a * log(x) - x - lgamma(a));
+		if (x < a + 1.0)
+		{
+			// Series of the lower tail
+			auto term = 1.0 / a, sum = term;
+			for (auto n = 1; n < 10000 && term > sum * DBL_EPSILON; ++n)
+			{
+				term *= x / (a + n);
+				sum += term;
+			}
+
+			return 1.0 - sum * scale;
+		}
+
+		// Continued fraction of the upper tail, by the modified Lentz method
+		auto b = x + 1.0 - a, c = 1.0 / DBL_MIN, d = 1.0 / b, h = d;
+		for (auto n = 1; n < 10000; ++n)
+		{
+			const auto an = -n * (n - a);
+			b += 2.0;
+			d = an * d + b;
+			c = b + an / c;
+			d = 1.0 / (fabs(d) < DBL_MIN ? DBL_MIN : d);
+			c = fabs(c) < DBL_MIN ? DBL_MIN : c;
+			const auto delta = d * c;
+			h *= delta;
+			if (fabs(delta - 1.0) < DBL_EPSILON) break;
+		}
+
+		return h * scale;
+	}
+
+	// Upper tail of the standard normal distribution
+	double normalP(double z)
+	{
+		return 0.5 * erfc(z / sqrt(2.0));
+	}
+
+	double chiSquare(const vector<uint32_t>& counts, const vector<double>& expected)
+	{
+		auto chi2 = 0.0;
+		for (size_t i = 0; i < counts.size(); ++i)
+		{
+			const auto d = counts[i] - expected[i];
+			chi2 += d * d / expected[i];
+		}
+
+		return chi2;
+	}
+
+	// The tests of a stream of NUM_WORDS words after the ones of SmallCrush [L'Ecuyer and Simard
+	// 2007, "TestU01"], scaled to the stream, and a test of RandomIndex; each gives the p-value of
+	// its statistic.
+	const struct
+	{
+		const char* Name;
+		double (*Test)(const uint32_t* pWords);
+	} randomTests[] =
+	{
+		{
+			// The ones of each bit
+			"frequency", [](const uint32_t* pWords)
+			{
+				uint32_t ones[32] = {};
+				for (auto i = 0u; i < NUM_WORDS; ++i)
+					for (uint8_t b = 0; b < 32; ++b) ones[b] += (pWords[i] >> b) & 1;
+
+				auto chi2 = 0.0;
+				for (const auto& n : ones)
+				{
+					const auto z = (2.0 * n - NUM_WORDS) / sqrt(NUM_WORDS);
+					chi2 += z * z;
+				}
+
+				return chiSquareP(chi2, 32.0);
+			}
+		},
+		{
+			// The pairs of the high bytes of the consecutive words, i.e. the neighbouring counters
+			"serial high", [](const uint32_t* pWords)
+			{
+				vector<uint32_t> counts(1 << 16);
+				for (auto i = 0u; i < NUM_WORDS; i += 2) ++counts[(pWords[i] >> 24) << 8 | pWords[i + 1] >> 24];
+
+				return chiSquareP(chiSquare(counts, vector<double>(counts.size(), NUM_WORDS / 2.0 / counts.size())),
+					counts.size() - 1.0);
+			}
+		},
+		{
+			// The pairs of the low bytes of the consecutive words
+			"serial low", [](const uint32_t* pWords)
+			{
+				vector<uint32_t> counts(1 << 16);
+				for (auto i = 0u; i < NUM_WORDS; i += 2) ++counts[(pWords[i] & 0xff) << 8 | (pWords[i + 1] & 0xff)];
+
+				return chiSquareP(chiSquare(counts, vector<double>(counts.size(), NUM_WORDS / 2.0 / counts.size())),
+					counts.size() - 1.0);
+			}
+		},
+		{
+			// sknuth_Gap: the gaps between the words whose high 4 bits are 0
+			"gap", [](const uint32_t* pWords)
+			{
+				const auto maxGap = 100u;
+				const auto p = 1.0 / 16.0;
+				vector<uint32_t> counts(maxGap + 1);
+				auto gap = 0u, numGaps = 0u;
+				for (auto i = 0u; i < NUM_WORDS; ++i)
+				{
+					if (pWords[i] >> 28) ++gap;
+					else
+					{
+						++counts[(min)(gap, maxGap)];
+						++numGaps;
+						gap = 0;
+					}
+				}
+
+				vector<double> expected(maxGap + 1);
+				for (auto r = 0u; r < maxGap; ++r) expected[r] = numGaps * p * pow(1.0 - p, r);
+				expected[maxGap] = numGaps * pow(1.0 - p, maxGap);
+
+				return chiSquareP(chiSquare(counts, expected), maxGap);
+			}
+		},
+		{
+			// smarsa_BirthdaySpacings: the repeated spacings of 4096 birthdays in 2^32 days, whose
+			// days are the high halves of 2 consecutive words; the repeats are Poisson(4) per sample.
+			"birthday spacings", [](const uint32_t* pWords)
+			{
+				const auto numBirthdays = 4096u;
+				const auto numSamples = NUM_WORDS / (2 * numBirthdays);
+				const auto lambda = pow(numBirthdays, 3.0) / (4.0 * 4294967296.0);
+				vector<uint32_t> days(numBirthdays);
+				auto numRepeats = 0u;
+				for (auto s = 0u; s < numSamples; ++s)
+				{
+					const auto pSample = &pWords[2 * numBirthdays * s];
+					for (auto i = 0u; i < numBirthdays; ++i) days[i] = (pSample[2 * i] & 0xffff0000) | pSample[2 * i + 1] >> 16;
+					sort(days.begin(), days.end());
+					for (auto i = numBirthdays - 1; i > 0; --i) days[i] -= days[i - 1];
+					sort(days.begin() + 1, days.end());
+					for (auto i = 2u; i < numBirthdays; ++i) numRepeats += days[i] == days[i - 1];
+				}
+
+				const auto mean = lambda * numSamples;
+
+				return normalP((numRepeats - mean) / sqrt(mean));
+			}
+		},
+		{
+			// sknuth_Collision: 2^17 balls in 2^20 cells per run, whose cells are the high 10 bits
+			// of 2 consecutive words
+			"collision", [](const uint32_t* pWords)
+			{
+				const auto numBalls = 1u << 17;
+				const auto numCells = 1u << 20;
+				const auto numRuns = NUM_WORDS / (2 * numBalls);
+				vector<uint8_t> cells(numCells);
+				auto numCollisions = 0u;
+				for (auto r = 0u; r < numRuns; ++r)
+				{
+					fill(cells.begin(), cells.end(), 0);
+					const auto pRun = &pWords[2 * numBalls * r];
+					for (auto i = 0u; i < numBalls; ++i)
+					{
+						auto& cell = cells[(pRun[2 * i] >> 22) << 10 | pRun[2 * i + 1] >> 22];
+						numCollisions += cell;
+						cell = 1;
+					}
+				}
+
+				// The collisions are the balls less the occupied cells.
+				const double n = numBalls, k = numCells;
+				const auto empty1 = exp(n * log1p(-1.0 / k)), empty2 = exp(n * log1p(-2.0 / k));
+				const auto mean = numRuns * (n - k + k * empty1);
+				const auto variance = numRuns * (k * (k - 1.0) * empty2 + k * empty1 - k * k * empty1 * empty1);
+
+				return normalP((numCollisions - mean) / sqrt(variance));
+			}
+		},
+		{
+			// sknuth_MaxOft: the maxima of 8 words, whose 8th powers are uniform, in 64 bins
+			"max of 8", [](const uint32_t* pWords)
+			{
+				const auto t = 8u;
+				vector<uint32_t> counts(64);
+				for (auto i = 0u; i < NUM_WORDS; i += t)
+				{
+					auto maxWord = 0u;
+					for (auto j = 0u; j < t; ++j) maxWord = (max)(maxWord, pWords[i + j]);
+					++counts[static_cast<uint32_t>(pow((maxWord + 0.5) / 4294967296.0, t) * counts.size())];
+				}
+
+				return chiSquareP(chiSquare(counts, vector<double>(counts.size(), NUM_WORDS / t / 64.0)),
+					counts.size() - 1.0);
+			}
+		},
+		{
+			// smarsa_MatrixRank: the GF(2) ranks of the 32 x 32 matrices of 32 consecutive words
+			"matrix rank", [](const uint32_t* pWords)
+			{
+				vector<uint32_t> counts(4);
+				for (auto i = 0u; i < NUM_WORDS; i += 32)
+				{
+					uint32_t rows[32];
+					memcpy(rows, &pWords[i], sizeof(rows));
+					auto rank = 0u;
+					for (uint8_t b = 0; b < 32 && rank < 32; ++b)
+					{
+						const auto bit = 1u << b;
+						auto pivot = rank;
+						while (pivot < 32 && !(rows[pivot] & bit)) ++pivot;
+						if (pivot == 32) continue;
+						swap(rows[rank], rows[pivot]);
+						for (auto r = rank + 1; r < 32; ++r) if (rows[r] & bit) rows[r] ^= rows[rank];
+						++rank;
+					}
+					++counts[32 - (max)(rank, 29u)];
+				}
+
+				// Ranks 32, 31, 30 and at most 29
+				const double probs[] = { 0.2887880951, 0.5775761902, 0.1283502644, 0.0052854502 };
+				vector<double> expected(4);
+				for (uint8_t r = 0; r < 4; ++r) expected[r] = NUM_WORDS / 32 * probs[r];
+
+				return chiSquareP(chiSquare(counts, expected), 3.0);
+			}
+		},
+		{
+			// RandomIndex of 1000 emitters
+			"index", [](const uint32_t* pWords)
+			{
+				vector<uint32_t> counts(1000);
+				for (auto i = 0u; i < NUM_WORDS; ++i) ++counts[SharedRandom::RandomIndex(pWords[i], 1000)];
+
+				return chiSquareP(chiSquare(counts, vector<double>(counts.size(), NUM_WORDS / 1000.0)),
+					counts.size() - 1.0);
+			}
+		}
+	};
+
+	// Runs the random tests on a stream, prints the p-values, and returns the number of the failures.
+	uint32_t testRandomStream(const char* pszName, const uint32_t* pWords)
+	{
+		auto numFailures = 0u;
+		cout << "Random: " << pszName << ", p-values:";
+		for (const auto& test : randomTests)
+		{
+			const auto p = test.Test(pWords);
+			const auto isFailed = !(p >= P_MIN && p <= 1.0 - P_MIN);
+			cout << " " << test.Name << " " << setprecision(4) << p << (isFailed ? " (fail)" : "") << ",";
+			numFailures += isFailed ? 1 : 0;
+		}
+		cout << " " << numFailures << " failures" << endl;
+
+		return numFailures;
+	}
+
+	// SoA particles of the CPU tests
+	struct ParticleStorage
+	{
+		vector<float> Arrays[7];
+
+		void Resize(uint32_t numParticles)
+		{
+			for (auto& arr : Arrays) arr.assign(numParticles, 0.0f);
+		}
+
+		ParticleArrays GetArrays()
+		{
+			ParticleArrays particles;
+			for (uint8_t j = 0; j < 3; ++j)
+			{
+				particles.pPos[j] = Arrays[j].data();
+				particles.pVelocity[j] = Arrays[j + 3].data();
+			}
+			particles.pLifeTime = Arrays[6].data();
+
+			return particles;
+		}
+
+		void Assign(const ParticleArrays& particles, uint32_t numParticles)
+		{
+			for (uint8_t j = 0; j < 3; ++j)
+			{
+				Arrays[j].assign(particles.pPos[j], particles.pPos[j] + numParticles);
+				Arrays[j + 3].assign(particles.pVelocity[j], particles.pVelocity[j] + numParticles);
+			}
+			Arrays[6].assign(particles.pLifeTime, particles.pLifeTime + numParticles);
+		}
+
+		bool IsSame(const ParticleStorage& storage) const
+		{
+			for (uint8_t j = 0; j < 7; ++j)
+				if (Arrays[j].size() != storage.Arrays[j].size() ||
+					memcmp(Arrays[j].data(), storage.Arrays[j].data(), sizeof(float) * Arrays[j].size()))
+					return false;
+
+			return true;
+		}
+	};
+
+	// Imports the mesh and distributes its emitters.
+	bool importEmitters(const char* pszFilename, float density, float scale, ObjLoader& objLoader,
+		Distributor& distributor)
+	{
+		ObjLoader::ImportOptions options;
+		options.NumThreads = 0;
+		if (!objLoader.Import(pszFilename, options)) return false;
+
+		distributor.Distribute(objLoader.GetVertices(), objLoader.GetVertexStride(), objLoader.GetIndices(),
+			objLoader.GetNumIndices(), density, scale);
+
+		return true;
+	}
+
+	// The position of an emitter in the mesh space, summed like the one of PoissonSampler
+	XMFLOAT3 getPosition(const uint8_t* pVertices, uint32_t stride, const EmitterInfo& emitter)
+	{
+		const float w[] = { emitter.Barycoord.x, emitter.Barycoord.y, 1.0f - (emitter.Barycoord.x + emitter.Barycoord.y) };
+		const uint32_t vIds[] = { emitter.Indices.x, emitter.Indices.y, emitter.Indices.z };
+		XMFLOAT3 p(0.0f, 0.0f, 0.0f);
+		for (uint8_t k = 0; k < 3; ++k)
+		{
+			const auto pPos = reinterpret_cast<const float*>(&pVertices[stride * vIds[k]]);
+			p = XMFLOAT3(p.x + pPos[0] * w[k], p.y + pPos[1] * w[k], p.z + pPos[2] * w[k]);
+		}
+
+		return p;
+	}
+
+	inline float distanceSq(const XMFLOAT3& a, const XMFLOAT3& b)
+	{
+		const XMFLOAT3 d(a.x - b.x, a.y - b.y, a.z - b.z);
+
+		return d.x * d.x + d.y * d.y + d.z * d.z;
+	}
+
+	// Points binned into the cells of a uniform grid, so the nearest point within the cell size is
+	// in the 27 cells around a query.
+	class PointGrid
+	{
+	public:
+		PointGrid(const vector<XMFLOAT3>& points, float cellSize) :
+			m_points(points),
+			m_cellScale(1.0f / cellSize),
+			m_minPt(FLT_MAX, FLT_MAX, FLT_MAX)
+		{
+			for (const auto& p : points)
+				m_minPt = XMFLOAT3((min)(m_minPt.x, p.x), (min)(m_minPt.y, p.y), (min)(m_minPt.z, p.z));
+
+			m_cellPoints.resize(points.size());
+			for (auto i = 0u; i < points.size(); ++i) m_cellPoints[i] = make_pair(getCellKey(points[i], 0, 0, 0), i);
+			sort(m_cellPoints.begin(), m_cellPoints.end());
+		}
+
+		// The squared distance to the nearest point other than the excluded one, if within the cell
+		// size; otherwise, at least the squared cell size.
+		float GetNearestDistanceSq(const XMFLOAT3& p, uint32_t exclude = UINT32_MAX) const
+		{
+			auto nearestSq = FLT_MAX;
+			for (auto k = -1; k <= 1; ++k)
+				for (auto j = -1; j <= 1; ++j)
+					for (auto i = -1; i <= 1; ++i)
+					{
+						const auto key = getCellKey(p, i, j, k);
+						for (auto it = lower_bound(m_cellPoints.cbegin(), m_cellPoints.cend(), make_pair(key, 0u));
+							it != m_cellPoints.cend() && it->first == key; ++it)
+							if (it->second != exclude) nearestSq = (min)(nearestSq, distanceSq(p, m_points[it->second]));
+					}
+
+			return nearestSq;
+		}
+
+	protected:
+		// The cells are biased by 2^20 along each axis, so the ones around the points are positive.
+		uint64_t getCellKey(const XMFLOAT3& p, int32_t i, int32_t j, int32_t k) const
+		{
+			const auto x = static_cast<uint64_t>(static_cast<int64_t>(floor((p.x - m_minPt.x) * m_cellScale)) + i + (1 << 20));
+			const auto y = static_cast<uint64_t>(static_cast<int64_t>(floor((p.y - m_minPt.y) * m_cellScale)) + j + (1 << 20));
+			const auto z = static_cast<uint64_t>(static_cast<int64_t>(floor((p.z - m_minPt.z) * m_cellScale)) + k + (1 << 20));
+
+			return (z << 42) | (y << 21) | x;
+		}
+
+		const vector<XMFLOAT3>& m_points;
+		vector<pair<uint64_t, uint32_t>> m_cellPoints;
+		float m_cellScale;
+		XMFLOAT3 m_minPt;
+	};
+
+	// The mean, the standard deviation and the maximum of the samples
+	XMFLOAT3 getStatistics(const vector<float>& samples)
+	{
+		auto sum = 0.0, sumSq = 0.0;
+		auto maxSample = 0.0f;
+		for (const auto& sample : samples)
+		{
+			sum += sample;
+			sumSq += static_cast<double>(sample) * sample;
+			maxSample = (max)(maxSample, sample);
+		}
+		const auto mean = sum / samples.size();
+
+		return XMFLOAT3(static_cast<float>(mean), static_cast<float>(sqrt((max)(sumSq / samples.size() - mean * mean, 0.0))),
+			maxSample);
+	}
+
+	// The world of the mesh at a time, moving like the one of Renderer::UpdateFrame
+	XMFLOAT3X4 getWorld(float time, float scale)
+	{
+		const auto world = XMMatrixScaling(scale, scale, scale) * XMMatrixRotationY(5.0f * time) *
+			XMMatrixTranslation(cos(time) * 4.0f, 2.5f + sin(time) * 2.0f, sin(time) * 4.0f);
+		XMFLOAT3X4 world3x4;
+		XMStoreFloat3x4(&world3x4, world);
+
+		return world3x4;
+	}
+
+	// Emits the particles of the slots like CSEmit, which blends the vertices of the mesh space and
+	// transforms each particle with the worlds of the frame and of the last one.
+	void emitLikeCSEmit(ThreadPool& threadPool, const ParticleArrays& particles, const uint32_t* pSlots,
+		uint32_t numSlots, const ObjLoader& objLoader, const Distributor& distributor,
+		const XMFLOAT3X4& world, const XMFLOAT3X4& worldPrev, uint32_t frame)
+	{
+		const auto pVertices = objLoader.GetVertices();
+		const auto stride = objLoader.GetVertexStride();
+		const auto pEmitters = distributor.GetEmitters();
+		const auto numEmitters = distributor.GetNumEmitters();
+		threadPool.ParallelFor(numSlots, [&](uint32_t begin, uint32_t end)
+		{
+			for (auto i = begin; i < end; ++i)
+			{
+				const auto slot = pSlots[i];
+				const auto random = SharedRandom::Pcg4d(XMUINT4(slot, frame, 0, 0));
+				const auto& emitter = pEmitters[SharedRandom::RandomIndex(random.x, numEmitters)];
+				const float w[] = { emitter.Barycoord.x, emitter.Barycoord.y, 1.0f - (emitter.Barycoord.x + emitter.Barycoord.y) };
+				const uint32_t vIds[] = { emitter.Indices.x, emitter.Indices.y, emitter.Indices.z };
+				const float* v[3];
+				for (uint8_t k = 0; k < 3; ++k) v[k] = reinterpret_cast<const float*>(&pVertices[stride * vIds[k]]);
+				const float pos[] =
+				{
+					w[0] * v[0][0] + w[1] * v[1][0] + w[2] * v[2][0],
+					w[0] * v[0][1] + w[1] * v[1][1] + w[2] * v[2][1],
+					w[0] * v[0][2] + w[1] * v[1][2] + w[2] * v[2][2]
+				};
+
+				for (uint8_t j = 0; j < 3; ++j)
+				{
+					const auto& m = world.m[j];
+					const auto& n = worldPrev.m[j];
+					const auto p = (m[0] * pos[0] + m[1] * pos[1] + m[2] * pos[2] + m[3]) * 0.1f;
+					const auto posPrev = (n[0] * pos[0] + n[1] * pos[1] + n[2] * pos[2] + n[3]) * 0.1f;
+					particles.pPos[j][slot] = p;
+					particles.pVelocity[j][slot] = (p - posPrev) / TIME_STEP;
+				}
+				particles.pLifeTime[slot] = FULL_LIFE + SharedRandom::RandomUnorm(random.y);
+			}
+		}, 1024);
+	}
+
+	// HLSL intrinsics, evaluated in the order of the shaders without FMAs
+	inline XMFLOAT3 cross(const XMFLOAT3& a, const XMFLOAT3& b)
+	{
+		return XMFLOAT3(a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x);
+	}
+
+	inline float dot(const XMFLOAT3& a, const XMFLOAT3& b)
+	{
+		return a.x * b.x + a.y * b.y + a.z * b.z;
+	}
+
+	inline XMFLOAT3 normalize(const XMFLOAT3& a)
+	{
+		const auto l = sqrt(dot(a, a));
+
+		return XMFLOAT3(a.x / l, a.y / l, a.z / l);
+	}
+
+	inline float lerp(float a, float b, float s)
+	{
+		return a + (b - a) * s;
+	}
+
+	// determinant of DSDistribute
+	inline float determinant(const XMFLOAT2& a, const XMFLOAT2& b, const XMFLOAT2& c)
+	{
+		return (b.x - a.x) * (c.y - a.y) - (b.y - a.y) * (c.x - a.x);
+	}
+
+	// Appends the emitters of a triangle, with its positions scaled like VSDistribute, by running
+	// CalcHSPatchConstants for each tile instance, and DSDistribute for each domain point of the
+	// integer partitioning.
+	void distributeLikeShaders(const XMFLOAT3 p[3], const XMUINT3& indices, vector<EmitterInfo>& emitters)
+	{
+		// CalcHSPatchConstants
+		if (p[0].y <= GROUND_Y || p[1].y <= GROUND_Y || p[2].y <= GROUND_Y) return;
+
+		const XMFLOAT3 e0(p[2].x - p[1].x, p[2].y - p[1].y, p[2].z - p[1].z);
+		const XMFLOAT3 e1(p[0].x - p[2].x, p[0].y - p[2].y, p[0].z - p[2].z);
+		XMFLOAT3 u(0.0f, 1.0f, 0.0f);
+		XMFLOAT3 r(1.0f, 0.0f, 0.0f);
+		const auto n = normalize(cross(e0, e1));
+		if (fabs(dot(n, u)) < 0.6667f)
+		{
+			r = normalize(cross(n, u));
+			u = cross(r, n);
+		}
+		else
+		{
+			u = normalize(cross(r, n));
+			r = cross(n, u);
+		}
+
+		XMFLOAT2 v[3];
+		for (uint8_t i = 0; i < 3; ++i) v[i] = XMFLOAT2(dot(r, p[i]), dot(u, p[i]));
+
+		const XMFLOAT2 minPt((min)(v[0].x, (min)(v[1].x, v[2].x)), (min)(v[0].y, (min)(v[1].y, v[2].y)));
+		const XMFLOAT2 maxPt((max)(v[0].x, (max)(v[1].x, v[2].x)), (max)(v[0].y, (max)(v[1].y, v[2].y)));
+		const XMFLOAT2 gridMin(floor(minPt.x), floor(minPt.y));
+		const XMFLOAT2 gridMax(ceil(maxPt.x), ceil(maxPt.y));
+		const XMFLOAT2 aabb(gridMax.x - gridMin.x, gridMax.y - gridMin.y);
+		if (!(aabb.x > 0.0f && aabb.y > 0.0f && aabb.x < MAX_GRID_EXTENT && aabb.y < MAX_GRID_EXTENT)) return;
+
+		const auto numTilesX = static_cast<uint32_t>(ceil(aabb.x / MAX_TESS_FACTOR));
+		const auto numTilesY = static_cast<uint32_t>(ceil(aabb.y / MAX_TESS_FACTOR));
+		for (auto tile = 0u; tile < numTilesX * numTilesY; ++tile)
+		{
+			const XMFLOAT2 tileMin(gridMin.x + MAX_TESS_FACTOR * static_cast<float>(tile % numTilesX),
+				gridMin.y + MAX_TESS_FACTOR * static_cast<float>(tile / numTilesX));
+			const XMFLOAT2 tileMax((min)(tileMin.x + MAX_TESS_FACTOR, gridMax.x),
+				(min)(tileMin.y + MAX_TESS_FACTOR, gridMax.y));
+
+			// The integer tess factors are the tile sizes.
+			const auto numCols = static_cast<uint32_t>(tileMax.x - tileMin.x);
+			const auto numRows = static_cast<uint32_t>(tileMax.y - tileMin.y);
+			for (auto j = 0u; j <= numRows; ++j)
+			{
+				for (auto i = 0u; i <= numCols; ++i)
+				{
+					// DSDistribute
+					const XMFLOAT2 domain(static_cast<float>(i) / numCols, static_cast<float>(j) / numRows);
+					if ((tileMax.x < gridMax.x && domain.x >= 1.0f) || (tileMax.y < gridMax.y && domain.y >= 1.0f)) continue;
+
+					const XMFLOAT2 pt(lerp(tileMin.x, tileMax.x, domain.x), lerp(tileMin.y, tileMax.y, domain.y));
+
+					const auto a01 = v[0].y - v[1].y;
+					const auto b01 = v[1].x - v[0].x;
+					const auto a12 = v[1].y - v[2].y;
+					const auto b12 = v[2].x - v[1].x;
+					const auto a20 = v[2].y - v[0].y;
+					const auto b20 = v[0].x - v[2].x;
+
+					XMFLOAT3 w(determinant(v[1], v[2], minPt), determinant(v[2], v[0], minPt), determinant(v[0], v[1], minPt));
+					const XMFLOAT2 dist(pt.x - minPt.x, pt.y - minPt.y);
+					w.x += (a12 * dist.x) + (b12 * dist.y);
+					w.y += (a20 * dist.x) + (b20 * dist.y);
+					w.z += (a01 * dist.x) + (b01 * dist.y);
+
+					if (w.x <= 0.0f && w.y <= 0.0f && w.z <= 0.0f)
+					{
+						const auto area = determinant(v[0], v[1], v[2]);
+						EmitterInfo emitter;
+						emitter.Indices = indices;
+						emitter.Barycoord = XMFLOAT2(w.x / area, w.y / area);
+						emitters.emplace_back(emitter);
+					}
+				}
+			}
+		}
+	}
+}
+
+bool SelfTest::Run()
+{
+	auto isPassed = TestRandom();
+	for (const auto& mesh : meshes) isPassed = TestObjLoader(mesh.FileName) && isPassed;
+	isPassed = TestGeometryKernels() && isPassed;
+	isPassed = TestMeshSimplifier(meshes[1].FileName) && isPassed;
+	for (auto i = 0; i < 2; ++i) isPassed = TestQuantize(meshes[i].FileName) && isPassed;
+	for (const auto& mesh : meshes) isPassed = TestDistributor(mesh.FileName, DENSITY, mesh.Scale) && isPassed;
+	isPassed = TestClipVolumes() && isPassed;
+	isPassed = TestEmitterCache(meshes[0].FileName, DENSITY, meshes[0].Scale) && isPassed;
+	for (auto i = 1; i < 4; i += 2) isPassed = TestEmitterMemory(meshes[i].FileName, DENSITY, meshes[i].Scale) && isPassed;
+	for (const auto& mesh : meshes) isPassed = TestRedistribute(mesh.FileName, DENSITY, mesh.Scale) && isPassed;
+	isPassed = TestMixedMesh(DENSITY, 1.0f) && isPassed;
+	for (const auto& mesh : meshes) isPassed = TestEmitterEncoding(mesh.FileName, DENSITY, mesh.Scale) && isPassed;
+	for (const auto& mesh : meshes) isPassed = TestMeshletBuilder(mesh.FileName, DENSITY, mesh.Scale) && isPassed;
+	for (const auto& mesh : meshes) isPassed = TestAliasSampler(mesh.FileName, DENSITY, mesh.Scale) && isPassed;
+	isPassed = TestPoissonSampler(meshes[0].FileName, DENSITY, meshes[0].Scale) && isPassed;
+	isPassed = TestCPUEmitter(meshes[0].FileName, DENSITY, meshes[0].Scale) && isPassed;
+	for (auto i = 1; i < 4; i += 2) isPassed = TestEmitterOrder(meshes[i].FileName, DENSITY, meshes[i].Scale) && isPassed;
+	isPassed = TestParticleIntegrator() && isPassed;
+	isPassed = TestParticlePool() && isPassed;
+	isPassed = TestCPUSimulation(meshes[0].FileName, DENSITY, meshes[0].Scale) && isPassed;
+	isPassed = TestEmissionBudget(meshes[0].FileName, DENSITY, meshes[0].Scale) && isPassed;
+
+	return isPassed;
+}
+
+void SelfTest::PrintResult(const char* pszName, bool isPassed)
+{
+	cout << pszName << (isPassed ? ": passed" : ": FAILED") << endl;
+}
+
+bool SelfTest::TestRandom()
+{
+	const auto seed = 1u;
+	const auto numCounters = NUM_WORDS / 4;
+	vector<XMUINT4> randoms(NUM_WORDS);
+	vector<uint32_t> words(NUM_WORDS);
+
+	// Parity of the tiers with Pcg4d, across the wrap of the counter and with a tail in each tier
+	const XMUINT4 counter(0xffff0000, seed, 0, 0);
+	const auto numParityCounters = (1u << 17) + 31;
+	auto isSame = true;
+	cout << "RandomBatch:";
+	forEachSIMDLevel([&](SIMDLevel level)
+	{
+		RandomBatch::Generate(randoms.data(), numParityCounters, counter);
+		auto isLevelSame = true;
+		for (auto i = 0u; i < numParityCounters && isLevelSame; ++i)
+		{
+			const auto random = SharedRandom::Pcg4d(XMUINT4(counter.x + i, counter.y, counter.z, counter.w));
+			isLevelSame = !memcmp(&randoms[i], &random, sizeof(XMUINT4));
+		}
+		cout << " " << getSIMDLevelName(level) << (isLevelSame ? " same" : " DIFFERENT") << ",";
+		isSame = isSame && isLevelSame;
+	});
+	cout << " as Pcg4d" << endl;
+	PrintResult("RandomBatch", isSame);
+
+	// The statistics of the words in the order of the batches, of the x words of the neighbouring
+	// particles, which pick the emitters, and of the x words of a particle over the frames
+	auto numFailures = 0u;
+	RandomBatch::Generate(randoms.data(), numCounters, XMUINT4(0, seed, 0, 0));
+	numFailures += testRandomStream("Pcg4d words", reinterpret_cast<const uint32_t*>(randoms.data()));
+
+	RandomBatch::Generate(randoms.data(), NUM_WORDS, XMUINT4(0, seed, 0, 0));
+	for (auto i = 0u; i < NUM_WORDS; ++i) words[i] = randoms[i].x;
+	numFailures += testRandomStream("Pcg4d x by particle", words.data());
+
+	for (auto i = 0u; i < NUM_WORDS; ++i) words[i] = SharedRandom::Pcg4d(XMUINT4(12345, i, 0, 0)).x;
+	numFailures += testRandomStream("Pcg4d x by frame", words.data());
+
+	// The replaced generator, i.e. the pair of the 16-bit outputs of the rand() LCG seeded with
+	// the particle ID and the base seed, for reference
+	const auto randLCG = [](uint32_t seed) { return ((seed * 0x343fd + 0x269ec3) >> 16) & 0xffff; };
+	for (auto i = 0u; i < NUM_WORDS; ++i) words[i] = randLCG(i) | randLCG(seed) << 16;
+	testRandomStream("rand() pair by particle (replaced)", words.data());
+
+	// Throughputs in 32-bit words, of the sequential rand() LCG with 2 steps per word, and of the
+	// batches of each tier
+	const auto lcgTime = getBestTime([&]()
+	{
+		auto state = seed;
+		for (auto i = 0u; i < NUM_WORDS; ++i)
+		{
+			state = state * 0x343fd + 0x269ec3;
+			const auto lo = (state >> 16) & 0xffff;
+			state = state * 0x343fd + 0x269ec3;
+			words[i] = lo | (state & 0xffff0000);
+		}
+	});
+	cout << fixed << setprecision(1) << "Random: rand() LCG " << NUM_WORDS / lcgTime / 1e6 << " M words/s";
+	forEachSIMDLevel([&](SIMDLevel level)
+	{
+		const auto time = getBestTime([&]() { RandomBatch::Generate(randoms.data(), numCounters, XMUINT4(0, seed, 0, 0)); });
+		cout << ", Pcg4d " << getSIMDLevelName(level) << " " << NUM_WORDS / time / 1e6 << " M words/s";
+	});
+	cout << endl;
+	cout.unsetf(ios::floatfield);
+
+	const auto isPassed = isSame && numFailures == 0;
+	PrintResult("Random", isPassed);
+
+	return isPassed;
+}
+
+bool SelfTest::TestObjLoader(const char* pszFilename)
+{
+	ifstream fileStream(pszFilename, ios::in | ios::binary | ios::ate);
+	if (!fileStream)
+	{
+		cout << "ObjLoader: cannot open " << pszFilename << endl;
+		PrintResult("ObjLoader", false);
+
+		return false;
+	}
+	const auto fileMB = static_cast<double>(fileStream.tellg()) / 1048576.0;
+	fileStream.close();
+
+	// Parity of the raw records with the CRT
+	vector<ObjLoader::float3> positions;
+	vector<uint32_t> indices;
+	const auto crtTime = getBestTime([&]() { parseObjByCRT(pszFilename, positions, indices); });
+
+	auto numPositions = 0u, numIndices = 0u;
+	auto isSame = true;
+	vector<ObjLoader::float3> normals;
+	vector<uint32_t> nIndices;
+	ObjLoader objLoader;
+	objLoader.ImportStream(pszFilename, [&](const ObjLoader::StreamBatch& batch)
+	{
+		const auto numBatchIndices = 3 * batch.NumTriangles;
+		isSame = isSame && batch.BasePosition + batch.NumPositions <= positions.size() &&
+			3 * batch.BaseTriangle + numBatchIndices <= indices.size() &&
+			!memcmp(batch.pPositions, &positions[batch.BasePosition], sizeof(ObjLoader::float3) * batch.NumPositions) &&
+			!memcmp(batch.pIndices, &indices[3 * batch.BaseTriangle], sizeof(uint32_t) * numBatchIndices);
+		numPositions += batch.NumPositions;
+		numIndices += numBatchIndices;
+		normals.insert(normals.end(), batch.pNormals, batch.pNormals + batch.NumNormals);
+		nIndices.insert(nIndices.end(), batch.pNIndices, batch.pNIndices + numBatchIndices);
+	}, 4096, false, false);
+	isSame = isSame && numPositions == positions.size() && numIndices == indices.size();
+
+	// The welding of the (position, normal) pairs against the splitting it replaced; every corner
+	// must get the same position and normal.
+	ObjLoaderProbe probe;
+	probe.SetRecords(positions, normals, indices, nIndices);
+	auto isAllocatedOnce = true;
+	auto weldTime = DBL_MAX;
+	for (auto i = 0u; i < NUM_RUNS; ++i) weldTime = (min)(probe.Weld(isAllocatedOnce), weldTime);
+	vector<uint32_t> splitIndices;
+	vector<ObjLoader::float3> splitVertexData;
+	auto numReallocs = 0u;
+	const auto splitTime = getBestTime([&]()
+	{
+		splitIndices = indices;
+		numReallocs = splitVertices(positions, normals, nIndices, splitIndices, splitVertexData);
+	});
+
+	const auto vertexSize = static_cast<uint32_t>(sizeof(ObjLoader::float3[2]));
+	auto isWeldSame = probe.GetVertexStride() == vertexSize && probe.GetNumIndices() == indices.size();
+	for (auto i = 0u; i < numIndices && isWeldSame; ++i)
+	{
+		const auto pWeldedVertex = &probe.GetVertices()[vertexSize * probe.GetIndices()[i]];
+		isWeldSame = !memcmp(pWeldedVertex, &splitVertexData[2 * splitIndices[i]], vertexSize);
+	}
+
+	const auto numSplitVertices = static_cast<uint32_t>(splitVertexData.size() / 2);
+	cout << fixed << setprecision(2) << "ObjLoader: " << pszFilename << ", weld " << probe.GetNumVertices() <<
+		" vertices, " << (isAllocatedOnce ? "allocated once" : "REALLOCATED") << ", " << weldTime * 1000.0 <<
+		" ms, split " << numSplitVertices << " vertices, " << numReallocs << " allocations, " << splitTime * 1000.0 <<
+		" ms, corners " << (isWeldSame ? "same" : "DIFFERENT") << endl;
+	cout.unsetf(ios::floatfield);
+	isSame = isSame && isWeldSame && isAllocatedOnce && probe.GetNumVertices() <= numSplitVertices;
+
+	// The ACMR of a FIFO cache of 16 and 32 entries before and after the optimization, which must
+	// keep the triangles by their positions
+	const auto getTriangles = [](const ObjLoader& loader)
+	{
+		const auto stride = loader.GetVertexStride();
+		const auto getPos = [&](uint32_t i) { return *reinterpret_cast<const XMFLOAT3*>(&loader.GetVertices()[stride * i]); };
+		const auto isLess = [](const XMFLOAT3& a, const XMFLOAT3& b)
+		{
+			return a.x != b.x ? a.x < b.x : (a.y != b.y ? a.y < b.y : a.z < b.z);
+		};
+
+		vector<array<XMFLOAT3, 3>> triangles(loader.GetNumIndices() / 3);
+		for (size_t i = 0; i < triangles.size(); ++i)
+		{
+			// The rotation that starts with the least position keeps the winding.
+			auto& tri = triangles[i];
+			for (uint8_t k = 0; k < 3; ++k) tri[k] = getPos(loader.GetIndices()[3 * i + k]);
+			while (isLess(tri[1], tri[0]) || isLess(tri[2], tri[0])) rotate(tri.begin(), tri.begin() + 1, tri.end());
+		}
+		sort(triangles.begin(), triangles.end(), [&](const array<XMFLOAT3, 3>& a, const array<XMFLOAT3, 3>& b)
+		{
+			return isLess(a[0], b[0]) || (!isLess(b[0], a[0]) && (isLess(a[1], b[1]) ||
+				(!isLess(b[1], a[1]) && isLess(a[2], b[2]))));
+		});
+
+		return triangles;
+	};
+
+	const auto triangles = getTriangles(probe);
+	const float acmrs[] =
+	{
+		ObjLoader::ComputeACMR(probe.GetIndices(), probe.GetNumIndices(), probe.GetNumVertices(), 16),
+		ObjLoader::ComputeACMR(probe.GetIndices(), probe.GetNumIndices(), probe.GetNumVertices(), 32)
+	};
+	auto optimizeTime = DBL_MAX;
+	for (auto i = 0u; i < NUM_RUNS; ++i) optimizeTime = (min)(probe.OptimizeVertexCache(16), optimizeTime);
+	const float optimizedAcmrs[] =
+	{
+		ObjLoader::ComputeACMR(probe.GetIndices(), probe.GetNumIndices(), probe.GetNumVertices(), 16),
+		ObjLoader::ComputeACMR(probe.GetIndices(), probe.GetNumIndices(), probe.GetNumVertices(), 32)
+	};
+	const auto optimizedTriangles = getTriangles(probe);
+	const auto isOptimizedSame = triangles.size() == optimizedTriangles.size() &&
+		!memcmp(triangles.data(), optimizedTriangles.data(), sizeof(triangles[0]) * triangles.size());
+
+	cout << fixed << setprecision(3) << "ObjLoader: " << pszFilename << ", ACMR of 16 and 32 entries " << acmrs[0] <<
+		" and " << acmrs[1] << " to " << optimizedAcmrs[0] << " and " << optimizedAcmrs[1] << " in " <<
+		setprecision(2) << optimizeTime * 1000.0 << " ms, triangles " << (isOptimizedSame ? "same" : "DIFFERENT") << endl;
+	cout.unsetf(ios::floatfield);
+	isSame = isSame && isOptimizedSame && optimizedAcmrs[0] <= acmrs[0] && optimizedAcmrs[1] <= acmrs[1];
+	isSame = checkGeometryKernels(probe, pszFilename) && isSame;
+
+	// Parity of the multi-threaded imports, and the throughputs on 1, 2, 4... up to the hardware threads.
+	// At least 2 threads are swept, so that the threaded path is checked on a single core.
+	const auto numHardwareThreads = ThreadPool::GetNumHardwareThreads();
+	vector<uint32_t> threadCounts;
+	for (auto n = 1u; n < (max)(numHardwareThreads, 2u); n *= 2) threadCounts.emplace_back(n);
+	threadCounts.emplace_back((max)(numHardwareThreads, 2u));
+
+	ObjLoader::ImportOptions options;
+	ObjLoader singleThreaded, multiThreaded;
+	vector<double> importTimes;
+	for (const auto& numThreads : threadCounts)
+	{
+		options.NumThreads = numThreads;
+		auto& objLoader = numThreads > 1 ? multiThreaded : singleThreaded;
+		importTimes.emplace_back(getBestTime([&]() { objLoader.Import(pszFilename, options); }));
+		if (numThreads > 1) isSame = isSame && singleThreaded.GetNumVertices() == multiThreaded.GetNumVertices() &&
+			singleThreaded.GetNumIndices() == multiThreaded.GetNumIndices() &&
+			singleThreaded.GetVertexStride() == multiThreaded.GetVertexStride() &&
+			!memcmp(singleThreaded.GetVertices(), multiThreaded.GetVertices(),
+				singleThreaded.GetVertexStride() * singleThreaded.GetNumVertices()) &&
+			!memcmp(singleThreaded.GetIndices(), multiThreaded.GetIndices(), sizeof(uint32_t) * singleThreaded.GetNumIndices());
+	}
+
+	cout << fixed << setprecision(1) << "ObjLoader: " << pszFilename << ", " << fileMB << " MB, CRT parse " <<
+		fileMB / crtTime << " MB/s, import MB/s (speedup) on";
+	for (size_t i = 0; i < threadCounts.size(); ++i)
+		cout << (i ? ", " : " ") << threadCounts[i] << (threadCounts[i] > 1 ? " threads " : " thread ") <<
+		fileMB / importTimes[i] << " (" << setprecision(2) << importTimes[0] / importTimes[i] << "x)" << setprecision(1);
+	cout << " of " << numHardwareThreads << " hardware" << endl;
+	cout.unsetf(ios::floatfield);
+	PrintResult("ObjLoader", isSame);
+
+	return isSame;
+}
+
+bool SelfTest::TestGeometryKernels()
+{
+	// A sphere of 1M triangles, whose poles have the degenerate ones
+	const auto numRows = 500u, numColumns = 1000u;
+	vector<ObjLoader::float3> positions;
+	vector<uint32_t> indices;
+	for (auto i = 0u; i <= numRows; ++i)
+	{
+		const auto theta = XM_PI * i / numRows;
+		for (auto j = 0u; j < numColumns; ++j)
+		{
+			const auto phi = 2.0f * XM_PI * j / numColumns;
+			positions.emplace_back(sin(theta) * cos(phi), cos(theta), sin(theta) * sin(phi));
+		}
+	}
+
+	for (auto i = 0u; i < numRows; ++i)
+	{
+		for (auto j = 0u; j < numColumns; ++j)
+		{
+			const auto v0 = i * numColumns + j, v1 = i * numColumns + (j + 1) % numColumns;
+			const uint32_t quad[] = { v0, v1, v0 + numColumns, v1, v1 + numColumns, v0 + numColumns };
+			indices.insert(indices.end(), quad, quad + 6);
+		}
+	}
+
+	ObjLoaderProbe probe;
+	probe.SetRecords(positions, vector<ObjLoader::float3>(), indices, vector<uint32_t>(indices.size(), UINT32_MAX));
+	const auto isPassed = checkGeometryKernels(probe, "sphere");
+	PrintResult("Geometry kernels", isPassed);
+
+	return isPassed;
+}
+
+bool SelfTest::TestMeshSimplifier(const char* pszFilename)
+{
+	ObjLoader::ImportOptions options;
+	options.NumThreads = 0;
+	ObjLoader objLoader;
+	if (!objLoader.Import(pszFilename, options))
+	{
+		cout << "MeshSimplifier: cannot import " << pszFilename << endl;
+		PrintResult("MeshSimplifier", false);
+
+		return false;
+	}
+
+	const auto pVertices = objLoader.GetVertices();
+	const auto numVertices = objLoader.GetNumVertices();
+	const auto stride = objLoader.GetVertexStride();
+	const auto pIndices = objLoader.GetIndices();
+	const auto numIndices = objLoader.GetNumIndices();
+	const auto numTris = numIndices / 3;
+	const auto getAABB = [](const MeshSimplifier::float3* pPositions, uint32_t numPositions, uint32_t stride)
+	{
+		const auto pBytes = reinterpret_cast<const uint8_t*>(pPositions);
+		XMFLOAT3 aabb[] = { XMFLOAT3(FLT_MAX, FLT_MAX, FLT_MAX), XMFLOAT3(-FLT_MAX, -FLT_MAX, -FLT_MAX) };
+		for (auto i = 0u; i < numPositions; ++i)
+		{
+			const auto& p = *reinterpret_cast<const XMFLOAT3*>(&pBytes[stride * i]);
+			aabb[0] = XMFLOAT3((min)(p.x, aabb[0].x), (min)(p.y, aabb[0].y), (min)(p.z, aabb[0].z));
+			aabb[1] = XMFLOAT3((max)(p.x, aabb[1].x), (max)(p.y, aabb[1].y), (max)(p.z, aabb[1].z));
+		}
+
+		return make_pair(aabb[0], aabb[1]);
+	};
+
+	const auto isSameFloat3 = [](const XMFLOAT3& a, const XMFLOAT3& b) { return a.x == b.x && a.y == b.y && a.z == b.z; };
+	const auto isSame = [](const MeshSimplifier& a, const MeshSimplifier& b)
+	{
+		return a.GetNumVertices() == b.GetNumVertices() && a.GetNumIndices() == b.GetNumIndices() &&
+			memcmp(a.GetPositions(), b.GetPositions(), sizeof(MeshSimplifier::float3) * a.GetNumVertices()) == 0 &&
+			memcmp(a.GetIndices(), b.GetIndices(), sizeof(uint32_t) * a.GetNumIndices()) == 0;
+	};
+
+	const auto aabb = getAABB(reinterpret_cast<const MeshSimplifier::float3*>(pVertices), numVertices, stride);
+	const auto numThreads = (max)(ThreadPool::GetNumHardwareThreads(), 4u);
+	auto isPassed = true;
+	for (const auto& ratio : { 0.5f, 0.1f, 0.01f })
+	{
+		const auto target = static_cast<uint32_t>(numTris * ratio);
+
+		// The collapses down to the target, on a single thread and on many
+		MeshSimplifier simplifier, parallelSimplifier;
+		const auto time = getBestTime([&]()
+		{
+			simplifier.Simplify(pVertices, numVertices, stride, pIndices, numIndices, target);
+		});
+		const auto parallelTime = getBestTime([&]()
+		{
+			parallelSimplifier.Simplify(pVertices, numVertices, stride, pIndices, numIndices, target, FLT_MAX, numThreads);
+		});
+		const auto isDeterministic = isSame(simplifier, parallelSimplifier);
+
+		const auto numOutTris = simplifier.GetNumIndices() / 3;
+		const auto outAABB = getAABB(simplifier.GetPositions(), simplifier.GetNumVertices(), sizeof(MeshSimplifier::float3));
+		const auto isAABBSame = isSameFloat3(outAABB.first, aabb.first) && isSameFloat3(outAABB.second, aabb.second);
+
+		// With half of the error of the unbounded run as maxError, the collapses stop before the
+		// target, within the bound.
+		const auto error = simplifier.GetError();
+		const auto maxError = 0.5f * error;
+		MeshSimplifier boundedSimplifier;
+		boundedSimplifier.Simplify(pVertices, numVertices, stride, pIndices, numIndices, target, maxError, numThreads);
+		const auto numBoundedTris = boundedSimplifier.GetNumIndices() / 3;
+		const auto isBounded = boundedSimplifier.GetError() <= maxError && numBoundedTris > numOutTris;
+
+		cout << fixed << setprecision(2) << "MeshSimplifier: " << pszFilename << ", " << numTris << " to " <<
+			numOutTris << " triangles (target " << target << ") in " << time * 1000.0 << " ms on 1 thread, " <<
+			parallelTime * 1000.0 << " ms on " << numThreads << " threads, " << (isDeterministic ? "same" : "DIFFERENT") <<
+			", AABB " << (isAABBSame ? "same" : "DIFFERENT") << ", error " << scientific << setprecision(3) <<
+			error << "; maxError " << maxError << " stops at " << numBoundedTris << " triangles with error " <<
+			boundedSimplifier.GetError() << endl;
+		cout.unsetf(ios::floatfield);
+
+		isPassed = isPassed && isDeterministic && isAABBSame && numOutTris <= target && isBounded;
+	}
+
+	PrintResult("MeshSimplifier", isPassed);
+
+	return isPassed;
+}
+
+bool SelfTest::TestQuantize(const char* pszFilename)
+{
+	ObjLoader::ImportOptions options;
+	options.NumThreads = 0;
+	ObjLoader objLoader;
+	if (!objLoader.Import(pszFilename, options))
+	{
+		cout << "Quantize: cannot import " << pszFilename << endl;
+		PrintResult("Quantize", false);
+
+		return false;
+	}
+
+	// The float vertices before Quantize
+	const auto numVertices = objLoader.GetNumVertices();
+	const auto floatStride = objLoader.GetVertexStride();
+	const auto hasNormals = objLoader.HasNormals();
+	const vector<uint8_t> vertices(objLoader.GetVertices(), objLoader.GetVertices() + floatStride * numVertices);
+	const auto getFloat3 = [&](uint32_t i, uint32_t offset)
+	{
+		return *reinterpret_cast<const ObjLoader::float3*>(&vertices[floatStride * i + offset]);
+	};
+
+	const auto time = getBestTime([&]() { objLoader.Quantize(); }, 1);
+	const auto pQuantized = objLoader.GetVertices();
+	const auto stride = objLoader.GetVertexStride();
+	const auto& aabb = objLoader.GetAABB();
+
+	// The errors as shares of the documented bounds; the float rounding of the encoded fraction and
+	// of the decoded component is allowed for by 4 ulps of the magnitudes of the range.
+	const auto getBound = [](float lo, float hi)
+	{
+		return (hi - lo) / 131070.0f + 4.0f * FLT_EPSILON * (fabs(lo) + fabs(hi));
+	};
+
+	const float positionBounds[] =
+	{
+		getBound(aabb.Min.x, aabb.Max.x),
+		getBound(aabb.Min.y, aabb.Max.y),
+		getBound(aabb.Min.z, aabb.Max.z)
+	};
+	auto positionError = 0.0f, normalError = 0.0f;
+	for (auto i = 0u; i < numVertices; ++i)
+	{
+		const auto pVertex = &pQuantized[stride * i];
+		const auto p = getFloat3(i, 0);
+		const auto q = ObjLoader::DecodePosition(reinterpret_cast<const uint16_t*>(pVertex), aabb);
+		positionError = (max)(positionError, fabs(q.x - p.x) / positionBounds[0]);
+		positionError = (max)(positionError, fabs(q.y - p.y) / positionBounds[1]);
+		positionError = (max)(positionError, fabs(q.z - p.z) / positionBounds[2]);
+
+		if (hasNormals)
+		{
+			// The angle by atan2, which stays accurate for the tiny ones
+			const auto n = getFloat3(i, sizeof(ObjLoader::float3));
+			const auto m = ObjLoader::DecodeNormal(reinterpret_cast<const int16_t*>(pVertex + sizeof(uint16_t[4])));
+			const auto cx = static_cast<double>(n.y) * m.z - static_cast<double>(n.z) * m.y;
+			const auto cy = static_cast<double>(n.z) * m.x - static_cast<double>(n.x) * m.z;
+			const auto cz = static_cast<double>(n.x) * m.y - static_cast<double>(n.y) * m.x;
+			const auto d = static_cast<double>(n.x) * m.x + static_cast<double>(n.y) * m.y + static_cast<double>(n.z) * m.z;
+			const auto angle = atan2(sqrt(cx * cx + cy * cy + cz * cz), d) * 180.0 / XM_PI;
+			normalError = (max)(normalError, static_cast<float>(angle / 0.008));
+		}
+	}
+
+	// The meshes have no texcoords, so the texcoord codec is run on a planar mapping of the
+	// positions over an offset range.
+	ObjLoader::TexcoordRange range;
+	range.Min = ObjLoader::float2(-2.0f, 0.5f);
+	range.Max = ObjLoader::float2(3.0f, 1.5f);
+	const float texcoordBounds[] = { getBound(range.Min.x, range.Max.x), getBound(range.Min.y, range.Max.y) };
+	auto texcoordError = 0.0f;
+	for (auto i = 0u; i < numVertices; ++i)
+	{
+		const auto p = getFloat3(i, 0);
+		const auto u = aabb.Max.x > aabb.Min.x ? (p.x - aabb.Min.x) / (aabb.Max.x - aabb.Min.x) : 0.0f;
+		const auto v = aabb.Max.y > aabb.Min.y ? (p.y - aabb.Min.y) / (aabb.Max.y - aabb.Min.y) : 0.0f;
+		const ObjLoader::float2 t(range.Min.x + (range.Max.x - range.Min.x) * u, range.Min.y + (range.Max.y - range.Min.y) * v);
+		uint16_t encoded[2];
+		ObjLoader::EncodeTexcoord(t, range, encoded);
+		const auto q = ObjLoader::DecodeTexcoord(encoded, range);
+		texcoordError = (max)(texcoordError, fabs(q.x - t.x) / texcoordBounds[0]);
+		texcoordError = (max)(texcoordError, fabs(q.y - t.y) / texcoordBounds[1]);
+	}
+
+	cout << fixed << setprecision(3) << "Quantize: " << pszFilename << ", " << numVertices << " vertices from " <<
+		floatStride << " to " << stride << " bytes in " << time * 1000.0 << " ms, max errors of the bounds: position " <<
+		positionError << ", normal " << normalError << ", texcoord " << texcoordError << endl;
+	cout.unsetf(ios::floatfield);
+
+	const auto isPassed = objLoader.IsQuantized() && positionError <= 1.0f && normalError <= 1.0f && texcoordError <= 1.0f;
+	PrintResult("Quantize", isPassed);
+
+	return isPassed;
+}
+
+bool SelfTest::TestDistributor(const char* pszFilename, float density, float scale)
+{
+	ObjLoader::ImportOptions options;
+	options.NumThreads = 0;
+	ObjLoader objLoader;
+	if (!objLoader.Import(pszFilename, options))
+	{
+		cout << "Distributor: cannot import " << pszFilename << endl;
+		PrintResult("Distributor", false);
+
+		return false;
+	}
+
+	const auto pVertices = objLoader.GetVertices();
+	const auto stride = objLoader.GetVertexStride();
+	const auto pIndices = objLoader.GetIndices();
+	const auto numIndices = objLoader.GetNumIndices();
+
+	// The shaders, in the triangle order of the draw, with the scaling of VSDistribute
+	const auto posScale = density * scale;
+	vector<EmitterInfo> emitters;
+	for (auto t = 0u; t < numIndices / 3; ++t)
+	{
+		XMFLOAT3 p[3];
+		const XMUINT3 indices(pIndices[3 * t], pIndices[3 * t + 1], pIndices[3 * t + 2]);
+		const uint32_t vIds[] = { indices.x, indices.y, indices.z };
+		for (uint8_t i = 0; i < 3; ++i)
+		{
+			const auto pPos = reinterpret_cast<const float*>(&pVertices[stride * vIds[i]]);
+			p[i] = XMFLOAT3(pPos[0] * posScale, pPos[1] * posScale, pPos[2] * posScale);
+		}
+		distributeLikeShaders(p, indices, emitters);
+	}
+
+	cout << "Distributor: " << pszFilename << endl;
+	Distributor distributor, singleThreaded;
+	const auto time = getBestTime([&]() { distributor.Distribute(pVertices, stride, pIndices, numIndices, density, scale); }, 1);
+	const auto numWrongTris = distributor.Verify(emitters.data(), static_cast<uint32_t>(emitters.size()));
+
+	singleThreaded.Distribute(pVertices, stride, pIndices, numIndices, density, scale, 1);
+	const auto numEmitters = distributor.GetNumEmitters();
+	const auto isDeterministic = singleThreaded.GetNumEmitters() == numEmitters &&
+		!memcmp(singleThreaded.GetEmitters(), distributor.GetEmitters(), sizeof(EmitterInfo) * numEmitters);
+	const auto numCounted = Distributor::Count(pVertices, stride, pIndices, numIndices, density, scale);
+
+	cout << setprecision(1) << "Distributor: " << numEmitters << " emitters in " << time * 1000.0 << " ms on " <<
+		ThreadPool::GetNumHardwareThreads() << " threads, " << (isDeterministic ? "same" : "DIFFERENT") <<
+		" on 1 thread, " << numCounted << " counted" << endl;
+	const auto isPassed = numWrongTris == 0 && isDeterministic && numCounted == numEmitters;
+	PrintResult("Distributor", isPassed);
+
+	return isPassed;
+}
+
+void SelfTest::CreateMixedMesh(vector<XMFLOAT3>& vertices, vector<uint32_t>& indices, float density, float scale)
+{
+	// The mesh is laid out in the grid cells of the distribution, on planes tilted off the axes.
+	const auto cellSize = 1.0f / (density * scale);
+	const auto addVertex = [&](float x, float y, float z, const XMFLOAT3& normal)
+	{
+		vertices.emplace_back(x * cellSize, y * cellSize, z * cellSize);
+		vertices.emplace_back(normal);
+	};
+
+	// A huge triangle of 99 tiles of the max tess factor
+	vertices.clear();
+	indices.clear();
+	const auto hugeNormal = normalize(cross(XMFLOAT3(0.0f, 96.0f, 640.0f), XMFLOAT3(544.0f, 32.0f, 0.0f)));
+	addVertex(0.0f, 32.0f, 0.0f, hugeNormal);
+	addVertex(0.0f, 128.0f, 640.0f, hugeNormal);
+	addVertex(544.0f, 64.0f, 0.0f, hugeNormal);
+	indices.insert(indices.end(), { 0, 1, 2 });
+
+	// Beside it, a grid of 200 x 200 quads of 0.517 cells, whose triangles have about 0.13 cells each
+	const auto gridSize = 200u;
+	const auto quadSize = 0.517f;
+	const auto tinyNormal = normalize(XMFLOAT3(-0.1f, 1.0f, 0.0f));
+	for (auto j = 0u; j <= gridSize; ++j)
+		for (auto i = 0u; i <= gridSize; ++i)
+		{
+			const auto x = 640.395f + quadSize * i;
+			addVertex(x, 32.0f + 0.1f * x, 1.187f + quadSize * j, tinyNormal);
+		}
+
+	for (auto j = 0u; j < gridSize; ++j)
+		for (auto i = 0u; i < gridSize; ++i)
+		{
+			const auto v = 3 + (gridSize + 1) * j + i;
+			indices.insert(indices.end(), { v, v + gridSize + 1, v + 1, v + 1, v + gridSize + 1, v + gridSize + 2 });
+		}
+}
+
+bool SelfTest::CheckMixedMeshDensity(const char* pszName, const XMFLOAT3* pVertices, const uint32_t* pIndices,
+	uint32_t numIndices, const EmitterInfo* pEmitters, uint32_t numEmitters, float density, float scale)
+{
+	// The areas in the grid cells of the huge triangle, which has the first 3 vertices, and of the
+	// tiny ones
+	const auto posScale = density * scale;
+	double areas[2] = {};
+	for (auto i = 0u; i < numIndices; i += 3)
+	{
+		const auto& p0 = pVertices[2 * pIndices[i]];
+		const auto& p1 = pVertices[2 * pIndices[i + 1]];
+		const auto& p2 = pVertices[2 * pIndices[i + 2]];
+		const auto n = cross(XMFLOAT3(p1.x - p0.x, p1.y - p0.y, p1.z - p0.z), XMFLOAT3(p2.x - p0.x, p2.y - p0.y, p2.z - p0.z));
+		areas[i > 0 ? 1 : 0] += 0.5 * sqrt(static_cast<double>(dot(n, n))) * posScale * posScale;
+	}
+
+	uint32_t nums[2] = {};
+	for (auto i = 0u; i < numEmitters; ++i) ++nums[pEmitters[i].Indices.x < 3 ? 0 : 1];
+
+	// The grid has an emitter per cell, up to the points along the boundaries.
+	const double densities[] = { nums[0] / areas[0], nums[1] / areas[1] };
+	cout << fixed << setprecision(4) << pszName << ": emitters per grid cell, huge triangle " << densities[0] <<
+		", tiny triangles " << densities[1] << endl;
+	cout.unsetf(ios::floatfield);
+
+	return fabs(densities[0] - 1.0) < 0.02 && fabs(densities[1] - 1.0) < 0.02;
+}
+
+bool SelfTest::TestMixedMesh(float density, float scale)
+{
+	vector<XMFLOAT3> vertices;
+	vector<uint32_t> indices;
+	CreateMixedMesh(vertices, indices, density, scale);
+	const auto pVertices = reinterpret_cast<const uint8_t*>(vertices.data());
+	const auto stride = static_cast<uint32_t>(sizeof(XMFLOAT3) * 2);
+	const auto numIndices = static_cast<uint32_t>(indices.size());
+
+	Distributor distributor;
+	distributor.Distribute(pVertices, stride, indices.data(), numIndices, density, scale);
+	vector<uint32_t> tiledIndices;
+	const auto numTiles = Distributor::CollectTiledTriangles(pVertices, stride, indices.data(), numIndices,
+		density, scale, tiledIndices);
+	cout << "MixedMesh: " << numIndices / 3 << " triangles, " << distributor.GetNumEmitters() << " emitters, " <<
+		tiledIndices.size() / 3 << " tiled triangle of " << numTiles << " tiles" << endl;
+
+	const auto isPassed = CheckMixedMeshDensity("MixedMesh", vertices.data(), indices.data(), numIndices,
+		distributor.GetEmitters(), distributor.GetNumEmitters(), density, scale) && numTiles > 1;
+	PrintResult("MixedMesh", isPassed);
+
+	return isPassed;
+}
+
+bool SelfTest::TestEmitterEncoding(const char* pszFilename, float density, float scale)
+{
+	ObjLoader objLoader;
+	Distributor distributor;
+	if (!importEmitters(pszFilename, density, scale, objLoader, distributor))
+	{
+		cout << "EmitterEncoding: cannot import " << pszFilename << endl;
+		PrintResult("EmitterEncoding", false);
+
+		return false;
+	}
+
+	const auto pVertices = objLoader.GetVertices();
+	const auto stride = objLoader.GetVertexStride();
+	const auto pIndices = objLoader.GetIndices();
+	const auto pEmitters = distributor.GetEmitters();
+	const auto numEmitters = distributor.GetNumEmitters();
+	vector<EmitterCompact> compactEmitters(numEmitters);
+	const auto encodeTime = getBestTime([&]() { distributor.EncodeEmitters(compactEmitters.data()); });
+
+	// The round trips keep the vertices and the point inside the triangle, and move the position,
+	// in the double precision, by at most the bound of Encode.
+	const auto getPositionD = [&](const EmitterInfo& emitter, const XMFLOAT2& barycoord, uint8_t i)
+	{
+		const uint32_t vIds[] = { emitter.Indices.x, emitter.Indices.y, emitter.Indices.z };
+		const double w[] = { barycoord.x, barycoord.y, 1.0 - (static_cast<double>(barycoord.x) + barycoord.y) };
+		auto p = 0.0;
+		for (uint8_t k = 0; k < 3; ++k) p += w[k] * reinterpret_cast<const float*>(&pVertices[stride * vIds[k]])[i];
+
+		return p;
+	};
+
+	auto numWrongEmitters = 0u;
+	auto maxErrorRatio = 0.0, maxError = 0.0;
+	for (auto i = 0u; i < numEmitters; ++i)
+	{
+		const auto& emitter = pEmitters[i];
+		const auto& compact = compactEmitters[i];
+		const auto decoded = Distributor::Decode(compact, pIndices);
+		const auto q0 = compact.Barycoord & 0xffff, q1 = compact.Barycoord >> 16;
+
+		const auto p0 = reinterpret_cast<const float*>(&pVertices[stride * emitter.Indices.x]);
+		const auto p1 = reinterpret_cast<const float*>(&pVertices[stride * emitter.Indices.y]);
+		const auto p2 = reinterpret_cast<const float*>(&pVertices[stride * emitter.Indices.z]);
+		auto d0 = 0.0, d1 = 0.0, errorSq = 0.0;
+		for (uint8_t j = 0; j < 3; ++j)
+		{
+			d0 += (static_cast<double>(p0[j]) - p2[j]) * (static_cast<double>(p0[j]) - p2[j]);
+			d1 += (static_cast<double>(p1[j]) - p2[j]) * (static_cast<double>(p1[j]) - p2[j]);
+			const auto e = getPositionD(decoded, decoded.Barycoord, j) - getPositionD(emitter, emitter.Barycoord, j);
+			errorSq += e * e;
+		}
+		const auto bound = (sqrt(d0) + sqrt(d1)) / 65535.0;
+		const auto error = sqrt(errorSq);
+		maxError = (max)(maxError, error);
+		if (bound > 0.0) maxErrorRatio = (max)(maxErrorRatio, error / bound);
+
+		const auto isRight = !memcmp(&decoded.Indices, &emitter.Indices, sizeof(XMUINT3)) && q0 + q1 <= 65535 &&
+			error <= bound * (1.0 + 1e-4);
+		numWrongEmitters += isRight ? 0 : 1;
+	}
+
+	// Throughputs of the fetches of the emission, i.e. the x of the emitters at random, from the
+	// shader layout and from the compact one through the index buffer
+	const auto numFetches = 1u << 22;
+	vector<uint32_t> ids(numFetches);
+	vector<float> xs(numFetches);
+	for (auto i = 0u; i < numFetches; ++i)
+		ids[i] = SharedRandom::RandomIndex(SharedRandom::Pcg4d(XMUINT4(i, 0, 3, 0)).x, numEmitters);
+	const auto fetch = [&](const EmitterInfo& emitter)
+	{
+		const float w[] = { emitter.Barycoord.x, emitter.Barycoord.y, 1.0f - (emitter.Barycoord.x + emitter.Barycoord.y) };
+		const uint32_t vIds[] = { emitter.Indices.x, emitter.Indices.y, emitter.Indices.z };
+		auto x = 0.0f;
+		for (uint8_t k = 0; k < 3; ++k) x += w[k] * reinterpret_cast<const float*>(&pVertices[stride * vIds[k]])[0];
+
+		return x;
+	};
+	const auto infoTime = getBestTime([&]() { for (auto i = 0u; i < numFetches; ++i) xs[i] = fetch(pEmitters[ids[i]]); });
+	const auto compactTime = getBestTime([&]()
+	{
+		for (auto i = 0u; i < numFetches; ++i) xs[i] = fetch(Distributor::Decode(compactEmitters[ids[i]], pIndices));
+	});
+
+	cout << "EmitterEncoding: " << pszFilename << ", " << numEmitters << " emitters, " << numWrongEmitters <<
+		" wrong round trips, max position error " << setprecision(3) << maxErrorRatio << " of the bound, " <<
+		maxError * density * scale << " grid cells" << endl;
+	cout << fixed << setprecision(1) << "EmitterEncoding: " << sizeof(EmitterInfo) * numEmitters / 1048576.0 <<
+		" MB in the shader layout, " << sizeof(EmitterCompact) * numEmitters / 1048576.0 << " MB compact, encoded at " <<
+		numEmitters / encodeTime / 1e6 << " M emitters/s; random fetches " << numFetches / infoTime / 1e6 <<
+		" M/s from the shader layout, " << numFetches / compactTime / 1e6 << " M/s compact" << endl;
+	cout.unsetf(ios::floatfield);
+
+	const auto isPassed = numWrongEmitters == 0;
+	PrintResult("EmitterEncoding", isPassed);
+
+	return isPassed;
+}
+
+bool SelfTest::TestEmitterCache(const char* pszFilename, float density, float scale)
+{
+	ObjLoader objLoader;
+	Distributor distributor;
+	const auto distributeTime = getBestTime([&]() { importEmitters(pszFilename, density, scale, objLoader, distributor); }, 1);
+	if (distributor.GetNumEmitters() == 0)
+	{
+		cout << "EmitterCache: cannot import " << pszFilename << endl;
+		PrintResult("EmitterCache", false);
+
+		return false;
+	}
+
+	const auto meshHash = EmitterCache::HashMesh(objLoader.GetVertices(), objLoader.GetVertexStride(),
+		objLoader.GetNumVertices(), objLoader.GetIndices(), objLoader.GetNumIndices());
+	ClipVolumes clipVolumes;
+	clipVolumes.AddHalfSpace(XMFLOAT3(0.0f, 1.0f, 0.0f), 0.0f);
+	const auto clipHash = EmitterCache::HashClipVolumes(clipVolumes);
+	const auto numEmitters = distributor.GetNumEmitters();
+	const auto pEmitters = distributor.GetEmitters();
+
+	// Round trip
+	const auto cacheFileName = string(pszFilename) + ".selftest.emitters";
+	EmitterCache cache;
+	auto isSaved = cache.Save(cacheFileName.c_str(), meshHash, 0, density, scale, pEmitters, numEmitters);
+	const auto loadTime = getBestTime([&]() { isSaved = cache.Load(cacheFileName.c_str(), meshHash, 0, density, scale) && isSaved; });
+	const auto isRoundTripped = isSaved && cache.GetNumEmitters() == numEmitters &&
+		!memcmp(cache.GetEmitters(), pEmitters, sizeof(EmitterInfo) * numEmitters);
+	cache.Release();
+
+	// Every rejection of Load
+	vector<char> file;
+	{
+		ifstream fileStream(cacheFileName, ios::in | ios::binary);
+		file.assign(istreambuf_iterator<char>(fileStream), istreambuf_iterator<char>());
+	}
+
+	const auto loadModified = [&](size_t size, size_t flippedByte)
+	{
+		{
+			auto modified = file;
+			modified.resize(size);
+			if (flippedByte < size) modified[flippedByte] ^= 1;
+			ofstream fileStream(cacheFileName, ios::out | ios::binary | ios::trunc);
+			fileStream.write(modified.data(), modified.size());
+		}
+		const auto isLoaded = cache.Load(cacheFileName.c_str(), meshHash, 0, density, scale);
+		cache.Release();
+
+		return isLoaded;
+	};
+
+	const auto isTruncatedRejected = !loadModified(file.size() - sizeof(EmitterInfo) / 2, SIZE_MAX) &&
+		!loadModified(file.size() / 2, SIZE_MAX) && !loadModified(8, SIZE_MAX);
+	const auto isCorruptRejected = !loadModified(file.size(), file.size() - sizeof(EmitterInfo) * numEmitters / 2) &&
+		!loadModified(file.size(), file.size() - 1);
+	loadModified(file.size(), SIZE_MAX);
+	const auto isKeyRejected = !cache.Load(cacheFileName.c_str(), meshHash, 0, density * 1.01f, scale) &&
+		!cache.Load(cacheFileName.c_str(), meshHash, 0, density, scale * 0.99f) &&
+		!cache.Load(cacheFileName.c_str(), meshHash, clipHash, density, scale) &&
+		!cache.Load(cacheFileName.c_str(), meshHash + 1, 0, density, scale);
+	const auto isReloaded = cache.Load(cacheFileName.c_str(), meshHash, 0, density, scale);
+	cache.Release();
+	remove(cacheFileName.c_str());
+
+	cout << fixed << setprecision(2) << "EmitterCache: " << pszFilename << ", " << numEmitters << " emitters, round trip " <<
+		(isRoundTripped ? "same" : "DIFFERENT") << ", load " << loadTime * 1000.0 << " ms vs import and distribute " <<
+		distributeTime * 1000.0 << " ms; truncated " << (isTruncatedRejected ? "rejected" : "LOADED") << ", corrupt " <<
+		(isCorruptRejected ? "rejected" : "LOADED") << ", wrong key " << (isKeyRejected ? "rejected" : "LOADED") << endl;
+	cout.unsetf(ios::floatfield);
+
+	const auto isPassed = isRoundTripped && isTruncatedRejected && isCorruptRejected && isKeyRejected && isReloaded;
+	PrintResult("EmitterCache", isPassed);
+
+	return isPassed;
+}
+
+bool SelfTest::TestClipVolumes()
+{
+	// The points of the parity test are random in [-1, 1]^3, and every 4th one lies on the surface of
+	// a volume, where the kernels must round like the scalar reference; the odd count leaves tails.
+	const auto numPoints = (1u << 16) + 13;
+	vector<XMUINT4> randoms(numPoints);
+	RandomBatch::Generate(randoms.data(), numPoints, XMUINT4(0, 0, 0, 19));
+	ClipVolumes clipVolumes;
+	clipVolumes.AddHalfSpace(XMFLOAT3(0.267261f, 0.534522f, 0.801784f), 0.75f);
+	clipVolumes.AddBox(XMFLOAT3(-0.5f, -0.25f, -0.75f), XMFLOAT3(0.25f, 0.5f, 0.125f));
+	clipVolumes.AddSphere(XMFLOAT3(0.5f, -0.5f, 0.25f), 0.375f);
+	vector<float> x(numPoints), y(numPoints), z(numPoints);
+	for (auto i = 0u; i < numPoints; ++i)
+	{
+		const auto& r = randoms[i];
+		x[i] = 2.0f * SharedRandom::RandomUnorm(r.x) - 1.0f;
+		y[i] = 2.0f * SharedRandom::RandomUnorm(r.y) - 1.0f;
+		z[i] = 2.0f * SharedRandom::RandomUnorm(r.z) - 1.0f;
+		switch (i % 12)
+		{
+		case 0:	// On the plane
+			y[i] = -(0.267261f * x[i] + 0.801784f * z[i] + 0.75f) / 0.534522f;
+			break;
+		case 4:	// On a face of the box
+			x[i] = r.w & 1 ? -0.5f : 0.25f;
+			break;
+		case 8:	// On the sphere, up to the rounding
+			x[i] = 0.5f + 0.375f * (2.0f * SharedRandom::RandomUnorm(r.w) - 1.0f);
+			y[i] = -0.5f;
+			z[i] = 0.25f + sqrt((max)(0.375f * 0.375f - (x[i] - 0.5f) * (x[i] - 0.5f), 0.0f));
+			break;
+		}
+	}
+
+	vector<uint32_t> refIds(numPoints), ids(numPoints);
+	auto numRefKept = 0u;
+	auto isSame = true;
+	cout << fixed << setprecision(1) << "ClipVolumes: " << numPoints << " points,";
+	forEachSIMDLevel([&](SIMDLevel level)
+	{
+		auto numKept = 0u;
+		const auto time = getBestTime([&]() { numKept = clipVolumes.Clip(x.data(), y.data(), z.data(), numPoints, ids.data()); });
+		if (level == SIMDLevel::SCALAR)
+		{
+			refIds = ids;
+			numRefKept = numKept;
+		}
+
+		const auto isLevelSame = numKept == numRefKept && equal(ids.cbegin(), ids.cbegin() + numKept, refIds.cbegin());
+		cout << " " << getSIMDLevelName(level) << " " << numPoints / time / 1e6 << " M points/s" <<
+			(level == SIMDLevel::SCALAR ? "" : isLevelSame ? " same" : " DIFFERENT") << ",";
+		isSame = isSame && isLevelSame;
+	});
+	cout << " " << numRefKept << " kept" << endl;
+	cout.unsetf(ios::floatfield);
+
+	// The emitters kept by the volumes on the AABBs of the meshes: the half-space on the -x side of
+	// the center, the box between the center and the max corner, and a sphere of the largest half
+	// extent around the max corner; the emitters of TuringBowl are all on its rim.
+	auto isCountSame = true;
+	for (const auto& mesh : meshes)
+	{
+		ObjLoader::ImportOptions options;
+		options.NumThreads = 0;
+		ObjLoader objLoader;
+		if (!objLoader.Import(mesh.FileName, options))
+		{
+			cout << "ClipVolumes: cannot import " << mesh.FileName << endl;
+			isCountSame = false;
+			continue;
+		}
+
+		const auto& aabb = objLoader.GetAABB();
+		const XMFLOAT3 center(0.5f * (aabb.Min.x + aabb.Max.x), 0.5f * (aabb.Min.y + aabb.Max.y), 0.5f * (aabb.Min.z + aabb.Max.z));
+		const XMFLOAT3 halfExtent(0.5f * (aabb.Max.x - aabb.Min.x), 0.5f * (aabb.Max.y - aabb.Min.y), 0.5f * (aabb.Max.z - aabb.Min.z));
+		ClipVolumes halfSpace, box, sphere;
+		halfSpace.AddHalfSpace(XMFLOAT3(1.0f, 0.0f, 0.0f), -center.x);
+		box.AddBox(center, XMFLOAT3(aabb.Max.x, aabb.Max.y, aabb.Max.z));
+		sphere.AddSphere(XMFLOAT3(aabb.Max.x, aabb.Max.y, aabb.Max.z), (max)(halfExtent.x, (max)(halfExtent.y, halfExtent.z)));
+
+		const auto pVertices = objLoader.GetVertices();
+		const auto stride = objLoader.GetVertexStride();
+		const auto pIndices = objLoader.GetIndices();
+		const auto numIndices = objLoader.GetNumIndices();
+		const auto numEmitters = Distributor::Count(pVertices, stride, pIndices, numIndices, DENSITY, mesh.Scale);
+		cout << fixed << setprecision(1) << "ClipVolumes: " << mesh.FileName << ", " << numEmitters << " emitters";
+		for (const auto& volumes : { make_pair("half-space", &halfSpace), make_pair("box", &box), make_pair("sphere", &sphere) })
+		{
+			Distributor distributor;
+			distributor.Distribute(pVertices, stride, pIndices, numIndices, DENSITY, mesh.Scale, 0, volumes.second);
+			const auto numKept = Distributor::Count(pVertices, stride, pIndices, numIndices, DENSITY, mesh.Scale, 0, volumes.second);
+			cout << ", " << volumes.first << " " << numKept << " (" << 100.0 * (numEmitters - numKept) / (max)(numEmitters, 1u) << "% fewer)";
+			isCountSame = isCountSame && numKept == distributor.GetNumEmitters() && numKept <= numEmitters;
+		}
+		cout << endl;
+		cout.unsetf(ios::floatfield);
+	}
+
+	const auto isPassed = isSame && isCountSame;
+	PrintResult("ClipVolumes", isPassed);
+
+	return isPassed;
+}
+
+bool SelfTest::TestEmitterMemory(const char* pszFilename, float density, float scale)
+{
+	ObjLoader objLoader;
+	Distributor distributor;
+	if (!importEmitters(pszFilename, density, scale, objLoader, distributor))
+	{
+		cout << "Emitter memory: cannot import " << pszFilename << endl;
+		PrintResult("Emitter memory", false);
+
+		return false;
+	}
+
+	auto numEmitters = 0u;
+	const auto time = getBestTime([&]()
+	{
+		numEmitters = Distributor::Count(objLoader.GetVertices(), objLoader.GetVertexStride(), objLoader.GetIndices(),
+			objLoader.GetNumIndices(), density, scale);
+	});
+
+	// The buffer used to have 1 << 24 entries, and the emitters were then copied into a scratch
+	// buffer of the exact size.
+	const auto mb = 1.0 / (1 << 20);
+	const auto exactSize = static_cast<double>(sizeof(EmitterInfo)) * numEmitters;
+	const auto fixedSize = static_cast<double>(sizeof(EmitterInfo)) * (1 << 24);
+	cout << fixed << setprecision(1) << "Emitter memory: " << pszFilename << ", " << numEmitters << " emitters, " <<
+		exactSize * mb << " MB exact against a peak of " << (fixedSize + exactSize) * mb << " MB with the fixed buffer" <<
+		(numEmitters > (1 << 24) ? ", which overflows" : "") << ", count in " << time * 1000.0 << " ms" << endl;
+	cout.unsetf(ios::floatfield);
+
+	const auto isPassed = numEmitters == distributor.GetNumEmitters();
+	PrintResult("Emitter memory", isPassed);
+
+	return isPassed;
+}
+
+bool SelfTest::TestRedistribute(const char* pszFilename, float density, float scale)
+{
+	ObjLoader objLoader;
+	Distributor distributor;
+	if (!importEmitters(pszFilename, density, scale, objLoader, distributor))
+	{
+		cout << "Redistribute: cannot import " << pszFilename << endl;
+		PrintResult("Redistribute", false);
+
+		return false;
+	}
+
+	// Steps of 0.5% of the scale from -5% to +5%, each redistributed from the last one and
+	// distributed afresh; the first Redistribute builds the bounds, so it is not timed.
+	const auto pVertices = objLoader.GetVertices();
+	const auto stride = objLoader.GetVertexStride();
+	const auto pIndices = objLoader.GetIndices();
+	const auto numIndices = objLoader.GetNumIndices();
+	const auto numSteps = 21u;
+	Distributor fresh;
+	distributor.Redistribute(pVertices, stride, pIndices, numIndices, density, scale * 0.95f);
+	auto distributeTime = 0.0, redistributeTime = 0.0;
+	auto numDifferentSteps = 0u;
+	for (auto i = 1u; i < numSteps; ++i)
+	{
+		const auto stepScale = scale * (0.95f + 0.005f * i);
+		distributeTime += getBestTime([&]() { fresh.Distribute(pVertices, stride, pIndices, numIndices, density, stepScale); }, 1);
+		redistributeTime += getBestTime([&]() { distributor.Redistribute(pVertices, stride, pIndices, numIndices, density, stepScale); }, 1);
+		const auto numEmitters = fresh.GetNumEmitters();
+		numDifferentSteps += distributor.GetNumEmitters() != numEmitters ||
+			memcmp(distributor.GetEmitters(), fresh.GetEmitters(), sizeof(EmitterInfo) * numEmitters) ? 1 : 0;
+	}
+
+	cout << fixed << setprecision(1) << "Redistribute: " << pszFilename << ", " << numSteps - 1 <<
+		" steps of 0.5% of the scale, " << numDifferentSteps << " different from Distribute, " <<
+		distributeTime * 1000.0 / (numSteps - 1) << " ms per Distribute, " << redistributeTime * 1000.0 / (numSteps - 1) <<
+		" ms per Redistribute on " << ThreadPool::GetNumHardwareThreads() << " threads" << endl;
+	cout.unsetf(ios::floatfield);
+
+	const auto isPassed = numDifferentSteps == 0;
+	PrintResult("Redistribute", isPassed);
+
+	return isPassed;
+}
+
+bool SelfTest::TestMeshletBuilder(const char* pszFilename, float density, float scale)
+{
+	ObjLoader::ImportOptions options;
+	options.NumThreads = 0;
+	ObjLoader objLoader;
+	if (!objLoader.Import(pszFilename, options))
+	{
+		cout << "MeshletBuilder: cannot import " << pszFilename << endl;
+		PrintResult("MeshletBuilder", false);
+
+		return false;
+	}
+
+	const auto pVertices = objLoader.GetVertices();
+	const auto stride = objLoader.GetVertexStride();
+	const auto pIndices = objLoader.GetIndices();
+	const auto numIndices = objLoader.GetNumIndices();
+	const auto numTris = numIndices / 3;
+	const auto numThreads = ThreadPool::GetNumHardwareThreads();
+	MeshletBuilder builder;
+	const auto buildTime = getBestTime([&]()
+	{
+		builder.Build(pVertices, objLoader.GetNumVertices(), stride, pIndices, numIndices,
+			MeshletBuilder::MaxVertices, MeshletBuilder::MaxPrimitives, numThreads);
+	});
+
+	// Every triangle once, in a meshlet within the limits, and every vertex in its bounds
+	const auto getPos = [&](uint32_t i) { return *reinterpret_cast<const XMFLOAT3*>(&pVertices[stride * i]); };
+	const auto toKey = [](uint32_t i0, uint32_t i1, uint32_t i2)
+	{
+		// The rotation that starts with the smallest index keeps the winding.
+		const auto i = (min)(i0, (min)(i1, i2));
+
+		return i == i0 ? XMUINT3(i0, i1, i2) : (i == i1 ? XMUINT3(i1, i2, i0) : XMUINT3(i2, i0, i1));
+	};
+
+	const auto isLess = [](const XMUINT3& a, const XMUINT3& b)
+	{
+		return a.x != b.x ? a.x < b.x : (a.y != b.y ? a.y < b.y : a.z < b.z);
+	};
+
+	vector<XMUINT3> inputTris, meshletTris;
+	inputTris.reserve(numTris);
+	meshletTris.reserve(numTris);
+	for (auto i = 0u; i < numTris; ++i)
+		inputTris.emplace_back(toKey(pIndices[3 * i], pIndices[3 * i + 1], pIndices[3 * i + 2]));
+
+	const auto numMeshlets = builder.GetNumMeshlets();
+	const auto pMeshlets = builder.GetMeshlets();
+	const auto pBounds = builder.GetBounds();
+	const auto pVertexIndices = builder.GetVertexIndices();
+	const auto pPrimIndices = builder.GetPrimitiveIndices();
+	auto isValid = true;
+	auto numVertices = 0.0, numPrims = 0.0, coneAngle = 0.0;
+	auto numCones = 0u;
+	for (auto i = 0u; i < numMeshlets; ++i)
+	{
+		const auto& meshlet = pMeshlets[i];
+		const auto& bounds = pBounds[i];
+		isValid = isValid && meshlet.VertexCount <= MeshletBuilder::MaxVertices &&
+			meshlet.PrimitiveCount <= MeshletBuilder::MaxPrimitives;
+		numVertices += meshlet.VertexCount;
+		numPrims += meshlet.PrimitiveCount;
+
+		const auto pLocal = &pVertexIndices[meshlet.VertexOffset];
+		for (auto j = 0u; j < meshlet.PrimitiveCount; ++j)
+		{
+			const auto tri = pPrimIndices[meshlet.PrimitiveOffset + j];
+			meshletTris.emplace_back(toKey(pLocal[tri & 0x3ff], pLocal[(tri >> 10) & 0x3ff], pLocal[tri >> 20]));
+		}
+
+		const auto eps = 1e-4f * (bounds.Radius + 1.0f);
+		for (auto j = 0u; j < meshlet.VertexCount; ++j)
+		{
+			const auto p = getPos(pLocal[j]);
+			const auto dx = p.x - bounds.Center.x, dy = p.y - bounds.Center.y, dz = p.z - bounds.Center.z;
+			isValid = isValid && sqrt(dx * dx + dy * dy + dz * dz) <= bounds.Radius + eps &&
+				p.x >= bounds.AABBMin.x && p.y >= bounds.AABBMin.y && p.z >= bounds.AABBMin.z &&
+				p.x <= bounds.AABBMax.x && p.y <= bounds.AABBMax.y && p.z <= bounds.AABBMax.z;
+		}
+
+		// The half angle of the normal cone, if its backface test is enabled
+		if (bounds.ConeCutoff < 1.0f)
+		{
+			coneAngle += asin(bounds.ConeCutoff);
+			++numCones;
+		}
+	}
+
+	sort(inputTris.begin(), inputTris.end(), isLess);
+	sort(meshletTris.begin(), meshletTris.end(), isLess);
+	isValid = isValid && inputTris.size() == meshletTris.size() &&
+		equal(inputTris.cbegin(), inputTris.cend(), meshletTris.cbegin(), [](const XMUINT3& a, const XMUINT3& b)
+		{
+			return a.x == b.x && a.y == b.y && a.z == b.z;
+		});
+
+	// The ground test of a triangle in HSDistribute, against the one of a meshlet by its AABB
+	const auto groundY = GROUND_Y / (density * scale);
+	auto numCulledTris = 0u;
+	const auto triTestTime = getBestTime([&]()
+	{
+		numCulledTris = 0;
+		for (auto i = 0u; i < numIndices; i += 3)
+			if (getPos(pIndices[i]).y <= groundY || getPos(pIndices[i + 1]).y <= groundY ||
+				getPos(pIndices[i + 2]).y <= groundY) ++numCulledTris;
+	});
+
+	auto numTrisInCulledMeshlets = 0u;
+	for (auto i = 0u; i < numMeshlets; ++i)
+		if (MeshletBuilder::IsBehindPlane(pBounds[i], MeshletBuilder::float3(0.0f, 1.0f, 0.0f), -groundY))
+			numTrisInCulledMeshlets += pMeshlets[i].PrimitiveCount;
+
+	Distributor distributor;
+	const auto distributeTime = getBestTime([&]()
+	{
+		distributor.Distribute(pVertices, stride, pIndices, numIndices, density, scale);
+	});
+
+	// The ground tests of the triangles in the culled meshlets are all that the pre-pass can save.
+	const auto savedTime = numTris > 0 ? triTestTime * numTrisInCulledMeshlets / numTris : 0.0;
+	cout << fixed << setprecision(2) << "MeshletBuilder: " << pszFilename << ", " << numMeshlets <<
+		" meshlets of " << numTris << " triangles, " << (numMeshlets > 0 ? numVertices / numMeshlets : 0.0) <<
+		" vertices and " << (numMeshlets > 0 ? numPrims / numMeshlets : 0.0) << " triangles per meshlet, " <<
+		numCones << " cones of " << (numCones > 0 ? coneAngle / numCones * 180.0 / XM_PI : 0.0) <<
+		" deg mean half angle, " << buildTime * 1000.0 << " ms per build on " << numThreads << " threads" << endl;
+	cout << "MeshletBuilder: ground culling of " << numCulledTris << " triangles by triangle, " <<
+		numTrisInCulledMeshlets << " by meshlet, saves " << savedTime * 1000.0 << " ms of " <<
+		distributeTime * 1000.0 << " ms per Distribute against " << buildTime * 1000.0 << " ms per build" << endl;
+	cout.unsetf(ios::floatfield);
+
+	PrintResult("MeshletBuilder", isValid);
+
+	return isValid;
+}
+
+bool SelfTest::TestAliasSampler(const char* pszFilename, float density, float scale)
+{
+	ObjLoader::ImportOptions options;
+	options.NumThreads = 0;
+	ObjLoader objLoader;
+	if (!objLoader.Import(pszFilename, options))
+	{
+		cout << "AliasSampler: cannot import " << pszFilename << endl;
+		PrintResult("AliasSampler", false);
+
+		return false;
+	}
+
+	// The samples with the ground culling of the distribution pass
+	const auto pVertices = objLoader.GetVertices();
+	const auto stride = objLoader.GetVertexStride();
+	const auto pIndices = objLoader.GetIndices();
+	const auto numIndices = objLoader.GetNumIndices();
+	const auto groundY = GROUND_Y / (density * scale);
+	const auto numSamples = 1u << 20;
+	AliasSampler aliasSampler;
+	vector<EmitterInfo> samples(numSamples);
+	if (!aliasSampler.Build(pVertices, stride, pIndices, numIndices, groundY))
+	{
+		cout << "AliasSampler: no area above the ground in " << pszFilename << endl;
+		PrintResult("AliasSampler", false);
+
+		return false;
+	}
+	const auto time = getBestTime([&]() { aliasSampler.Sample(samples.data(), numSamples, pIndices, 0); });
+
+	// The bins are the cubic cells on the mesh AABB that hold the centroids of the triangles, each
+	// split into the 4 sub-triangles between the edge midpoints, which have a quarter of the area:
+	// the alias table is checked by the cells, and the barycentric coordinates by the sub-triangles.
+	const auto& aabb = objLoader.GetAABB();
+	const auto extent = (max)(aabb.Max.x - aabb.Min.x, (max)(aabb.Max.y - aabb.Min.y, aabb.Max.z - aabb.Min.z));
+	const auto cellScale = NUM_CELLS / (extent > 0.0f ? extent : 1.0f);
+	const auto getPos = [&](uint32_t i) { return *reinterpret_cast<const XMFLOAT3*>(&pVertices[stride * i]); };
+	const auto getCell = [&](const XMUINT3& tri)
+	{
+		const auto toCell = [&](float x0, float x1, float x2, float minX)
+		{
+			const auto x = (x0 + x1 + x2) / 3.0f;
+
+			return (min)(static_cast<uint32_t>((max)((x - minX) * cellScale, 0.0f)), NUM_CELLS - 1u);
+		};
+
+		const auto v0 = getPos(tri.x), v1 = getPos(tri.y), v2 = getPos(tri.z);
+
+		return (toCell(v0.z, v1.z, v2.z, aabb.Min.z) * NUM_CELLS + toCell(v0.y, v1.y, v2.y, aabb.Min.y)) *
+			NUM_CELLS + toCell(v0.x, v1.x, v2.x, aabb.Min.x);
+	};
+
+	const auto numBins = 4 * NUM_CELLS * NUM_CELLS * NUM_CELLS;
+	vector<double> areas(numBins);
+	for (auto i = 0u; i + 2 < numIndices; i += 3)
+	{
+		const XMUINT3 tri(pIndices[i], pIndices[i + 1], pIndices[i + 2]);
+		const auto v0 = getPos(tri.x), v1 = getPos(tri.y), v2 = getPos(tri.z);
+		if (v0.y <= groundY || v1.y <= groundY || v2.y <= groundY) continue;
+
+		const double e1[] = { v1.x - v0.x, v1.y - v0.y, v1.z - v0.z };
+		const double e2[] = { v2.x - v0.x, v2.y - v0.y, v2.z - v0.z };
+		const auto cx = e1[1] * e2[2] - e1[2] * e2[1];
+		const auto cy = e1[2] * e2[0] - e1[0] * e2[2];
+		const auto cz = e1[0] * e2[1] - e1[1] * e2[0];
+		const auto area = 0.5 * sqrt(cx * cx + cy * cy + cz * cz);
+		const auto cell = getCell(tri);
+		for (auto j = 0u; j < 4; ++j) areas[4 * cell + j] += 0.25 * area;
+	}
+
+	vector<uint32_t> binCounts(numBins);
+	for (const auto& sample : samples)
+	{
+		const auto& b = sample.Barycoord;
+		const auto w = 1.0f - b.x - b.y;
+		const auto subTriangle = b.x >= 0.5f ? 0u : (b.y >= 0.5f ? 1u : (w >= 0.5f ? 2u : 3u));
+		++binCounts[4 * getCell(sample.Indices) + subTriangle];
+	}
+
+	// The chi-square statistic of the samples against the area shares, as a standard score
+	auto totalArea = 0.0;
+	for (const auto& area : areas) totalArea += area;
+	vector<uint32_t> counts;
+	vector<double> expected;
+	auto numZeroAreaSamples = 0u;
+	for (auto i = 0u; i < numBins; ++i)
+	{
+		if (areas[i] > 0.0)
+		{
+			counts.emplace_back(binCounts[i]);
+			expected.emplace_back(areas[i] / totalArea * numSamples);
+		}
+		else numZeroAreaSamples += binCounts[i];
+	}
+	const auto chi2 = chiSquare(counts, expected);
+	const auto numDoFs = static_cast<int>(counts.size()) - 1;
+	const auto z = numDoFs > 0 ? (chi2 - numDoFs) / sqrt(2.0 * numDoFs) : 0.0;
+
+	cout << fixed << setprecision(1) << "AliasSampler: " << pszFilename << ", " << aliasSampler.GetNumEntries() <<
+		" entries, " << numSamples << " samples at " << numSamples / time / 1e6 << " M samples/s, chi-square " <<
+		chi2 << " with " << numDoFs << " DoFs, z = " << setprecision(2) << z << ", " << numZeroAreaSamples <<
+		" samples in bins without area" << endl;
+	cout.unsetf(ios::floatfield);
+
+	const auto isPassed = fabs(z) < 4.0 && numZeroAreaSamples == 0;
+	PrintResult("AliasSampler", isPassed);
+
+	return isPassed;
+}
+
+bool SelfTest::TestPoissonSampler(const char* pszFilename, float density, float scale)
+{
+	ObjLoader objLoader;
+	Distributor distributor;
+	if (!importEmitters(pszFilename, density, scale, objLoader, distributor))
+	{
+		cout << "PoissonSampler: cannot import " << pszFilename << endl;
+		PrintResult("PoissonSampler", false);
+
+		return false;
+	}
+
+	// The spacing and the ground culling of the grid of the distribution pass, in the mesh space
+	const auto pVertices = objLoader.GetVertices();
+	const auto stride = objLoader.GetVertexStride();
+	const auto pIndices = objLoader.GetIndices();
+	const auto numIndices = objLoader.GetNumIndices();
+	const auto spacing = 1.0f / (density * scale);
+	const auto groundY = GROUND_Y * spacing;
+	const auto getPositions = [&](const EmitterInfo* pEmitters, uint32_t numEmitters)
+	{
+		vector<XMFLOAT3> positions(numEmitters);
+		for (auto i = 0u; i < numEmitters; ++i) positions[i] = getPosition(pVertices, stride, pEmitters[i]);
+
+		return positions;
+	};
+
+	// The samples on 1 and 4 threads
+	PoissonSampler samplers[2];
+	const uint32_t numsThreads[] = { 1, 4 };
+	double times[2];
+	for (uint8_t k = 0; k < 2; ++k)
+		times[k] = getBestTime([&]() { samplers[k].Sample(pVertices, stride, pIndices, numIndices, spacing, groundY,
+			8.0f, 0, numsThreads[k]); }, 1);
+	const auto numSamples = samplers[0].GetNumEmitters();
+	const auto isSame = numSamples > 0 && samplers[1].GetNumEmitters() == numSamples &&
+		!memcmp(samplers[0].GetEmitters(), samplers[1].GetEmitters(), sizeof(EmitterInfo) * numSamples);
+
+	// The samples at 4 times the spacing, pair by pair, and the ones at the spacing, by the cells
+	// of the spacing, which hold every closer pair
+	PoissonSampler coarseSampler;
+	const auto coarseSpacing = 4.0f * spacing;
+	coarseSampler.Sample(pVertices, stride, pIndices, numIndices, coarseSpacing, groundY, 8.0f, 0, 4);
+	const auto coarsePositions = getPositions(coarseSampler.GetEmitters(), coarseSampler.GetNumEmitters());
+	const auto numCoarseSamples = static_cast<uint32_t>(coarsePositions.size());
+	auto numCloseCoarsePairs = 0u;
+	for (auto i = 0u; i < numCoarseSamples; ++i)
+		for (auto j = i + 1; j < numCoarseSamples; ++j)
+			numCloseCoarsePairs += distanceSq(coarsePositions[i], coarsePositions[j]) < coarseSpacing * coarseSpacing ? 1 : 0;
+
+	const auto positions = getPositions(samplers[0].GetEmitters(), numSamples);
+	const PointGrid grid(positions, spacing);
+	auto numCloseSamples = 0u;
+	for (auto i = 0u; i < numSamples; ++i)
+		numCloseSamples += grid.GetNearestDistanceSq(positions[i], i) < spacing * spacing ? 1 : 0;
+
+	// The distances of area-uniform points on the mesh to the nearest samples and to the nearest
+	// dense emitters, in the spacing
+	const auto numProbes = 1u << 18;
+	AliasSampler aliasSampler;
+	aliasSampler.Build(pVertices, stride, pIndices, numIndices, groundY);
+	vector<EmitterInfo> probes(numProbes);
+	aliasSampler.Sample(probes.data(), numProbes, pIndices, 1);
+	const auto probePositions = getPositions(probes.data(), numProbes);
+	const auto densePositions = getPositions(distributor.GetEmitters(), distributor.GetNumEmitters());
+	const PointGrid denseGrid(densePositions, spacing);
+	vector<float> distances[2];
+	for (auto& d : distances) d.resize(numProbes);
+	for (auto i = 0u; i < numProbes; ++i)
+	{
+		distances[0][i] = (min)(sqrt(grid.GetNearestDistanceSq(probePositions[i])) / spacing, 1.0f);
+		distances[1][i] = (min)(sqrt(denseGrid.GetNearestDistanceSq(probePositions[i])) / spacing, 1.0f);
+	}
+	const XMFLOAT3 coverages[] = { getStatistics(distances[0]), getStatistics(distances[1]) };
+	uint32_t numsUncovered[2];
+	for (uint8_t k = 0; k < 2; ++k)
+		numsUncovered[k] = static_cast<uint32_t>(count(distances[k].cbegin(), distances[k].cend(), 1.0f));
+
+	cout << fixed << setprecision(2) << "PoissonSampler: " << numSamples << " samples against " <<
+		distributor.GetNumEmitters() << " dense emitters, " << numSamples / times[0] / 1e6 << " M samples/s on 1 thread, " <<
+		numSamples / times[1] / 1e6 << " M samples/s on 4 threads, " << (isSame ? "same" : "DIFFERENT") << endl;
+	cout << "PoissonSampler: " << numCloseCoarsePairs << " pairs of " << numCoarseSamples <<
+		" samples at 4 times the spacing and " << numCloseSamples << " samples closer than the spacing" << endl;
+	cout << setprecision(3) << "PoissonSampler: mean/max distance of " << numProbes <<
+		" points to the samples " << coverages[0].x << "/" << coverages[0].z << ", " << numsUncovered[0] <<
+		" beyond the spacing, to the dense emitters " << coverages[1].x << "/" << coverages[1].z << ", " <<
+		numsUncovered[1] << " beyond the spacing" << endl;
+	cout.unsetf(ios::floatfield);
+
+	// The samples are about 90% of a saturated dart throwing, so they leave little of the mesh
+	// farther than the spacing from them.
+	const auto isPassed = isSame && numCloseCoarsePairs == 0 && numCloseSamples == 0 && numsUncovered[0] < numProbes / 100;
+	PrintResult("PoissonSampler", isPassed);
+
+	return isPassed;
+}
+
+bool SelfTest::TestCPUEmitter(const char* pszFilename, float density, float scale)
+{
+	ObjLoader objLoader;
+	Distributor distributor;
+	if (!importEmitters(pszFilename, density, scale, objLoader, distributor))
+	{
+		cout << "CPUEmitter: cannot import " << pszFilename << endl;
+		PrintResult("CPUEmitter", false);
+
+		return false;
+	}
+
+	ThreadPool threadPool;
+	CPUEmitter emitter;
+	const XMFLOAT3X4 worlds[] = { getWorld(0.0f, scale), getWorld(TIME_STEP, scale) };
+	const auto emit = [&](ParticleStorage& storage, const uint32_t* pSlots, uint32_t numSlots)
+	{
+		emitter.UpdateFrame(threadPool, worlds[1], TIME_STEP, 1);
+		emitter.Emit(threadPool, storage.GetArrays(), pSlots, numSlots);
+	};
+
+	// Parity of the tiers with the scalar reference, over a window that wraps around the slots,
+	// so a batch of the words falls back to Pcg4d
+	const auto numParityParticles = (1u << 16) + 13;
+	vector<uint32_t> slots(numParityParticles);
+	for (auto i = 0u; i < numParityParticles; ++i) slots[i] = (i + numParityParticles - 100) % numParityParticles;
+
+	ParticleStorage reference, particles;
+	auto isSame = true;
+	cout << "CPUEmitter:";
+	forEachSIMDLevel([&](SIMDLevel level)
+	{
+		auto& storage = level == SIMDLevel::SCALAR ? reference : particles;
+		storage.Resize(numParityParticles);
+		emitter.Init(objLoader.GetVertices(), objLoader.GetVertexStride(), objLoader.GetNumVertices(),
+			distributor.GetEmitters(), distributor.GetNumEmitters());
+		emitter.UpdateFrame(threadPool, worlds[0], TIME_STEP, 0);
+		emit(storage, slots.data(), numParityParticles);
+		const auto isLevelSame = level == SIMDLevel::SCALAR || storage.IsSame(reference);
+		cout << " " << getSIMDLevelName(level) << (isLevelSame ? " same" : " DIFFERENT") << ",";
+		isSame = isSame && isLevelSame;
+	});
+	cout << " as the scalar reference" << endl;
+
+	// The differences from the transform per particle of CSEmit, by rounding only, relative to the
+	// largest position and velocity; the lifetimes are the same.
+	ParticleStorage csEmitParticles;
+	csEmitParticles.Resize(numParityParticles);
+	emitLikeCSEmit(threadPool, csEmitParticles.GetArrays(), slots.data(), numParityParticles,
+		objLoader, distributor, worlds[1], worlds[0], 1);
+	auto maxPos = 0.0f, maxVelocity = 0.0f, maxPosError = 0.0f, maxVelocityError = 0.0f;
+	for (uint8_t j = 0; j < 3; ++j)
+	{
+		for (auto i = 0u; i < numParityParticles; ++i)
+		{
+			const auto& pos = csEmitParticles.Arrays[j];
+			const auto& velocity = csEmitParticles.Arrays[j + 3];
+			maxPos = (max)(maxPos, fabs(pos[i]));
+			maxVelocity = (max)(maxVelocity, fabs(velocity[i]));
+			maxPosError = (max)(maxPosError, fabs(reference.Arrays[j][i] - pos[i]));
+			maxVelocityError = (max)(maxVelocityError, fabs(reference.Arrays[j + 3][i] - velocity[i]));
+		}
+	}
+	const auto posError = maxPosError / maxPos, velocityError = maxVelocityError / maxVelocity;
+	const auto isLifeTimeSame = !memcmp(reference.Arrays[6].data(), csEmitParticles.Arrays[6].data(),
+		sizeof(float) * numParityParticles);
+	cout << scientific << setprecision(1) << "CPUEmitter: relative to CSEmit, position error " << posError <<
+		", velocity error " << velocityError << ", lifetimes " << (isLifeTimeSame ? "same" : "DIFFERENT") << endl;
+
+	// Throughputs of the emission of a window, with the transform of the vertices once per frame,
+	// and with the transforms per particle
+	cout << fixed << "CPUEmitter: " << objLoader.GetNumVertices() << " vertices, M particles/s on " <<
+		threadPool.GetNumThreads() << " threads, batched vs per particle";
+	for (auto n = 16u; n <= 22u; n += 2)
+	{
+		const auto numParticles = 1u << n;
+		slots.resize(numParticles);
+		for (auto i = 0u; i < numParticles; ++i) slots[i] = i;
+		particles.Resize(numParticles);
+		const auto batchedTime = getBestTime([&]() { emit(particles, slots.data(), numParticles); });
+		const auto perParticleTime = getBestTime([&]()
+		{
+			emitLikeCSEmit(threadPool, particles.GetArrays(), slots.data(), numParticles,
+				objLoader, distributor, worlds[1], worlds[0], 1);
+		});
+		cout << (n > 16 ? ", 2^" : ": 2^") << n << " " << numParticles / batchedTime / 1e6 << " vs " <<
+			numParticles / perParticleTime / 1e6;
+	}
+	cout << endl;
+	cout.unsetf(ios::floatfield);
+
+	const auto isPassed = isSame && posError < 1e-5f && velocityError < 1e-3f && isLifeTimeSame;
+	PrintResult("CPUEmitter", isPassed);
+
+	return isPassed;
+}
+
+bool SelfTest::TestEmitterOrder(const char* pszFilename, float density, float scale)
+{
+	ObjLoader objLoader;
+	Distributor distributor;
+	if (!importEmitters(pszFilename, density, scale, objLoader, distributor))
+	{
+		cout << "Emitter order: cannot import " << pszFilename << endl;
+		PrintResult("Emitter order", false);
+
+		return false;
+	}
+
+	// The orders of the emitters and the vertices: shuffled both, as the appends of the distribution
+	// pass at worst; of the Distributor; and sorted by EmitterSorter.
+	const auto stride = objLoader.GetVertexStride();
+	const auto numVertices = objLoader.GetNumVertices();
+	const auto numEmitters = distributor.GetNumEmitters();
+	vector<uint8_t> vertices[3];
+	vector<EmitterInfo> emitters[3];
+	for (uint8_t i = 0; i < 3; ++i)
+	{
+		vertices[i].assign(objLoader.GetVertices(), objLoader.GetVertices() + stride * numVertices);
+		emitters[i].assign(distributor.GetEmitters(), distributor.GetEmitters() + numEmitters);
+	}
+
+	vector<XMUINT4> randoms((max)(numEmitters, numVertices));
+	RandomBatch::Generate(randoms.data(), static_cast<uint32_t>(randoms.size()), XMUINT4(0, 0, 2, 0));
+	vector<uint32_t> vertexIds(numVertices);
+	for (auto i = 0u; i < numVertices; ++i) vertexIds[i] = i;
+	for (auto i = numVertices; i > 1; --i) swap(vertexIds[i - 1], vertexIds[SharedRandom::RandomIndex(randoms[i - 1].x, i)]);
+	for (auto i = numEmitters; i > 1; --i) swap(emitters[0][i - 1], emitters[0][SharedRandom::RandomIndex(randoms[i - 1].y, i)]);
+	for (auto i = 0u; i < numVertices; ++i)
+		memcpy(&vertices[0][stride * vertexIds[i]], objLoader.GetVertices() + stride * i, stride);
+	for (auto& emitter : emitters[0])
+		emitter.Indices = XMUINT3(vertexIds[emitter.Indices.x], vertexIds[emitter.Indices.y], vertexIds[emitter.Indices.z]);
+
+	vector<uint32_t> indices(objLoader.GetIndices(), objLoader.GetIndices() + objLoader.GetNumIndices());
+	EmitterSorter::SortByMorton(emitters[2].data(), numEmitters, vertices[2].data(), stride);
+	EmitterSorter::ReorderVertices(emitters[2].data(), numEmitters, vertices[2].data(), stride, numVertices,
+		indices.data(), static_cast<uint32_t>(indices.size()));
+
+	// The orders hold the same emitters.
+	const auto getPositions = [&](uint8_t i)
+	{
+		vector<XMFLOAT3> positions(numEmitters);
+		for (auto j = 0u; j < numEmitters; ++j) positions[j] = getPosition(vertices[i].data(), stride, emitters[i][j]);
+		sort(positions.begin(), positions.end(), [](const XMFLOAT3& a, const XMFLOAT3& b)
+		{
+			return a.x != b.x ? a.x < b.x : (a.y != b.y ? a.y < b.y : a.z < b.z);
+		});
+
+		return positions;
+	};
+
+	const auto positions = getPositions(1);
+	auto isSame = true;
+	for (uint8_t i = 0; i < 3; i += 2)
+	{
+		const auto orderPositions = getPositions(i);
+		isSame = isSame && !memcmp(orderPositions.data(), positions.data(), sizeof(XMFLOAT3) * numEmitters);
+	}
+
+	// Throughputs of CPUEmitter::Emit over windows of the slots
+	ThreadPool threadPool;
+	const XMFLOAT3X4 worlds[] = { getWorld(0.0f, scale), getWorld(TIME_STEP, scale) };
+	const char* orderNames[] = { "shuffled", "distributed", "sorted" };
+	ParticleStorage particles;
+	vector<uint32_t> slots;
+	cout << fixed << setprecision(1) << "Emitter order: " << pszFilename << ", " << numEmitters << " emitters, " <<
+		numVertices << " vertices, M particles/s on " << threadPool.GetNumThreads() << " threads";
+	for (auto n = 16u; n <= 22u; n += 3)
+	{
+		const auto numParticles = 1u << n;
+		slots.resize(numParticles);
+		for (auto i = 0u; i < numParticles; ++i) slots[i] = i;
+		particles.Resize(numParticles);
+		cout << (n > 16 ? ", 2^" : ": 2^") << n;
+		for (uint8_t i = 0; i < 3; ++i)
+		{
+			CPUEmitter emitter;
+			emitter.Init(vertices[i].data(), stride, numVertices, emitters[i].data(), numEmitters);
+			emitter.UpdateFrame(threadPool, worlds[0], TIME_STEP, 0);
+			const auto time = getBestTime([&]()
+			{
+				emitter.UpdateFrame(threadPool, worlds[1], TIME_STEP, 1);
+				emitter.Emit(threadPool, particles.GetArrays(), slots.data(), numParticles);
+			});
+			cout << (i > 0 ? " vs " : " ") << orderNames[i] << " " << numParticles / time / 1e6;
+		}
+	}
+	cout << endl;
+	cout.unsetf(ios::floatfield);
+
+	PrintResult("Emitter order", isSame);
+
+	return isSame;
+}
+
+bool SelfTest::TestParticleIntegrator()
+{
+	// Random states, of which a third are dead and a fifth are on or under the ground
+	const auto numParticles = (1u << 20) + 13;
+	vector<XMUINT4> randoms(2 * numParticles);
+	RandomBatch::Generate(randoms.data(), 2 * numParticles, XMUINT4(0, 0, 1, 0));
+	ParticleStorage initial, reference, particles;
+	initial.Resize(numParticles);
+	for (auto i = 0u; i < numParticles; ++i)
+	{
+		const uint32_t words[] =
+		{
+			randoms[2 * i].x, randoms[2 * i].y, randoms[2 * i].z, randoms[2 * i].w,
+			randoms[2 * i + 1].x, randoms[2 * i + 1].y, randoms[2 * i + 1].z
+		};
+		for (uint8_t j = 0; j < 3; ++j)
+		{
+			initial.Arrays[j][i] = SharedRandom::RandomUnorm(words[j]) * 4.0f - (j == 1 ? 0.8f : 2.0f);
+			initial.Arrays[j + 3][i] = SharedRandom::RandomUnorm(words[j + 3]) * 4.0f - 2.0f;
+		}
+		initial.Arrays[6][i] = SharedRandom::RandomUnorm(words[6]) * 1.5f - 0.5f;
+	}
+
+	// Parity of the tiers with the scalar reference over a few steps, with an acceleration
+	ThreadPool threadPool;
+	const XMFLOAT3 acceleration(0.5f, -0.98f, 0.25f);
+	auto isSame = true;
+	cout << "ParticleIntegrator:";
+	forEachSIMDLevel([&](SIMDLevel level)
+	{
+		auto& storage = level == SIMDLevel::SCALAR ? reference : particles;
+		storage = initial;
+		for (uint8_t k = 0; k < 4; ++k)
+			ParticleIntegrator::Integrate(threadPool, storage.GetArrays(), numParticles, TIME_STEP, acceleration);
+		const auto isLevelSame = level == SIMDLevel::SCALAR || storage.IsSame(reference);
+		cout << " " << getSIMDLevelName(level) << (isLevelSame ? " same" : " DIFFERENT") << ",";
+		isSame = isSame && isLevelSame;
+	});
+	cout << " as the scalar reference" << endl;
+
+	// A step leaves the dead particles untouched, and takes a time step off the lifetimes of the
+	// live ones.
+	particles = initial;
+	ParticleIntegrator::Integrate(threadPool, particles.GetArrays(), numParticles, TIME_STEP, acceleration);
+	auto numWrongParticles = 0u;
+	for (auto i = 0u; i < numParticles; ++i)
+	{
+		auto isRight = true;
+		if (initial.Arrays[6][i] > 0.0f) isRight = particles.Arrays[6][i] == initial.Arrays[6][i] - TIME_STEP;
+		else for (uint8_t j = 0; j < 7; ++j) isRight = isRight && !memcmp(&particles.Arrays[j][i], &initial.Arrays[j][i], sizeof(float));
+		numWrongParticles += isRight ? 0 : 1;
+	}
+	cout << "ParticleIntegrator: " << numWrongParticles << " particles break the step invariants" << endl;
+
+	// Throughputs of the tiers; a live particle reads and writes its 7 floats.
+	const auto numBenchParticles = 1u << 22;
+	const auto bytesPerParticle = 2 * 7 * sizeof(float);
+	particles.Resize(numBenchParticles);
+	for (auto i = 0u; i < numBenchParticles; ++i) particles.Arrays[6][i] = initial.Arrays[6][i % numParticles];
+	cout << fixed << setprecision(1) << "ParticleIntegrator: 2^22 particles, " << bytesPerParticle <<
+		" bytes per particle, M particles/s (GB/s) on " << threadPool.GetNumThreads() << " threads";
+	forEachSIMDLevel([&](SIMDLevel level)
+	{
+		const auto time = getBestTime([&]()
+		{
+			ParticleIntegrator::Integrate(threadPool, particles.GetArrays(), numBenchParticles, 0.0001f);
+		});
+		cout << (level > SIMDLevel::SCALAR ? ", " : ": ") << getSIMDLevelName(level) << " " <<
+			numBenchParticles / time / 1e6 << " (" << numBenchParticles * bytesPerParticle / time / 1e9 << ")";
+	});
+	cout << endl;
+	cout.unsetf(ios::floatfield);
+
+	const auto isPassed = isSame && numWrongParticles == 0;
+	PrintResult("ParticleIntegrator", isPassed);
+
+	return isPassed;
+}
+
+bool SelfTest::TestParticlePool()
+{
+	// Concurrent emissions take every slot exactly once.
+	const auto capacity = (1u << 18) + 5;
+	ParticlePool pool;
+	pool.Init(capacity);
+	vector<atomic_uint32_t> numsTaken(capacity);
+	for (auto& numTaken : numsTaken) numTaken = 0;
+	ThreadPool threadPool(4);
+	threadPool.Execute(64, [&](uint32_t)
+	{
+		uint32_t indices[100];
+		for (auto n = pool.Emit(100, indices); n > 0; n = pool.Emit(100, indices))
+			for (auto j = 0u; j < n; ++j) ++numsTaken[indices[j]];
+	});
+	auto isRight = pool.GetNumAlive() == capacity && pool.GetNumDead() == 0 &&
+		all_of(numsTaken.cbegin(), numsTaken.cend(), [](const atomic_uint32_t& numTaken) { return numTaken == 1; });
+
+	// Frames of updates that kill a quarter of the particles, and of emissions into the dead slots,
+	// on 1 and 4 threads. The alive list holds the live slots in ascending order after an update,
+	// the emission takes only dead slots, and the lists do not depend on the threads.
+	ParticlePool pools[2];
+	ThreadPool singleThreadPool(1);
+	ThreadPool* const pThreadPools[] = { &singleThreadPool, &threadPool };
+	vector<uint32_t> emitted[2];
+	vector<uint8_t> isAlive(capacity, 0);
+	auto isSame = true;
+	for (auto& p : pools) p.Init(capacity);
+	for (auto& e : emitted) e.resize(capacity);
+	for (auto frame = 0u; frame < 16; ++frame)
+	{
+		for (uint8_t k = 0; k < 2; ++k)
+		{
+			pools[k].Update(*pThreadPools[k], [frame](const uint32_t* pIndices, uint32_t numIndices, uint8_t* pAlive)
+			{
+				for (auto j = 0u; j < numIndices; ++j)
+					pAlive[j] = (SharedRandom::Pcg4d(XMUINT4(pIndices[j], frame, 2, 0)).x & 3) != 0;
+			});
+		}
+		for (auto i = 0u; i < capacity; ++i)
+			isAlive[i] = isAlive[i] && (SharedRandom::Pcg4d(XMUINT4(i, frame, 2, 0)).x & 3) != 0;
+
+		const auto numAlive = pools[0].GetNumAlive();
+		const auto pAlive = pools[0].GetAliveIndices();
+		isRight = isRight && numAlive + pools[0].GetNumDead() == capacity &&
+			numAlive == static_cast<uint32_t>(count(isAlive.cbegin(), isAlive.cend(), 1)) &&
+			all_of(pAlive, pAlive + numAlive, [&](uint32_t i) { return isAlive[i] != 0; }) &&
+			is_sorted(pAlive, pAlive + numAlive) && adjacent_find(pAlive, pAlive + numAlive) == pAlive + numAlive;
+		isSame = isSame && numAlive == pools[1].GetNumAlive() &&
+			!memcmp(pAlive, pools[1].GetAliveIndices(), sizeof(uint32_t) * numAlive);
+
+		const auto numEmit = capacity / 3 + frame * 1001;
+		const auto numEmitted = pools[0].Emit(numEmit, emitted[0].data());
+		isSame = isSame && pools[1].Emit(numEmit, emitted[1].data()) == numEmitted &&
+			!memcmp(emitted[0].data(), emitted[1].data(), sizeof(uint32_t) * numEmitted);
+		isRight = isRight && numEmitted == (min)(numEmit, capacity - numAlive);
+		for (auto j = 0u; j < numEmitted; ++j)
+		{
+			isRight = isRight && !isAlive[emitted[0][j]];
+			isAlive[emitted[0][j]] = 1;
+		}
+	}
+	cout << "ParticlePool: " << capacity << " slots, concurrent emission and 16 frames of updates " <<
+		(isRight ? "right" : "WRONG") << ", 1 and 4 threads " << (isSame ? "same" : "DIFFERENT") << endl;
+
+	// The frames at each alive ratio, each refilled to the ratio, by the fused scan of the update and
+	// the emission, by ParticleIntegrator and an emission scan like CPUSimulation, and by the pool;
+	// the integration of the fused scan and of the pool is the same, without the ground response.
+	const auto emit = [](const ParticleArrays& particles, uint32_t slot, uint32_t frame)
+	{
+		for (uint8_t j = 0; j < 3; ++j)
+		{
+			particles.pPos[j][slot] = 0.0f;
+			particles.pVelocity[j][slot] = 1.0f;
+		}
+		particles.pLifeTime[slot] = TIME_STEP * (((slot + frame) * 2654435761u >> 24) % (2 * LIFE_FRAMES) + 1);
+	};
+	const auto integrate = [](const ParticleArrays& particles, uint32_t slot)
+	{
+		for (uint8_t j = 0; j < 3; ++j) particles.pPos[j][slot] += particles.pVelocity[j][slot] * TIME_STEP;
+		particles.pLifeTime[slot] -= TIME_STEP;
+
+		return particles.pLifeTime[slot] > 0.0f;
+	};
+
+	cout << fixed << setprecision(0) << "ParticlePool: us per frame on 1 thread, fused scan/ParticleIntegrator and "
+		"emission scan/pool";
+	ParticleStorage storages[3];
+	vector<uint32_t> indices;
+	for (auto n = 16u; n <= 20u; n += 4)
+	{
+		const auto numParticles = 1u << n;
+		indices.resize(numParticles);
+		for (const auto ratio : { 0.1, 0.5, 0.9, 0.99 })
+		{
+			const auto target = static_cast<uint32_t>(numParticles * ratio);
+			for (auto& storage : storages) storage.Resize(numParticles);
+			const ParticleArrays particles[] = { storages[0].GetArrays(), storages[1].GetArrays(), storages[2].GetArrays() };
+			uint32_t numsAlive[] = { 0, 0 };
+			uint32_t frames[] = { 0, 0, 0 };
+			pool.Init(numParticles);
+
+			const function<void()> runFrames[] =
+			{
+				[&]()
+				{
+					auto numEmit = target - (min)(numsAlive[0], target);
+					auto numAlive = 0u;
+					for (auto i = 0u; i < numParticles; ++i)
+					{
+						if (particles[0].pLifeTime[i] > 0.0f) numAlive += integrate(particles[0], i) ? 1 : 0;
+						else if (numEmit > 0)
+						{
+							emit(particles[0], i, frames[0]);
+							--numEmit;
+							++numAlive;
+						}
+					}
+					numsAlive[0] = numAlive;
+					++frames[0];
+				},
+				[&]()
+				{
+					ParticleIntegrator::Integrate(singleThreadPool, particles[1], numParticles, TIME_STEP);
+					auto numEmit = target - (min)(numsAlive[1], target);
+					auto numAlive = 0u;
+					for (auto i = 0u; i < numParticles; ++i)
+					{
+						if (particles[1].pLifeTime[i] > 0.0f) ++numAlive;
+						else if (numEmit > 0)
+						{
+							emit(particles[1], i, frames[1]);
+							--numEmit;
+							++numAlive;
+						}
+					}
+					numsAlive[1] = numAlive;
+					++frames[1];
+				},
+				[&]()
+				{
+					pool.Update(singleThreadPool, [&](const uint32_t* pIndices, uint32_t numIndices, uint8_t* pAlive)
+					{
+						for (auto j = 0u; j < numIndices; ++j) pAlive[j] = integrate(particles[2], pIndices[j]);
+					});
+					const auto numAlive = pool.GetNumAlive();
+					const auto numEmitted = pool.Emit(target - (min)(numAlive, target), indices.data());
+					for (auto j = 0u; j < numEmitted; ++j) emit(particles[2], indices[j], frames[2]);
+					++frames[2];
+				}
+			};
+
+			cout << (n > 16 || ratio > 0.1 ? ", 2^" : ": 2^") << n << " at " << ratio * 100.0 << "%";
+			for (const auto& runFrame : runFrames)
+			{
+				for (auto i = 0u; i < 2 * LIFE_FRAMES; ++i) runFrame();
+				const auto time = getBestTime([&]() { for (auto i = 0u; i < 8; ++i) runFrame(); });
+				cout << (&runFrame > runFrames ? "/" : " ") << time / 8.0 * 1e6;
+			}
+		}
+	}
+	cout << endl;
+	cout.unsetf(ios::floatfield);
+
+	const auto isPassed = isRight && isSame;
+	PrintResult("ParticlePool", isPassed);
+
+	return isPassed;
+}
+
+bool SelfTest::TestCPUSimulation(const char* pszFilename, float density, float scale)
+{
+	ObjLoader objLoader;
+	Distributor distributor;
+	if (!importEmitters(pszFilename, density, scale, objLoader, distributor))
+	{
+		cout << "CPUSimulation: cannot import " << pszFilename << endl;
+		PrintResult("CPUSimulation", false);
+
+		return false;
+	}
+
+	// The runs of the scalar reference on 1 thread, and of the supported tier on 1 and 4 threads
+	const auto numParticles = 1u << 18;
+	const auto maxLevel = GetSIMDLevel();
+	const struct
+	{
+		SIMDLevel Level;
+		uint32_t NumThreads;
+	} runs[] = { { SIMDLevel::SCALAR, 1 }, { maxLevel, 1 }, { maxLevel, 4 } };
+
+	ParticleStorage reference, particles;
+	auto numEmitted = 0u, numAlive = 0u;
+	auto isSame = true;
+	cout << "CPUSimulation:";
+	for (const auto& run : runs)
+	{
+		LimitSIMDLevel(run.Level);
+		CPUSimulation simulation(run.NumThreads);
+		simulation.Init(numParticles, objLoader.GetVertices(), objLoader.GetVertexStride(),
+			objLoader.GetNumVertices(), distributor.GetEmitters(), distributor.GetNumEmitters());
+		numEmitted = 0;
+		for (auto i = 0u; i < NUM_FRAMES; ++i)
+			numEmitted += simulation.UpdateFrame(getWorld(TIME_STEP * i, scale), TIME_STEP);
+		LimitSIMDLevel(SIMDLevel::AVX512);
+
+		auto& storage = &run == runs ? reference : particles;
+		storage.Assign(simulation.GetParticles(), numParticles);
+		const auto isRunSame = &run == runs || storage.IsSame(reference);
+		cout << " " << getSIMDLevelName(run.Level) << " on " << run.NumThreads << (run.NumThreads > 1 ? " threads" : " thread") <<
+			(&run == runs ? "," : (isRunSame ? " same," : " DIFFERENT,"));
+		isSame = isSame && isRunSame;
+	}
+	numAlive = static_cast<uint32_t>(count_if(particles.Arrays[6].cbegin(), particles.Arrays[6].cend(),
+		[](float lifeTime) { return lifeTime > 0.0f; }));
+	cout << " after " << NUM_FRAMES << " frames, " << numEmitted << " emitted, " << numAlive << " of " <<
+		numParticles << " alive" << endl;
+
+	const auto isPassed = isSame && numEmitted > 0 && numAlive > 0;
+	PrintResult("CPUSimulation", isPassed);
+
+	return isPassed;
+}
+
+bool SelfTest::TestEmissionBudget(const char* pszFilename, float density, float scale)
+{
+	ObjLoader objLoader;
+	Distributor distributor;
+	if (!importEmitters(pszFilename, density, scale, objLoader, distributor))
+	{
+		cout << "EmissionBudget: cannot import " << pszFilename << endl;
+		PrintResult("EmissionBudget", false);
+
+		return false;
+	}
+
+	// Runs of 10 seconds at 60 fps with a hitch of a quarter of a second, from the empty store, with
+	// the default budget of the app, and with the re-emission of every dead particle at once that the
+	// budget replaced. The runs are deterministic, so the time of a frame is the best of its runs.
+	const auto numParticles = 1u << 18;
+	const auto numFrames = 600u;
+	const auto hitchFrame = 300u;
+	vector<float> numsEmitted[2], frameTimes[2];
+	for (uint8_t k = 0; k < 2; ++k)
+	{
+		numsEmitted[k].resize(numFrames);
+		frameTimes[k].assign(numFrames, FLT_MAX);
+		for (auto n = 0u; n < NUM_RUNS; ++n)
+		{
+			CPUSimulation simulation;
+			simulation.Init(numParticles, objLoader.GetVertices(), objLoader.GetVertexStride(),
+				objLoader.GetNumVertices(), distributor.GetEmitters(), distributor.GetNumEmitters());
+			if (k > 0) simulation.SetEmissionRate(FLT_MAX, numParticles);
+
+			auto time = 0.0f;
+			for (auto i = 0u; i < numFrames; ++i)
+			{
+				const auto timeStep = i == hitchFrame ? 0.25f : TIME_STEP;
+				time += timeStep;
+				const auto start = chrono::steady_clock::now();
+				numsEmitted[k][i] = static_cast<float>(simulation.UpdateFrame(getWorld(time, scale), timeStep));
+				const chrono::duration<float, milli> frameTime = chrono::steady_clock::now() - start;
+				frameTimes[k][i] = (min)(frameTimes[k][i], frameTime.count());
+			}
+		}
+	}
+
+	// The default budget of CPUSimulation and Emitter
+	const auto cap = numParticles / 16;
+	const auto maxPerFrame = static_cast<uint32_t>(ceil(numParticles / (FULL_LIFE + 1.0f) * TIME_STEP));
+	auto numOverBudget = 0u;
+	for (auto i = 0u; i < numFrames; ++i)
+		numOverBudget += numsEmitted[0][i] > (i == hitchFrame ? cap : maxPerFrame) ? 1 : 0;
+
+	XMFLOAT3 emitted[2], times[2];
+	for (uint8_t k = 0; k < 2; ++k)
+	{
+		emitted[k] = getStatistics(numsEmitted[k]);
+		times[k] = getStatistics(frameTimes[k]);
+	}
+
+	const char* names[] = { "budgeted", "unbudgeted" };
+	cout << fixed << setprecision(1) << "EmissionBudget: " << numParticles << " particles, " << numFrames <<
+		" frames, mean/std dev/max";
+	for (uint8_t k = 0; k < 2; ++k)
+		cout << (k > 0 ? ", " : ": ") << names[k] << " " << emitted[k].x << "/" << emitted[k].y << "/" << emitted[k].z <<
+		" emitted, " << setprecision(2) << times[k].x << "/" << times[k].y << "/" << times[k].z << " ms" << setprecision(1);
+	cout << endl;
+	cout << "EmissionBudget: " << numOverBudget << " frames over the budget of " << maxPerFrame << " per frame, " <<
+		static_cast<uint32_t>(numsEmitted[0][hitchFrame]) << " and " <<
+		static_cast<uint32_t>(numsEmitted[0][hitchFrame + 1]) << " at and after the hitch with the cap of " <<
+		cap << endl;
+	cout.unsetf(ios::floatfield);
+
+	// The budget bounds every frame, the hitch by the cap, and drops the particles over the cap
+	// instead of carrying them, so its counts vary less than the ones of the re-emission. The frame
+	// times depend on the machine and its load, so they are only reported.
+	const auto isPassed = numOverBudget == 0 && emitted[0].y < emitted[1].y;
+	PrintResult("EmissionBudget", isPassed);
+
+	return isPassed;
+}
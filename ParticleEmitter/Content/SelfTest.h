@@ -0,0 +1,128 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include "Core/XUSG.h"
+
+struct EmitterInfo;
+
+// Headless tests and benchmarks of the CPU code, run by the -selftest option before the GPU
+// ones of the asset loading; the window is never shown, and the app quits with the exit code 0
+// if every test passed (start /wait from a console to get it). The results are printed to the
+// standard output. The meshes are the ones of Bin/Assets, relative to the working directory.
+class SelfTest
+{
+public:
+	// Runs all the CPU tests, and returns whether they all passed.
+	static bool Run();
+
+	static void PrintResult(const char* pszName, bool isPassed);
+
+	// Checks the batches of RandomBatch at each SIMD tier against Pcg4d, runs SmallCrush-class
+	// statistical tests on the streams that the emission draws, and reports the throughputs
+	// against the rand() LCG that Pcg4d replaced.
+	static bool TestRandom();
+
+	// Checks the single-pass parser of ObjLoader against a parse by the CRT, line by line, the
+	// welding of the vertices against the splitting it replaced, the vertex cache optimization by
+	// its ACMR, the SIMD tiers of the normals and the AABB against the scalar reference, and the
+	// multi-threaded import against the single-threaded one, and reports the throughputs.
+	static bool TestObjLoader(const char* pszFilename);
+
+	// Checks and benchmarks the SIMD tiers of the normals and the AABB of ObjLoader on a sphere
+	// of 1M triangles.
+	static bool TestGeometryKernels();
+
+	// Simplifies the mesh at several targets, checks that MeshSimplifier does not depend on the
+	// threads, keeps the AABB and stops at maxError, and reports the times against the output sizes.
+	static bool TestMeshSimplifier(const char* pszFilename);
+
+	// Checks that the positions, normals and texcoords decoded after ObjLoader::Quantize stay within
+	// the error bounds of the Encode/Decode functions.
+	static bool TestQuantize(const char* pszFilename);
+
+	// Checks the Distributor against a literal transcription of HSDistribute and DSDistribute,
+	// which runs a patch per tile instance and a domain point per grid point, and checks that the
+	// emitters do not depend on the threads and that Count gives their number. The distribution
+	// pass itself is checked against the Distributor when the self test loads the assets.
+	static bool TestDistributor(const char* pszFilename, float density, float scale);
+
+	// Creates a mesh of a huge triangle, of many tiles of the distribution pass, and of a grid of
+	// tiny triangles, of less than a grid cell each, on tilted planes. Each vertex is a position
+	// and a normal, in the layout of the renderer.
+	static void CreateMixedMesh(std::vector<DirectX::XMFLOAT3>& vertices, std::vector<uint32_t>& indices,
+		float density, float scale);
+
+	// Checks that the emitters of the mixed mesh have the density of the grid, within 2%, on the
+	// huge triangle and on the tiny ones, and prints them.
+	static bool CheckMixedMeshDensity(const char* pszName, const DirectX::XMFLOAT3* pVertices,
+		const uint32_t* pIndices, uint32_t numIndices, const EmitterInfo* pEmitters, uint32_t numEmitters,
+		float density, float scale);
+
+	// Checks the density of the Distributor on the mixed mesh; the distribution pass is checked on
+	// it when the self test loads the assets.
+	static bool TestMixedMesh(float density, float scale);
+
+	// Checks that the round trips of the emitters through the compact layout of the Distributor keep
+	// the triangles, and move the positions by no more than the bound of Encode, and benchmarks the
+	// emitter fetches and the memory against the shader layout.
+	static bool TestEmitterEncoding(const char* pszFilename, float density, float scale);
+
+	// Saves and loads the emitters by EmitterCache, checks that Load rejects the truncated and the
+	// corrupt files and the other keys, and reports the load time against the distribution.
+	static bool TestEmitterCache(const char* pszFilename, float density, float scale);
+
+	// Checks that the SIMD kernels of ClipVolumes keep the points of the scalar reference, including
+	// the ones on the surfaces, and reports how many fewer emitters the meshes get with a volume
+	// of each type on their AABBs.
+	static bool TestClipVolumes();
+
+	// Reports the exact size of the emitter buffer from Distributor::Count against the peak of the
+	// former fixed buffer, and checks the count against the emitters of Distribute.
+	static bool TestEmitterMemory(const char* pszFilename, float density, float scale);
+
+	// Sweeps the scale in small steps, checks that Distributor::Redistribute gives the emitters of
+	// a fresh Distribute at each step, and reports the times of both.
+	static bool TestRedistribute(const char* pszFilename, float density, float scale);
+
+	// Checks that the meshlets of MeshletBuilder hold every triangle once within the limits and
+	// their vertices within the bounds, and reports their sizes, the cone spread, the build time,
+	// and the time that their ground culling could save in the distribution pass.
+	static bool TestMeshletBuilder(const char* pszFilename, float density, float scale);
+
+	// Compares the samples of AliasSampler with the area shares of the triangles above the ground by a
+	// chi-square test over the cells of the mesh AABB, and reports the throughput.
+	static bool TestAliasSampler(const char* pszFilename, float density, float scale);
+
+	// Checks that no two samples of PoissonSampler are closer than the spacing, and that they do
+	// not depend on the threads, and reports the throughputs and the coverage of the mesh against
+	// the one of the dense emitters of the Distributor.
+	static bool TestPoissonSampler(const char* pszFilename, float density, float scale);
+
+	// Checks CPUEmitter at each SIMD tier against the scalar reference, and against a transcription
+	// of CSEmit within the rounding, and benchmarks the emission against the transforms per particle.
+	static bool TestCPUEmitter(const char* pszFilename, float density, float scale);
+
+	// Benchmarks CPUEmitter::Emit on the emitters and vertices shuffled, in the order of the
+	// Distributor, and sorted by EmitterSorter, and checks that the orders hold the same emitters.
+	static bool TestEmitterOrder(const char* pszFilename, float density, float scale);
+
+	// Checks ParticleIntegrator at each SIMD tier against the scalar reference, and the invariants
+	// of a step, and reports the throughputs.
+	static bool TestParticleIntegrator();
+
+	// Checks that concurrent emissions of ParticlePool take each slot once, that its lists stay
+	// right over the frames and do not depend on the threads, and benchmarks it at a range of alive
+	// ratios against the dense scans, which CPUSimulation keeps.
+	static bool TestParticlePool();
+
+	// Checks that the runs of CPUSimulation do not depend on the SIMD tier or the threads.
+	static bool TestCPUSimulation(const char* pszFilename, float density, float scale);
+
+	// Runs CPUSimulation headless with the emission budget and with the re-emission of every dead
+	// particle at once, checks the cap of the budget and the variance of the counts, and reports
+	// the frame times.
+	static bool TestEmissionBudget(const char* pszFilename, float density, float scale);
+};
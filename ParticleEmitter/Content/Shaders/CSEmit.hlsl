@@ -3,8 +3,7 @@
 //--------------------------------------------------------------------------------------
 
 #include "Common.hlsli"
-
-#define RAND_MAX 0xffff
+#include "SharedRandom.h"
 
 struct Emitter
 {
@@ -29,10 +28,12 @@ cbuffer cbPerObject
 	uint	g_baseSeed;
 	uint	g_numEmitters;
 	uint	g_numParticles;
+	uint	g_emitBegin;
+	uint	g_numEmit;
 	matrix	g_viewProj;
 };
 
-static const float g_fullLife = 0.5;
+static const float g_fullLife = FULL_LIFE;
 
 //--------------------------------------------------------------------------------------
 // Buffers
@@ -41,24 +42,13 @@ RWStructuredBuffer<Particle> g_rwParticles;
 StructuredBuffer<Emitter>	g_roEmitters;
 StructuredBuffer<Vertex>	g_roVertices;
 
-uint rand(inout uint seed)
-{
-	// The same implementation of current Windows rand()
-	// msvcrt.dll: 77C271D8 mov     ecx, [eax + 14h]
-	// msvcrt.dll: 77C271DB imul    ecx, 343FDh
-	// msvcrt.dll: 77C271E1 add     ecx, 269EC3h
-	// msvcrt.dll: 77C271E7 mov     [eax + 14h], ecx
-	// msvcrt.dll: 77C271EA mov     eax, ecx
-	// msvcrt.dll: 77C271EC shr     eax, 10h
-	// msvcrt.dll: 77C271EF and     eax, 7FFFh
-	seed = seed * 0x343fd + 0x269ec3;   // a = 214013, b = 2531011
-
-	return (seed >> 0x10) & RAND_MAX;
-}
-
-uint rand(inout uint2 seed, uint range)
+//--------------------------------------------------------------------------------------
+// Emission budget of the frame
+//--------------------------------------------------------------------------------------
+bool IsInEmissionWindow(uint particleId)
 {
-	return (rand(seed.x) | (rand(seed.y) << 16)) % range;
+	// The dead particles of g_numEmit slots from g_emitBegin, wrapped around the buffer, emit.
+	return (particleId + g_numParticles - g_emitBegin) % g_numParticles < g_numEmit;
 }
 
 //--------------------------------------------------------------------------------------
@@ -66,9 +56,11 @@ uint rand(inout uint2 seed, uint range)
 //--------------------------------------------------------------------------------------
 Particle Emit(uint particleId, Particle particle)
 {
+	// Random words of the particle at the frame
+	const uint4 random = Pcg4d(uint4(particleId, g_baseSeed, 0, 0));
+
 	// Load emitter with a random index
-	uint2 seed = { particleId, g_baseSeed };
-	const uint emitterIdx = rand(seed, g_numEmitters);
+	const uint emitterIdx = RandomIndex(random.x, g_numEmitters);
 	const Emitter emitter = g_roEmitters[emitterIdx];
 	const float3 barycoord = { emitter.Barycoord, 1.0 - (emitter.Barycoord.x + emitter.Barycoord.y) };
 
@@ -84,7 +76,7 @@ Particle Emit(uint particleId, Particle particle)
 	const float3 posPrev = WorldToSimulationSpace(mul(pos, g_worldPrev));
 	particle.Pos = WorldToSimulationSpace(mul(pos, g_world));
 	particle.Velocity = (particle.Pos - posPrev) / g_timeStep;
-	particle.LifeTime = g_fullLife + rand(seed, 1000) / 1000.0f;
+	particle.LifeTime = g_fullLife + RandomUnorm(random.y);
 
 	return particle;
 }
@@ -97,7 +89,7 @@ void main(uint DTid : SV_DispatchThreadID)
 {
 	// Load particle
 	Particle particle = g_rwParticles[DTid];
-	if (particle.LifeTime > 0.0) return;
+	if (particle.LifeTime > 0.0 || !IsInEmissionWindow(DTid)) return;
 	
 	particle = Emit(DTid, particle);
 	g_rwParticles[DTid] = particle;
@@ -5,8 +5,9 @@
 // Output control point
 struct DSCtrlPointIn
 {
-	float3	Pos	: POSITION;
-	uint	VId	: VERTEXID;
+	float3	Pos		: POSITION;
+	uint	VId		: VERTEXID;
+	uint	Tile	: TILE;
 };
 
 // Output patch constant data.
@@ -15,6 +16,7 @@ struct HSConstDataOut
 	float EdgeTessFactor[4]		: SV_TessFactor;
 	float InsideTessFactor[2]	: SV_InsideTessFactor;
 	float4 MinMaxPt				: AABB;
+	float2 GridMaxPt			: GRID_MAX;
 	float3x3 ToTangentSpace		: TANGENT_SPACE;
 };
 
@@ -42,6 +44,10 @@ void main(
 	float2 domain : SV_DomainLocation,
 	const OutputPatch<DSCtrlPointIn, NUM_CONTROL_POINTS> patch)
 {
+	// The last row and column of a tile belong to the next tile.
+	const bool2 isOpen = input.MinMaxPt.zw < input.GridMaxPt;
+	if ((isOpen.x && domain.x >= 1.0) || (isOpen.y && domain.y >= 1.0)) return;
+
 	float3 v[3];
 	[unroll] for (uint i = 0; i < 3; ++i)
 		v[i] = mul(input.ToTangentSpace, patch[i].Pos);
@@ -2,20 +2,22 @@
 // Copyright (c) XU, Tianchen. All rights reserved.
 //--------------------------------------------------------------------------------------
 
-#define GROUND_Y 0.1
+#include "SharedConst.h"
 
 // Input control point
 struct HSCtrlPointIn
 {
-	float3	Pos	: POSITION;
-	uint	VId	: VERTEXID;
+	float3	Pos		: POSITION;
+	uint	VId		: VERTEXID;
+	uint	Tile	: TILE;
 };
 
 // Output control point
 struct HSCtrlPointOut
 {
-	float3	Pos	: POSITION;
-	uint	VId	: VERTEXID;
+	float3	Pos		: POSITION;
+	uint	VId		: VERTEXID;
+	uint	Tile	: TILE;
 };
 
 // Output patch constant data.
@@ -24,6 +26,7 @@ struct HSConstDataOut
 	float EdgeTessFactor[4]		: SV_TessFactor;
 	float InsideTessFactor[2]	: SV_InsideTessFactor;
 	float4 MinMaxPt				: AABB;
+	float2 GridMaxPt			: GRID_MAX;
 	float3x3 ToTangentSpace		: TANGENT_SPACE;
 };
 
@@ -41,7 +44,7 @@ HSConstDataOut CalcHSPatchConstants(InputPatch<HSCtrlPointIn, NUM_CONTROL_POINTS
 		return output;
 	}
 
-	// Compute tangent space
+	// Compute orthonormal tangent space, so the grid is the same density on any orientation
 	float3 e[2];
 	e[0] = ip[2].Pos - ip[1].Pos;
 	e[1] = ip[0].Pos - ip[2].Pos;
@@ -50,12 +53,12 @@ HSConstDataOut CalcHSPatchConstants(InputPatch<HSCtrlPointIn, NUM_CONTROL_POINTS
 	const float3 n = normalize(cross(e[0], e[1]));
 	if (abs(dot(n, u)) < 0.6667)
 	{
-		r = cross(n, u);
+		r = normalize(cross(n, u));
 		u = cross(r, n);
 	}
 	else
 	{
-		u = cross(r, n);
+		u = normalize(cross(r, n));
 		r = cross(n, u);
 	}
 	output.ToTangentSpace = float3x3(r, u, n);
@@ -66,17 +69,31 @@ HSConstDataOut CalcHSPatchConstants(InputPatch<HSCtrlPointIn, NUM_CONTROL_POINTS
 		v[i] = mul(output.ToTangentSpace, ip[i].Pos);
 
 	// Compute AABB
-	output.MinMaxPt.xy = min(v[0].xy, min(v[1].xy, v[2].xy));
-	output.MinMaxPt.zw = max(v[0].xy, max(v[1].xy, v[2].xy));
-	output.MinMaxPt.xy = floor(output.MinMaxPt.xy);
-	output.MinMaxPt.zw = ceil(output.MinMaxPt.zw);
-	const float2 aabb = output.MinMaxPt.zw - output.MinMaxPt.xy;
+	const float2 gridMin = floor(min(v[0].xy, min(v[1].xy, v[2].xy)));
+	const float2 gridMax = ceil(max(v[0].xy, max(v[1].xy, v[2].xy)));
+	const float2 aabb = gridMax - gridMin;
+
+	// The tess factors are capped by the hardware, so the grid is split into tiles of the max
+	// tess factor, one per instance; the patches of the tiles out of the grid are culled.
+	const uint2 numTiles = uint2(ceil(aabb / MAX_TESS_FACTOR));
+	const uint tile = ip[0].Tile;
+	if (!(all(aabb > 0.0) && all(aabb < MAX_GRID_EXTENT)) || tile / numTiles.x >= numTiles.y)
+	{
+		output = (HSConstDataOut)0;
+
+		return output;
+	}
+
+	output.MinMaxPt.xy = gridMin + MAX_TESS_FACTOR * float2(tile % numTiles.x, tile / numTiles.x);
+	output.MinMaxPt.zw = min(output.MinMaxPt.xy + MAX_TESS_FACTOR, gridMax);
+	output.GridMaxPt = gridMax;
+	const float2 tileSize = output.MinMaxPt.zw - output.MinMaxPt.xy;
 
 	// Output tess factors
-	output.EdgeTessFactor[0] = output.EdgeTessFactor[2] = aabb.y;
-	output.EdgeTessFactor[1] = output.EdgeTessFactor[3] = aabb.x;
-	output.InsideTessFactor[0] = aabb.x;
-	output.InsideTessFactor[1] = aabb.y;
+	output.EdgeTessFactor[0] = output.EdgeTessFactor[2] = tileSize.y;
+	output.EdgeTessFactor[1] = output.EdgeTessFactor[3] = tileSize.x;
+	output.InsideTessFactor[0] = tileSize.x;
+	output.InsideTessFactor[1] = tileSize.y;
 
 	return output;
 }
@@ -94,6 +111,7 @@ HSCtrlPointOut main(InputPatch<HSCtrlPointIn, NUM_CONTROL_POINTS> ip,
 	// Insert code to compute Output here
 	output.Pos = ip[i].Pos;
 	output.VId = ip[i].VId;
+	output.Tile = ip[i].Tile;
 
 	return output;
 }
@@ -13,8 +13,9 @@ struct VSIn
 
 struct VSOut
 {
-	float3	Pos	: POSITION;
-	uint	VId	: VERTEXID;
+	float3	Pos		: POSITION;
+	uint	VId		: VERTEXID;
+	uint	Tile	: TILE;
 };
 
 //--------------------------------------------------------------------------------------
@@ -23,17 +24,19 @@ struct VSOut
 cbuffer cbPerObject
 {
 	float4x3	g_transform;
+	uint		g_baseTile;
 };
 
 //--------------------------------------------------------------------------------------
 // Simple transform
 //--------------------------------------------------------------------------------------
-VSOut main(VSIn input, uint vId : SV_VERTEXID)
+VSOut main(VSIn input, uint vId : SV_VERTEXID, uint instanceId : SV_INSTANCEID)
 {
 	VSOut output;
 
 	output.Pos = mul(float4(input.Pos, 1.0), g_transform);
 	output.VId = vId;
+	output.Tile = g_baseTile + instanceId;
 
 	return output;
 }
@@ -30,7 +30,8 @@ void UpdateParticle(uint particleId, inout Particle particle, float3 acceleratio
 		particle.Pos += particle.Velocity * g_timeStep;
 		particle.LifeTime -= g_timeStep;
 	}
-	else particle = Emit(particleId, particle);
+	else if (IsInEmissionWindow(particleId)) particle = Emit(particleId, particle);
+	else particle.Pos.y = 3.402823466e+38;	// Park it out of the view and the grids, like the unborn ones
 
 	g_rwParticles[particleId] = particle;
 }
@@ -7,3 +7,10 @@
 
 #define GRID_SIZE_FHF	64
 #define BOUNDARY_FHF	0.0f, 4.0f, 0.0f, 4.0f
+
+#define FULL_LIFE		0.5f	// Plus up to 1 second at random
+
+// Emitter distribution, shared by HSDistribute and Distributor so that they stay in step
+#define GROUND_Y		0.1f	// Triangles with a vertex at or below it emit nothing
+#define MAX_TESS_FACTOR	64.0f
+#define MAX_GRID_EXTENT	1048576.0f	// Keeps the tile count in 32 bits
@@ -0,0 +1,85 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+// Counter-based random numbers, shared by the shaders and the CPU code. The 4D PCG hash
+// [Jarzynski and Olano 2020, "Hash Functions for GPU Rendering"] maps a counter, e.g.
+// (particle ID, frame, stream, 0), to 4 well-mixed 32-bit words, so a particle draws its numbers
+// directly from its IDs without a state, and the GPU and the CPU get the same ones. A final
+// xorshift is added to the hash, so that the low bits are mixed as well as the high ones.
+
+#ifndef SHARED_RANDOM_H
+#define SHARED_RANDOM_H
+
+#ifdef __cplusplus
+#include "Core/XUSG.h"
+
+namespace SharedRandom
+{
+	using uint = uint32_t;
+	using uint4 = DirectX::XMUINT4;
+#define SHARED_INLINE inline
+#else
+#define SHARED_INLINE
+#endif
+
+SHARED_INLINE uint4 Pcg4d(uint4 v)
+{
+	v.x = v.x * 1664525u + 1013904223u;
+	v.y = v.y * 1664525u + 1013904223u;
+	v.z = v.z * 1664525u + 1013904223u;
+	v.w = v.w * 1664525u + 1013904223u;
+
+	v.x += v.y * v.w;
+	v.y += v.z * v.x;
+	v.z += v.x * v.y;
+	v.w += v.y * v.z;
+
+	v.x ^= v.x >> 16u;
+	v.y ^= v.y >> 16u;
+	v.z ^= v.z >> 16u;
+	v.w ^= v.w >> 16u;
+
+	v.x += v.y * v.w;
+	v.y += v.z * v.x;
+	v.z += v.x * v.y;
+	v.w += v.y * v.z;
+
+	v.x ^= v.x >> 16u;
+	v.y ^= v.y >> 16u;
+	v.z ^= v.z >> 16u;
+	v.w ^= v.w >> 16u;
+
+	return v;
+}
+
+// Maps a word to [0, 1) with the 24 bits a float holds exactly.
+SHARED_INLINE float RandomUnorm(uint x)
+{
+	return (x >> 8u) * (1.0f / 16777216.0f);
+}
+
+// Maps a word to [0, n) by the multiply-shift, i.e. the high word of x * n, which unlike x % n
+// gives every index the same share of the words up to one. Shader model 5.0 has no 64-bit
+// integers, so the shaders build the high word from 16-bit partial products.
+SHARED_INLINE uint RandomIndex(uint x, uint n)
+{
+#ifdef __cplusplus
+	return static_cast<uint>((static_cast<uint64_t>(x) * n) >> 32);
+#else
+	const uint lo = (x & 0xffff) * (n & 0xffff);
+	const uint mid0 = (x >> 16) * (n & 0xffff);
+	const uint mid1 = (x & 0xffff) * (n >> 16);
+	const uint carry = ((lo >> 16) + (mid0 & 0xffff) + (mid1 & 0xffff)) >> 16;
+
+	return (x >> 16) * (n >> 16) + (mid0 >> 16) + (mid1 >> 16) + carry;
+#endif
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#undef SHARED_INLINE
+
+#endif
@@ -9,7 +9,12 @@
 //
 //*********************************************************
 
+#include "Optional/XUSGObjLoader.h"
 #include "ParticleEmitter.h"
+#include "Distributor.h"
+#include "EmitterCache.h"
+#include "EmitterSorter.h"
+#include "SelfTest.h"
 #include "stb_image_write.h"
 
 using namespace std;
@@ -37,9 +42,13 @@ ParticleEmitter::ParticleEmitter(uint32_t width, uint32_t height, std::wstring n
 	m_simulationMethod(SPH_SIMULATION),
 	m_showFPS(true),
 	m_isPaused(false),
+	m_isSelfTest(false),
+	m_isSelfTestPassed(false),
 	m_tracking(false),
 	m_meshFileName("Assets/bunny.obj"),
 	m_meshPosScale(0.0f, 0.0f, 0.0f, 1.0f),
+	m_emissionRate(0.0f),
+	m_maxEmission(0),
 	m_screenShot(0)
 {
 #if defined (_DEBUG)
@@ -61,8 +70,18 @@ ParticleEmitter::~ParticleEmitter()
 
 void ParticleEmitter::OnInit()
 {
+	// The self test runs the CPU tests before the asset loading, and quits with the exit code 0
+	// if all of them passed.
+	if (m_isSelfTest) m_isSelfTestPassed = SelfTest::Run();
+
 	LoadPipeline();
 	LoadAssets();
+
+	if (m_isSelfTest)
+	{
+		SelfTest::PrintResult("Self test", m_isSelfTestPassed);
+		PostQuitMessage(m_isSelfTestPassed ? 0 : 1);
+	}
 }
 
 // Load the rendering pipeline dependencies.
@@ -188,9 +207,13 @@ void ParticleEmitter::LoadPipeline()
 // Load the sample assets.
 void ParticleEmitter::LoadAssets()
 {
-	const auto counter = RawBuffer::MakeUnique();
-	XUSG_N_RETURN(counter->Create(m_device.get(), sizeof(uint32_t), ResourceFlag::DENY_SHADER_RESOURCE,
-		MemoryType::READBACK, 0, nullptr, 0), ThrowIfFailed(E_FAIL));
+	// Load the mesh
+	ObjLoader::ImportOptions importOptions;
+	importOptions.NumThreads = 0;
+	importOptions.UseCache = true;
+	importOptions.Optimize = true;
+	ObjLoader objLoader;
+	XUSG_N_RETURN(objLoader.Import(m_meshFileName.c_str(), importOptions), ThrowIfFailed(E_FAIL));
 
 	// Create the command list.
 	m_commandList = CommandList::MakeUnique();
@@ -201,7 +224,7 @@ void ParticleEmitter::LoadAssets()
 	vector<Resource::uptr> uploaders(0);
 	// Create renderer
 	m_renderer = make_unique<Renderer>();
-	XUSG_N_RETURN(m_renderer->Init(pCommandList, m_width, m_height, uploaders, m_meshFileName.c_str(),
+	XUSG_N_RETURN(m_renderer->Init(pCommandList, m_width, m_height, uploaders, objLoader,
 		g_backBufferFormat, Format::D24_UNORM_S8_UINT), ThrowIfFailed(E_FAIL));
 
 	// Create emitter
@@ -209,6 +232,7 @@ void ParticleEmitter::LoadAssets()
 	m_emitter = make_unique<Emitter>();
 	XUSG_N_RETURN(m_emitter->Init(pCommandList, numParticles, m_descriptorTableLib, uploaders,
 		m_renderer->GetInputLayout(), g_backBufferFormat, Format::D24_UNORM_S8_UINT), ThrowIfFailed(E_FAIL));
+	m_emitter->SetEmissionRate(m_emissionRate, m_maxEmission);
 
 	// Create SPH fluid simulator
 	m_fluidSPH = make_unique<FluidSPH>();
@@ -226,11 +250,106 @@ void ParticleEmitter::LoadAssets()
 		nullptr, &uploaders, Format::R32_UINT, 1024 * 5 + 387);
 #endif
 
-	m_emitter->Distribute(pCommandList, counter.get(), m_renderer->GetVertexBuffer(),
-		m_renderer->GetIndexBuffer(), m_renderer->GetNumIndices(), 32.0f, m_meshPosScale.w);
+	// Upload the emitters from the cache, or distribute them and read them back for the cache.
+	// On a miss, the emitters are counted on the CPU, so the emitter buffer is created at its final size.
+	// The clip volumes are only supported by the CPU distribution, whose emitters are uploaded instead.
+	// The emitters are cached in the Morton order of their positions for the locality of the fetches.
+	// The self test skips the cache, so that the distribution pass runs and is checked.
+	const auto density = 32.0f;
+	const auto emitterCacheFileName = m_meshFileName + ".emitters";
+	const auto meshHash = EmitterCache::HashMesh(objLoader.GetVertices(), objLoader.GetVertexStride(),
+		objLoader.GetNumVertices(), objLoader.GetIndices(), objLoader.GetNumIndices());
+	const auto clipHash = EmitterCache::HashClipVolumes(m_clipVolumes);
+	const auto isClipped = !m_clipVolumes.IsEmpty();
+	EmitterCache emitterCache;
+	vector<EmitterInfo> emitters;
+	const auto counter = RawBuffer::MakeUnique();
+	const auto isEmitterCached = !m_isSelfTest && emitterCache.Load(emitterCacheFileName.c_str(), meshHash, clipHash, density, m_meshPosScale.w);
+	if (isEmitterCached)
+	{
+		XUSG_N_RETURN(m_emitter->SetEmitters(pCommandList, emitterCache.GetNumEmitters(), emitterCache.GetEmitters(),
+			m_renderer->GetVertexBuffer(), uploaders), ThrowIfFailed(E_FAIL));
+		emitterCache.Release();
+	}
+	else if (isClipped)
+	{
+		Distributor distributor;
+		distributor.Distribute(objLoader.GetVertices(), objLoader.GetVertexStride(), objLoader.GetIndices(),
+			objLoader.GetNumIndices(), density, m_meshPosScale.w, 0, &m_clipVolumes);
+		emitters.assign(distributor.GetEmitters(), distributor.GetEmitters() + distributor.GetNumEmitters());
+		EmitterSorter::SortByMorton(emitters.data(), static_cast<uint32_t>(emitters.size()),
+			objLoader.GetVertices(), objLoader.GetVertexStride());
+		XUSG_N_RETURN(m_emitter->SetEmitters(pCommandList, static_cast<uint32_t>(emitters.size()), emitters.data(),
+			m_renderer->GetVertexBuffer(), uploaders), ThrowIfFailed(E_FAIL));
+	}
+	else
+	{
+		// The large triangles are drawn again for the rest of their tiles.
+		vector<uint32_t> tiledIndices;
+		const auto numTiles = Distributor::CollectTiledTriangles(objLoader.GetVertices(), objLoader.GetVertexStride(),
+			objLoader.GetIndices(), objLoader.GetNumIndices(), density, m_meshPosScale.w, tiledIndices);
+		XUSG_N_RETURN(m_emitter->SetTiledTriangles(pCommandList, tiledIndices.data(),
+			static_cast<uint32_t>(tiledIndices.size()), numTiles, uploaders), ThrowIfFailed(E_FAIL));
+
+		XUSG_N_RETURN(counter->Create(m_device.get(), sizeof(uint32_t), ResourceFlag::DENY_SHADER_RESOURCE,
+			MemoryType::READBACK, 0, nullptr, 0), ThrowIfFailed(E_FAIL));
+		const auto numEmitters = Distributor::Count(objLoader.GetVertices(), objLoader.GetVertexStride(),
+			objLoader.GetIndices(), objLoader.GetNumIndices(), density, m_meshPosScale.w);
+		XUSG_N_RETURN(m_emitter->Distribute(pCommandList, numEmitters, counter.get(), m_renderer->GetVertexBuffer(),
+			m_renderer->GetIndexBuffer(), m_renderer->GetNumIndices(), density, m_meshPosScale.w), ThrowIfFailed(E_FAIL));
+	}
+
+	// The self test also runs the distribution pass on a mesh of a huge triangle, drawn in tiles,
+	// and of tiny triangles, with an emitter of its own.
+	Emitter mixedEmitter;
+	vector<XMFLOAT3> mixedVertices;
+	vector<uint32_t> mixedIndices;
+	const auto mixedVB = VertexBuffer::MakeUnique();
+	const auto mixedIB = IndexBuffer::MakeUnique();
+	const auto mixedCounter = RawBuffer::MakeUnique();
+	const auto mixedReadBack = Buffer::MakeUnique();
+	if (m_isSelfTest)
+	{
+		SelfTest::CreateMixedMesh(mixedVertices, mixedIndices, density, 1.0f);
+		const auto pVertices = reinterpret_cast<const uint8_t*>(mixedVertices.data());
+		const auto stride = static_cast<uint32_t>(sizeof(XMFLOAT3) * 2);
+		const auto numVertices = static_cast<uint32_t>(mixedVertices.size() / 2);
+		const auto numIndices = static_cast<uint32_t>(mixedIndices.size());
+		XUSG_N_RETURN(mixedVB->Create(m_device.get(), numVertices, stride, ResourceFlag::NONE,
+			MemoryType::DEFAULT, 1, nullptr, 1, nullptr, 1, nullptr, MemoryFlag::NONE, L"MixedMeshVB"), ThrowIfFailed(E_FAIL));
+		uploaders.emplace_back(Resource::MakeUnique());
+		XUSG_N_RETURN(mixedVB->Upload(pCommandList, uploaders.back().get(), pVertices, stride * numVertices, 0,
+			ResourceState::VERTEX_AND_CONSTANT_BUFFER | ResourceState::NON_PIXEL_SHADER_RESOURCE), ThrowIfFailed(E_FAIL));
+		XUSG_N_RETURN(mixedIB->Create(m_device.get(), sizeof(uint32_t) * numIndices, Format::R32_UINT, ResourceFlag::NONE,
+			MemoryType::DEFAULT, 1, nullptr, 1, nullptr, 1, nullptr, MemoryFlag::NONE, L"MixedMeshIB"), ThrowIfFailed(E_FAIL));
+		uploaders.emplace_back(Resource::MakeUnique());
+		XUSG_N_RETURN(mixedIB->Upload(pCommandList, uploaders.back().get(), mixedIndices.data(),
+			sizeof(uint32_t) * numIndices, 0, ResourceState::INDEX_BUFFER), ThrowIfFailed(E_FAIL));
+
+		XUSG_N_RETURN(mixedEmitter.Init(pCommandList, 1, m_descriptorTableLib, uploaders,
+			m_renderer->GetInputLayout(), g_backBufferFormat, Format::D24_UNORM_S8_UINT), ThrowIfFailed(E_FAIL));
+		vector<uint32_t> tiledIndices;
+		const auto numTiles = Distributor::CollectTiledTriangles(pVertices, stride, mixedIndices.data(), numIndices,
+			density, 1.0f, tiledIndices);
+		XUSG_N_RETURN(mixedEmitter.SetTiledTriangles(pCommandList, tiledIndices.data(),
+			static_cast<uint32_t>(tiledIndices.size()), numTiles, uploaders), ThrowIfFailed(E_FAIL));
+
+		XUSG_N_RETURN(mixedCounter->Create(m_device.get(), sizeof(uint32_t), ResourceFlag::DENY_SHADER_RESOURCE,
+			MemoryType::READBACK, 0, nullptr, 0), ThrowIfFailed(E_FAIL));
+		const auto numEmitters = Distributor::Count(pVertices, stride, mixedIndices.data(), numIndices, density, 1.0f);
+		XUSG_N_RETURN(mixedEmitter.Distribute(pCommandList, numEmitters, mixedCounter.get(), mixedVB.get(),
+			mixedIB.get(), numIndices, density, 1.0f), ThrowIfFailed(E_FAIL));
+		mixedEmitter.ReadBackEmitters(pCommandList, mixedReadBack.get());
+	}
 
+	const auto emitterReadBack = Buffer::MakeUnique();
 #if defined(_DEBUG)
+	const auto isDistributionVerified = true;
+	m_emitter->ReadBackEmitters(pCommandList, emitterReadBack.get());
 	prefixSumUtil.PrefixSum(pCommandList);
+#else
+	const auto isDistributionVerified = m_isSelfTest && !isClipped;
+	if (!isEmitterCached && !isClipped) m_emitter->ReadBackEmitters(pCommandList, emitterReadBack.get());
 #endif
 
 	// Close the command list and execute it to begin the initial GPU setup.
@@ -255,22 +374,71 @@ void ParticleEmitter::LoadAssets()
 		WaitForGpu();
 	}
 
+	// The distribution pass may append fewer emitters than counted, e.g. with another rounding; the
+	// emitters are then used but not cached, as the cache must hold the complete distribution. The
+	// self test fails on it.
+	auto isEmitterCountExact = true;
+	if (!isEmitterCached && !isClipped)
+	{
+		isEmitterCountExact = m_emitter->SetEmitterCount(counter.get());
+		if (m_isSelfTest)
+		{
+			SelfTest::PrintResult("Emitter count", isEmitterCountExact);
+			m_isSelfTestPassed = m_isSelfTestPassed && isEmitterCountExact;
+		}
+	}
+
+	if (!isEmitterCached && isEmitterCountExact)
+	{
+		if (!isClipped)
+		{
+			const auto pEmitters = static_cast<const EmitterInfo*>(emitterReadBack->Map(nullptr));
+			emitters.assign(pEmitters, pEmitters + m_emitter->GetNumEmitters());
+			emitterReadBack->Unmap();
+			EmitterSorter::SortByMorton(emitters.data(), static_cast<uint32_t>(emitters.size()),
+				objLoader.GetVertices(), objLoader.GetVertexStride());
+		}
+
+		emitterCache.Save(emitterCacheFileName.c_str(), meshHash, clipHash, density, m_meshPosScale.w,
+			emitters.data(), static_cast<uint32_t>(emitters.size()));
+	}
+
 #if defined(_DEBUG)
 	prefixSumUtil.VerifyPrefixSum();
 #endif
 
-	// Shrink memory cost
-	StructuredBuffer::uptr emitterScratch = StructuredBuffer::MakeUnique();
-	XUSG_N_RETURN(m_commandAllocators[m_frameIndex]->Reset(), ThrowIfFailed(E_FAIL));
-	XUSG_N_RETURN(pCommandList->Reset(m_commandAllocators[m_frameIndex].get(), nullptr), ThrowIfFailed(E_FAIL));
-	XUSG_N_RETURN(m_emitter->SetEmitterCount(pCommandList, counter.get(), emitterScratch), ThrowIfFailed(E_FAIL));
+	// Verify the distribution pass against the CPU one; the self test allows the edge flips of
+	// a triangle in a thousand.
+	if (isDistributionVerified)
+	{
+		Distributor distributor;
+		distributor.Distribute(objLoader.GetVertices(), objLoader.GetVertexStride(), objLoader.GetIndices(),
+			objLoader.GetNumIndices(), density, m_meshPosScale.w, 0, &m_clipVolumes);
+		const auto numWrongTris = distributor.Verify(static_cast<const EmitterInfo*>(emitterReadBack->Map(nullptr)),
+			m_emitter->GetNumEmitters());
+		emitterReadBack->Unmap();
+
+		if (m_isSelfTest)
+		{
+			const auto isPassed = numWrongTris <= objLoader.GetNumIndices() / 3000;
+			SelfTest::PrintResult("Distribution pass", isPassed);
+			m_isSelfTestPassed = m_isSelfTestPassed && isPassed;
+		}
 
-	// Close the command list and execute it to begin the initial GPU setup.
-	XUSG_N_RETURN(pCommandList->Close(), ThrowIfFailed(E_FAIL));
-	m_commandQueue->ExecuteCommandList(pCommandList);
+	}
 
-	// Create synchronization objects and wait until assets have been uploaded to the GPU.
-	WaitForGpu();
+	// The density of the distribution pass on the huge triangle and on the tiny ones
+	if (m_isSelfTest)
+	{
+		const auto isEmitterCountExact = mixedEmitter.SetEmitterCount(mixedCounter.get());
+		const auto isPassed = SelfTest::CheckMixedMeshDensity("Tiled distribution pass", mixedVertices.data(),
+			mixedIndices.data(), static_cast<uint32_t>(mixedIndices.size()),
+			static_cast<const EmitterInfo*>(mixedReadBack->Map(nullptr)), mixedEmitter.GetNumEmitters(),
+			density, 1.0f) && isEmitterCountExact;
+		mixedReadBack->Unmap();
+		SelfTest::PrintResult("Tiled distribution pass", isPassed);
+		m_isSelfTestPassed = m_isSelfTestPassed && isPassed;
+	}
 
 	// Projection
 	const auto aspectRatio = m_width / static_cast<float>(m_height);
@@ -423,6 +591,11 @@ void ParticleEmitter::OnMouseLeave()
 	m_tracking = false;
 }
 
+bool ParticleEmitter::IsHeadless() const
+{
+	return m_isSelfTest;
+}
+
 void ParticleEmitter::ParseCommandLineArgs(wchar_t* argv[], int argc)
 {
 	const auto str_tolower = [](wstring s)
@@ -467,7 +640,52 @@ void ParticleEmitter::ParseCommandLineArgs(wchar_t* argv[], int argc)
 			if (hasNextArgValue(i)) i += swscanf_s(argv[i + 1], L"%f", &m_meshPosScale.z);
 			if (hasNextArgValue(i)) i += swscanf_s(argv[i + 1], L"%f", &m_meshPosScale.w);
 		}
+		else if (isArgMatched(i, L"clipPlane"))
+		{
+			XMFLOAT4 plane(0.0f, 1.0f, 0.0f, 0.0f);
+			if (hasNextArgValue(i)) i += swscanf_s(argv[i + 1], L"%f", &plane.x);
+			if (hasNextArgValue(i)) i += swscanf_s(argv[i + 1], L"%f", &plane.y);
+			if (hasNextArgValue(i)) i += swscanf_s(argv[i + 1], L"%f", &plane.z);
+			if (hasNextArgValue(i)) i += swscanf_s(argv[i + 1], L"%f", &plane.w);
+			m_clipVolumes.AddHalfSpace(XMFLOAT3(plane.x, plane.y, plane.z), plane.w);
+		}
+		else if (isArgMatched(i, L"clipBox"))
+		{
+			XMFLOAT3 minPt(0.0f, 0.0f, 0.0f), maxPt(0.0f, 0.0f, 0.0f);
+			if (hasNextArgValue(i)) i += swscanf_s(argv[i + 1], L"%f", &minPt.x);
+			if (hasNextArgValue(i)) i += swscanf_s(argv[i + 1], L"%f", &minPt.y);
+			if (hasNextArgValue(i)) i += swscanf_s(argv[i + 1], L"%f", &minPt.z);
+			if (hasNextArgValue(i)) i += swscanf_s(argv[i + 1], L"%f", &maxPt.x);
+			if (hasNextArgValue(i)) i += swscanf_s(argv[i + 1], L"%f", &maxPt.y);
+			if (hasNextArgValue(i)) i += swscanf_s(argv[i + 1], L"%f", &maxPt.z);
+			m_clipVolumes.AddBox(minPt, maxPt);
+		}
+		else if (isArgMatched(i, L"clipSphere"))
+		{
+			XMFLOAT4 sphere(0.0f, 0.0f, 0.0f, 0.0f);
+			if (hasNextArgValue(i)) i += swscanf_s(argv[i + 1], L"%f", &sphere.x);
+			if (hasNextArgValue(i)) i += swscanf_s(argv[i + 1], L"%f", &sphere.y);
+			if (hasNextArgValue(i)) i += swscanf_s(argv[i + 1], L"%f", &sphere.z);
+			if (hasNextArgValue(i)) i += swscanf_s(argv[i + 1], L"%f", &sphere.w);
+			m_clipVolumes.AddSphere(XMFLOAT3(sphere.x, sphere.y, sphere.z), sphere.w);
+		}
+		else if (isArgMatched(i, L"emitRate"))
+		{
+			if (hasNextArgValue(i)) i += swscanf_s(argv[i + 1], L"%f", &m_emissionRate);
+			if (hasNextArgValue(i)) i += swscanf_s(argv[i + 1], L"%u", &m_maxEmission);
+		}
+		else if (isArgMatched(i, L"selftest")) m_isSelfTest = true;
+	}
+
+#if !defined(_DEBUG)
+	// Print the self test to the console of the caller, or to a new one
+	if (m_isSelfTest && (AttachConsole(ATTACH_PARENT_PROCESS) || AllocConsole()))
+	{
+		FILE* stream;
+		freopen_s(&stream, "CONOUT$", "w+t", stdout);
+		freopen_s(&stream, "CONOUT$", "w+t", stderr);
 	}
+#endif
 }
 
 void ParticleEmitter::PopulateCommandList()
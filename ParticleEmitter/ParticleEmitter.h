@@ -17,6 +17,7 @@
 #include "Emitter.h"
 #include "FluidSPH.h"
 #include "FluidFH.h"
+#include "ClipVolumes.h"
 
 using namespace DirectX;
 
@@ -45,6 +46,7 @@ public:
 	virtual void OnMouseLeave();
 
 	virtual void ParseCommandLineArgs(wchar_t* argv[], int argc);
+	virtual bool IsHeadless() const;
 
 private:
 	enum DeviceType : uint8_t
@@ -100,6 +102,8 @@ private:
 	SimulationMethod m_simulationMethod;
 	bool		m_showFPS;
 	bool		m_isPaused;
+	bool		m_isSelfTest;
+	bool		m_isSelfTestPassed;
 
 	// User camera interactions
 	bool m_tracking;
@@ -108,6 +112,9 @@ private:
 	// User external settings
 	std::string m_meshFileName;
 	XMFLOAT4 m_meshPosScale;
+	ClipVolumes m_clipVolumes;	// In the mesh space
+	float m_emissionRate;		// Particles per second; 0 for the default
+	uint32_t m_maxEmission;		// Particles per frame; 0 for the default
 
 	// Screen-shot helpers and state
 	XUSG::Buffer::uptr	m_readBuffer;
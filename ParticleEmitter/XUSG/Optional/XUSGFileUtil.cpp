@@ -0,0 +1,64 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include "XUSGFileUtil.h"
+
+using namespace std;
+using namespace XUSG;
+
+uint64_t XUSG::HashData(const void* pData, size_t size, uint64_t basis)
+{
+	auto h = basis;
+
+	const auto p = static_cast<const uint8_t*>(pData);
+	const auto numWords = size / sizeof(uint64_t);
+	for (size_t i = 0; i < numWords; ++i)
+	{
+		uint64_t word;
+		memcpy(&word, &p[sizeof(uint64_t) * i], sizeof(uint64_t));
+		h = (h ^ word) * FNV_PRIME;
+	}
+
+	for (auto i = sizeof(uint64_t) * numWords; i < size; ++i) h = (h ^ p[i]) * FNV_PRIME;
+
+	return h;
+}
+
+const void* XUSG::MapFile(const char* pszFilename, HANDLE& hFile, HANDLE& hMapping,
+	uint64_t& size, uint64_t* pTime)
+{
+	hMapping = nullptr;
+	hFile = CreateFileA(pszFilename, GENERIC_READ, FILE_SHARE_READ, nullptr,
+		OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (hFile == INVALID_HANDLE_VALUE) return nullptr;
+
+	LARGE_INTEGER fileSize;
+	FILETIME lastWrite;
+	const void* pData = nullptr;
+	if (GetFileSizeEx(hFile, &fileSize) && fileSize.QuadPart > 0 &&
+		(!pTime || GetFileTime(hFile, nullptr, nullptr, &lastWrite)))
+	{
+		size = static_cast<uint64_t>(fileSize.QuadPart);
+		if (pTime) *pTime = (static_cast<uint64_t>(lastWrite.dwHighDateTime) << 32) | lastWrite.dwLowDateTime;
+		hMapping = CreateFileMappingA(hFile, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		pData = hMapping ? MapViewOfFile(hMapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+	}
+
+	if (!pData)
+	{
+		if (hMapping) CloseHandle(hMapping);
+		CloseHandle(hFile);
+		hMapping = nullptr;
+		hFile = INVALID_HANDLE_VALUE;
+	}
+
+	return pData;
+}
+
+void XUSG::UnmapFile(const void* pData, HANDLE hFile, HANDLE hMapping)
+{
+	UnmapViewOfFile(pData);
+	CloseHandle(hMapping);
+	CloseHandle(hFile);
+}
@@ -0,0 +1,20 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+namespace XUSG
+{
+	// 64-bit FNV-1a, 8 bytes per step; the hashes chain by passing the previous one as the basis.
+	const uint64_t FNV_BASIS = 0xcbf29ce484222325ull;
+	const uint64_t FNV_PRIME = 0x100000001b3ull;
+
+	uint64_t HashData(const void* pData, size_t size, uint64_t basis = FNV_BASIS);
+
+	// Maps a whole non-empty file read-only; the file size and the last-write time are returned.
+	// On failure, nullptr is returned and both handles are left closed.
+	const void* MapFile(const char* pszFilename, HANDLE& hFile, HANDLE& hMapping,
+		uint64_t& size, uint64_t* pTime = nullptr);
+	void UnmapFile(const void* pData, HANDLE hFile, HANDLE hMapping);
+}
@@ -0,0 +1,548 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include "XUSGMeshSimplifier.h"
+
+using namespace std;
+using namespace XUSG;
+
+namespace
+{
+	struct double3
+	{
+		double x;
+		double y;
+		double z;
+	};
+
+	inline double3 toDouble3(const MeshSimplifier::float3& v)
+	{
+		return { v.x, v.y, v.z };
+	}
+
+	inline double3 sub(const double3& a, const double3& b)
+	{
+		return { a.x - b.x, a.y - b.y, a.z - b.z };
+	}
+
+	inline double3 cross(const double3& a, const double3& b)
+	{
+		return { a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x };
+	}
+
+	inline double dot(const double3& a, const double3& b)
+	{
+		return a.x * b.x + a.y * b.y + a.z * b.z;
+	}
+
+	inline uint64_t getHeapKey(float cost, uint32_t slot)
+	{
+		uint32_t costBits;
+		memcpy(&costBits, &cost, sizeof(float));
+
+		return (static_cast<uint64_t>(costBits) << 32) | slot;
+	}
+
+	inline double3 triNormal(const double3& p0, const double3& p1, const double3& p2)
+	{
+		return cross(sub(p1, p0), sub(p2, p0));
+	}
+}
+
+MeshSimplifier::MeshSimplifier() :
+	m_numTris(0),
+	m_markStamp(0),
+	m_error(0.0f)
+{
+}
+
+MeshSimplifier::~MeshSimplifier()
+{
+}
+
+void MeshSimplifier::Simplify(const uint8_t* pVertices, uint32_t numVertices, uint32_t stride,
+	const uint32_t* pIndices, uint32_t numIndices, uint32_t targetNumTriangles,
+	float maxError, uint32_t numThreads)
+{
+	m_error = 0.0f;
+	weldPositions(pVertices, numVertices, stride, pIndices, numIndices);
+
+	// Lock the vertices on the faces of the AABB.
+	const auto numPos = static_cast<uint32_t>(m_positions.size());
+	m_aabbMin = m_aabbMax = numPos > 0 ? m_positions[0] : float3(0.0f, 0.0f, 0.0f);
+	for (const auto& p : m_positions)
+	{
+		m_aabbMin = float3((min)(p.x, m_aabbMin.x), (min)(p.y, m_aabbMin.y), (min)(p.z, m_aabbMin.z));
+		m_aabbMax = float3((max)(p.x, m_aabbMax.x), (max)(p.y, m_aabbMax.y), (max)(p.z, m_aabbMax.z));
+	}
+
+	m_locked.resize(numPos);
+	for (auto i = 0u; i < numPos; ++i)
+	{
+		const auto& p = m_positions[i];
+		m_locked[i] = p.x == m_aabbMin.x || p.y == m_aabbMin.y || p.z == m_aabbMin.z ||
+			p.x == m_aabbMax.x || p.y == m_aabbMax.y || p.z == m_aabbMax.z;
+	}
+
+	m_removed.assign(numPos, 0);
+	m_versions.assign(numPos, 0);
+	m_marks.assign(numPos, 0);
+	m_markStamp = 0;
+
+	ThreadPool threadPool(numThreads);
+	vector<uint64_t> edges;
+	computeQuadrics(threadPool, edges);
+
+	// Evaluate the initial collapses in parallel. The min-heap holds 8-byte keys of the cost bits
+	// (ordered like the non-negative costs) over the collapse slots, which also break the ties.
+	const auto numEdges = static_cast<uint32_t>(edges.size());
+	vector<Collapse> collapses(numEdges);
+	vector<uint64_t> heap(numEdges);
+	threadPool.ParallelFor(numEdges, [&](uint32_t begin, uint32_t end)
+	{
+		for (auto i = begin; i < end; ++i)
+		{
+			auto& c = collapses[i];
+			const auto isValid = makeCollapse(static_cast<uint32_t>(edges[i] >> 32), static_cast<uint32_t>(edges[i]), c);
+			heap[i] = isValid ? getHeapKey(c.Cost, i) : UINT64_MAX;
+		}
+	}, 4096);
+	heap.erase(remove(heap.begin(), heap.end(), UINT64_MAX), heap.end());
+	make_heap(heap.begin(), heap.end(), greater<uint64_t>());
+
+	const auto maxCost = static_cast<double>(maxError) * maxError;
+	while (m_numTris > targetNumTriangles && !heap.empty())
+	{
+		pop_heap(heap.begin(), heap.end(), greater<uint64_t>());
+		const auto c = collapses[static_cast<uint32_t>(heap.back())];
+		heap.pop_back();
+
+		// Skip the collapses whose vertices have changed since they were evaluated.
+		if (m_removed[c.V0] || m_removed[c.V1] || c.Version0 != m_versions[c.V0] || c.Version1 != m_versions[c.V1]) continue;
+
+		float3 target;
+		const auto cost = evaluateCollapse(c.V0, c.V1, target);
+		if (cost > maxCost) break;
+
+		const auto removed = m_locked[c.V0] ? c.V1 : c.V0;
+		const auto kept = removed == c.V0 ? c.V1 : c.V0;
+		if (!isCollapseValid(removed, kept, target)) continue;
+		collapse(removed, kept, target, cost);
+
+		// Re-evaluate the edges around the kept vertex.
+		const auto stamp = ++m_markStamp;
+		m_marks[kept] = stamp;
+		for (const auto& t : m_vertexTris[kept])
+		{
+			for (uint8_t k = 0; k < 3; ++k)
+			{
+				const auto v = m_indices[t * 3 + k];
+				if (m_marks[v] == stamp) continue;
+				m_marks[v] = stamp;
+
+				Collapse e;
+				if (!makeCollapse((min)(kept, v), (max)(kept, v), e)) continue;
+				heap.emplace_back(getHeapKey(e.Cost, static_cast<uint32_t>(collapses.size())));
+				push_heap(heap.begin(), heap.end(), greater<uint64_t>());
+				collapses.emplace_back(e);
+			}
+		}
+	}
+
+	compact();
+}
+
+uint32_t MeshSimplifier::GetNumVertices() const
+{
+	return static_cast<uint32_t>(m_positions.size());
+}
+
+uint32_t MeshSimplifier::GetNumIndices() const
+{
+	return static_cast<uint32_t>(m_indices.size());
+}
+
+const MeshSimplifier::float3* MeshSimplifier::GetPositions() const
+{
+	return m_positions.data();
+}
+
+const uint32_t* MeshSimplifier::GetSourceVertices() const
+{
+	return m_sourceVertices.data();
+}
+
+const uint32_t* MeshSimplifier::GetIndices() const
+{
+	return m_indices.data();
+}
+
+float MeshSimplifier::GetError() const
+{
+	return m_error;
+}
+
+void MeshSimplifier::weldPositions(const uint8_t* pVertices, uint32_t numVertices, uint32_t stride,
+	const uint32_t* pIndices, uint32_t numIndices)
+{
+	// Group bit-identical positions; each group is represented by its smallest vertex index.
+	const auto getPosition = [pVertices, stride](uint32_t i)
+	{
+		return reinterpret_cast<const uint32_t*>(pVertices + static_cast<size_t>(stride) * i);
+	};
+
+	vector<uint32_t> order(numVertices);
+	for (auto i = 0u; i < numVertices; ++i) order[i] = i;
+	sort(order.begin(), order.end(), [&getPosition](uint32_t a, uint32_t b)
+	{
+		const auto pa = getPosition(a);
+		const auto pb = getPosition(b);
+		for (uint8_t k = 0; k < 3; ++k) if (pa[k] != pb[k]) return pa[k] < pb[k];
+
+		return a < b;
+	});
+
+	vector<uint32_t> remap(numVertices);
+	for (auto i = 0u; i < numVertices;)
+	{
+		auto j = i + 1;
+		while (j < numVertices && memcmp(getPosition(order[i]), getPosition(order[j]), sizeof(float3)) == 0) ++j;
+		for (auto k = i; k < j; ++k) remap[order[k]] = order[i];
+		i = j;
+	}
+
+	m_positions.clear();
+	m_sourceVertices.clear();
+	for (auto i = 0u; i < numVertices; ++i)
+	{
+		if (remap[i] != i) continue;
+		m_positions.emplace_back(reinterpret_cast<const float*>(getPosition(i)));
+		m_sourceVertices.emplace_back(i);
+	}
+
+	// Representatives precede the rest of their groups, so they are renumbered first.
+	for (auto i = 0u, j = 0u; i < numVertices; ++i) remap[i] = remap[i] == i ? j++ : remap[remap[i]];
+
+	// Degenerate triangles after welding are dropped from the start.
+	const auto numTris = numIndices / 3;
+	m_indices.resize(numTris * 3);
+	m_deadTris.assign(numTris, 0);
+	m_numTris = numTris;
+	for (auto i = 0u; i < numTris; ++i)
+	{
+		const auto v0 = m_indices[i * 3] = remap[pIndices[i * 3]];
+		const auto v1 = m_indices[i * 3 + 1] = remap[pIndices[i * 3 + 1]];
+		const auto v2 = m_indices[i * 3 + 2] = remap[pIndices[i * 3 + 2]];
+		if (v0 == v1 || v1 == v2 || v2 == v0)
+		{
+			m_deadTris[i] = 1;
+			--m_numTris;
+		}
+	}
+}
+
+void MeshSimplifier::computeQuadrics(ThreadPool& threadPool, vector<uint64_t>& edges)
+{
+	const auto numPos = static_cast<uint32_t>(m_positions.size());
+	const auto numTris = static_cast<uint32_t>(m_indices.size() / 3);
+
+	// Vertex-to-triangle adjacency in the triangle order
+	vector<uint32_t> counts(numPos, 0);
+	for (auto i = 0u; i < numTris; ++i)
+		if (!m_deadTris[i]) for (uint8_t k = 0; k < 3; ++k) ++counts[m_indices[i * 3 + k]];
+	m_vertexTris.assign(numPos, vector<uint32_t>());
+	for (auto i = 0u; i < numPos; ++i) m_vertexTris[i].reserve(counts[i]);
+	for (auto i = 0u; i < numTris; ++i)
+		if (!m_deadTris[i]) for (uint8_t k = 0; k < 3; ++k) m_vertexTris[m_indices[i * 3 + k]].emplace_back(i);
+
+	// Plane quadrics of the triangles, gathered per vertex so that the sums are deterministic
+	vector<Quadric> triQuadrics(numTris);
+	threadPool.ParallelFor(numTris, [&](uint32_t begin, uint32_t end)
+	{
+		for (auto i = begin; i < end; ++i)
+		{
+			auto& q = triQuadrics[i];
+			memset(&q, 0, sizeof(Quadric));
+			if (m_deadTris[i]) continue;
+
+			const auto p0 = toDouble3(m_positions[m_indices[i * 3]]);
+			const auto n = triNormal(p0, toDouble3(m_positions[m_indices[i * 3 + 1]]), toDouble3(m_positions[m_indices[i * 3 + 2]]));
+			const auto l = sqrt(dot(n, n));
+			if (l > 0.0) addPlane(q, n.x / l, n.y / l, n.z / l, -dot(n, p0) / l);
+		}
+	}, 4096);
+
+	m_quadrics.resize(numPos);
+	threadPool.ParallelFor(numPos, [&](uint32_t begin, uint32_t end)
+	{
+		for (auto i = begin; i < end; ++i)
+		{
+			auto& q = m_quadrics[i];
+			memset(&q, 0, sizeof(Quadric));
+			for (const auto& t : m_vertexTris[i])
+				for (uint8_t k = 0; k < 10; ++k) q.A[k] += triQuadrics[t].A[k];
+		}
+	}, 4096);
+
+	// Unique edges; the ones with a single triangle are boundaries, which get a plane through
+	// the edge perpendicular to their triangle, so that they keep their shape.
+	vector<pair<uint64_t, uint32_t>> triEdges;
+	triEdges.reserve(static_cast<size_t>(m_numTris) * 3);
+	for (auto i = 0u; i < numTris; ++i)
+	{
+		if (m_deadTris[i]) continue;
+		for (uint8_t k = 0; k < 3; ++k)
+		{
+			const auto v0 = m_indices[i * 3 + k];
+			const auto v1 = m_indices[i * 3 + (k + 1) % 3];
+			triEdges.emplace_back((static_cast<uint64_t>((min)(v0, v1)) << 32) | (max)(v0, v1), i);
+		}
+	}
+	sort(triEdges.begin(), triEdges.end());
+
+	edges.clear();
+	edges.reserve(triEdges.size() / 2 + 1);
+	const auto numTriEdges = triEdges.size();
+	for (size_t i = 0; i < numTriEdges;)
+	{
+		auto j = i + 1;
+		while (j < numTriEdges && triEdges[j].first == triEdges[i].first) ++j;
+		edges.emplace_back(triEdges[i].first);
+
+		if (j - i == 1)
+		{
+			const auto t = triEdges[i].second;
+			const auto v0 = static_cast<uint32_t>(triEdges[i].first >> 32);
+			const auto v1 = static_cast<uint32_t>(triEdges[i].first);
+			const auto p0 = toDouble3(m_positions[v0]);
+			const auto n = triNormal(toDouble3(m_positions[m_indices[t * 3]]),
+				toDouble3(m_positions[m_indices[t * 3 + 1]]), toDouble3(m_positions[m_indices[t * 3 + 2]]));
+			const auto b = cross(sub(toDouble3(m_positions[v1]), p0), n);
+			const auto l = sqrt(dot(b, b));
+			if (l > 0.0)
+			{
+				Quadric q = {};
+				addPlane(q, b.x / l, b.y / l, b.z / l, -dot(b, p0) / l);
+				for (uint8_t k = 0; k < 10; ++k)
+				{
+					m_quadrics[v0].A[k] += q.A[k];
+					m_quadrics[v1].A[k] += q.A[k];
+				}
+			}
+		}
+
+		i = j;
+	}
+}
+
+double MeshSimplifier::evaluateCollapse(uint32_t v0, uint32_t v1, float3& target) const
+{
+	Quadric q;
+	for (uint8_t k = 0; k < 10; ++k) q.A[k] = m_quadrics[v0].A[k] + m_quadrics[v1].A[k];
+
+	const auto& p0 = m_positions[v0];
+	const auto& p1 = m_positions[v1];
+	if (m_locked[v0] || m_locked[v1]) target = m_locked[v0] ? p0 : p1;
+	else
+	{
+		// Minimize the quadric by Cramer's rule, unless the system is ill-conditioned.
+		const auto& a = q.A;
+		const auto c00 = a[4] * a[7] - a[5] * a[5];
+		const auto c01 = a[2] * a[5] - a[1] * a[7];
+		const auto c02 = a[1] * a[5] - a[2] * a[4];
+		const auto det = a[0] * c00 + a[1] * c01 + a[2] * c02;
+		const auto scale = (max)((max)(fabs(a[0]), fabs(a[4])), fabs(a[7]));
+		if (fabs(det) > 1e-9 * scale * scale * scale)
+		{
+			const auto c11 = a[0] * a[7] - a[2] * a[2];
+			const auto c12 = a[1] * a[2] - a[0] * a[5];
+			const auto c22 = a[0] * a[4] - a[1] * a[1];
+			const auto x = -(c00 * a[3] + c01 * a[6] + c02 * a[8]) / det;
+			const auto y = -(c01 * a[3] + c11 * a[6] + c12 * a[8]) / det;
+			const auto z = -(c02 * a[3] + c12 * a[6] + c22 * a[8]) / det;
+			target = float3(
+				(min)((max)(static_cast<float>(x), m_aabbMin.x), m_aabbMax.x),
+				(min)((max)(static_cast<float>(y), m_aabbMin.y), m_aabbMax.y),
+				(min)((max)(static_cast<float>(z), m_aabbMin.z), m_aabbMax.z));
+		}
+		else
+		{
+			// Fall back to the best of the end points and the midpoint.
+			const float3 candidates[] =
+			{
+				p0, p1, float3((p0.x + p1.x) * 0.5f, (p0.y + p1.y) * 0.5f, (p0.z + p1.z) * 0.5f)
+			};
+			auto bestCost = DBL_MAX;
+			for (const auto& p : candidates)
+			{
+				const auto cost = evaluate(q, p.x, p.y, p.z);
+				if (cost < bestCost)
+				{
+					bestCost = cost;
+					target = p;
+				}
+			}
+		}
+	}
+
+	return (max)(evaluate(q, target.x, target.y, target.z), 0.0);
+}
+
+bool MeshSimplifier::makeCollapse(uint32_t v0, uint32_t v1, Collapse& collapse) const
+{
+	// Two locked vertices cannot be merged without changing the AABB.
+	if (m_locked[v0] && m_locked[v1]) return false;
+
+	float3 target;
+	collapse.Cost = static_cast<float>(evaluateCollapse(v0, v1, target));
+	collapse.V0 = v0;
+	collapse.V1 = v1;
+	collapse.Version0 = m_versions[v0];
+	collapse.Version1 = m_versions[v1];
+
+	return true;
+}
+
+bool MeshSimplifier::isCollapseValid(uint32_t removed, uint32_t kept, const float3& target)
+{
+	// Link condition: the vertices may only share the neighbors opposite to their shared edge.
+	const auto stamp = m_markStamp + 1;
+	m_markStamp += 2;
+	auto numSharedTris = 0u;
+	for (const auto& t : m_vertexTris[removed])
+	{
+		if (m_deadTris[t]) continue;
+		const auto pTri = &m_indices[t * 3];
+		numSharedTris += pTri[0] == kept || pTri[1] == kept || pTri[2] == kept ? 1 : 0;
+		for (uint8_t k = 0; k < 3; ++k) m_marks[pTri[k]] = stamp;
+	}
+
+	auto numSharedVerts = 0u;
+	for (const auto& t : m_vertexTris[kept])
+	{
+		if (m_deadTris[t]) continue;
+		for (uint8_t k = 0; k < 3; ++k)
+		{
+			const auto v = m_indices[t * 3 + k];
+			if (v != removed && v != kept && m_marks[v] == stamp)
+			{
+				m_marks[v] = stamp + 1;
+				++numSharedVerts;
+			}
+		}
+	}
+	if (numSharedVerts != numSharedTris) return false;
+
+	// The surviving triangles around both vertices must not flip or degenerate.
+	const auto p = toDouble3(target);
+	for (const auto& v : { removed, kept })
+	{
+		const auto other = v == removed ? kept : removed;
+		for (const auto& t : m_vertexTris[v])
+		{
+			if (m_deadTris[t]) continue;
+			const auto pTri = &m_indices[t * 3];
+			if (pTri[0] == other || pTri[1] == other || pTri[2] == other) continue;
+
+			double3 pos[3], q[3];
+			for (uint8_t k = 0; k < 3; ++k)
+			{
+				pos[k] = toDouble3(m_positions[pTri[k]]);
+				q[k] = pTri[k] == v ? p : pos[k];
+			}
+			const auto n0 = triNormal(pos[0], pos[1], pos[2]);
+			const auto n1 = triNormal(q[0], q[1], q[2]);
+			if (dot(n0, n1) <= 1e-3 * sqrt(dot(n0, n0) * dot(n1, n1))) return false;
+		}
+	}
+
+	return true;
+}
+
+void MeshSimplifier::collapse(uint32_t removed, uint32_t kept, const float3& target, double cost)
+{
+	auto& keptTris = m_vertexTris[kept];
+	for (const auto& t : m_vertexTris[removed])
+	{
+		if (m_deadTris[t]) continue;
+
+		const auto pTri = &m_indices[t * 3];
+		if (pTri[0] == kept || pTri[1] == kept || pTri[2] == kept)
+		{
+			m_deadTris[t] = 1;
+			--m_numTris;
+		}
+		else
+		{
+			for (uint8_t k = 0; k < 3; ++k) pTri[k] = pTri[k] == removed ? kept : pTri[k];
+			keptTris.emplace_back(t);
+		}
+	}
+	vector<uint32_t>().swap(m_vertexTris[removed]);
+	keptTris.erase(remove_if(keptTris.begin(), keptTris.end(),
+		[this](uint32_t t) { return m_deadTris[t] != 0; }), keptTris.end());
+
+	m_removed[removed] = 1;
+	m_positions[kept] = target;
+	for (uint8_t k = 0; k < 10; ++k) m_quadrics[kept].A[k] += m_quadrics[removed].A[k];
+	++m_versions[kept];
+	m_error = (max)(m_error, static_cast<float>(sqrt(cost)));
+}
+
+void MeshSimplifier::compact()
+{
+	// Keep the referenced vertices in their order, and the surviving triangles in theirs.
+	const auto numPos = static_cast<uint32_t>(m_positions.size());
+	const auto numTris = static_cast<uint32_t>(m_deadTris.size());
+	vector<uint32_t> remap(numPos, UINT32_MAX);
+	for (auto i = 0u; i < numTris; ++i)
+		if (!m_deadTris[i]) for (uint8_t k = 0; k < 3; ++k) remap[m_indices[i * 3 + k]] = 0;
+
+	auto numVerts = 0u;
+	for (auto i = 0u; i < numPos; ++i)
+	{
+		if (remap[i] == UINT32_MAX) continue;
+		remap[i] = numVerts;
+		m_positions[numVerts] = m_positions[i];
+		m_sourceVertices[numVerts++] = m_sourceVertices[i];
+	}
+	m_positions.resize(numVerts);
+	m_sourceVertices.resize(numVerts);
+
+	auto numIndices = 0u;
+	for (auto i = 0u; i < numTris; ++i)
+		if (!m_deadTris[i]) for (uint8_t k = 0; k < 3; ++k) m_indices[numIndices++] = remap[m_indices[i * 3 + k]];
+	m_indices.resize(numIndices);
+
+	// Release the working data.
+	vector<Quadric>().swap(m_quadrics);
+	vector<vector<uint32_t>>().swap(m_vertexTris);
+	vector<uint32_t>().swap(m_versions);
+	vector<uint32_t>().swap(m_marks);
+	vector<uint8_t>().swap(m_locked);
+	vector<uint8_t>().swap(m_removed);
+	vector<uint8_t>().swap(m_deadTris);
+}
+
+void MeshSimplifier::addPlane(Quadric& q, double a, double b, double c, double d)
+{
+	q.A[0] += a * a;
+	q.A[1] += a * b;
+	q.A[2] += a * c;
+	q.A[3] += a * d;
+	q.A[4] += b * b;
+	q.A[5] += b * c;
+	q.A[6] += b * d;
+	q.A[7] += c * c;
+	q.A[8] += c * d;
+	q.A[9] += d * d;
+}
+
+double MeshSimplifier::evaluate(const Quadric& q, double x, double y, double z)
+{
+	const auto& a = q.A;
+
+	return a[0] * x * x + 2.0 * a[1] * x * y + 2.0 * a[2] * x * z + 2.0 * a[3] * x +
+		a[4] * y * y + 2.0 * a[5] * y * z + 2.0 * a[6] * y + a[7] * z * z + 2.0 * a[8] * z + a[9];
+}
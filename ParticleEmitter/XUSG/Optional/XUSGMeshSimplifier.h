@@ -0,0 +1,95 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include "XUSGThreadPool.h"
+
+namespace XUSG
+{
+	// Quadric error metric simplification by edge collapses [Garland and Heckbert 1997]
+	class MeshSimplifier
+	{
+	public:
+		struct float3
+		{
+			float x;
+			float y;
+			float z;
+
+			float3() = default;
+			constexpr float3(float _x, float _y, float _z) : x(_x), y(_y), z(_z) {}
+			explicit float3(const float* pArray) : x(pArray[0]), y(pArray[1]), z(pArray[2]) {}
+
+			float3& operator= (const float3& Float3) { x = Float3.x; y = Float3.y; z = Float3.z; return *this; }
+		};
+
+		MeshSimplifier();
+		virtual ~MeshSimplifier();
+
+		// Collapses the edges in the order of their quadric error, until at most targetNumTriangles
+		// remain, or the next collapse would move a vertex farther than maxError from the planes of
+		// the triangles it absorbed. The vertices read their positions from the first 12 bytes.
+		// Coincident positions are welded first, so attribute seams do not crack. Vertices on the
+		// faces of the AABB are never moved or removed, and new positions are clamped into the AABB,
+		// so the AABB is preserved. The collapse order is deterministic; the quadrics and the initial
+		// edge costs are evaluated on numThreads threads.
+		void Simplify(const uint8_t* pVertices, uint32_t numVertices, uint32_t stride,
+			const uint32_t* pIndices, uint32_t numIndices, uint32_t targetNumTriangles,
+			float maxError = FLT_MAX, uint32_t numThreads = 1);
+
+		uint32_t GetNumVertices() const;
+		uint32_t GetNumIndices() const;
+		const float3* GetPositions() const;
+		const uint32_t* GetSourceVertices() const;	// Input vertex that lends its attributes to each output vertex
+		const uint32_t* GetIndices() const;
+		float GetError() const;						// Largest error of the performed collapses
+
+	protected:
+		struct Quadric
+		{
+			double A[10];	// Upper triangle of the symmetric 4x4 matrix: xx xy xz xw yy yz yw zz zw ww
+		};
+
+		// Kept compact; the target position is re-evaluated when a collapse is popped. The versions are
+		// 32-bit, as a vertex that absorbs many collapses would wrap a 16-bit one around to a stale match.
+		struct Collapse
+		{
+			float		Cost;
+			uint32_t	V0;
+			uint32_t	V1;
+			uint32_t	Version0;
+			uint32_t	Version1;
+		};
+
+		void weldPositions(const uint8_t* pVertices, uint32_t numVertices, uint32_t stride,
+			const uint32_t* pIndices, uint32_t numIndices);
+		void computeQuadrics(ThreadPool& threadPool, std::vector<uint64_t>& edges);
+		double evaluateCollapse(uint32_t v0, uint32_t v1, float3& target) const;
+		bool makeCollapse(uint32_t v0, uint32_t v1, Collapse& collapse) const;
+		bool isCollapseValid(uint32_t removed, uint32_t kept, const float3& target);
+		void collapse(uint32_t removed, uint32_t kept, const float3& target, double cost);
+		void compact();
+
+		static void addPlane(Quadric& q, double a, double b, double c, double d);
+		static double evaluate(const Quadric& q, double x, double y, double z);
+
+		std::vector<float3>					m_positions;
+		std::vector<uint32_t>				m_sourceVertices;
+		std::vector<uint32_t>				m_indices;
+		std::vector<Quadric>				m_quadrics;
+		std::vector<std::vector<uint32_t>>	m_vertexTris;
+		std::vector<uint32_t>				m_versions;
+		std::vector<uint32_t>				m_marks;
+		std::vector<uint8_t>				m_locked;
+		std::vector<uint8_t>				m_removed;
+		std::vector<uint8_t>				m_deadTris;
+
+		float3		m_aabbMin;
+		float3		m_aabbMax;
+		uint32_t	m_numTris;
+		uint32_t	m_markStamp;
+		float		m_error;
+	};
+}
@@ -0,0 +1,323 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include "XUSGMeshletBuilder.h"
+
+using namespace std;
+using namespace XUSG;
+
+namespace
+{
+	using float3 = MeshletBuilder::float3;
+
+	inline float3 sub(const float3& a, const float3& b)
+	{
+		return float3(a.x - b.x, a.y - b.y, a.z - b.z);
+	}
+
+	inline float3 cross(const float3& a, const float3& b)
+	{
+		return float3(a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x);
+	}
+
+	inline float dot(const float3& a, const float3& b)
+	{
+		return a.x * b.x + a.y * b.y + a.z * b.z;
+	}
+
+	inline float3 scale(const float3& a, float s)
+	{
+		return float3(a.x * s, a.y * s, a.z * s);
+	}
+
+	inline const float3& getPosition(const uint8_t* pVertices, uint32_t stride, uint32_t i)
+	{
+		return reinterpret_cast<const float3*>(&pVertices[stride * i])[0];
+	}
+}
+
+MeshletBuilder::MeshletBuilder()
+{
+}
+
+MeshletBuilder::~MeshletBuilder()
+{
+}
+
+void MeshletBuilder::Build(const uint8_t* pVertices, uint32_t numVertices, uint32_t stride,
+	const uint32_t* pIndices, uint32_t numIndices, uint32_t maxVertices,
+	uint32_t maxPrimitives, uint32_t numThreads)
+{
+	m_meshlets.clear();
+	m_bounds.clear();
+	m_vertexIndices.clear();
+	m_primitiveIndices.clear();
+
+	maxVertices = (min)((max)(maxVertices, 3u), 256u);
+	maxPrimitives = (max)(maxPrimitives, 1u);
+	const auto numTris = numIndices / 3;
+	numIndices = numTris * 3;
+
+	// Vertex-to-triangle adjacency in the compressed sparse row form
+	vector<uint32_t> offsets(numVertices + 1, 0);
+	for (auto i = 0u; i < numIndices; ++i) ++offsets[pIndices[i] + 1];
+	for (auto i = 0u; i < numVertices; ++i) offsets[i + 1] += offsets[i];
+	vector<uint32_t> adjacency(numIndices);
+	{
+		vector<uint32_t> cursors(offsets.cbegin(), offsets.cend() - 1);
+		for (auto i = 0u; i < numIndices; ++i) adjacency[cursors[pIndices[i]]++] = i / 3;
+	}
+
+	vector<uint32_t> liveTris(numVertices);
+	for (auto i = 0u; i < numVertices; ++i) liveTris[i] = offsets[i + 1] - offsets[i];
+	vector<uint8_t> emitted(numTris, 0);
+	vector<uint16_t> localIndices(numVertices, UINT16_MAX);
+
+	// Among the unemitted triangles around the meshlet, finds the one adding the fewest vertices
+	// within the budget, then with the fewest live triangles on its vertices, which closes the
+	// holes first. The emitted triangles are dropped from the candidates on the way.
+	vector<uint32_t> candidates;
+	vector<uint32_t> candidateStamps(numTris, 0);
+	const auto findTriangle = [&](uint32_t vertexBudget)
+	{
+		auto bestTri = UINT32_MAX;
+		auto bestScore = UINT64_MAX;
+		auto numCandidates = 0u;
+		for (const auto& t : candidates)
+		{
+			if (emitted[t]) continue;
+			candidates[numCandidates++] = t;
+
+			const auto v0 = pIndices[3 * t];
+			const auto v1 = pIndices[3 * t + 1];
+			const auto v2 = pIndices[3 * t + 2];
+			const auto numNewVerts = static_cast<uint32_t>(localIndices[v0] == UINT16_MAX) +
+				(localIndices[v1] == UINT16_MAX && v1 != v0) +
+				(localIndices[v2] == UINT16_MAX && v2 != v0 && v2 != v1);
+			if (numNewVerts > vertexBudget) continue;
+
+			const auto score = (static_cast<uint64_t>(numNewVerts) << 32) | (liveTris[v0] + liveTris[v1] + liveTris[v2]);
+			if (score < bestScore)
+			{
+				bestScore = score;
+				bestTri = t;
+			}
+		}
+		candidates.resize(numCandidates);
+
+		return bestTri;
+	};
+
+	Meshlet meshlet = {};
+	const auto flush = [&]()
+	{
+		for (auto i = meshlet.VertexOffset; i < meshlet.VertexOffset + meshlet.VertexCount; ++i)
+			localIndices[m_vertexIndices[i]] = UINT16_MAX;
+		m_meshlets.emplace_back(meshlet);
+		meshlet.VertexOffset += meshlet.VertexCount;
+		meshlet.PrimitiveOffset += meshlet.PrimitiveCount;
+		meshlet.VertexCount = 0;
+		meshlet.PrimitiveCount = 0;
+	};
+
+	auto cursor = 0u;
+	for (auto numEmitted = 0u; numEmitted < numTris; ++numEmitted)
+	{
+		auto t = meshlet.PrimitiveCount > 0 ? findTriangle(maxVertices - meshlet.VertexCount) : UINT32_MAX;
+
+		// Seed the next meshlet next to the last one, or else at the next triangle in the input order.
+		if (t == UINT32_MAX)
+		{
+			if (meshlet.PrimitiveCount > 0) flush();
+			t = findTriangle(maxVertices);
+			candidates.clear();
+		}
+
+		for (; t == UINT32_MAX; ++cursor) if (!emitted[cursor]) t = cursor;
+
+		// Append the triangle.
+		uint32_t localTri[3];
+		for (uint8_t k = 0; k < 3; ++k)
+		{
+			const auto v = pIndices[3 * t + k];
+			if (localIndices[v] == UINT16_MAX)
+			{
+				localIndices[v] = static_cast<uint16_t>(meshlet.VertexCount++);
+				m_vertexIndices.emplace_back(v);
+
+				const auto stamp = static_cast<uint32_t>(m_meshlets.size()) + 1;
+				for (auto j = offsets[v]; j < offsets[v + 1]; ++j)
+				{
+					const auto f = adjacency[j];
+					if (!emitted[f] && candidateStamps[f] != stamp)
+					{
+						candidateStamps[f] = stamp;
+						candidates.emplace_back(f);
+					}
+				}
+			}
+			localTri[k] = localIndices[v];
+			--liveTris[v];
+		}
+		m_primitiveIndices.emplace_back(localTri[0] | (localTri[1] << 10) | (localTri[2] << 20));
+		emitted[t] = 1;
+
+		if (++meshlet.PrimitiveCount >= maxPrimitives) flush();
+	}
+	if (meshlet.PrimitiveCount > 0) flush();
+
+	// Compute the bounds.
+	const auto numMeshlets = static_cast<uint32_t>(m_meshlets.size());
+	m_bounds.resize(numMeshlets);
+	ThreadPool threadPool(numThreads);
+	threadPool.ParallelFor(numMeshlets, [&](uint32_t begin, uint32_t end)
+	{
+		for (auto i = begin; i < end; ++i) computeBounds(pVertices, stride, i);
+	}, 256);
+}
+
+uint32_t MeshletBuilder::GetNumMeshlets() const
+{
+	return static_cast<uint32_t>(m_meshlets.size());
+}
+
+const MeshletBuilder::Meshlet* MeshletBuilder::GetMeshlets() const
+{
+	return m_meshlets.data();
+}
+
+const MeshletBuilder::Bounds* MeshletBuilder::GetBounds() const
+{
+	return m_bounds.data();
+}
+
+const uint32_t* MeshletBuilder::GetVertexIndices() const
+{
+	return m_vertexIndices.data();
+}
+
+const uint32_t* MeshletBuilder::GetPrimitiveIndices() const
+{
+	return m_primitiveIndices.data();
+}
+
+bool MeshletBuilder::IsBehindPlane(const Bounds& bounds, const float3& normal, float d)
+{
+	// The AABB corner farthest along the plane normal
+	const float3 p(normal.x >= 0.0f ? bounds.AABBMax.x : bounds.AABBMin.x,
+		normal.y >= 0.0f ? bounds.AABBMax.y : bounds.AABBMin.y,
+		normal.z >= 0.0f ? bounds.AABBMax.z : bounds.AABBMin.z);
+
+	return dot(normal, p) + d <= 0.0f;
+}
+
+bool MeshletBuilder::IsBackFacing(const Bounds& bounds, const float3& eyePt)
+{
+	if (bounds.ConeCutoff >= 1.0f) return false;
+
+	const auto v = sub(bounds.ConeApex, eyePt);
+	const auto l = sqrt(dot(v, v));
+
+	return dot(v, bounds.ConeAxis) >= bounds.ConeCutoff * l;
+}
+
+void MeshletBuilder::computeBounds(const uint8_t* pVertices, uint32_t stride, uint32_t i)
+{
+	const auto& meshlet = m_meshlets[i];
+	const auto pVertIdx = &m_vertexIndices[meshlet.VertexOffset];
+	const auto pPrimIdx = &m_primitiveIndices[meshlet.PrimitiveOffset];
+	const auto getPos = [&](uint32_t j) -> const float3& { return getPosition(pVertices, stride, pVertIdx[j]); };
+	auto& bounds = m_bounds[i];
+
+	// AABB, and the pair of the axis extremes farthest apart as the initial sphere [Ritter 1990]
+	uint32_t minIdx[3] = {}, maxIdx[3] = {};
+	bounds.AABBMin = bounds.AABBMax = getPos(0);
+	for (auto j = 1u; j < meshlet.VertexCount; ++j)
+	{
+		const auto& p = getPos(j);
+		const float pa[] = { p.x, p.y, p.z };
+		float* const pMin[] = { &bounds.AABBMin.x, &bounds.AABBMin.y, &bounds.AABBMin.z };
+		float* const pMax[] = { &bounds.AABBMax.x, &bounds.AABBMax.y, &bounds.AABBMax.z };
+		for (uint8_t k = 0; k < 3; ++k)
+		{
+			if (pa[k] < *pMin[k])
+			{
+				*pMin[k] = pa[k];
+				minIdx[k] = j;
+			}
+			if (pa[k] > *pMax[k])
+			{
+				*pMax[k] = pa[k];
+				maxIdx[k] = j;
+			}
+		}
+	}
+
+	auto maxDistSq = -1.0f;
+	for (uint8_t k = 0; k < 3; ++k)
+	{
+		const auto d = sub(getPos(maxIdx[k]), getPos(minIdx[k]));
+		const auto distSq = dot(d, d);
+		if (distSq > maxDistSq)
+		{
+			maxDistSq = distSq;
+			bounds.Center = scale(float3(getPos(maxIdx[k]).x + getPos(minIdx[k]).x,
+				getPos(maxIdx[k]).y + getPos(minIdx[k]).y, getPos(maxIdx[k]).z + getPos(minIdx[k]).z), 0.5f);
+			bounds.Radius = sqrt(distSq) * 0.5f;
+		}
+	}
+
+	// Grow the sphere to enclose the outliers.
+	for (auto j = 0u; j < meshlet.VertexCount; ++j)
+	{
+		const auto d = sub(getPos(j), bounds.Center);
+		const auto dist = sqrt(dot(d, d));
+		if (dist > bounds.Radius)
+		{
+			const auto radius = (bounds.Radius + dist) * 0.5f;
+			const auto t = (radius - bounds.Radius) / dist;
+			bounds.Center = float3(bounds.Center.x + d.x * t, bounds.Center.y + d.y * t, bounds.Center.z + d.z * t);
+			bounds.Radius = radius;
+		}
+	}
+
+	// Normal cone: the axis averages the unit face normals, and the apex is pulled back along it
+	// until every triangle plane faces away from the apex [meshoptimizer].
+	float3 axis(0.0f, 0.0f, 0.0f);
+	for (auto j = 0u; j < meshlet.PrimitiveCount; ++j)
+	{
+		const auto tri = pPrimIdx[j];
+		const auto& p0 = getPos(tri & 0x3ff);
+		const auto n = cross(sub(getPos((tri >> 10) & 0x3ff), p0), sub(getPos(tri >> 20), p0));
+		const auto l = sqrt(dot(n, n));
+		if (l > 0.0f) axis = float3(axis.x + n.x / l, axis.y + n.y / l, axis.z + n.z / l);
+	}
+
+	const auto axisLen = sqrt(dot(axis, axis));
+	bounds.ConeAxis = axisLen > 0.0f ? scale(axis, 1.0f / axisLen) : float3(0.0f, 0.0f, 1.0f);
+	bounds.ConeApex = bounds.Center;
+	bounds.ConeCutoff = 1.0f;
+	if (!(axisLen > 0.0f)) return;
+
+	auto minDot = 1.0f;
+	auto maxT = 0.0f;
+	for (auto j = 0u; j < meshlet.PrimitiveCount; ++j)
+	{
+		const auto tri = pPrimIdx[j];
+		const auto& p0 = getPos(tri & 0x3ff);
+		const auto n = cross(sub(getPos((tri >> 10) & 0x3ff), p0), sub(getPos(tri >> 20), p0));
+		const auto l = sqrt(dot(n, n));
+		if (!(l > 0.0f)) continue;
+
+		const auto nDotAxis = dot(n, bounds.ConeAxis) / l;
+		minDot = (min)(minDot, nDotAxis);
+		if (nDotAxis > 0.0f) maxT = (max)(maxT, dot(sub(bounds.Center, p0), n) / l / nDotAxis);
+	}
+
+	// Wide cones can hardly ever be culled, so their test is disabled.
+	if (minDot <= 0.1f) return;
+
+	bounds.ConeApex = sub(bounds.Center, scale(bounds.ConeAxis, maxT));
+	bounds.ConeCutoff = sqrt(1.0f - minDot * minDot);
+}
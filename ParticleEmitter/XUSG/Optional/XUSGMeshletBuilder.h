@@ -0,0 +1,84 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include "XUSGThreadPool.h"
+
+namespace XUSG
+{
+	// Partitions an indexed triangle mesh into meshlets (clusters) with culling bounds
+	class MeshletBuilder
+	{
+	public:
+		struct float3
+		{
+			float x;
+			float y;
+			float z;
+
+			float3() = default;
+			constexpr float3(float _x, float _y, float _z) : x(_x), y(_y), z(_z) {}
+			explicit float3(const float* pArray) : x(pArray[0]), y(pArray[1]), z(pArray[2]) {}
+
+			float3& operator= (const float3& Float3) { x = Float3.x; y = Float3.y; z = Float3.z; return *this; }
+		};
+
+		struct Meshlet
+		{
+			uint32_t VertexOffset;		// First entry in the vertex indices
+			uint32_t VertexCount;
+			uint32_t PrimitiveOffset;	// First entry in the primitive indices
+			uint32_t PrimitiveCount;
+		};
+
+		struct Bounds
+		{
+			float3	Center;			// Bounding sphere
+			float	Radius;
+			float3	AABBMin;
+			float3	AABBMax;
+			float3	ConeApex;		// Normal cone; a cutoff of 1 disables the backface test.
+			float3	ConeAxis;
+			float	ConeCutoff;		// Sine of the half angle of the normal cone
+		};
+
+		static const uint32_t MaxVertices = 64;
+		static const uint32_t MaxPrimitives = 124;
+
+		MeshletBuilder();
+		virtual ~MeshletBuilder();
+
+		// Greedily grows each meshlet across the shared edges, preferring the triangles that add the
+		// fewest vertices, so the input order only picks the seeds; a vertex-cache optimized order
+		// keeps them close. The vertices read their positions from the first 12 bytes, so the float
+		// layout is required. Up to 256 vertices per meshlet can be indexed. The bounds are computed
+		// on numThreads threads.
+		void Build(const uint8_t* pVertices, uint32_t numVertices, uint32_t stride,
+			const uint32_t* pIndices, uint32_t numIndices, uint32_t maxVertices = MaxVertices,
+			uint32_t maxPrimitives = MaxPrimitives, uint32_t numThreads = 1);
+
+		uint32_t GetNumMeshlets() const;
+		const Meshlet* GetMeshlets() const;
+		const Bounds* GetBounds() const;
+		const uint32_t* GetVertexIndices() const;		// Mesh vertices referenced by the meshlets
+		const uint32_t* GetPrimitiveIndices() const;	// Meshlet-local triangles packed as 10:10:10 bits
+
+		// Whether every vertex of the meshlet lies on or behind the plane dot(normal, p) + d = 0,
+		// e.g. on or below the ground with normal (0, 1, 0) and d = -groundY
+		static bool IsBehindPlane(const Bounds& bounds, const float3& normal, float d);
+
+		// Whether all triangles of the meshlet face away from the eye position, with the face normals
+		// oriented by the index winding like the normals of ObjLoader
+		static bool IsBackFacing(const Bounds& bounds, const float3& eyePt);
+
+	protected:
+		void computeBounds(const uint8_t* pVertices, uint32_t stride, uint32_t i);
+
+		std::vector<Meshlet>	m_meshlets;
+		std::vector<Bounds>		m_bounds;
+		std::vector<uint32_t>	m_vertexIndices;
+		std::vector<uint32_t>	m_primitiveIndices;
+	};
+}
@@ -3,50 +3,778 @@
 //--------------------------------------------------------------------------------------
 
 #include "XUSGObjLoader.h"
+#include "XUSGMeshSimplifier.h"
+#include "XUSGSIMD.h"
+#include "XUSGFileUtil.h"
+#if XUSG_SIMD_X86
+#include <immintrin.h>
+#endif
 
 using namespace std;
 using namespace XUSG;
 
-ObjLoader::ObjLoader()
+namespace
 {
+	inline bool isSpace(char c)
+	{
+		return c == ' ' || c == '\t' || c == '\r';
+	}
+
+	inline bool isDigit(char c)
+	{
+		return c >= '0' && c <= '9';
+	}
+
+	inline const char* skipSpaces(const char* p, const char* pEnd)
+	{
+		while (p < pEnd && isSpace(*p)) ++p;
+
+		return p;
+	}
+
+	inline const char* skipLine(const char* p, const char* pEnd)
+	{
+		while (p < pEnd && *p != '\n') ++p;
+
+		return p < pEnd ? p + 1 : p;
+	}
+
+	const uint32_t cacheMagic = 0x48534d58; // "XMSH"
+	const uint32_t cacheVersion = 2;
+
+	enum CacheFlag : uint32_t
+	{
+		CACHE_NEED_NORM	= (1 << 0),
+		CACHE_FOR_DX	= (1 << 1),
+		CACHE_SWAP_YZ	= (1 << 2),
+		CACHE_OPTIMIZE	= (1 << 3)
+	};
+
+	const uint32_t vertexCacheSize = 16;
+
+	inline uint16_t encodeUnorm16(float x, float lo, float hi)
+	{
+		const auto t = hi > lo ? (x - lo) / (hi - lo) : 0.0f;
+
+		return static_cast<uint16_t>((min)((max)(t, 0.0f), 1.0f) * 65535.0f + 0.5f);
+	}
+
+	inline float decodeUnorm16(uint16_t x, float lo, float hi)
+	{
+		return lo + (hi - lo) * (x / 65535.0f);
+	}
+
+	// Reflects the lower hemisphere of the octahedron across the diagonals; it is an involution.
+	inline void foldOctahedron(float& x, float& y)
+	{
+		const auto ox = x;
+		x = (1.0f - fabs(y)) * (ox >= 0.0f ? 1.0f : -1.0f);
+		y = (1.0f - fabs(ox)) * (y >= 0.0f ? 1.0f : -1.0f);
+	}
+
+	string getCacheFileName(const char* pszFilename)
+	{
+		return string(pszFilename) + ".cache";
+	}
+
+	// Returns p unchanged if there is no integer at p.
+	const char* parseInt(const char* p, const char* pEnd, int64_t& value)
+	{
+		const auto pStart = p;
+		const auto neg = p < pEnd && *p == '-';
+		if (p < pEnd && (*p == '-' || *p == '+')) ++p;
+		if (p >= pEnd || !isDigit(*p)) return pStart;
+
+		value = 0;
+		for (; p < pEnd && isDigit(*p); ++p) value = value * 10 + (*p - '0');
+		value = neg ? -value : value;
+
+		return p;
+	}
+
+	// Parses a decimal float with the same result as strtof(). The common cases take the
+	// exact fast paths (Clinger), and the rest falls back to strtof() on a local copy.
+	const char* parseFloat(const char* p, const char* pEnd, float& value)
+	{
+		static const float pow10f[] = { 1e0f, 1e1f, 1e2f, 1e3f, 1e4f, 1e5f, 1e6f, 1e7f, 1e8f, 1e9f, 1e10f };
+		static const double pow10d[] =
+		{
+			1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+			1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+		};
+
+		const auto pStart = p;
+		const auto neg = p < pEnd && *p == '-';
+		if (p < pEnd && (*p == '-' || *p == '+')) ++p;
+
+		uint64_t mantissa = 0;
+		auto exponent = 0;
+		auto numDigits = 0u;
+		auto hasDigits = false;
+		auto truncated = false;
+		for (; p < pEnd && isDigit(*p); ++p)
+		{
+			hasDigits = true;
+			if (numDigits < 19)
+			{
+				mantissa = mantissa * 10 + (*p - '0');
+				numDigits += mantissa ? 1 : 0;
+			}
+			else
+			{
+				truncated = true;
+				++exponent;
+			}
+		}
+
+		if (p < pEnd && *p == '.')
+		{
+			for (++p; p < pEnd && isDigit(*p); ++p)
+			{
+				hasDigits = true;
+				if (numDigits < 19)
+				{
+					mantissa = mantissa * 10 + (*p - '0');
+					numDigits += mantissa ? 1 : 0;
+					--exponent;
+				}
+				else truncated = true;
+			}
+		}
+
+		if (hasDigits && p < pEnd && (*p == 'e' || *p == 'E'))
+		{
+			int64_t e;
+			const auto pExp = parseInt(p + 1, pEnd, e);
+			if (pExp != p + 1)
+			{
+				exponent += static_cast<int>((max)((min)(e, int64_t(1000)), int64_t(-1000)));
+				p = pExp;
+			}
+		}
+
+		if (hasDigits && !truncated)
+		{
+			if (mantissa <= (1ull << 24) && exponent >= -10 && exponent <= 10)
+			{
+				// Both operands are exact in float, so a single rounding happens.
+				const auto f = static_cast<float>(mantissa);
+				value = exponent < 0 ? f / pow10f[-exponent] : f * pow10f[exponent];
+				value = neg ? -value : value;
+
+				return p;
+			}
+
+			if (mantissa <= (1ull << 53) && exponent >= -22 && exponent <= 22)
+			{
+				// Correctly rounded in double; rounding to float again is exact
+				// unless the double lands right on a float midpoint.
+				const auto d = static_cast<double>(mantissa);
+				const auto r = exponent < 0 ? d / pow10d[-exponent] : d * pow10d[exponent];
+				uint64_t bits;
+				memcpy(&bits, &r, sizeof(bits));
+				if ((bits & 0x1fffffff) != 0x10000000)
+				{
+					value = static_cast<float>(neg ? -r : r);
+
+					return p;
+				}
+			}
+		}
+
+		// Fall back to the CRT for long mantissas, huge exponents, inf, and nan.
+		char buffer[64];
+		auto len = 0u;
+		for (p = pStart; p < pEnd && len + 1 < sizeof(buffer) && !isSpace(*p) && *p != '\n' && *p != '/'; ++p)
+			buffer[len++] = *p;
+		buffer[len] = '\0';
+
+		char* pStop;
+		const auto f = strtof(buffer, &pStop);
+		if (pStop == buffer) return pStart;
+		value = f;
+
+		return pStart + (pStop - buffer);
+	}
+
+	// Normals and bounds kernels. Face normals are float4 rows (x, y, z, 0), one per triangle.
+	// The SIMD kernels evaluate the same operations in the same order as the scalar references,
+	// so they match bit for bit unless the compiler contracts the scalar code into FMAs. Then the
+	// normals differ by up to 1e-6 per component, and up to 2e-4 at vertices whose face normals
+	// nearly cancel out (bunny, dragon and a 1M-triangle sphere); the bounds are always exact.
+	// Position loads are 16 bytes wide, which needs a stride of at least 16 bytes for the
+	// normal kernels (positions with normals); computeBounds leaves the last vertex to the caller.
+	using FaceNormalFunc = void (*)(const uint8_t* pVertices, uint32_t stride,
+		const uint32_t* pIndices, uint32_t begin, uint32_t end, float* pFaceNormals);
+	using VertexNormalFunc = void (*)(const float* pFaceNormals, const uint32_t* pOffsets,
+		const uint32_t* pAdjacency, uint32_t begin, uint32_t end, uint8_t* pVertices, uint32_t stride);
+	using BoundsFunc = void (*)(const uint8_t* pVertices, uint32_t stride,
+		uint32_t begin, uint32_t end, float* pMin, float* pMax);
+
+	void computeFaceNormalsScalar(const uint8_t* pVertices, uint32_t stride,
+		const uint32_t* pIndices, uint32_t begin, uint32_t end, float* pFaceNormals)
+	{
+		for (auto i = begin; i < end; ++i)
+		{
+			const auto pv0 = reinterpret_cast<const float*>(pVertices + stride * pIndices[i * 3]);
+			const auto pv1 = reinterpret_cast<const float*>(pVertices + stride * pIndices[i * 3 + 1]);
+			const auto pv2 = reinterpret_cast<const float*>(pVertices + stride * pIndices[i * 3 + 2]);
+			const float e1[] = { pv1[0] - pv0[0], pv1[1] - pv0[1], pv1[2] - pv0[2] };
+			const float e2[] = { pv2[0] - pv1[0], pv2[1] - pv1[1], pv2[2] - pv1[2] };
+			float n[] = { e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0] };
+			const auto l = sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+
+			// Degenerate triangles do not contribute.
+			const auto pn = &pFaceNormals[i * 4];
+			pn[0] = l > 0.0f ? n[0] / l : 0.0f;
+			pn[1] = l > 0.0f ? n[1] / l : 0.0f;
+			pn[2] = l > 0.0f ? n[2] / l : 0.0f;
+			pn[3] = 0.0f;
+		}
+	}
+
+	void computeVertexNormalsScalar(const float* pFaceNormals, const uint32_t* pOffsets,
+		const uint32_t* pAdjacency, uint32_t begin, uint32_t end, uint8_t* pVertices, uint32_t stride)
+	{
+		for (auto i = begin; i < end; ++i)
+		{
+			// Sum in the triangle order, as the former sequential scatter-adds did.
+			float n[] = { 0.0f, 0.0f, 0.0f };
+			for (auto j = pOffsets[i]; j < pOffsets[i + 1]; ++j)
+			{
+				const auto pn = &pFaceNormals[pAdjacency[j] * 4];
+				n[0] += pn[0];
+				n[1] += pn[1];
+				n[2] += pn[2];
+			}
+
+			const auto l = sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+			const auto pVn = reinterpret_cast<float*>(pVertices + stride * i) + 3;
+			pVn[0] = l > 0.0f ? n[0] / l : 0.0f;
+			pVn[1] = l > 0.0f ? n[1] / l : 0.0f;
+			pVn[2] = l > 0.0f ? n[2] / l : 0.0f;
+		}
+	}
+
+	void computeBoundsScalar(const uint8_t* pVertices, uint32_t stride,
+		uint32_t begin, uint32_t end, float* pMin, float* pMax)
+	{
+		for (auto i = begin; i < end; ++i)
+		{
+			const auto p = reinterpret_cast<const float*>(pVertices + stride * i);
+			for (uint8_t k = 0; k < 3; ++k)
+			{
+				pMin[k] = p[k] < pMin[k] ? p[k] : pMin[k];
+				pMax[k] = p[k] > pMax[k] ? p[k] : pMax[k];
+			}
+		}
+	}
+
+#if XUSG_SIMD_X86
+	// Cross product and normalization of the edges of 4, 8, or 16 triangles in SoA form
+#define XUSG_FACE_NORMAL_SOA(mul, sub, add, sqrt_) \
+	const auto e1x = sub(v1x, v0x), e1y = sub(v1y, v0y), e1z = sub(v1z, v0z); \
+	const auto e2x = sub(v2x, v1x), e2y = sub(v2y, v1y), e2z = sub(v2z, v1z); \
+	const auto nx = sub(mul(e1y, e2z), mul(e1z, e2y)); \
+	const auto ny = sub(mul(e1z, e2x), mul(e1x, e2z)); \
+	const auto nz = sub(mul(e1x, e2y), mul(e1y, e2x)); \
+	const auto l = sqrt_(add(add(mul(nx, nx), mul(ny, ny)), mul(nz, nz)))
+
+	inline __m128 loadFloat3(const uint8_t* pVertices, uint32_t stride, uint32_t i)
+	{
+		return _mm_loadu_ps(reinterpret_cast<const float*>(pVertices + stride * i));
+	}
+
+	void computeFaceNormalsSSE42(const uint8_t* pVertices, uint32_t stride,
+		const uint32_t* pIndices, uint32_t begin, uint32_t end, float* pFaceNormals)
+	{
+		auto i = begin;
+		for (; i + 4 <= end; i += 4)
+		{
+			__m128 v[3][4];
+			for (uint8_t k = 0; k < 3; ++k)
+			{
+				for (uint8_t j = 0; j < 4; ++j) v[k][j] = loadFloat3(pVertices, stride, pIndices[(i + j) * 3 + k]);
+				_MM_TRANSPOSE4_PS(v[k][0], v[k][1], v[k][2], v[k][3]);
+			}
+
+			const auto &v0x = v[0][0], &v0y = v[0][1], &v0z = v[0][2];
+			const auto &v1x = v[1][0], &v1y = v[1][1], &v1z = v[1][2];
+			const auto &v2x = v[2][0], &v2y = v[2][1], &v2z = v[2][2];
+			XUSG_FACE_NORMAL_SOA(_mm_mul_ps, _mm_sub_ps, _mm_add_ps, _mm_sqrt_ps);
+			const auto mask = _mm_cmpgt_ps(l, _mm_setzero_ps());
+			auto rx = _mm_and_ps(_mm_div_ps(nx, l), mask);
+			auto ry = _mm_and_ps(_mm_div_ps(ny, l), mask);
+			auto rz = _mm_and_ps(_mm_div_ps(nz, l), mask);
+			auto rw = _mm_setzero_ps();
+			_MM_TRANSPOSE4_PS(rx, ry, rz, rw);
+			_mm_storeu_ps(&pFaceNormals[i * 4], rx);
+			_mm_storeu_ps(&pFaceNormals[i * 4 + 4], ry);
+			_mm_storeu_ps(&pFaceNormals[i * 4 + 8], rz);
+			_mm_storeu_ps(&pFaceNormals[i * 4 + 12], rw);
+		}
+
+		computeFaceNormalsScalar(pVertices, stride, pIndices, i, end, pFaceNormals);
+	}
+
+	void computeFaceNormalsAVX2(const uint8_t* pVertices, uint32_t stride,
+		const uint32_t* pIndices, uint32_t begin, uint32_t end, float* pFaceNormals)
+	{
+		// Gather positions by float offsets, which covers buffers up to 8 GB.
+		const auto pBase = reinterpret_cast<const float*>(pVertices);
+		const auto vStride = _mm256_set1_epi32(stride / sizeof(float));
+		const auto corners = _mm256_setr_epi32(0, 3, 6, 9, 12, 15, 18, 21);
+		const auto zero = _mm256_setzero_ps();
+
+		auto i = begin;
+		for (; i + 8 <= end; i += 8)
+		{
+			const auto pTriIndices = reinterpret_cast<const int*>(&pIndices[i * 3]);
+			const auto o0 = _mm256_mullo_epi32(_mm256_i32gather_epi32(pTriIndices, corners, 4), vStride);
+			const auto o1 = _mm256_mullo_epi32(_mm256_i32gather_epi32(pTriIndices + 1, corners, 4), vStride);
+			const auto o2 = _mm256_mullo_epi32(_mm256_i32gather_epi32(pTriIndices + 2, corners, 4), vStride);
+			const auto v0x = _mm256_i32gather_ps(pBase, o0, 4), v0y = _mm256_i32gather_ps(pBase + 1, o0, 4), v0z = _mm256_i32gather_ps(pBase + 2, o0, 4);
+			const auto v1x = _mm256_i32gather_ps(pBase, o1, 4), v1y = _mm256_i32gather_ps(pBase + 1, o1, 4), v1z = _mm256_i32gather_ps(pBase + 2, o1, 4);
+			const auto v2x = _mm256_i32gather_ps(pBase, o2, 4), v2y = _mm256_i32gather_ps(pBase + 1, o2, 4), v2z = _mm256_i32gather_ps(pBase + 2, o2, 4);
+			XUSG_FACE_NORMAL_SOA(_mm256_mul_ps, _mm256_sub_ps, _mm256_add_ps, _mm256_sqrt_ps);
+			const auto mask = _mm256_cmp_ps(l, zero, _CMP_GT_OQ);
+			const auto rx = _mm256_and_ps(_mm256_div_ps(nx, l), mask);
+			const auto ry = _mm256_and_ps(_mm256_div_ps(ny, l), mask);
+			const auto rz = _mm256_and_ps(_mm256_div_ps(nz, l), mask);
+
+			// Transpose to rows; each 128-bit lane k of r[j] holds the row of triangle 4k + j.
+			const auto t0 = _mm256_unpacklo_ps(rx, ry), t1 = _mm256_unpackhi_ps(rx, ry);
+			const auto t2 = _mm256_unpacklo_ps(rz, zero), t3 = _mm256_unpackhi_ps(rz, zero);
+			const auto r0 = _mm256_shuffle_ps(t0, t2, 0x44), r1 = _mm256_shuffle_ps(t0, t2, 0xee);
+			const auto r2 = _mm256_shuffle_ps(t1, t3, 0x44), r3 = _mm256_shuffle_ps(t1, t3, 0xee);
+			const auto pn = &pFaceNormals[i * 4];
+			_mm256_storeu_ps(pn, _mm256_permute2f128_ps(r0, r1, 0x20));
+			_mm256_storeu_ps(pn + 8, _mm256_permute2f128_ps(r2, r3, 0x20));
+			_mm256_storeu_ps(pn + 16, _mm256_permute2f128_ps(r0, r1, 0x31));
+			_mm256_storeu_ps(pn + 24, _mm256_permute2f128_ps(r2, r3, 0x31));
+		}
+
+		computeFaceNormalsSSE42(pVertices, stride, pIndices, i, end, pFaceNormals);
+	}
+
+	void computeFaceNormalsAVX512(const uint8_t* pVertices, uint32_t stride,
+		const uint32_t* pIndices, uint32_t begin, uint32_t end, float* pFaceNormals)
+	{
+		const auto pBase = reinterpret_cast<const float*>(pVertices);
+		const auto vStride = _mm512_set1_epi32(stride / sizeof(float));
+		const auto corners = _mm512_setr_epi32(0, 3, 6, 9, 12, 15, 18, 21, 24, 27, 30, 33, 36, 39, 42, 45);
+		const auto zero = _mm512_setzero_ps();
+
+		auto i = begin;
+		for (; i + 16 <= end; i += 16)
+		{
+			const auto pTriIndices = reinterpret_cast<const int*>(&pIndices[i * 3]);
+			const auto o0 = _mm512_mullo_epi32(_mm512_i32gather_epi32(corners, pTriIndices, 4), vStride);
+			const auto o1 = _mm512_mullo_epi32(_mm512_i32gather_epi32(corners, pTriIndices + 1, 4), vStride);
+			const auto o2 = _mm512_mullo_epi32(_mm512_i32gather_epi32(corners, pTriIndices + 2, 4), vStride);
+			const auto v0x = _mm512_i32gather_ps(o0, pBase, 4), v0y = _mm512_i32gather_ps(o0, pBase + 1, 4), v0z = _mm512_i32gather_ps(o0, pBase + 2, 4);
+			const auto v1x = _mm512_i32gather_ps(o1, pBase, 4), v1y = _mm512_i32gather_ps(o1, pBase + 1, 4), v1z = _mm512_i32gather_ps(o1, pBase + 2, 4);
+			const auto v2x = _mm512_i32gather_ps(o2, pBase, 4), v2y = _mm512_i32gather_ps(o2, pBase + 1, 4), v2z = _mm512_i32gather_ps(o2, pBase + 2, 4);
+			XUSG_FACE_NORMAL_SOA(_mm512_mul_ps, _mm512_sub_ps, _mm512_add_ps, _mm512_sqrt_ps);
+			const auto mask = _mm512_cmp_ps_mask(l, zero, _CMP_GT_OQ);
+			const auto rx = _mm512_maskz_div_ps(mask, nx, l);
+			const auto ry = _mm512_maskz_div_ps(mask, ny, l);
+			const auto rz = _mm512_maskz_div_ps(mask, nz, l);
+
+			// Transpose to rows; each 128-bit lane k of r[j] holds the row of triangle 4k + j.
+			const auto t0 = _mm512_unpacklo_ps(rx, ry), t1 = _mm512_unpackhi_ps(rx, ry);
+			const auto t2 = _mm512_unpacklo_ps(rz, zero), t3 = _mm512_unpackhi_ps(rz, zero);
+			const __m512 r[] =
+			{
+				_mm512_shuffle_ps(t0, t2, 0x44), _mm512_shuffle_ps(t0, t2, 0xee),
+				_mm512_shuffle_ps(t1, t3, 0x44), _mm512_shuffle_ps(t1, t3, 0xee)
+			};
+			const auto pn = &pFaceNormals[i * 4];
+			for (uint8_t j = 0; j < 4; ++j)
+			{
+				_mm_storeu_ps(pn + 4 * j, _mm512_extractf32x4_ps(r[j], 0));
+				_mm_storeu_ps(pn + 4 * j + 16, _mm512_extractf32x4_ps(r[j], 1));
+				_mm_storeu_ps(pn + 4 * j + 32, _mm512_extractf32x4_ps(r[j], 2));
+				_mm_storeu_ps(pn + 4 * j + 48, _mm512_extractf32x4_ps(r[j], 3));
+			}
+		}
+
+		computeFaceNormalsAVX2(pVertices, stride, pIndices, i, end, pFaceNormals);
+	}
+
+#undef XUSG_FACE_NORMAL_SOA
+
+	void computeVertexNormalsSSE42(const float* pFaceNormals, const uint32_t* pOffsets,
+		const uint32_t* pAdjacency, uint32_t begin, uint32_t end, uint8_t* pVertices, uint32_t stride)
+	{
+		for (auto i = begin; i < end; ++i)
+		{
+			auto n = _mm_setzero_ps();
+			for (auto j = pOffsets[i]; j < pOffsets[i + 1]; ++j)
+				n = _mm_add_ps(n, _mm_loadu_ps(&pFaceNormals[pAdjacency[j] * 4]));
+
+			// (x * x + y * y) + z * z, in the order of the scalar reference
+			const auto sq = _mm_mul_ps(n, n);
+			const auto l = _mm_sqrt_ss(_mm_add_ss(_mm_add_ss(sq, _mm_shuffle_ps(sq, sq, 0x55)), _mm_shuffle_ps(sq, sq, 0xaa)));
+			const auto ll = _mm_shuffle_ps(l, l, 0);
+			n = _mm_and_ps(_mm_div_ps(n, ll), _mm_cmpgt_ps(ll, _mm_setzero_ps()));
+
+			const auto pVn = reinterpret_cast<float*>(pVertices + stride * i) + 3;
+			_mm_storel_pi(reinterpret_cast<__m64*>(pVn), n);
+			_mm_store_ss(pVn + 2, _mm_movehl_ps(n, n));
+		}
+	}
+
+	void computeBoundsSSE42(const uint8_t* pVertices, uint32_t stride,
+		uint32_t begin, uint32_t end, float* pMin, float* pMax)
+	{
+		auto vMin = _mm_set_ps(0.0f, pMin[2], pMin[1], pMin[0]);
+		auto vMax = _mm_set_ps(0.0f, pMax[2], pMax[1], pMax[0]);
+		for (auto i = begin; i < end; ++i)
+		{
+			const auto p = loadFloat3(pVertices, stride, i);
+			vMin = _mm_min_ps(p, vMin);
+			vMax = _mm_max_ps(p, vMax);
+		}
+
+		alignas(16) float results[2][4];
+		_mm_store_ps(results[0], vMin);
+		_mm_store_ps(results[1], vMax);
+		memcpy(pMin, results[0], sizeof(float[3]));
+		memcpy(pMax, results[1], sizeof(float[3]));
+	}
+
+	void computeBoundsAVX2(const uint8_t* pVertices, uint32_t stride,
+		uint32_t begin, uint32_t end, float* pMin, float* pMax)
+	{
+		// Two vertices per register, one per 128-bit lane
+		const auto vMin0 = _mm_set_ps(0.0f, pMin[2], pMin[1], pMin[0]);
+		const auto vMax0 = _mm_set_ps(0.0f, pMax[2], pMax[1], pMax[0]);
+		auto vMin = _mm256_set_m128(vMin0, vMin0);
+		auto vMax = _mm256_set_m128(vMax0, vMax0);
+		auto i = begin;
+		for (; i + 2 <= end; i += 2)
+		{
+			const auto p = _mm256_set_m128(loadFloat3(pVertices, stride, i + 1), loadFloat3(pVertices, stride, i));
+			vMin = _mm256_min_ps(p, vMin);
+			vMax = _mm256_max_ps(p, vMax);
+		}
+
+		alignas(16) float results[2][4];
+		_mm_store_ps(results[0], _mm_min_ps(_mm256_castps256_ps128(vMin), _mm256_extractf128_ps(vMin, 1)));
+		_mm_store_ps(results[1], _mm_max_ps(_mm256_castps256_ps128(vMax), _mm256_extractf128_ps(vMax, 1)));
+		memcpy(pMin, results[0], sizeof(float[3]));
+		memcpy(pMax, results[1], sizeof(float[3]));
+
+		computeBoundsSSE42(pVertices, stride, i, end, pMin, pMax);
+	}
+
+	void computeBoundsAVX512(const uint8_t* pVertices, uint32_t stride,
+		uint32_t begin, uint32_t end, float* pMin, float* pMax)
+	{
+		// Four vertices per register, one per 128-bit lane
+		auto vMin = _mm512_broadcast_f32x4(_mm_set_ps(0.0f, pMin[2], pMin[1], pMin[0]));
+		auto vMax = _mm512_broadcast_f32x4(_mm_set_ps(0.0f, pMax[2], pMax[1], pMax[0]));
+		auto i = begin;
+		for (; i + 4 <= end; i += 4)
+		{
+			auto p = _mm512_castps128_ps512(loadFloat3(pVertices, stride, i));
+			p = _mm512_insertf32x4(p, loadFloat3(pVertices, stride, i + 1), 1);
+			p = _mm512_insertf32x4(p, loadFloat3(pVertices, stride, i + 2), 2);
+			p = _mm512_insertf32x4(p, loadFloat3(pVertices, stride, i + 3), 3);
+			vMin = _mm512_min_ps(p, vMin);
+			vMax = _mm512_max_ps(p, vMax);
+		}
+
+		auto rMin = _mm_min_ps(_mm512_extractf32x4_ps(vMin, 0), _mm512_extractf32x4_ps(vMin, 1));
+		auto rMax = _mm_max_ps(_mm512_extractf32x4_ps(vMax, 0), _mm512_extractf32x4_ps(vMax, 1));
+		rMin = _mm_min_ps(rMin, _mm_min_ps(_mm512_extractf32x4_ps(vMin, 2), _mm512_extractf32x4_ps(vMin, 3)));
+		rMax = _mm_max_ps(rMax, _mm_max_ps(_mm512_extractf32x4_ps(vMax, 2), _mm512_extractf32x4_ps(vMax, 3)));
+
+		alignas(16) float results[2][4];
+		_mm_store_ps(results[0], rMin);
+		_mm_store_ps(results[1], rMax);
+		memcpy(pMin, results[0], sizeof(float[3]));
+		memcpy(pMax, results[1], sizeof(float[3]));
+
+		computeBoundsSSE42(pVertices, stride, i, end, pMin, pMax);
+	}
+#endif
+
+	FaceNormalFunc getFaceNormalFunc()
+	{
+#if XUSG_SIMD_X86
+		switch (GetSIMDLevel())
+		{
+		case SIMDLevel::AVX512:
+			return computeFaceNormalsAVX512;
+		case SIMDLevel::AVX2:
+			return computeFaceNormalsAVX2;
+		case SIMDLevel::SSE4_2:
+			return computeFaceNormalsSSE42;
+		}
+#endif
+		return computeFaceNormalsScalar;
+	}
+
+	VertexNormalFunc getVertexNormalFunc()
+	{
+#if XUSG_SIMD_X86
+		if (GetSIMDLevel() >= SIMDLevel::SSE4_2) return computeVertexNormalsSSE42;
+#endif
+		return computeVertexNormalsScalar;
+	}
+
+	BoundsFunc getBoundsFunc()
+	{
+#if XUSG_SIMD_X86
+		switch (GetSIMDLevel())
+		{
+		case SIMDLevel::AVX512:
+			return computeBoundsAVX512;
+		case SIMDLevel::AVX2:
+			return computeBoundsAVX2;
+		case SIMDLevel::SSE4_2:
+			return computeBoundsSSE42;
+		}
+#endif
+		return computeBoundsScalar;
+	}
 }
 
-ObjLoader::~ObjLoader()
+ObjLoader::ObjLoader() :
+	m_stride(0),
+	m_hasNormals(false),
+	m_hasTexcoords(false),
+	m_isQuantized(false),
+	m_pCache(nullptr),
+	m_hCacheFile(INVALID_HANDLE_VALUE),
+	m_hCacheMapping(nullptr)
 {
 }
 
-bool ObjLoader::Import(const char* pszFilename, bool needNorm, bool needAABB, bool forDX, bool swapYZ)
+ObjLoader::~ObjLoader()
 {
-	FILE* pFile;
-	fopen_s(&pFile, pszFilename, "r");
+	releaseCache();
+}
 
-	if (!pFile) return false;
+bool ObjLoader::Import(const char* pszFilename, const ImportOptions& options)
+{
+	const auto needNorm = options.NeedNormal;
+	const auto forDX = options.ForDX;
+	const auto swapYZ = options.SwapYZ;
+	const auto useCache = options.UseCache;
+	const auto optimize = options.Optimize;
+	auto numThreads = options.NumThreads;
+
+	releaseCache();
+	m_vertices.clear();
+	m_indices.clear();
+	m_isQuantized = false;
+
+	auto flags = needNorm ? CACHE_NEED_NORM : 0u;
+	flags |= forDX ? CACHE_FOR_DX : 0;
+	flags |= swapYZ ? CACHE_SWAP_YZ : 0;
+	flags |= optimize ? CACHE_OPTIMIZE : 0;
+	if (useCache && loadCache(pszFilename, flags)) return true;
+
+	// Map the OBJ file, so that it can be parsed in a single pass without any staging copies.
+	HANDLE hFile, hMapping;
+	uint64_t fileSize, fileTime;
+	const auto pData = static_cast<const char*>(MapFile(pszFilename, hFile, hMapping, fileSize, &fileTime));
+	if (!pData) return false;
 
 	m_stride = sizeof(float3);
 	m_stride += needNorm ? sizeof(float3) : 0;
 
 	// Import the OBJ file.
-	uint32_t numTexc, numNorm;
-	importGeometryFirstPass(pFile, numTexc, numNorm);
-	rewind(pFile);
-	importGeometrySecondPass(pFile, numTexc, numNorm, forDX, swapYZ);
-	fclose(pFile);
+	ObjGeometry geometry;
+	const auto dataSize = static_cast<size_t>(fileSize);
+	numThreads = numThreads ? numThreads : ThreadPool::GetNumHardwareThreads();
+	if (numThreads > 1) importGeometry(pData, pData + dataSize, forDX, swapYZ, numThreads, geometry);
+	else importGeometry(pData, pData + dataSize, forDX, swapYZ, geometry);
+	const auto fileHash = useCache ? HashData(pData, dataSize) : 0;
+	UnmapFile(pData, hFile, hMapping);
+
+	createGeometry(geometry, needNorm, forDX, swapYZ);
 
 	// Perform post import tasks.
-	if (needNorm && !numNorm) recomputeNormals();
-	if (needAABB) computeAABB();
+	if (needNorm && geometry.Normals.empty()) recomputeNormals(numThreads);
+	if (optimize)
+	{
+		optimizeVertexCache(vertexCacheSize);
+		reorderVertices();
+	}
+	if (options.NeedAABB || useCache) computeAABB();
+
+	// Failing to write the cache is not an error.
+	if (useCache) saveCache(pszFilename, flags, fileSize, fileTime, fileHash);
+
+	return true;
+}
+
+bool ObjLoader::Import(const char* pszFilename, bool needNorm, bool needAABB,
+	bool forDX, bool swapYZ, uint32_t numThreads, bool useCache, bool optimize)
+{
+	ImportOptions options;
+	options.NeedNormal = needNorm;
+	options.NeedAABB = needAABB;
+	options.ForDX = forDX;
+	options.SwapYZ = swapYZ;
+	options.UseCache = useCache;
+	options.Optimize = optimize;
+	options.NumThreads = numThreads;
+
+	return Import(pszFilename, options);
+}
+
+bool ObjLoader::ImportStream(const char* pszFilename, const StreamFunc& func,
+	uint32_t batchSize, bool forDX, bool swapYZ)
+{
+	if (batchSize == 0) return false;
+
+	HANDLE hFile, hMapping;
+	uint64_t fileSize;
+	const auto pData = static_cast<const char*>(MapFile(pszFilename, hFile, hMapping, fileSize, nullptr));
+	if (!pData) return false;
+
+	// Hand out the parsed records and recycle the batch storage.
+	const auto flipWinding = forDX != swapYZ;
+	const FlushFunc flush = [&func, flipWinding](ObjGeometry& geometry)
+	{
+		const auto numTris = static_cast<uint32_t>(geometry.Indices.size() / 3);
+		if (flipWinding)
+		{
+			for (auto i = 0u; i < numTris; ++i)
+			{
+				swap(geometry.Indices[3 * i], geometry.Indices[3 * i + 2]);
+				swap(geometry.NIndices[3 * i], geometry.NIndices[3 * i + 2]);
+				swap(geometry.TIndices[3 * i], geometry.TIndices[3 * i + 2]);
+			}
+		}
+
+		StreamBatch batch;
+		batch.pPositions = geometry.Positions.data();
+		batch.pNormals = geometry.Normals.data();
+		batch.pTexcoords = geometry.Texcoords.data();
+		batch.pIndices = geometry.Indices.data();
+		batch.pNIndices = geometry.NIndices.data();
+		batch.pTIndices = geometry.TIndices.data();
+		batch.NumPositions = static_cast<uint32_t>(geometry.Positions.size());
+		batch.NumNormals = static_cast<uint32_t>(geometry.Normals.size());
+		batch.NumTexcoords = static_cast<uint32_t>(geometry.Texcoords.size());
+		batch.NumTriangles = numTris;
+		batch.BasePosition = geometry.BasePosition;
+		batch.BaseNormal = geometry.BaseNormal;
+		batch.BaseTexcoord = geometry.BaseTexcoord;
+		batch.BaseTriangle = geometry.BaseTriangle;
+		if (batch.NumPositions > 0 || batch.NumNormals > 0 || batch.NumTexcoords > 0 || batch.NumTriangles > 0)
+			func(batch);
+
+		geometry.BasePosition += batch.NumPositions;
+		geometry.BaseNormal += batch.NumNormals;
+		geometry.BaseTexcoord += batch.NumTexcoords;
+		geometry.BaseTriangle += batch.NumTriangles;
+		geometry.Positions.clear();
+		geometry.Normals.clear();
+		geometry.Texcoords.clear();
+		geometry.Indices.clear();
+		geometry.NIndices.clear();
+		geometry.TIndices.clear();
+		geometry.RelIndices.clear();
+		geometry.RelNIndices.clear();
+		geometry.RelTIndices.clear();
+	};
+
+	ObjGeometry geometry;
+	importGeometry(pData, pData + static_cast<size_t>(fileSize), forDX, swapYZ, geometry, batchSize, &flush);
+	flush(geometry);
+	UnmapFile(pData, hFile, hMapping);
 
 	return true;
 }
 
+void ObjLoader::Simplify(uint32_t targetNumTriangles, float maxError, uint32_t numThreads)
+{
+	if (m_isQuantized) return;
+
+	MeshSimplifier simplifier;
+	simplifier.Simplify(GetVertices(), GetNumVertices(), GetVertexStride(), GetIndices(),
+		GetNumIndices(), targetNumTriangles, maxError, numThreads);
+
+	// The simplified mesh supersedes the mapped cache, if any.
+	const auto stride = GetVertexStride();
+	const auto numVert = simplifier.GetNumVertices();
+	const auto pPositions = simplifier.GetPositions();
+	const auto pSourceVertices = simplifier.GetSourceVertices();
+	const auto pSrc = GetVertices();
+	vector<uint8_t> vertices(stride * numVert);
+	for (auto i = 0u; i < numVert; ++i)
+	{
+		memcpy(&vertices[stride * i], pSrc + stride * pSourceVertices[i], stride);
+		memcpy(&vertices[stride * i], &pPositions[i], sizeof(float3));
+	}
+	m_indices.assign(simplifier.GetIndices(), simplifier.GetIndices() + simplifier.GetNumIndices());
+	releaseCache();
+	m_vertices.swap(vertices);
+
+	if (m_hasNormals) recomputeNormals(numThreads);
+}
+
+void ObjLoader::Quantize()
+{
+	if (m_isQuantized) return;
+
+	// The vertices are rewritten, so a mapped cache is copied out first.
+	if (m_pCache)
+	{
+		m_vertices.assign(GetVertices(), GetVertices() + GetVertexStride() * GetNumVertices());
+		m_indices.assign(GetIndices(), GetIndices() + GetNumIndices());
+		releaseCache();
+	}
+
+	computeAABB();
+	const auto numVert = GetNumVertices();
+	if (m_hasTexcoords && numVert > 0)
+	{
+		m_texcoordRange.Min = m_texcoordRange.Max = getTexcoord(0);
+		for (auto i = 1u; i < numVert; ++i)
+		{
+			const auto& t = getTexcoord(i);
+			m_texcoordRange.Min = float2((min)(m_texcoordRange.Min.x, t.x), (min)(m_texcoordRange.Min.y, t.y));
+			m_texcoordRange.Max = float2((max)(m_texcoordRange.Max.x, t.x), (max)(m_texcoordRange.Max.y, t.y));
+		}
+	}
+
+	// Position (with a zero w for the 4-byte element alignment), normal, texcoord
+	auto stride = static_cast<uint32_t>(sizeof(uint16_t[4]));
+	const auto normalOffset = stride;
+	stride += m_hasNormals ? sizeof(int16_t[2]) : 0;
+	const auto texcoordOffset = stride;
+	stride += m_hasTexcoords ? sizeof(uint16_t[2]) : 0;
+
+	vector<uint8_t> vertices(stride * numVert, 0);
+	for (auto i = 0u; i < numVert; ++i)
+	{
+		const auto pDst = &vertices[stride * i];
+		EncodePosition(getPosition(i), m_aabb, reinterpret_cast<uint16_t*>(pDst));
+		if (m_hasNormals) EncodeNormal(getNormal(i), reinterpret_cast<int16_t*>(pDst + normalOffset));
+		if (m_hasTexcoords) EncodeTexcoord(getTexcoord(i), m_texcoordRange, reinterpret_cast<uint16_t*>(pDst + texcoordOffset));
+	}
+
+	m_vertices.swap(vertices);
+	m_stride = stride;
+	m_isQuantized = true;
+}
+
 const uint32_t ObjLoader::GetNumVertices() const
 {
-	return static_cast<uint32_t>(m_vertices.size() / GetVertexStride());
+	return m_pCache ? m_pCache->NumVertices : static_cast<uint32_t>(m_vertices.size() / GetVertexStride());
 }
 
 const uint32_t ObjLoader::GetNumIndices() const
 {
-	return static_cast<uint32_t>(m_indices.size());
+	return m_pCache ? m_pCache->NumIndices : static_cast<uint32_t>(m_indices.size());
 }
 
 const uint32_t ObjLoader::GetVertexStride() const
@@ -56,12 +784,13 @@ const uint32_t ObjLoader::GetVertexStride() const
 
 const uint8_t* ObjLoader::GetVertices() const
 {
-	return m_vertices.data();
+	return m_pCache ? reinterpret_cast<const uint8_t*>(m_pCache) + m_pCache->VertexOffset : m_vertices.data();
 }
 
 const uint32_t* ObjLoader::GetIndices() const
 {
-	return m_indices.data();
+	return m_pCache ? reinterpret_cast<const uint32_t*>(reinterpret_cast<const uint8_t*>(m_pCache) +
+		m_pCache->IndexOffset) : m_indices.data();
 }
 
 const ObjLoader::AABB& ObjLoader::GetAABB() const
@@ -69,350 +798,686 @@ const ObjLoader::AABB& ObjLoader::GetAABB() const
 	return m_aabb;
 }
 
-void ObjLoader::importGeometryFirstPass(FILE* pFile, uint32_t& numTexc, uint32_t& numNorm)
+const ObjLoader::TexcoordRange& ObjLoader::GetTexcoordRange() const
+{
+	return m_texcoordRange;
+}
+
+bool ObjLoader::HasNormals() const
 {
-	auto v = 0u;
-	auto vt = 0u;
-	auto vn = 0u;
-	char buffer[256] = { 0 };
+	return m_hasNormals;
+}
 
-	auto numVert = 0u;
-	auto numTri = 0u;
-	numTexc = 0;
-	numNorm = 0;
+bool ObjLoader::HasTexcoords() const
+{
+	return m_hasTexcoords;
+}
 
-	while (fscanf_s(pFile, "%s", buffer, static_cast<uint32_t>(sizeof(buffer))) != EOF)
+bool ObjLoader::IsQuantized() const
+{
+	return m_isQuantized;
+}
+
+void ObjLoader::EncodePosition(const float3& position, const AABB& aabb, uint16_t encoded[3])
+{
+	encoded[0] = encodeUnorm16(position.x, aabb.Min.x, aabb.Max.x);
+	encoded[1] = encodeUnorm16(position.y, aabb.Min.y, aabb.Max.y);
+	encoded[2] = encodeUnorm16(position.z, aabb.Min.z, aabb.Max.z);
+}
+
+ObjLoader::float3 ObjLoader::DecodePosition(const uint16_t encoded[3], const AABB& aabb)
+{
+	return float3(decodeUnorm16(encoded[0], aabb.Min.x, aabb.Max.x),
+		decodeUnorm16(encoded[1], aabb.Min.y, aabb.Max.y),
+		decodeUnorm16(encoded[2], aabb.Min.z, aabb.Max.z));
+}
+
+void ObjLoader::EncodeNormal(const float3& normal, int16_t encoded[2])
+{
+	// Octahedral mapping [Cigolle et al. 2014]
+	const auto l1 = fabs(normal.x) + fabs(normal.y) + fabs(normal.z);
+	if (!(l1 > 0.0f))
 	{
-		switch (buffer[0])
-		{
-		case 'f':   // v, v//vn, v/vt, v/vt/vn.
-			fscanf_s(pFile, "%s", buffer, static_cast<uint32_t>(sizeof(buffer)));
+		encoded[0] = encoded[1] = 0;
 
-			if (strstr(buffer, "//")) // v//vn
-			{
-				sscanf_s(buffer, "%u//%u", &v, &vn);
-				fscanf_s(pFile, "%u//%u", &v, &vn);
-				fscanf_s(pFile, "%u//%u", &v, &vn);
-				++numTri;
+		return;
+	}
 
-				while (fscanf_s(pFile, "%u//%u", &v, &vn) > 0) ++numTri;
-			}
-			else if (sscanf_s(buffer, "%u/%u/%u", &v, &vt, &vn) == 3) // v/vt/vn
-			{
-				fscanf_s(pFile, "%u/%u/%u", &v, &vt, &vn);
-				fscanf_s(pFile, "%u/%u/%u", &v, &vt, &vn);
-				++numTri;
+	auto x = normal.x / l1;
+	auto y = normal.y / l1;
+	if (normal.z < 0.0f) foldOctahedron(x, y);
 
-				while (fscanf_s(pFile, "%u/%u/%u", &v, &vt, &vn) > 0) ++numTri;
+	// Plain rounding is up to 2x off; pick the best of the 4 neighboring codes instead.
+	const auto l2 = sqrt(normal.x * normal.x + normal.y * normal.y + normal.z * normal.z);
+	const auto fx = floor(x * 32767.0f);
+	const auto fy = floor(y * 32767.0f);
+	auto bestDot = -FLT_MAX;
+	for (uint8_t i = 0; i < 4; ++i)
+	{
+		const int16_t candidate[] =
+		{
+			static_cast<int16_t>((min)((max)(fx + (i & 1), -32767.0f), 32767.0f)),
+			static_cast<int16_t>((min)((max)(fy + (i >> 1), -32767.0f), 32767.0f))
+		};
+		const auto n = DecodeNormal(candidate);
+		const auto dot = (n.x * normal.x + n.y * normal.y + n.z * normal.z) / l2;
+		if (dot > bestDot)
+		{
+			bestDot = dot;
+			encoded[0] = candidate[0];
+			encoded[1] = candidate[1];
+		}
+	}
+}
 
-				//m_hasTexcoord = true;
-			}
-			else if (sscanf_s(buffer, "%u/%u", &v, &vt) == 2) // v/vt
-			{
-				fscanf_s(pFile, "%u/%u", &v, &vt);
-				fscanf_s(pFile, "%u/%u", &v, &vt);
-				++numTri;
+ObjLoader::float3 ObjLoader::DecodeNormal(const int16_t encoded[2])
+{
+	auto x = (max)(encoded[0] / 32767.0f, -1.0f);
+	auto y = (max)(encoded[1] / 32767.0f, -1.0f);
+	const auto z = 1.0f - fabs(x) - fabs(y);
+	if (z < 0.0f) foldOctahedron(x, y);
 
-				while (fscanf_s(pFile, "%u/%u", &v, &vt) > 0) ++numTri;
+	const auto l = sqrt(x * x + y * y + z * z);
 
-				//m_hasTexcoord = true;
-			}
-			else // v
-			{
-				fscanf_s(pFile, "%u", &v);
-				fscanf_s(pFile, "%u", &v);
-				++numTri;
+	return float3(x / l, y / l, z / l);
+}
 
-				while (fscanf_s(pFile, "%u", &v) > 0)
-					++numTri;
-			}
-			break;
+void ObjLoader::EncodeTexcoord(const float2& texcoord, const TexcoordRange& range, uint16_t encoded[2])
+{
+	encoded[0] = encodeUnorm16(texcoord.x, range.Min.x, range.Max.x);
+	encoded[1] = encodeUnorm16(texcoord.y, range.Min.y, range.Max.y);
+}
 
-		case 'v':   // v, vt, or vn
-			switch (buffer[1])
-			{
-			case '\0':
-				fgets(buffer, sizeof(buffer), pFile);
-				++numVert;
-				break;
-			case 't':
-				fgets(buffer, sizeof(buffer), pFile);
-				++numTexc;
-				break;
-			case 'n':
-				fgets(buffer, sizeof(buffer), pFile);
-				++numNorm;
-				break;
-			default:
-				break;
-			}
-			break;
+ObjLoader::float2 ObjLoader::DecodeTexcoord(const uint16_t encoded[2], const TexcoordRange& range)
+{
+	return float2(decodeUnorm16(encoded[0], range.Min.x, range.Max.x),
+		decodeUnorm16(encoded[1], range.Min.y, range.Max.y));
+}
 
-		default:
-			fgets(buffer, sizeof(buffer), pFile);
-			break;
+float ObjLoader::ComputeACMR(const uint32_t* pIndices, uint32_t numIndices,
+	uint32_t numVertices, uint32_t cacheSize)
+{
+	const auto numTris = numIndices / 3;
+	if (numTris == 0) return 0.0f;
+
+	// A vertex stays in the FIFO cache until cacheSize further misses have been loaded.
+	vector<uint32_t> timeStamps(numVertices, 0);
+	auto time = cacheSize + 1;
+	auto numMisses = 0u;
+	for (auto i = 0u; i < numIndices; ++i)
+	{
+		auto& timeStamp = timeStamps[pIndices[i]];
+		if (time - timeStamp > cacheSize)
+		{
+			timeStamp = time++;
+			++numMisses;
 		}
 	}
 
-	// Allocate memory for the OBJ model data.
-	const auto numIdx = numTri * 3;
-	m_stride += m_stride <= sizeof(float3) && numNorm ? sizeof(float3) : 0;
-	m_stride += numTexc ? sizeof(float[2]) : 0;
-	m_vertices.reserve(m_stride * (max)((max)(numVert, numTexc), numNorm));
-	m_vertices.resize(m_stride * numVert);
-	m_indices.resize(numIdx);
+	return static_cast<float>(numMisses) / numTris;
 }
 
-void ObjLoader::importGeometrySecondPass(FILE* pFile, uint32_t numTexc, uint32_t numNorm, bool forDX, bool swapYZ)
+void ObjLoader::importGeometry(const char* pData, const char* pEnd, bool forDX, bool swapYZ,
+	ObjGeometry& geometry, uint32_t batchSize, const FlushFunc* pFlush)
 {
-	auto numVert = 0u;
-	auto numTri = 0u;
-	char buffer[256] = { 0 };
+	const auto loadFloat3 = [pEnd, forDX, swapYZ](const char* p, float3& v)
+	{
+		v = float3(0.0f, 0.0f, 0.0f);
+		p = parseFloat(skipSpaces(p, pEnd), pEnd, v.x);
+		p = parseFloat(skipSpaces(p, pEnd), pEnd, v.y);
+		p = parseFloat(skipSpaces(p, pEnd), pEnd, v.z);
+		if (swapYZ)
+		{
+			const auto tmp = v.y;
+			v.y = v.z;
+			v.z = tmp;
+		}
+		v.z = forDX ? -v.z : v.z;
+
+		return p;
+	};
 
-	vector<float3> normals;
-	vector<uint32_t> tIndices, nIndices;
-	if (numTexc) tIndices.resize(m_indices.size());
-	if (numNorm) nIndices.resize(m_indices.size());
-	normals.reserve(numNorm);
+	const auto loadFloat2 = [pEnd, forDX](const char* p, float2& v)
+	{
+		v = float2(0.0f, 0.0f);
+		p = parseFloat(skipSpaces(p, pEnd), pEnd, v.x);
+		p = parseFloat(skipSpaces(p, pEnd), pEnd, v.y);
+		v.y = forDX ? 1.0f - v.y : v.y;
+
+		return p;
+	};
+
+	// Resolve the 1-based or negative (relative) OBJ index. Relative ones are resolved
+	// against the records of this range, and get rebased when the ranges are merged.
+	const auto resolveIndex = [](int64_t vi, size_t count)
+	{
+		return static_cast<uint32_t>(vi < 0 ? vi + static_cast<int64_t>(count) : vi - 1);
+	};
 
-	while (fscanf_s(pFile, "%s", buffer, static_cast<uint32_t>(sizeof(buffer))) != EOF)
+	// In streaming mode, a full batch of any record type is flushed before it grows further.
+	const auto flushIfFull = [&geometry, batchSize, pFlush]()
+	{
+		if (pFlush && (geometry.Positions.size() >= batchSize || geometry.Normals.size() >= batchSize ||
+			geometry.Texcoords.size() >= batchSize || geometry.Indices.size() >= 3 * static_cast<size_t>(batchSize)))
+			(*pFlush)(geometry);
+	};
+
+	geometry.BasePosition = 0;
+	geometry.BaseNormal = 0;
+	geometry.BaseTexcoord = 0;
+	geometry.BaseTriangle = 0;
+
+	// Reserve by a rough estimate of the record sizes to avoid most of the reallocations.
+	const auto dataSize = static_cast<size_t>(pEnd - pData);
+	geometry.Positions.reserve(pFlush ? batchSize : dataSize / 64);
+	geometry.Indices.reserve(pFlush ? 3 * static_cast<size_t>(batchSize) : dataSize / 16);
+
+	auto p = pData;
+	while (p < pEnd)
 	{
-		switch (buffer[0])
+		p = skipSpaces(p, pEnd);
+		if (p >= pEnd) break;
+
+		// Read the keyword of the record.
+		const auto pKeyword = p;
+		while (p < pEnd && !isSpace(*p) && *p != '\n') ++p;
+		const auto keywordLen = p - pKeyword;
+
+		if (keywordLen == 1 && pKeyword[0] == 'v')
 		{
-		case 'f': // v, v//vn, v/vt, or v/vt/vn.
-			loadIndices(pFile, numTri, numTexc, numNorm, nIndices, tIndices);
-			break;
-		case 'v': // v, vn, or vt.
-			switch (buffer[1])
-			{
-			case '\0': // v
+			geometry.Positions.emplace_back();
+			p = loadFloat3(p, geometry.Positions.back());
+			flushIfFull();
+		}
+		else if (keywordLen == 2 && pKeyword[0] == 'v' && pKeyword[1] == 'n')
+		{
+			geometry.Normals.emplace_back();
+			p = loadFloat3(p, geometry.Normals.back());
+			flushIfFull();
+		}
+		else if (keywordLen == 2 && pKeyword[0] == 'v' && pKeyword[1] == 't')
+		{
+			geometry.Texcoords.emplace_back();
+			p = loadFloat2(p, geometry.Texcoords.back());
+			flushIfFull();
+		}
+		else if (keywordLen == 1 && pKeyword[0] == 'f')
+		{
+			// v, v//vn, v/vt, or v/vt/vn; polygons are triangulated as fans.
+			uint32_t v[3], vn[3], vt[3];
+			bool vRel[3], vnRel[3], vtRel[3];
+			auto numCorners = 0u;
+			while (true)
 			{
-				auto& p = getPosition(numVert++);
-				fscanf_s(pFile, "%f %f %f", &p.x, &p.y, &p.z);
-				if (swapYZ)
+				int64_t vi;
+				p = skipSpaces(p, pEnd);
+				const auto pNext = parseInt(p, pEnd, vi);
+				if (pNext == p) break;
+				p = pNext;
+
+				const auto k = numCorners < 3 ? numCorners : 2;
+				v[k] = resolveIndex(vi, geometry.BasePosition + geometry.Positions.size());
+				vRel[k] = vi < 0;
+				vn[k] = UINT32_MAX;
+				vnRel[k] = false;
+				vt[k] = UINT32_MAX;
+				vtRel[k] = false;
+				if (p < pEnd && *p == '/')
 				{
-					const auto tmp = p.y;
-					p.y = p.z;
-					p.z = tmp;
+					const auto pNext = parseInt(p + 1, pEnd, vi);
+					if (pNext != p + 1)
+					{
+						vt[k] = resolveIndex(vi, geometry.BaseTexcoord + geometry.Texcoords.size());
+						vtRel[k] = vi < 0;
+					}
+					p = pNext;
+					if (p < pEnd && *p == '/')
+					{
+						const auto pNext = parseInt(++p, pEnd, vi);
+						if (pNext != p)
+						{
+							vn[k] = resolveIndex(vi, geometry.BaseNormal + geometry.Normals.size());
+							vnRel[k] = vi < 0;
+						}
+						p = pNext;
+					}
 				}
-				p.z = forDX ? -p.z : p.z;
-				break;
-			}
-			case 'n':
-				normals.emplace_back();
-				fscanf_s(pFile, "%f %f %f",
-					&normals.back().x,
-					&normals.back().y,
-					&normals.back().z);
-				if (swapYZ)
+
+				if (++numCorners >= 3)
 				{
-					const auto tmp = normals.back().y;
-					normals.back().y = normals.back().z;
-					normals.back().z = tmp;
+					for (uint8_t i = 0; i < 3; ++i)
+					{
+						const auto slot = static_cast<uint32_t>(geometry.Indices.size());
+						if (vRel[i]) geometry.RelIndices.emplace_back(slot);
+						if (vnRel[i]) geometry.RelNIndices.emplace_back(slot);
+						if (vtRel[i]) geometry.RelTIndices.emplace_back(slot);
+						geometry.Indices.emplace_back(v[i]);
+						geometry.NIndices.emplace_back(vn[i]);
+						geometry.TIndices.emplace_back(vt[i]);
+					}
+					v[1] = v[2];
+					vRel[1] = vRel[2];
+					vn[1] = vn[2];
+					vnRel[1] = vnRel[2];
+					vt[1] = vt[2];
+					vtRel[1] = vtRel[2];
+					flushIfFull();
 				}
-				normals.back().z = forDX ? -normals.back().z : normals.back().z;
-			default:
-				break;
 			}
-			break;
-
-		default:
-			fgets(buffer, sizeof(buffer), pFile);
-			break;
 		}
+
+		p = skipLine(p, pEnd);
 	}
+}
 
-	computePerVertexNormals(normals, nIndices);
+void ObjLoader::importGeometry(const char* pData, const char* pEnd, bool forDX, bool swapYZ,
+	uint32_t numThreads, ObjGeometry& geometry)
+{
+	// Split the data into chunks at line boundaries, a few per thread for load balancing.
+	const size_t minChunkSize = 1 << 16;
+	const auto dataSize = static_cast<size_t>(pEnd - pData);
+	const auto numChunks = static_cast<uint32_t>((min)(static_cast<size_t>(numThreads) * 4, dataSize / minChunkSize + 1));
+
+	vector<const char*> bounds(numChunks + 1);
+	bounds[0] = pData;
+	bounds[numChunks] = pEnd;
+	for (auto i = 1u; i < numChunks; ++i)
+	{
+		const auto p = (max)(pData + dataSize * i / numChunks, bounds[i - 1]);
+		bounds[i] = p > pData && p[-1] == '\n' ? p : skipLine(p, pEnd);
+	}
 
-	if ((forDX && !swapYZ) || (!forDX && swapYZ)) reverse(m_indices.begin(), m_indices.end());
+	// Parse the chunks in parallel.
+	ThreadPool threadPool(numThreads);
+	vector<ObjGeometry> chunks(numChunks);
+	threadPool.Execute(numChunks, [&](uint32_t i)
+	{
+		importGeometry(bounds[i], bounds[i + 1], forDX, swapYZ, chunks[i]);
+	});
+
+	mergeGeometries(chunks, geometry, threadPool);
 }
 
-void ObjLoader::loadIndices(FILE* pFile, uint32_t& numTri, uint32_t numTexc,
-	uint32_t numNorm, vector<uint32_t>& nIndices, vector<uint32_t>& tIndices)
+void ObjLoader::mergeGeometries(vector<ObjGeometry>& chunks, ObjGeometry& geometry, ThreadPool& threadPool)
 {
-	int64_t vi;
-	uint32_t v[3] = { 0 };
-	uint32_t vt[3] = { 0 };
-	uint32_t vn[3] = { 0 };
+	// Prefix sums over the per-chunk counts locate each chunk in the merged arrays.
+	const auto numChunks = static_cast<uint32_t>(chunks.size());
+	vector<size_t> vBase(numChunks + 1, 0), nBase(numChunks + 1, 0), tBase(numChunks + 1, 0), iBase(numChunks + 1, 0);
+	for (auto i = 0u; i < numChunks; ++i)
+	{
+		vBase[i + 1] = vBase[i] + chunks[i].Positions.size();
+		nBase[i + 1] = nBase[i] + chunks[i].Normals.size();
+		tBase[i + 1] = tBase[i] + chunks[i].Texcoords.size();
+		iBase[i + 1] = iBase[i] + chunks[i].Indices.size();
+	}
 
-	const auto numVert = GetNumVertices();
+	geometry.Positions.resize(vBase[numChunks]);
+	geometry.Normals.resize(nBase[numChunks]);
+	geometry.Texcoords.resize(tBase[numChunks]);
+	geometry.Indices.resize(iBase[numChunks]);
+	geometry.NIndices.resize(iBase[numChunks]);
+	geometry.TIndices.resize(iBase[numChunks]);
 
-	for (uint8_t i = 0; i < 3; ++i)
+	threadPool.Execute(numChunks, [&](uint32_t i)
 	{
-		fscanf_s(pFile, "%lld", &vi);
-		v[i] = static_cast<uint32_t>(vi < 0 ? vi + numVert : vi - 1);
-		m_indices[numTri * 3 + i] = v[i];
+		auto& chunk = chunks[i];
+		copy(chunk.Positions.cbegin(), chunk.Positions.cend(), geometry.Positions.begin() + vBase[i]);
+		copy(chunk.Normals.cbegin(), chunk.Normals.cend(), geometry.Normals.begin() + nBase[i]);
+		copy(chunk.Texcoords.cbegin(), chunk.Texcoords.cend(), geometry.Texcoords.begin() + tBase[i]);
+		copy(chunk.Indices.cbegin(), chunk.Indices.cend(), geometry.Indices.begin() + iBase[i]);
+		copy(chunk.NIndices.cbegin(), chunk.NIndices.cend(), geometry.NIndices.begin() + iBase[i]);
+		copy(chunk.TIndices.cbegin(), chunk.TIndices.cend(), geometry.TIndices.begin() + iBase[i]);
+
+		// Rebase the relative indices, which were resolved against the chunk-local counts.
+		const auto pIndices = &geometry.Indices[iBase[i]];
+		const auto pNIndices = &geometry.NIndices[iBase[i]];
+		const auto pTIndices = &geometry.TIndices[iBase[i]];
+		for (const auto& slot : chunk.RelIndices) pIndices[slot] += static_cast<uint32_t>(vBase[i]);
+		for (const auto& slot : chunk.RelNIndices) pNIndices[slot] += static_cast<uint32_t>(nBase[i]);
+		for (const auto& slot : chunk.RelTIndices) pTIndices[slot] += static_cast<uint32_t>(tBase[i]);
+
+		chunk = ObjGeometry();
+	});
+}
 
-		if (tIndices.size() > 0)
-		{
-			fscanf_s(pFile, "/%lld", &vi);
-			vt[i] = static_cast<uint32_t>(vi < 0 ? vi + numTexc : vi - 1);
-			tIndices[numTri * 3 + i] = vt[i];
-		}
-		else if (nIndices.size() > 0) fscanf_s(pFile, "/");
+void ObjLoader::createGeometry(ObjGeometry& geometry, bool needNorm, bool forDX, bool swapYZ)
+{
+	// Determine the vertex layout of the OBJ model data.
+	m_stride += m_stride <= sizeof(float3) && !geometry.Normals.empty() ? sizeof(float3) : 0;
+	m_stride += geometry.Texcoords.empty() ? 0 : sizeof(float2);
+	m_hasNormals = m_stride >= sizeof(float3[2]);
+	m_hasTexcoords = !geometry.Texcoords.empty();
+	m_indices = move(geometry.Indices);
 
-		if (nIndices.size() > 0)
-		{
-			fscanf_s(pFile, "/%lld", &vi);
-			vn[i] = static_cast<uint32_t>(vi < 0 ? vi + numNorm : vi - 1);
-			nIndices[numTri * 3 + i] = vn[i];
-		}
+	weldVertices(geometry);
+
+	if ((forDX && !swapYZ) || (!forDX && swapYZ)) reverse(m_indices.begin(), m_indices.end());
+}
+
+bool ObjLoader::loadCache(const char* pszFilename, uint32_t flags)
+{
+	// Stat the source file
+	const auto hSource = CreateFileA(pszFilename, GENERIC_READ, FILE_SHARE_READ, nullptr,
+		OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (hSource == INVALID_HANDLE_VALUE) return false;
+
+	LARGE_INTEGER sourceSize;
+	FILETIME lastWrite;
+	const auto hasStat = GetFileSizeEx(hSource, &sourceSize) && GetFileTime(hSource, nullptr, nullptr, &lastWrite);
+	CloseHandle(hSource);
+	if (!hasStat) return false;
+	const auto sourceTime = (static_cast<uint64_t>(lastWrite.dwHighDateTime) << 32) | lastWrite.dwLowDateTime;
+
+	// Map the cache file
+	uint64_t cacheSize;
+	const auto pCache = static_cast<const CacheHeader*>(MapFile(getCacheFileName(pszFilename).c_str(),
+		m_hCacheFile, m_hCacheMapping, cacheSize));
+	if (!pCache) return false;
+	m_pCache = pCache;
+
+	// Validate the header and the layout
+	if (cacheSize < sizeof(CacheHeader))
+	{
+		releaseCache();
+
+		return false;
 	}
-	++numTri;
 
-	v[1] = v[2];
-	vt[1] = vt[2];
-	vn[1] = vn[2];
+	const auto vertexBytes = static_cast<uint64_t>(pCache->NumVertices) * pCache->Stride;
+	const auto indexBytes = static_cast<uint64_t>(pCache->NumIndices) * sizeof(uint32_t);
+	if (pCache->Magic != cacheMagic ||
+		pCache->Version != cacheVersion || pCache->Flags != flags ||
+		pCache->SourceSize != static_cast<uint64_t>(sourceSize.QuadPart) ||
+		pCache->Stride == 0 || pCache->Stride % sizeof(float) ||
+		pCache->VertexOffset < sizeof(CacheHeader) || pCache->VertexOffset % sizeof(float) ||
+		pCache->IndexOffset < pCache->VertexOffset + vertexBytes || pCache->IndexOffset % sizeof(uint32_t) ||
+		pCache->IndexOffset + indexBytes > cacheSize)
+	{
+		releaseCache();
+
+		return false;
+	}
 
-	while (fscanf_s(pFile, "%lld", &vi) > 0)
+	// A different time stamp alone, e.g. from a fresh checkout, is resolved by the content hash.
+	if (pCache->SourceTime != sourceTime)
 	{
-		v[2] = static_cast<uint32_t>(vi < 0 ? vi + numVert : vi - 1);
-		m_indices[numTri * 3] = v[0];
-		m_indices[numTri * 3 + 1] = v[1];
-		m_indices[numTri * 3 + 2] = v[2];
-		v[1] = v[2];
+		HANDLE hFile, hMapping;
+		uint64_t fileSize;
+		const auto pData = MapFile(pszFilename, hFile, hMapping, fileSize);
+		const auto isSame = pData && HashData(pData, static_cast<size_t>(fileSize)) == pCache->SourceHash;
+		if (pData) UnmapFile(pData, hFile, hMapping);
 
-		if (tIndices.size() > 0)
+		if (!isSame)
 		{
-			fscanf_s(pFile, "/%lld", &vi);
-			vt[2] = static_cast<uint32_t>(vi < 0 ? vi + numTexc : vi - 1);
-			tIndices[numTri * 3] = vt[0];
-			tIndices[numTri * 3 + 1] = vt[1];
-			tIndices[numTri * 3 + 2] = vt[2];
-			vt[1] = vt[2];
-		}
-		else if (nIndices.size() > 0) fscanf_s(pFile, "/");
+			releaseCache();
 
-		if (nIndices.size() > 0)
-		{
-			fscanf_s(pFile, "/%lld", &vi);
-			vn[2] = static_cast<uint32_t>(vi < 0 ? vi + numNorm : vi - 1);
-			nIndices[numTri * 3] = vn[0];
-			nIndices[numTri * 3 + 1] = vn[1];
-			nIndices[numTri * 3 + 2] = vn[2];
-			vn[1] = vn[2];
+			return false;
 		}
-
-		++numTri;
 	}
+
+	m_stride = pCache->Stride;
+	m_hasNormals = m_stride >= sizeof(float3[2]);
+	m_hasTexcoords = m_stride == sizeof(float3) + sizeof(float2) || m_stride == sizeof(float3[2]) + sizeof(float2);
+	m_aabb = pCache->Aabb;
+
+	return true;
 }
 
-void ObjLoader::computePerVertexNormals(const vector<float3>& normals, const vector<uint32_t>& nIndices)
+bool ObjLoader::saveCache(const char* pszFilename, uint32_t flags, uint64_t sourceSize,
+	uint64_t sourceTime, uint64_t sourceHash) const
 {
-	if (normals.empty()) return;
+	CacheHeader header = {};
+	header.Magic = cacheMagic;
+	header.Version = cacheVersion;
+	header.Flags = flags;
+	header.Stride = m_stride;
+	header.SourceSize = sourceSize;
+	header.SourceTime = sourceTime;
+	header.SourceHash = sourceHash;
+	header.NumVertices = GetNumVertices();
+	header.NumIndices = GetNumIndices();
+	header.VertexOffset = sizeof(CacheHeader);
+	header.IndexOffset = header.VertexOffset + m_vertices.size();
+	header.Aabb = m_aabb;
+
+	ofstream fileStream(getCacheFileName(pszFilename), ios::out | ios::binary | ios::trunc);
+	if (!fileStream) return false;
+
+	fileStream.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	fileStream.write(reinterpret_cast<const char*>(m_vertices.data()), m_vertices.size());
+	fileStream.write(reinterpret_cast<const char*>(m_indices.data()), sizeof(uint32_t) * m_indices.size());
+
+	return fileStream.good();
+}
 
-	const auto stride = GetVertexStride();
-	vector<uint32_t> vni(GetNumVertices(), UINT32_MAX);
+void ObjLoader::releaseCache()
+{
+	if (m_pCache) UnmapFile(m_pCache, m_hCacheFile, m_hCacheMapping);
+	m_pCache = nullptr;
+	m_hCacheFile = INVALID_HANDLE_VALUE;
+	m_hCacheMapping = nullptr;
+}
 
+void ObjLoader::weldVertices(const ObjGeometry& geometry)
+{
+	struct Combination
+	{
+		uint32_t V;
+		uint32_t VN;
+		uint32_t VT;
+		uint32_t Index;
+	};
+
+	const auto& normals = geometry.Normals;
+	const auto& texcoords = geometry.Texcoords;
+	const auto& nIndices = geometry.NIndices;
+	const auto& tIndices = geometry.TIndices;
+	const auto numVert = static_cast<uint32_t>(geometry.Positions.size());
 	const auto numIdx = static_cast<uint32_t>(m_indices.size());
-	for (auto i = 0u; i < numIdx; i++)
+
+	// Every position keeps its slot for the first combination that references it; later distinct
+	// combinations are appended. The open-addressing table is sized for the worst case up front.
+	vector<Combination> table;
+	auto numWelded = numVert;
+	if (!normals.empty() || !texcoords.empty())
 	{
-		auto vi = m_indices[i];
-		if (vni[vi] == nIndices[i]) continue;
+		auto capacity = 16u;
+		while (capacity < 2 * numIdx) capacity <<= 1;
+		table.resize(capacity, { UINT32_MAX, UINT32_MAX, UINT32_MAX, UINT32_MAX });
+		vector<bool> claimed(numVert);
 
-		if (vni[vi] < UINT32_MAX)
+		for (auto i = 0u; i < numIdx; ++i)
 		{
-			// Split vertex
-			vi = GetNumVertices();
-			m_vertices.resize(m_vertices.size() + stride);
-			const auto pDst = getVertex(vi);
-			const auto pSrc = getVertex(m_indices[i]);
-			memcpy(pDst, pSrc, stride);
-			m_indices[i] = vi;
+			const auto v = m_indices[i];
+			const auto vn = nIndices[i];
+			const auto vt = tIndices[i];
+			if (vn == UINT32_MAX && vt == UINT32_MAX) continue;
+
+			auto h = v * 0x9e3779b1u ^ vn * 0x85ebca77u ^ vt * 0xc2b2ae3du;
+			h ^= h >> 15;
+			auto slot = h & (capacity - 1);
+			while (table[slot].V != UINT32_MAX && (table[slot].V != v || table[slot].VN != vn || table[slot].VT != vt))
+				slot = (slot + 1) & (capacity - 1);
+
+			auto& combination = table[slot];
+			if (combination.V == UINT32_MAX)
+			{
+				combination = { v, vn, vt, claimed[v] ? numWelded++ : v };
+				claimed[v] = true;
+			}
+			m_indices[i] = combination.Index;
 		}
-		else vni[vi] = nIndices[i];
-
-		float3 n = normals[nIndices[i]];
-		const auto l = sqrt(n.x * n.x + n.y * n.y + n.z * n.z);
-		n.x /= l;
-		n.y /= l;
-		n.z /= l;
-
-		getNormal(vi) = n;
-	}
-
-	m_vertices.shrink_to_fit();
-}
-
-void ObjLoader::recomputeNormals()
-{
-	float3 e1, e2, n;
-
-	const auto numTri = static_cast<uint32_t>(m_indices.size()) / 3;
-	for (auto i = 0u; i < numTri; i++)
-	{
-		const auto pv0 = &getPosition(m_indices[i * 3]);
-		const auto pv1 = &getPosition(m_indices[i * 3 + 1]);
-		const auto pv2 = &getPosition(m_indices[i * 3 + 2]);
-		e1.x = pv1->x - pv0->x;
-		e1.y = pv1->y - pv0->y;
-		e1.z = pv1->z - pv0->z;
-		e2.x = pv2->x - pv1->x;
-		e2.y = pv2->y - pv1->y;
-		e2.z = pv2->z - pv1->z;
-		n.x = e1.y * e2.z - e1.z * e2.y;
-		n.y = e1.z * e2.x - e1.x * e2.z;
-		n.z = e1.x * e2.y - e1.y * e2.x;
-		const auto l = sqrt(n.x * n.x + n.y * n.y + n.z * n.z);
-		n.x /= l;
-		n.y /= l;
-		n.z /= l;
-
-		const auto pVn0 = &getNormal(m_indices[i * 3]);
-		const auto pVn1 = &getNormal(m_indices[i * 3 + 1]);
-		const auto pVn2 = &getNormal(m_indices[i * 3 + 2]);
-		pVn0->x += n.x;
-		pVn0->y += n.y;
-		pVn0->z += n.z;
-		pVn1->x += n.x;
-		pVn1->y += n.y;
-		pVn1->z += n.z;
-		pVn2->x += n.x;
-		pVn2->y += n.y;
-		pVn2->z += n.z;
 	}
 
+	// Fill the vertices with a single allocation.
+	m_vertices.resize(m_stride * numWelded);
+	for (auto i = 0u; i < numVert; ++i) getPosition(i) = geometry.Positions[i];
+
+	for (const auto& combination : table)
+	{
+		if (combination.V == UINT32_MAX) continue;
+
+		const auto i = combination.Index;
+		if (i >= numVert) getPosition(i) = geometry.Positions[combination.V];
+		if (combination.VN != UINT32_MAX)
+		{
+			float3 n = normals[combination.VN];
+			const auto l = sqrt(n.x * n.x + n.y * n.y + n.z * n.z);
+			n.x /= l;
+			n.y /= l;
+			n.z /= l;
+
+			getNormal(i) = n;
+		}
+		if (combination.VT != UINT32_MAX) getTexcoord(i) = texcoords[combination.VT];
+	}
+}
+
+void ObjLoader::recomputeNormals(uint32_t numThreads)
+{
 	const auto numVert = GetNumVertices();
-	for (auto i = 0u; i < numVert; ++i)
+	const auto numIdx = static_cast<uint32_t>(m_indices.size());
+	const auto numTri = numIdx / 3;
+	const auto stride = GetVertexStride();
+
+	// Vertex-to-triangle adjacency in the compressed sparse row form, in the triangle order
+	vector<uint32_t> offsets(numVert + 1, 0);
+	for (auto i = 0u; i < numIdx; ++i) ++offsets[m_indices[i] + 1];
+	for (auto i = 0u; i < numVert; ++i) offsets[i + 1] += offsets[i];
+	vector<uint32_t> adjacency(numIdx);
 	{
-		const auto pVn = &getNormal(i);
-		const auto l = sqrt(pVn->x * pVn->x + pVn->y * pVn->y + pVn->z * pVn->z);
-		pVn->x /= l;
-		pVn->y /= l;
-		pVn->z /= l;
+		vector<uint32_t> cursors(offsets.cbegin(), offsets.cend() - 1);
+		for (auto i = 0u; i < numIdx; ++i) adjacency[cursors[m_indices[i]]++] = i / 3;
 	}
+
+	// Each vertex gathers the normals of its triangles, so the threads never write to shared data.
+	vector<float> faceNormals(numTri * 4);
+	const auto computeFaceNormals = getFaceNormalFunc();
+	const auto computeVertexNormals = getVertexNormalFunc();
+	ThreadPool threadPool(numThreads);
+	threadPool.ParallelFor(numTri, [&](uint32_t begin, uint32_t end)
+	{
+		computeFaceNormals(m_vertices.data(), stride, m_indices.data(), begin, end, faceNormals.data());
+	}, 1024);
+	threadPool.ParallelFor(numVert, [&](uint32_t begin, uint32_t end)
+	{
+		computeVertexNormals(faceNormals.data(), offsets.data(), adjacency.data(),
+			begin, end, m_vertices.data(), stride);
+	}, 1024);
 }
 
 void ObjLoader::computeAABB()
 {
-	float xMax, xMin, yMax, yMin, zMax, zMin;
-	const auto& p = getPosition(0);
-	xMax = xMin = p.x;
-	yMax = yMin = p.y;
-	zMax = zMin = p.z;
+	const auto numVert = GetNumVertices();
+	if (numVert == 0) return;
+
+	// The kernels read positions 16 bytes wide, so the last vertex is merged separately.
+	const auto& p = getPosition(numVert - 1);
+	float aabbMin[] = { p.x, p.y, p.z };
+	float aabbMax[] = { p.x, p.y, p.z };
+	getBoundsFunc()(m_vertices.data(), GetVertexStride(), 0, numVert - 1, aabbMin, aabbMax);
 
-	auto x = 0.0f, y = 0.0f, z = 0.0f;
+	m_aabb.Min = float3(aabbMin);
+	m_aabb.Max = float3(aabbMax);
+}
 
+void ObjLoader::optimizeVertexCache(uint32_t cacheSize)
+{
+	// Tipsify [Sander et al. 2007]: fan the triangles around a vertex, and pick the next fanning
+	// vertex among the ones just referenced, preferring those that would stay in the cache.
 	const auto numVert = GetNumVertices();
-	for (auto i = 1u; i < numVert; ++i)
+	const auto numIdx = static_cast<uint32_t>(m_indices.size());
+	const auto numTris = numIdx / 3;
+
+	// Vertex-to-triangle adjacency in the compressed sparse row form
+	vector<uint32_t> offsets(numVert + 1, 0);
+	for (auto i = 0u; i < numIdx; ++i) ++offsets[m_indices[i] + 1];
+	for (auto i = 0u; i < numVert; ++i) offsets[i + 1] += offsets[i];
+	vector<uint32_t> adjacency(numIdx);
 	{
-		const auto& p = getPosition(i);
-		x = p.x;
-		y = p.y;
-		z = p.z;
+		vector<uint32_t> cursors(offsets.cbegin(), offsets.cend() - 1);
+		for (auto i = 0u; i < numIdx; ++i) adjacency[cursors[m_indices[i]]++] = i / 3;
+	}
 
-		if (x < xMin) xMin = x;
-		else if (x > xMax) xMax = x;
+	vector<uint32_t> liveTris(numVert), timeStamps(numVert, 0);
+	for (auto i = 0u; i < numVert; ++i) liveTris[i] = offsets[i + 1] - offsets[i];
+	vector<bool> emitted(numTris);
+	vector<uint32_t> indices, deadEnds, candidates;
+	indices.reserve(numIdx);
+	deadEnds.reserve(numIdx);
+
+	auto time = cacheSize + 1;
+	auto cursor = 0u;
+	auto f = numTris > 0 ? 0u : UINT32_MAX;
+	while (f != UINT32_MAX)
+	{
+		candidates.clear();
+		for (auto i = offsets[f]; i < offsets[f + 1]; ++i)
+		{
+			const auto t = adjacency[i];
+			if (emitted[t]) continue;
 
-		if (y < yMin) yMin = y;
-		else if (y > yMax) yMax = y;
+			for (uint8_t k = 0; k < 3; ++k)
+			{
+				const auto v = m_indices[3 * t + k];
+				indices.emplace_back(v);
+				deadEnds.emplace_back(v);
+				candidates.emplace_back(v);
+				--liveTris[v];
+				if (time - timeStamps[v] > cacheSize) timeStamps[v] = time++;
+			}
+			emitted[t] = true;
+		}
+
+		// A candidate is worth its age in the cache if fanning it would not evict it meanwhile.
+		f = UINT32_MAX;
+		int64_t bestPriority = -1;
+		for (const auto& v : candidates)
+		{
+			if (liveTris[v] == 0) continue;
+
+			const auto age = time - timeStamps[v];
+			const int64_t priority = age + 2 * liveTris[v] <= cacheSize ? age : 0;
+			if (priority > bestPriority)
+			{
+				bestPriority = priority;
+				f = v;
+			}
+		}
+
+		// Dead end: fall back to the most recently referenced vertex with live triangles,
+		// or else to the next one in the input order.
+		while (f == UINT32_MAX && !deadEnds.empty())
+		{
+			const auto v = deadEnds.back();
+			deadEnds.pop_back();
+			if (liveTris[v] > 0) f = v;
+		}
 
-		if (z < zMin) zMin = z;
-		else if (z > zMax) zMax = z;
+		for (; f == UINT32_MAX && cursor < numVert; ++cursor)
+			if (liveTris[cursor] > 0) f = cursor;
 	}
 
-	m_aabb.Min = float3(xMin, yMin, zMin);
-	m_aabb.Max = float3(xMax, yMax, zMax);
+	m_indices.swap(indices);
+}
+
+void ObjLoader::reorderVertices()
+{
+	// Renumber the vertices in the order of their first use; unreferenced ones go to the end.
+	const auto numVert = GetNumVertices();
+	const auto stride = GetVertexStride();
+	vector<uint32_t> remap(numVert, UINT32_MAX);
+	auto numRemapped = 0u;
+	for (auto& i : m_indices)
+	{
+		if (remap[i] == UINT32_MAX) remap[i] = numRemapped++;
+		i = remap[i];
+	}
+	for (auto& i : remap) if (i == UINT32_MAX) i = numRemapped++;
+
+	vector<uint8_t> vertices(m_vertices.size());
+	for (auto i = 0u; i < numVert; ++i) memcpy(&vertices[stride * remap[i]], getVertex(i), stride);
+	m_vertices.swap(vertices);
 }
 
 void* ObjLoader::getVertex(uint32_t i)
@@ -429,3 +1494,8 @@ ObjLoader::float3& ObjLoader::getNormal(uint32_t i)
 {
 	return reinterpret_cast<float3*>(getVertex(i))[1];
 }
+
+ObjLoader::float2& ObjLoader::getTexcoord(uint32_t i)
+{
+	return reinterpret_cast<float2*>(reinterpret_cast<uint8_t*>(getVertex(i)) + GetVertexStride() - sizeof(float2))[0];
+}
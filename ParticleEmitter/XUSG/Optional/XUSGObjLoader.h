@@ -4,11 +4,25 @@
 
 #pragma once
 
+#include "XUSGThreadPool.h"
+
 namespace XUSG
 {
 	class ObjLoader
 	{
 	public:
+		struct float2
+		{
+			float x;
+			float y;
+
+			float2() = default;
+			constexpr float2(float _x, float _y) : x(_x), y(_y) {}
+			explicit float2(const float* pArray) : x(pArray[0]), y(pArray[1]) {}
+
+			float2& operator= (const float2& Float2) { x = Float2.x; y = Float2.y; return *this; }
+		};
+
 		struct float3
 		{
 			float x;
@@ -28,11 +42,80 @@ namespace XUSG
 			float3 Max;
 		};
 
+		struct TexcoordRange
+		{
+			float2 Min;
+			float2 Max;
+		};
+
+		struct StreamBatch
+		{
+			const float3*	pPositions;
+			const float3*	pNormals;
+			const float2*	pTexcoords;
+			const uint32_t*	pIndices;		// Position indices, 3 per triangle
+			const uint32_t*	pNIndices;		// Normal indices, 3 per triangle; UINT32_MAX if absent
+			const uint32_t*	pTIndices;		// Texcoord indices, 3 per triangle; UINT32_MAX if absent
+			uint32_t		NumPositions;
+			uint32_t		NumNormals;
+			uint32_t		NumTexcoords;
+			uint32_t		NumTriangles;
+			uint32_t		BasePosition;	// Indices of the first records of the batch in the file
+			uint32_t		BaseNormal;
+			uint32_t		BaseTexcoord;
+			uint32_t		BaseTriangle;
+		};
+
+		// Options of Import, named to keep the call sites readable
+		struct ImportOptions
+		{
+			bool		NeedNormal = true;
+			bool		NeedAABB = true;
+			bool		ForDX = true;
+			bool		SwapYZ = false;
+			bool		UseCache = false;
+			bool		Optimize = false;
+			uint32_t	NumThreads = 1;		// 0 for the hardware threads
+		};
+
+		using StreamFunc = std::function<void(const StreamBatch& batch)>;
+
 		ObjLoader();
+		ObjLoader(const ObjLoader&) = delete;
 		virtual ~ObjLoader();
 
-		bool Import(const char* pszFilename, bool needNorm = true,
-			bool needAABB = true, bool forDX = true, bool swapYZ = false);
+		ObjLoader& operator=(const ObjLoader&) = delete;
+
+		// Each unique (v, vn, vt) combination of the faces becomes exactly one vertex. Texcoords
+		// follow the normal in the vertex when the file has any; forDX flips their v.
+		// With useCache, the imported geometry is written to a binary cache next to the OBJ file,
+		// and later imports map that cache read-only, as long as the source file is unchanged.
+		// With optimize, the triangles are reordered for post-transform vertex-cache reuse (Tipsify),
+		// and the vertices are then renumbered in the order of their first use.
+		bool Import(const char* pszFilename, const ImportOptions& options);
+		bool Import(const char* pszFilename, bool needNorm = true, bool needAABB = true,
+			bool forDX = true, bool swapYZ = false, uint32_t numThreads = 1, bool useCache = false,
+			bool optimize = false);
+
+		// Parses the OBJ file and hands the records to func in batches of at most batchSize
+		// positions, normals and triangles each, without holding the whole geometry in memory.
+		// Indices are resolved to the file-global records; triangles keep the file order, so
+		// forDX flips the winding within each triangle rather than reversing the index buffer.
+		bool ImportStream(const char* pszFilename, const StreamFunc& func,
+			uint32_t batchSize = 4096, bool forDX = true, bool swapYZ = false);
+
+		// Simplifies the imported mesh with MeshSimplifier, which documents the parameters. Each vertex
+		// keeps the attributes of one of its source vertices, and the normals, if any, are recomputed.
+		// Requires the float layout, so a quantized mesh is left unchanged.
+		void Simplify(uint32_t targetNumTriangles, float maxError = FLT_MAX, uint32_t numThreads = 1);
+
+		// Converts the vertices in place to the compact layout, which halves the vertex footprint:
+		//   R16G16B16A16_UNORM	position over the AABB (w is zero)
+		//   R16G16_SNORM		octahedral normal, if any
+		//   R16G16_UNORM		texcoord over the texcoord range, if any
+		// The stride becomes 8, 12 or 16 bytes; the Encode/Decode functions below give the
+		// round-trip error bounds. Call it last, since the other passes need the float layout.
+		void Quantize();
 
 		const uint32_t GetNumVertices() const;
 		const uint32_t GetNumIndices() const;
@@ -41,25 +124,100 @@ namespace XUSG
 		const uint32_t* GetIndices() const;
 
 		const AABB& GetAABB() const;
+		const TexcoordRange& GetTexcoordRange() const;	// Valid after Quantize
+
+		bool HasNormals() const;
+		bool HasTexcoords() const;
+		bool IsQuantized() const;
+
+		// Error of a component within 1/131070 of the AABB extent along its axis, plus float rounding
+		static void EncodePosition(const float3& position, const AABB& aabb, uint16_t encoded[3]);
+		static float3 DecodePosition(const uint16_t encoded[3], const AABB& aabb);
+
+		// Error of a unit normal within 0.008 degrees; a zero normal decodes to +z.
+		static void EncodeNormal(const float3& normal, int16_t encoded[2]);
+		static float3 DecodeNormal(const int16_t encoded[2]);
+
+		// Error of a component within 1/131070 of the texcoord range along its axis, plus float rounding
+		static void EncodeTexcoord(const float2& texcoord, const TexcoordRange& range, uint16_t encoded[2]);
+		static float2 DecodeTexcoord(const uint16_t encoded[2], const TexcoordRange& range);
+
+		// Average cache miss ratio (misses per triangle) of a FIFO post-transform vertex cache
+		static float ComputeACMR(const uint32_t* pIndices, uint32_t numIndices,
+			uint32_t numVertices, uint32_t cacheSize = 16);
 
 	protected:
-		void importGeometryFirstPass(FILE* pFile, uint32_t& numTexc, uint32_t& numNorm);
-		void importGeometrySecondPass(FILE* pFile, uint32_t numTexc, uint32_t numNorm, bool forDX, bool swapYZ);
-		void loadIndices(FILE* pFile, uint32_t& numTri, uint32_t numTexc, uint32_t numNorm,
-			std::vector<uint32_t>& nIndices, std::vector<uint32_t>& tIndices);
-		void computePerVertexNormals(const std::vector<float3>& normals, const std::vector<uint32_t>& nIndices);
-		void recomputeNormals();
+		struct CacheHeader
+		{
+			uint32_t	Magic;
+			uint32_t	Version;
+			uint32_t	Flags;
+			uint32_t	Stride;
+			uint64_t	SourceSize;
+			uint64_t	SourceTime;
+			uint64_t	SourceHash;
+			uint32_t	NumVertices;
+			uint32_t	NumIndices;
+			uint64_t	VertexOffset;
+			uint64_t	IndexOffset;
+			AABB		Aabb;
+			uint32_t	Reserved[2];
+		};
+
+		struct ObjGeometry
+		{
+			std::vector<float3>		Positions;
+			std::vector<float3>		Normals;
+			std::vector<float2>		Texcoords;
+			std::vector<uint32_t>	Indices;
+			std::vector<uint32_t>	NIndices;
+			std::vector<uint32_t>	TIndices;
+			std::vector<uint32_t>	RelIndices;		// Slots of Indices resolved from negative OBJ indices
+			std::vector<uint32_t>	RelNIndices;	// Slots of NIndices resolved from negative OBJ indices
+			std::vector<uint32_t>	RelTIndices;	// Slots of TIndices resolved from negative OBJ indices
+			uint32_t				BasePosition;	// Records already flushed in streaming mode
+			uint32_t				BaseNormal;
+			uint32_t				BaseTexcoord;
+			uint32_t				BaseTriangle;
+		};
+
+		using FlushFunc = std::function<void(ObjGeometry& geometry)>;
+
+		void importGeometry(const char* pData, const char* pEnd, bool forDX, bool swapYZ,
+			ObjGeometry& geometry, uint32_t batchSize = 0, const FlushFunc* pFlush = nullptr);
+		void importGeometry(const char* pData, const char* pEnd, bool forDX, bool swapYZ,
+			uint32_t numThreads, ObjGeometry& geometry);
+		void mergeGeometries(std::vector<ObjGeometry>& chunks, ObjGeometry& geometry, ThreadPool& threadPool);
+		void createGeometry(ObjGeometry& geometry, bool needNorm, bool forDX, bool swapYZ);
+		bool loadCache(const char* pszFilename, uint32_t flags);
+		bool saveCache(const char* pszFilename, uint32_t flags, uint64_t sourceSize,
+			uint64_t sourceTime, uint64_t sourceHash) const;
+		void releaseCache();
+
+		void weldVertices(const ObjGeometry& geometry);
+		void recomputeNormals(uint32_t numThreads);
 		void computeAABB();
+		void optimizeVertexCache(uint32_t cacheSize);
+		void reorderVertices();
 
 		void* getVertex(uint32_t i);
 		float3& getPosition(uint32_t i);
 		float3& getNormal(uint32_t i);
+		float2& getTexcoord(uint32_t i);
 
 		std::vector<uint8_t>	m_vertices;
 		std::vector<uint32_t>	m_indices;
 
 		uint32_t	m_stride;
+		bool		m_hasNormals;
+		bool		m_hasTexcoords;
+		bool		m_isQuantized;
 
 		AABB		m_aabb;
+		TexcoordRange m_texcoordRange;
+
+		const CacheHeader* m_pCache;
+		HANDLE		m_hCacheFile;
+		HANDLE		m_hCacheMapping;
 	};
 }
@@ -0,0 +1,61 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include "XUSGSIMD.h"
+#if XUSG_SIMD_X86
+#include <intrin.h>
+#endif
+
+using namespace std;
+using namespace XUSG;
+
+namespace
+{
+	SIMDLevel detectSIMDLevel()
+	{
+#if XUSG_SIMD_X86
+		int info[4];
+		__cpuid(info, 0);
+		const auto maxLeaf = info[0];
+
+		__cpuid(info, 1);
+		const auto hasSSE42 = (info[2] & (1 << 20)) != 0;
+		const auto hasFMA = (info[2] & (1 << 12)) != 0;
+		const auto hasOSXSAVE = (info[2] & (1 << 27)) != 0;
+		const auto hasAVX = (info[2] & (1 << 28)) != 0;
+		if (!hasSSE42) return SIMDLevel::SCALAR;
+		if (!hasOSXSAVE || !hasAVX || maxLeaf < 7) return SIMDLevel::SSE4_2;
+
+		// The OS must save the YMM state, and the opmask and ZMM states for AVX-512.
+		const auto xcr0 = _xgetbv(0);
+		if ((xcr0 & 0x6) != 0x6) return SIMDLevel::SSE4_2;
+
+		__cpuidex(info, 7, 0);
+		const auto hasAVX2 = (info[1] & (1 << 5)) != 0;
+		const auto hasAVX512 = (info[1] & (1 << 16)) && (info[1] & (1 << 17)) &&
+			(info[1] & (1 << 30)) && (info[1] & (1u << 31));
+		if (!hasAVX2 || !hasFMA) return SIMDLevel::SSE4_2;
+		if (!hasAVX512 || (xcr0 & 0xe6) != 0xe6) return SIMDLevel::AVX2;
+
+		return SIMDLevel::AVX512;
+#elif XUSG_SIMD_ARM
+		return SIMDLevel::NEON;
+#else
+		return SIMDLevel::SCALAR;
+#endif
+	}
+
+	const SIMDLevel g_detectedLevel = detectSIMDLevel();
+	atomic<uint8_t> g_maxLevel(static_cast<uint8_t>(SIMDLevel::AVX512));
+}
+
+SIMDLevel XUSG::GetSIMDLevel()
+{
+	return static_cast<SIMDLevel>((min)(static_cast<uint8_t>(g_detectedLevel), g_maxLevel.load()));
+}
+
+void XUSG::LimitSIMDLevel(SIMDLevel maxLevel)
+{
+	g_maxLevel = static_cast<uint8_t>(maxLevel);
+}
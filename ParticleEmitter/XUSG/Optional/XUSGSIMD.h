@@ -0,0 +1,30 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#if defined(_M_IX86) || defined(_M_X64)
+#define XUSG_SIMD_X86 1
+#elif defined(_M_ARM64) || defined(__aarch64__)
+#define XUSG_SIMD_ARM 1
+#endif
+
+namespace XUSG
+{
+	// Instruction-set tiers of the CPU kernels with runtime dispatch; each tier implies the lower ones.
+	enum class SIMDLevel : uint8_t
+	{
+		SCALAR,
+		SSE4_2,
+		NEON = SSE4_2,	// The 128-bit tier on ARM64, where NEON is part of the base ISA
+		AVX2,		// AVX2 and FMA
+		AVX512		// AVX-512 F, DQ, BW and VL
+	};
+
+	// Returns the highest tier supported by both the CPU and the OS, capped by LimitSIMDLevel().
+	SIMDLevel GetSIMDLevel();
+
+	// Caps the dispatched tier, e.g. to validate the SIMD kernels against the scalar references.
+	void LimitSIMDLevel(SIMDLevel maxLevel);
+}
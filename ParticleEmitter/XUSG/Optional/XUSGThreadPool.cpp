@@ -0,0 +1,129 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include "XUSGThreadPool.h"
+
+using namespace std;
+using namespace XUSG;
+
+ThreadPool::ThreadPool(uint32_t numThreads) :
+	m_pTask(nullptr),
+	m_numTasks(0),
+	m_jobId(0),
+	m_nextTask(0),
+	m_numDone(0),
+	m_numActive(0),
+	m_quit(false)
+{
+	numThreads = numThreads ? numThreads : GetNumHardwareThreads();
+
+	// The calling thread is one of the workers.
+	m_workers.reserve(numThreads - 1);
+	for (auto i = 1u; i < numThreads; ++i) m_workers.emplace_back(&ThreadPool::workerMain, this);
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		lock_guard<mutex> lock(m_mutex);
+		m_quit = true;
+	}
+	m_jobReady.notify_all();
+
+	for (auto& worker : m_workers) worker.join();
+}
+
+void ThreadPool::Execute(uint32_t numTasks, const TaskFunc& task)
+{
+	if (numTasks <= 1 || m_workers.empty())
+	{
+		for (auto i = 0u; i < numTasks; ++i) task(i);
+
+		return;
+	}
+
+	{
+		lock_guard<mutex> lock(m_mutex);
+		m_pTask = &task;
+		m_numTasks = numTasks;
+		m_nextTask = 0;
+		m_numDone = 0;
+		++m_jobId;
+	}
+	m_jobReady.notify_all();
+
+	// Work on the tasks as well
+	auto numDone = 0u;
+	for (auto i = m_nextTask++; i < numTasks; i = m_nextTask++)
+	{
+		task(i);
+		++numDone;
+	}
+
+	// Wait for the tasks taken by the workers, and for the workers to leave the job.
+	unique_lock<mutex> lock(m_mutex);
+	m_numDone += numDone;
+	m_jobDone.wait(lock, [this, numTasks]() { return m_numDone == numTasks && !m_numActive; });
+	m_pTask = nullptr;
+}
+
+void ThreadPool::ParallelFor(uint32_t numItems, const RangeFunc& func, uint32_t grainSize)
+{
+	// Oversubscribe the threads a bit for load balancing.
+	const auto numThreads = GetNumThreads();
+	auto rangeSize = (numItems + numThreads * 4 - 1) / (numThreads * 4);
+	rangeSize = (max)(rangeSize, (max)(grainSize, 1u));
+	const auto numRanges = (numItems + rangeSize - 1) / rangeSize;
+
+	Execute(numRanges, [&func, numItems, rangeSize](uint32_t i)
+	{
+		const auto begin = rangeSize * i;
+		func(begin, (min)(begin + rangeSize, numItems));
+	});
+}
+
+uint32_t ThreadPool::GetNumThreads() const
+{
+	return static_cast<uint32_t>(m_workers.size()) + 1;
+}
+
+uint32_t ThreadPool::GetNumHardwareThreads()
+{
+	return (max)(thread::hardware_concurrency(), 1u);
+}
+
+void ThreadPool::workerMain()
+{
+	uint64_t jobId = 0;
+
+	while (true)
+	{
+		const TaskFunc* pTask;
+		uint32_t numTasks;
+		{
+			unique_lock<mutex> lock(m_mutex);
+			m_jobReady.wait(lock, [this, jobId]() { return m_quit || (m_pTask && m_jobId != jobId); });
+			if (m_quit) return;
+
+			jobId = m_jobId;
+			pTask = m_pTask;
+			numTasks = m_numTasks;
+			++m_numActive;
+		}
+
+		auto numDone = 0u;
+		for (auto i = m_nextTask++; i < numTasks; i = m_nextTask++)
+		{
+			(*pTask)(i);
+			++numDone;
+		}
+
+		{
+			lock_guard<mutex> lock(m_mutex);
+			m_numDone += numDone;
+			--m_numActive;
+		}
+		m_jobDone.notify_one();
+	}
+}
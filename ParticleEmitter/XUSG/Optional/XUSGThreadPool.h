@@ -0,0 +1,46 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+namespace XUSG
+{
+	class ThreadPool
+	{
+	public:
+		using TaskFunc = std::function<void(uint32_t taskIdx)>;
+		using RangeFunc = std::function<void(uint32_t begin, uint32_t end)>;
+
+		ThreadPool(uint32_t numThreads = 0);
+		virtual ~ThreadPool();
+
+		// Runs task(i) for i in [0, numTasks), and returns when all the tasks are done.
+		// The calling thread works on the tasks as well. Jobs must not be nested.
+		void Execute(uint32_t numTasks, const TaskFunc& task);
+
+		// Splits [0, numItems) into contiguous ranges of at least grainSize items.
+		void ParallelFor(uint32_t numItems, const RangeFunc& func, uint32_t grainSize = 1);
+
+		uint32_t GetNumThreads() const;
+
+		static uint32_t GetNumHardwareThreads();
+
+	protected:
+		void workerMain();
+
+		std::vector<std::thread>	m_workers;
+
+		std::mutex					m_mutex;
+		std::condition_variable		m_jobReady;
+		std::condition_variable		m_jobDone;
+
+		const TaskFunc*				m_pTask;
+		uint32_t					m_numTasks;
+		uint64_t					m_jobId;
+		std::atomic_uint32_t		m_nextTask;
+		std::atomic_uint32_t		m_numDone;
+		uint32_t					m_numActive;
+		bool						m_quit;
+	};
+}
@@ -43,6 +43,10 @@
 #include <unordered_map>
 #endif
 #include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
 #include <wrl.h>
 #include <shellapi.h>
 